@@ -1,6 +1,9 @@
 #include "Camera.h"
 #include "RenderWindow.h"
 #include "Geometry.h"
+#include "ShadowCascades.h"
+
+#include <algorithm>
 
 using namespace DirectX;
 
@@ -76,6 +79,12 @@ void SphericalCamera::GetFrustum(Frustum * frustum, const Extent2D & viewportSiz
 		aspectRatio, frustum);
 }
 
+void SphericalCamera::SetShadowCascades(const uint32_t cascadeCount, const float splitBlend,
+	const float shadowDistance)
+{
+	ComputeCascadeSplits(NearPlane, std::min(FarPlane, shadowDistance), cascadeCount, splitBlend, &CascadeInfo);
+}
+
 const CameraShadowInfo* SphericalCamera::GetShadowInfo() const
 {
 	return &CascadeInfo;
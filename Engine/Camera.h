@@ -3,6 +3,7 @@
 
 #include <DirectXMath.h>
 #include <vector>
+#include <stdint.h>
 
 struct Extent2D;
 struct Frustum;
@@ -53,6 +54,10 @@ public:
 	void GetFrustum(Frustum* frustum, const Extent2D& viewportSize, const float nearPlane, const float farPlane) override;
 	virtual const CameraShadowInfo* GetShadowInfo() const override;
 
+	// Splits the view up to the far plane or the shadow distance, whichever is nearer, into
+	// shadow cascades
+	void SetShadowCascades(const uint32_t cascadeCount, const float splitBlend, const float shadowDistance);
+
 	void GetForward(DirectX::XMFLOAT3* vecOut);
 	void LookAt(const float x, const float y, const float z);
 	void LookAt(const DirectX::XMFLOAT3& target);
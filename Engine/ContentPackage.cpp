@@ -5,6 +5,8 @@
 #include "DDSTextureLoader.h"
 #include "MaterialData.h"
 #include "GraphicsDebug.h"
+#include "OcclusionCulling.h"
+#include "MeshSimplifier.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -12,6 +14,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 #include <vector>
 #include <fstream>
 #include <sstream>
@@ -27,13 +30,21 @@ void BytecodeBlob::Destroy()
 ContentPackage::ContentPackage(ID3D11Device* device) :
 device(device)
 {
+	lodParams.LevelCount = DEFAULT_MESH_LOD_LEVELS;
+	lodParams.LevelRatio = DEFAULT_MESH_LOD_RATIO;
+	lodParams.MaxError = DEFAULT_MESH_LOD_MAX_ERROR;
 }
 
 ContentPackage::ContentPackage(Renderer* renderer) :
-device(renderer->GetDevice())
+ContentPackage(renderer->GetDevice())
 {
 }
 
+void ContentPackage::SetMeshLodParams(const MeshLodParams& params)
+{
+	lodParams = params;
+}
+
 void ContentPackage::SetVertexLayout(const InputElementLayout* layout)
 {
 	vertexStrideByte = layout->Stride;
@@ -233,50 +244,108 @@ bool ContentPackage::LoadMesh(const std::string& contentLocation, StaticMesh** m
 		meshOffset += mesh->mNumVertices * vertexStrideFloat;
 	}
 
-	size_t indexCount = 0;
+	auto infinity = numeric_limits<float>::infinity();
+	Bounds bounds = { { infinity, infinity, infinity }, { -infinity, -infinity, -infinity } };
+
 	for (size_t i = 0; i < scene->mNumMeshes; ++i)
-		indexCount += scene->mMeshes[i]->mNumFaces * 3;
+	{
+		auto mesh = scene->mMeshes[i];
+		for (size_t vertexId = 0; vertexId < mesh->mNumVertices; ++vertexId)
+		{
+			auto vertex = mesh->mVertices[vertexId];
+			if (vertex.x > bounds.Upper.x)
+				bounds.Upper.x = vertex.x;
+			if (vertex.y > bounds.Upper.y)
+				bounds.Upper.y = vertex.y;
+			if (vertex.z > bounds.Upper.z)
+				bounds.Upper.z = vertex.z;
 
-	void* meshIndices = nullptr;
-	if (indexFormat == DXGI_FORMAT_R16_UINT)
+			if (vertex.x < bounds.Lower.x)
+				bounds.Lower.x = vertex.x;
+			if (vertex.y < bounds.Lower.y)
+				bounds.Lower.y = vertex.y;
+			if (vertex.z < bounds.Lower.z)
+				bounds.Lower.z = vertex.z;
+		}
+	}
+
+	// Each level of detail is simplified from the one before it and appended to the index buffer,
+	// all of the levels share the vertex buffer
+	vector<vector<XMFLOAT3>> meshPositions(scene->mNumMeshes);
+	vector<vector<uint32_t>> meshLevelIndices(scene->mNumMeshes);
+	for (size_t i = 0; i < scene->mNumMeshes; ++i)
 	{
-		uint16_t* meshIndices16 = new uint16_t[indexCount];
-		meshIndices = meshIndices16;
+		auto mesh = scene->mMeshes[i];
+		for (size_t vertexId = 0; vertexId < mesh->mNumVertices; ++vertexId)
+			meshPositions[i].push_back(XMFLOAT3(mesh->mVertices[vertexId].x, mesh->mVertices[vertexId].y,
+				mesh->mVertices[vertexId].z));
 
-		size_t indexOffset = 0;
-		meshOffset = 0;
-		for (size_t i = 0; i < scene->mNumMeshes; ++i)
+		for (size_t faceId = 0; faceId < mesh->mNumFaces; ++faceId)
 		{
-			auto mesh = scene->mMeshes[i];
-			for (size_t faceId = 0, indexId = indexOffset; faceId < mesh->mNumFaces; ++faceId)
-			{
-				meshIndices16[indexId++] = mesh->mFaces[faceId].mIndices[0] + static_cast<uint16_t>(meshOffset);
-				meshIndices16[indexId++] = mesh->mFaces[faceId].mIndices[1] + static_cast<uint16_t>(meshOffset);
-				meshIndices16[indexId++] = mesh->mFaces[faceId].mIndices[2] + static_cast<uint16_t>(meshOffset);
-			}
-			indexOffset += mesh->mNumFaces * 3;
-			meshOffset += mesh->mNumVertices * vertexStrideFloat;
+			meshLevelIndices[i].push_back(mesh->mFaces[faceId].mIndices[0]);
+			meshLevelIndices[i].push_back(mesh->mFaces[faceId].mIndices[1]);
+			meshLevelIndices[i].push_back(mesh->mFaces[faceId].mIndices[2]);
 		}
 	}
-	else
-	{
-		uint32_t* meshIndices32 = new uint32_t[indexCount];
-		meshIndices = meshIndices32;
 
-		size_t indexOffset = 0;
-		meshOffset = 0;
-		for (size_t i = 0; i < scene->mNumMeshes; ++i)
+	float meshRadius = 0.5f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Upper) - XMLoadFloat3(&bounds.Lower)));
+	float levelError = 0.0f;
+	vector<uint32_t> indices;
+	vector<MeshLod> lods;
+
+	for (uint32_t level = 0; level < max(lodParams.LevelCount, 1u); ++level)
+	{
+		if (level > 0)
 		{
-			auto mesh = scene->mMeshes[i];
-			for (size_t faceId = 0, indexId = indexOffset; faceId < mesh->mNumFaces; ++faceId)
+			// Errors of successive levels add up, so each level may only use what the levels
+			// before it left of the budget
+			float simplifyError = 0.0f;
+			for (size_t i = 0; i < scene->mNumMeshes; ++i)
 			{
-				meshIndices32[indexId++] = mesh->mFaces[faceId].mIndices[0] + meshOffset;
-				meshIndices32[indexId++] = mesh->mFaces[faceId].mIndices[1] + meshOffset;
-				meshIndices32[indexId++] = mesh->mFaces[faceId].mIndices[2] + meshOffset;
+				vector<uint32_t> simplified;
+				float meshError;
+				auto targetCount = static_cast<size_t>(meshLevelIndices[i].size() * lodParams.LevelRatio);
+				if (SimplifyMesh(meshPositions[i], meshLevelIndices[i], targetCount,
+					lodParams.MaxError * meshRadius - levelError, &simplified, &meshError))
+				{
+					meshLevelIndices[i].swap(simplified);
+					simplifyError = max(simplifyError, meshError);
+				}
 			}
-			indexOffset += mesh->mNumFaces * 3;
-			meshOffset += mesh->mNumVertices * vertexStrideFloat;
+
+			size_t levelCount = 0;
+			for (size_t i = 0; i < scene->mNumMeshes; ++i)
+				levelCount += meshLevelIndices[i].size();
+
+			if (levelCount > lods.back().IndexCount * (1.0f - MESH_LOD_MIN_REDUCTION))
+				break;
+
+			levelError += simplifyError;
+		}
+
+		MeshLod lod;
+		lod.IndexOffset = indices.size();
+		lod.Error = meshRadius > 0.0f ? levelError / meshRadius : 0.0f;
+
+		uint32_t vertexOffset = 0;
+		for (size_t i = 0; i < scene->mNumMeshes; ++i)
+		{
+			for (auto index : meshLevelIndices[i])
+				indices.push_back(index + vertexOffset);
+			vertexOffset += scene->mMeshes[i]->mNumVertices;
 		}
+
+		lod.IndexCount = indices.size() - lod.IndexOffset;
+		lods.push_back(lod);
+	}
+
+	size_t indexCount = indices.size();
+	vector<uint16_t> indices16;
+	void* meshIndices = indices.data();
+	if (indexFormat == DXGI_FORMAT_R16_UINT)
+	{
+		indices16.assign(indices.begin(), indices.end());
+		meshIndices = indices16.data();
 	}
 
 	D3D11_BUFFER_DESC bufferDesc;
@@ -296,7 +365,6 @@ bool ContentPackage::LoadMesh(const std::string& contentLocation, StaticMesh** m
 	if (FAILED(result))
 	{
 		delete[] meshData;
-		delete[] meshIndices;
 		return false;
 	}
 
@@ -311,7 +379,6 @@ bool ContentPackage::LoadMesh(const std::string& contentLocation, StaticMesh** m
 	result = device->CreateBuffer(&bufferDesc, &bufferData, &indexBuffer);
 
 	delete[] meshData;
-	delete[] meshIndices;
 
 	if (FAILED(result))
 	{
@@ -319,38 +386,18 @@ bool ContentPackage::LoadMesh(const std::string& contentLocation, StaticMesh** m
 		return false;
 	}
 
-	auto infinity = numeric_limits<float>::infinity();
-	Bounds bounds = { { infinity, infinity, infinity }, { -infinity, -infinity, -infinity } };
-
-	for (size_t i = 0; i < scene->mNumMeshes; ++i)
-	{
-		auto mesh = scene->mMeshes[i];
-		for (size_t vertexId = 0; vertexId < mesh->mNumVertices; ++vertexId)
-		{
-			auto vertex = mesh->mVertices[vertexId];
-			if (vertex.x > bounds.Upper.x)
-				bounds.Upper.x = vertex.x;
-			if (vertex.y > bounds.Upper.y)
-				bounds.Upper.y = vertex.y;
-			if (vertex.z > bounds.Upper.z)
-				bounds.Upper.z = vertex.z;
-
-			if (vertex.x < bounds.Lower.x)
-				bounds.Lower.x = vertex.x;
-			if (vertex.y < bounds.Lower.y)
-				bounds.Lower.y = vertex.y;
-			if (vertex.z < bounds.Lower.z)
-				bounds.Lower.z = vertex.z;
-		}
-	}
-
 	stringstream strstream;
 	strstream << "Computed Mesh Bounds : { (" << bounds.Lower.x << ", " << bounds.Lower.y << ", " <<
 		bounds.Lower.z << "), (" << bounds.Upper.x << ", " << bounds.Upper.y << ", " << bounds.Upper.z <<
 		") }\n";
+	strstream << "Computed Mesh Levels :";
+	for (auto& lod : lods)
+		strstream << " " << lod.IndexCount / 3;
+	strstream << " triangles\n";
 	OutputDebugString(strstream.str().c_str());
 
-	*meshOut = new StaticMesh(vertexBuffer, indexBuffer, indexCount, 0, bounds, indexFormat);
+	*meshOut = new StaticMesh(vertexBuffer, indexBuffer, lods[0].IndexCount, 0, bounds, indexFormat);
+	(*meshOut)->SetLods(lods);
 	staticMeshes[contentLocation] = *meshOut;
 
 #if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
@@ -366,6 +413,72 @@ bool ContentPackage::LoadMesh(const std::string& contentLocation, StaticMesh** m
 	return true;
 }
 
+bool ContentPackage::LoadOccluderMesh(const std::string& contentLocation, OccluderMesh** meshOut)
+{
+	OutputDebugString("Loading resource ");
+	OutputDebugString(contentLocation.c_str());
+	OutputDebugString("\n");
+
+	auto findResult = occluderMeshes.find(contentLocation);
+	if (findResult != occluderMeshes.end())
+	{
+		*meshOut = findResult->second;
+		return true;
+	}
+
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(contentLocation.c_str(),
+		(aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType |
+		aiProcess_PreTransformVertices));
+
+	if (scene == nullptr)
+		return false;
+
+	if (!scene->HasMeshes())
+	{
+		OutputDebugString("Scene does not have meshes!\n");
+		return false;
+	}
+
+	auto occluderMesh = new OccluderMesh();
+
+	for (size_t i = 0; i < scene->mNumMeshes; ++i)
+	{
+		auto mesh = scene->mMeshes[i];
+		if (!mesh->HasPositions())
+		{
+			OutputDebugString("Mesh is missing positions!\n");
+			delete occluderMesh;
+			return false;
+		}
+
+		auto meshOffset = static_cast<uint32_t>(occluderMesh->Positions.size());
+		for (size_t vertexId = 0; vertexId < mesh->mNumVertices; ++vertexId)
+		{
+			auto& vertex = mesh->mVertices[vertexId];
+			occluderMesh->Positions.push_back(XMFLOAT3(vertex.x, vertex.y, vertex.z));
+		}
+
+		// Points and lines are sorted into meshes of their own and cover nothing
+		for (size_t faceId = 0; faceId < mesh->mNumFaces; ++faceId)
+		{
+			auto& face = mesh->mFaces[faceId];
+			if (face.mNumIndices != 3)
+				continue;
+
+			occluderMesh->Indices.push_back(face.mIndices[0] + meshOffset);
+			occluderMesh->Indices.push_back(face.mIndices[1] + meshOffset);
+			occluderMesh->Indices.push_back(face.mIndices[2] + meshOffset);
+		}
+	}
+
+	*meshOut = occluderMesh;
+	occluderMeshes[contentLocation] = occluderMesh;
+	return true;
+}
+
 bool ContentPackage::LoadTexture2D(const std::string& contentLocation, ID3D11Resource** textureResource,
 	ID3D11ShaderResourceView** resourceView)
 {
@@ -541,6 +654,15 @@ void ContentPackage::Destroy()
 		OutputDebugString("\n");
 	}
 
+	for (auto mesh : occluderMeshes)
+	{
+		delete mesh.second;
+
+		OutputDebugString("Destroying resource ");
+		OutputDebugString(mesh.first.c_str());
+		OutputDebugString("\n");
+	}
+
 	for (auto texture : textures)
 	{
 		texture.second.second->Release();
@@ -5,8 +5,10 @@
 #include <d3d11.h>
 
 #include "InputElementDesc.h"
+#include "MeshSimplifier.h"
 
 class StaticMesh;
+struct OccluderMesh;
 class Renderer;
 class MaterialData;
 
@@ -23,6 +25,7 @@ class ContentPackage
 {
 protected:
 	std::map<std::string, StaticMesh*> staticMeshes;
+	std::map<std::string, OccluderMesh*> occluderMeshes;
 	std::map<std::string, std::pair<ID3D11Resource*, ID3D11ShaderResourceView*>> textures;
 	std::map<std::string, ID3D11VertexShader*> vertexShaders;
 	std::map<std::string, ID3D11PixelShader*> pixelShaders;
@@ -41,14 +44,19 @@ protected:
 
 	size_t vertexStrideFloat;
 	size_t vertexStrideByte;
+	MeshLodParams lodParams;
 
 public:
 	ContentPackage(ID3D11Device* device);
 	ContentPackage(Renderer* renderer);
 
 	void SetVertexLayout(const InputElementLayout* layout);
+	// Levels of detail generated for meshes loaded after this is set
+	void SetMeshLodParams(const MeshLodParams& params);
 
 	bool LoadMesh(const std::string& contentLocation, StaticMesh** meshOut);
+	// Loads only the positions and triangles of a mesh, to be rasterized as an occluder
+	bool LoadOccluderMesh(const std::string& contentLocation, OccluderMesh** meshOut);
 	bool LoadTexture2D(const std::string& contentLocation, ID3D11Resource** texture,
 		ID3D11ShaderResourceView** resourceView);
 
@@ -0,0 +1,156 @@
+#include "D3D11RenderContext.h"
+
+D3D11RenderContext::D3D11RenderContext() :
+	device(nullptr),
+	deviceContext(nullptr),
+	swapChain(nullptr)
+{
+}
+
+void D3D11RenderContext::Initialize(ID3D11Device* device, ID3D11DeviceContext* deviceContext,
+	IDXGISwapChain* swapChain)
+{
+	this->device = device;
+	this->deviceContext = deviceContext;
+	this->swapChain = swapChain;
+}
+
+HRESULT D3D11RenderContext::CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+	ID3D11Buffer** bufferOut)
+{
+	return device->CreateBuffer(desc, initialData, bufferOut);
+}
+
+HRESULT D3D11RenderContext::CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut)
+{
+	return device->CreateQuery(desc, queryOut);
+}
+
+void D3D11RenderContext::Release(ID3D11DeviceChild* object)
+{
+	if (object != nullptr)
+		object->Release();
+}
+
+void D3D11RenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4])
+{
+	deviceContext->ClearRenderTargetView(renderTarget, color);
+}
+
+void D3D11RenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags,
+	FLOAT depth, UINT8 stencil)
+{
+	deviceContext->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil);
+}
+
+void D3D11RenderContext::OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+	ID3D11DepthStencilView* depthStencilView)
+{
+	deviceContext->OMSetRenderTargets(viewCount, renderTargets, depthStencilView);
+}
+
+void D3D11RenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	deviceContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void D3D11RenderContext::RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports)
+{
+	deviceContext->RSSetViewports(viewportCount, viewports);
+}
+
+void D3D11RenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+	deviceContext->RSSetState(state);
+}
+
+void D3D11RenderContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	deviceContext->IASetPrimitiveTopology(topology);
+}
+
+void D3D11RenderContext::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	deviceContext->IASetInputLayout(inputLayout);
+}
+
+void D3D11RenderContext::IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+	const UINT* strides, const UINT* offsets)
+{
+	deviceContext->IASetVertexBuffers(startSlot, bufferCount, buffers, strides, offsets);
+}
+
+void D3D11RenderContext::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	deviceContext->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11RenderContext::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	deviceContext->VSSetShader(shader, classInstances, classInstanceCount);
+}
+
+void D3D11RenderContext::VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	deviceContext->VSSetConstantBuffers(startSlot, bufferCount, buffers);
+}
+
+void D3D11RenderContext::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	deviceContext->PSSetShader(shader, classInstances, classInstanceCount);
+}
+
+void D3D11RenderContext::PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	deviceContext->PSSetConstantBuffers(startSlot, bufferCount, buffers);
+}
+
+void D3D11RenderContext::PSSetShaderResources(UINT startSlot, UINT viewCount,
+	ID3D11ShaderResourceView* const* views)
+{
+	deviceContext->PSSetShaderResources(startSlot, viewCount, views);
+}
+
+void D3D11RenderContext::PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers)
+{
+	deviceContext->PSSetSamplers(startSlot, samplerCount, samplers);
+}
+
+HRESULT D3D11RenderContext::Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+	D3D11_MAPPED_SUBRESOURCE* mappedOut)
+{
+	return deviceContext->Map(resource, subresource, mapType, mapFlags, mappedOut);
+}
+
+void D3D11RenderContext::Unmap(ID3D11Resource* resource, UINT subresource)
+{
+	deviceContext->Unmap(resource, subresource);
+}
+
+void D3D11RenderContext::Draw(UINT vertexCount, UINT startVertex)
+{
+	deviceContext->Draw(vertexCount, startVertex);
+}
+
+void D3D11RenderContext::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex,
+	INT baseVertex, UINT startInstance)
+{
+	deviceContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void D3D11RenderContext::End(ID3D11Asynchronous* query)
+{
+	deviceContext->End(query);
+}
+
+HRESULT D3D11RenderContext::GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags)
+{
+	return deviceContext->GetData(query, data, dataSize, getDataFlags);
+}
+
+HRESULT D3D11RenderContext::Present(UINT syncInterval, UINT flags)
+{
+	return swapChain->Present(syncInterval, flags);
+}
\ No newline at end of file
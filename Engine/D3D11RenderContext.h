@@ -0,0 +1,66 @@
+#ifndef D3D11_RENDER_CONTEXT_H_
+#define D3D11_RENDER_CONTEXT_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <d3d11.h>
+
+#include "RenderContext.h"
+
+// Passes every call on to a device, its immediate context and the swap chain presented to
+class D3D11RenderContext : public IRenderContext
+{
+public:
+	D3D11RenderContext();
+
+	void Initialize(ID3D11Device* device, ID3D11DeviceContext* deviceContext, IDXGISwapChain* swapChain);
+
+	HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Buffer** bufferOut) override;
+	HRESULT CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut) override;
+	void Release(ID3D11DeviceChild* object) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth,
+		UINT8 stencil) override;
+	void OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+		ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) override;
+	void RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports) override;
+	void RSSetState(ID3D11RasterizerState* state) override;
+
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+		const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShaderResources(UINT startSlot, UINT viewCount, ID3D11ShaderResourceView* const* views) override;
+	void PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers) override;
+
+	HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+		D3D11_MAPPED_SUBRESOURCE* mappedOut) override;
+	void Unmap(ID3D11Resource* resource, UINT subresource) override;
+
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex,
+		UINT startInstance) override;
+
+	void End(ID3D11Asynchronous* query) override;
+	HRESULT GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags) override;
+
+	HRESULT Present(UINT syncInterval, UINT flags) override;
+
+protected:
+	ID3D11Device* device;
+	ID3D11DeviceContext* deviceContext;
+	IDXGISwapChain* swapChain;
+};
+
+#endif
\ No newline at end of file
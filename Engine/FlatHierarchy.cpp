@@ -0,0 +1,92 @@
+#include "FlatHierarchy.h"
+#include "SceneGraph.h"
+
+using namespace std;
+
+FlatHierarchy::FlatHierarchy() :
+	Generation(0)
+{
+}
+
+uint32_t FlatHierarchy::Push(const Bounds& bounds, SceneNode* leafData)
+{
+	auto index = GetSize();
+
+	LowerX.push_back(bounds.Lower.x);
+	LowerY.push_back(bounds.Lower.y);
+	LowerZ.push_back(bounds.Lower.z);
+	UpperX.push_back(bounds.Upper.x);
+	UpperY.push_back(bounds.Upper.y);
+	UpperZ.push_back(bounds.Upper.z);
+	SkipIndices.push_back(index + 1);
+	LeafData.push_back(leafData);
+	RejectPlanes.push_back(0);
+
+	return index;
+}
+
+void FlatHierarchy::Clear()
+{
+	LowerX.clear();
+	LowerY.clear();
+	LowerZ.clear();
+	UpperX.clear();
+	UpperY.clear();
+	UpperZ.clear();
+	SkipIndices.clear();
+	LeafData.clear();
+	RejectPlanes.clear();
+	++Generation;
+}
+
+void CompileFlatRegion(RegionNode* region, FlatHierarchy* hierarchyOut)
+{
+	// A nested zone's bounds are the same as the bounds of its own root region,
+	// so the root region takes the place of the leaf that refers to the zone.
+	if (region->LeafData != nullptr && region->LeafData->IsZone())
+	{
+		auto index = hierarchyOut->GetSize();
+		region->FlatIndex = INVALID_FLAT_INDEX;
+		CompileFlatRegion(&region->LeafData->Region, hierarchyOut);
+		hierarchyOut->LeafData[index] = region->LeafData;
+		return;
+	}
+
+	auto index = hierarchyOut->Push(region->AABB, region->LeafData);
+	region->FlatIndex = index;
+
+	if (region->Node1 != nullptr)
+		CompileFlatRegion(region->Node1, hierarchyOut);
+	if (region->Node2 != nullptr)
+		CompileFlatRegion(region->Node2, hierarchyOut);
+	if (region->Node3 != nullptr)
+		CompileFlatRegion(region->Node3, hierarchyOut);
+
+	hierarchyOut->SkipIndices[index] = hierarchyOut->GetSize();
+}
+
+void CompileFlatHierarchy(SceneNode* zone, FlatHierarchy* hierarchyOut)
+{
+	hierarchyOut->Clear();
+
+	if (!zone->IsZone())
+	{
+		OutputDebugString("Scene node specified is not a zone!\n");
+		return;
+	}
+
+	CompileFlatRegion(&zone->Region, hierarchyOut);
+}
+
+void RecompileEnclosingFlatHierarchies(SceneNode* zone)
+{
+	for (auto node = zone->Parent; node != nullptr; node = node->Parent)
+	{
+		if (!node->IsZone())
+			continue;
+
+		auto compiledHierarchy = &node->Ref.ZoneData->CompiledHierarchy;
+		if (!compiledHierarchy->IsEmpty())
+			CompileFlatHierarchy(node, compiledHierarchy);
+	}
+}
\ No newline at end of file
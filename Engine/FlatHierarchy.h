@@ -0,0 +1,79 @@
+#ifndef FLAT_HIERARCHY_H_
+#define FLAT_HIERARCHY_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "Geometry.h"
+
+class SceneNode;
+struct RegionNode;
+
+// A region hierarchy compiled into a single depth first array. The first child of an entry
+// is always the entry directly after it, and the skip index of an entry is the index of the
+// first entry after its subtree. Nested zones are inlined into the array of their parent zone,
+// with the zone as the leaf data of the entry for its root region.
+class FlatHierarchy
+{
+public:
+	std::vector<float> LowerX;
+	std::vector<float> LowerY;
+	std::vector<float> LowerZ;
+	std::vector<float> UpperX;
+	std::vector<float> UpperY;
+	std::vector<float> UpperZ;
+	std::vector<uint32_t> SkipIndices;
+	std::vector<SceneNode*> LeafData;
+	// Frustum plane that rejected each entry when it was last culled
+	std::vector<uint8_t> RejectPlanes;
+	// Changes every time the hierarchy is cleared, so that indices kept from before can be
+	// recognized as stale
+	uint32_t Generation;
+
+	FlatHierarchy();
+
+	inline uint32_t GetSize() const;
+	inline bool IsEmpty() const;
+	inline void GetBounds(const uint32_t index, Bounds* boundsOut) const;
+	inline void SetBounds(const uint32_t index, const Bounds& bounds);
+
+	uint32_t Push(const Bounds& bounds, SceneNode* leafData);
+	void Clear();
+};
+
+void CompileFlatHierarchy(SceneNode* zone, FlatHierarchy* hierarchyOut);
+// Recompiles the non-empty arrays of the zones enclosing a zone whose hierarchy has changed, since
+// they inline it. The outermost zone is compiled last, so regions keep their index in its array.
+void RecompileEnclosingFlatHierarchies(SceneNode* zone);
+
+inline uint32_t FlatHierarchy::GetSize() const
+{
+	return static_cast<uint32_t>(SkipIndices.size());
+}
+
+inline bool FlatHierarchy::IsEmpty() const
+{
+	return SkipIndices.empty();
+}
+
+inline void FlatHierarchy::GetBounds(const uint32_t index, Bounds* boundsOut) const
+{
+	boundsOut->Lower.x = LowerX[index];
+	boundsOut->Lower.y = LowerY[index];
+	boundsOut->Lower.z = LowerZ[index];
+	boundsOut->Upper.x = UpperX[index];
+	boundsOut->Upper.y = UpperY[index];
+	boundsOut->Upper.z = UpperZ[index];
+}
+
+inline void FlatHierarchy::SetBounds(const uint32_t index, const Bounds& bounds)
+{
+	LowerX[index] = bounds.Lower.x;
+	LowerY[index] = bounds.Lower.y;
+	LowerZ[index] = bounds.Lower.z;
+	UpperX[index] = bounds.Upper.x;
+	UpperY[index] = bounds.Upper.y;
+	UpperZ[index] = bounds.Upper.z;
+}
+
+#endif
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include <limits>
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 using namespace std;
 using namespace DirectX;
 
@@ -24,34 +28,219 @@ inline void ConstructPlaneFromPoints(const DirectX::XMVECTOR& p1, const DirectX:
 
 bool IsOutsideFrustum(const Bounds& bounds, const Frustum& frustum)
 {
-	XMFLOAT3 testPoints[] =
-	{
-		{ bounds.Lower.x, bounds.Lower.y, bounds.Lower.z },
-		{ bounds.Lower.x, bounds.Lower.y, bounds.Upper.z },
-		{ bounds.Lower.x, bounds.Upper.y, bounds.Lower.z },
-		{ bounds.Lower.x, bounds.Upper.y, bounds.Upper.z },
-		{ bounds.Upper.x, bounds.Lower.y, bounds.Lower.z },
-		{ bounds.Upper.x, bounds.Lower.y, bounds.Upper.z },
-		{ bounds.Upper.x, bounds.Upper.y, bounds.Lower.z },
-		{ bounds.Upper.x, bounds.Upper.y, bounds.Upper.z }
-	};
+	return TestFrustum(bounds, frustum) == FRUSTUM_OUTSIDE;
+}
+
+// Plane normals point out of the frustum. For each plane only two corners of a box matter, the
+// n-vertex with the smallest distance along the normal and the p-vertex with the largest. The box
+// is outside if its n-vertex is in front of the plane and inside if its p-vertex is behind it.
+// Comparisons involving NaN, such as from infinite bounds, are false and so report intersection.
+inline FrustumTestResult TestPlane(const Bounds& bounds, const Plane& plane)
+{
+	auto& normal = plane.Normal;
+
+	float nDistance =
+		normal.x * (normal.x >= 0.0f ? bounds.Lower.x : bounds.Upper.x) +
+		normal.y * (normal.y >= 0.0f ? bounds.Lower.y : bounds.Upper.y) +
+		normal.z * (normal.z >= 0.0f ? bounds.Lower.z : bounds.Upper.z);
+
+	if (nDistance > plane.Distance)
+		return FRUSTUM_OUTSIDE;
+
+	float pDistance =
+		normal.x * (normal.x >= 0.0f ? bounds.Upper.x : bounds.Lower.x) +
+		normal.y * (normal.y >= 0.0f ? bounds.Upper.y : bounds.Lower.y) +
+		normal.z * (normal.z >= 0.0f ? bounds.Upper.z : bounds.Lower.z);
+
+	if (pDistance <= plane.Distance)
+		return FRUSTUM_INSIDE;
+
+	return FRUSTUM_INTERSECTING;
+}
+
+FrustumTestResult TestFrustum(const Bounds& bounds, const Frustum& frustum)
+{
+	auto result = FRUSTUM_INSIDE;
 
 	for (int i = 0; i < 6; ++i)
 	{
-		int sum = 0;
+		auto planeResult = TestPlane(bounds, frustum.Planes[i]);
+		if (planeResult == FRUSTUM_OUTSIDE)
+			return FRUSTUM_OUTSIDE;
+		if (planeResult == FRUSTUM_INTERSECTING)
+			result = FRUSTUM_INTERSECTING;
+	}
 
-		for (int j = 0; j < 8; ++j)
-		{
-			sum += ((testPoints[j].x * frustum.Planes[i].Normal.x +
-				testPoints[j].y * frustum.Planes[i].Normal.y +
-				testPoints[j].z * frustum.Planes[i].Normal.z) > frustum.Planes[i].Distance);
+	return result;
+}
 
-			if (sum == 8)
-				return true;
+FrustumTestResult TestFrustum(const Bounds& bounds, const Frustum& frustum, uint32_t* planeMaskInOut,
+	uint8_t* rejectPlaneInOut)
+{
+	auto planeMask = *planeMaskInOut;
+	auto rejectPlane = *rejectPlaneInOut;
+
+	if ((planeMask & (1 << rejectPlane)) != 0)
+	{
+		auto planeResult = TestPlane(bounds, frustum.Planes[rejectPlane]);
+		if (planeResult == FRUSTUM_OUTSIDE)
+			return FRUSTUM_OUTSIDE;
+		if (planeResult == FRUSTUM_INSIDE)
+			planeMask &= ~(1 << rejectPlane);
+	}
+
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		if (i == rejectPlane || (planeMask & (1 << i)) == 0)
+			continue;
+
+		auto planeResult = TestPlane(bounds, frustum.Planes[i]);
+		if (planeResult == FRUSTUM_OUTSIDE)
+		{
+			*rejectPlaneInOut = i;
+			return FRUSTUM_OUTSIDE;
 		}
+		if (planeResult == FRUSTUM_INSIDE)
+			planeMask &= ~(1 << i);
 	}
 
-	return false;
+	*planeMaskInOut = planeMask;
+	return planeMask == 0 ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTING;
+}
+
+// Picks the coordinate streams holding the n-vertex and p-vertex of every box for a plane.
+// The choice only depends on the signs of the normal, so it is the same for all boxes.
+struct VertexStreams
+{
+	const float* X;
+	const float* Y;
+	const float* Z;
+};
+
+inline void GetPlaneVertexStreams(const BoundsStreams& bounds, const Plane& plane,
+	VertexStreams* nVertexOut, VertexStreams* pVertexOut)
+{
+	bool bPositiveX = plane.Normal.x >= 0.0f;
+	bool bPositiveY = plane.Normal.y >= 0.0f;
+	bool bPositiveZ = plane.Normal.z >= 0.0f;
+
+	nVertexOut->X = bPositiveX ? bounds.LowerX : bounds.UpperX;
+	nVertexOut->Y = bPositiveY ? bounds.LowerY : bounds.UpperY;
+	nVertexOut->Z = bPositiveZ ? bounds.LowerZ : bounds.UpperZ;
+	pVertexOut->X = bPositiveX ? bounds.UpperX : bounds.LowerX;
+	pVertexOut->Y = bPositiveY ? bounds.UpperY : bounds.LowerY;
+	pVertexOut->Z = bPositiveZ ? bounds.UpperZ : bounds.LowerZ;
+}
+
+inline void StoreFrustumTestResults(const uint32_t outsideMask, const uint32_t insideMask, const uint32_t count,
+	FrustumTestResult* resultsOut)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if ((outsideMask & (1 << i)) != 0)
+			resultsOut[i] = FRUSTUM_OUTSIDE;
+		else if ((insideMask & (1 << i)) != 0)
+			resultsOut[i] = FRUSTUM_INSIDE;
+		else
+			resultsOut[i] = FRUSTUM_INTERSECTING;
+	}
+}
+
+inline void TestFrustum4(const BoundsStreams& bounds, const uint32_t first, const Frustum& frustum,
+	FrustumTestResult* resultsOut)
+{
+	VertexStreams nVertex;
+	VertexStreams pVertex;
+	XMVECTOR outside = XMVectorFalseInt();
+	XMVECTOR inside = XMVectorTrueInt();
+
+	for (int i = 0; i < 6; ++i)
+	{
+		auto& plane = frustum.Planes[i];
+		GetPlaneVertexStreams(bounds, plane, &nVertex, &pVertex);
+
+		auto normalX = XMVectorReplicate(plane.Normal.x);
+		auto normalY = XMVectorReplicate(plane.Normal.y);
+		auto normalZ = XMVectorReplicate(plane.Normal.z);
+		auto distance = XMVectorReplicate(plane.Distance);
+
+		auto nDistance = XMVectorMultiply(normalX, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nVertex.X + first)));
+		nDistance = XMVectorMultiplyAdd(normalY, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nVertex.Y + first)), nDistance);
+		nDistance = XMVectorMultiplyAdd(normalZ, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nVertex.Z + first)), nDistance);
+
+		auto pDistance = XMVectorMultiply(normalX, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pVertex.X + first)));
+		pDistance = XMVectorMultiplyAdd(normalY, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pVertex.Y + first)), pDistance);
+		pDistance = XMVectorMultiplyAdd(normalZ, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pVertex.Z + first)), pDistance);
+
+		outside = XMVectorOrInt(outside, XMVectorGreater(nDistance, distance));
+		inside = XMVectorAndInt(inside, XMVectorLessOrEqual(pDistance, distance));
+	}
+
+	XMUINT4 outsideMasks;
+	XMUINT4 insideMasks;
+	XMStoreUInt4(&outsideMasks, outside);
+	XMStoreUInt4(&insideMasks, inside);
+
+	uint32_t outsideMask = (outsideMasks.x & 1) | (outsideMasks.y & 2) | (outsideMasks.z & 4) | (outsideMasks.w & 8);
+	uint32_t insideMask = (insideMasks.x & 1) | (insideMasks.y & 2) | (insideMasks.z & 4) | (insideMasks.w & 8);
+	StoreFrustumTestResults(outsideMask, insideMask, 4, resultsOut + first);
+}
+
+#ifdef __AVX__
+inline void TestFrustum8(const BoundsStreams& bounds, const uint32_t first, const Frustum& frustum,
+	FrustumTestResult* resultsOut)
+{
+	VertexStreams nVertex;
+	VertexStreams pVertex;
+	__m256 outside = _mm256_setzero_ps();
+	__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+	for (int i = 0; i < 6; ++i)
+	{
+		auto& plane = frustum.Planes[i];
+		GetPlaneVertexStreams(bounds, plane, &nVertex, &pVertex);
+
+		auto normalX = _mm256_set1_ps(plane.Normal.x);
+		auto normalY = _mm256_set1_ps(plane.Normal.y);
+		auto normalZ = _mm256_set1_ps(plane.Normal.z);
+		auto distance = _mm256_set1_ps(plane.Distance);
+
+		auto nDistance = _mm256_mul_ps(normalX, _mm256_loadu_ps(nVertex.X + first));
+		nDistance = _mm256_add_ps(nDistance, _mm256_mul_ps(normalY, _mm256_loadu_ps(nVertex.Y + first)));
+		nDistance = _mm256_add_ps(nDistance, _mm256_mul_ps(normalZ, _mm256_loadu_ps(nVertex.Z + first)));
+
+		auto pDistance = _mm256_mul_ps(normalX, _mm256_loadu_ps(pVertex.X + first));
+		pDistance = _mm256_add_ps(pDistance, _mm256_mul_ps(normalY, _mm256_loadu_ps(pVertex.Y + first)));
+		pDistance = _mm256_add_ps(pDistance, _mm256_mul_ps(normalZ, _mm256_loadu_ps(pVertex.Z + first)));
+
+		outside = _mm256_or_ps(outside, _mm256_cmp_ps(nDistance, distance, _CMP_GT_OQ));
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(pDistance, distance, _CMP_LE_OQ));
+	}
+
+	StoreFrustumTestResults(_mm256_movemask_ps(outside), _mm256_movemask_ps(inside), 8, resultsOut + first);
+}
+#endif
+
+void TestFrustumBatch(const BoundsStreams& bounds, const uint32_t count, const Frustum& frustum,
+	FrustumTestResult* resultsOut)
+{
+	uint32_t i = 0;
+
+#ifdef __AVX__
+	for (; i + 8 <= count; i += 8)
+		TestFrustum8(bounds, i, frustum, resultsOut);
+#endif
+
+	for (; i + 4 <= count; i += 4)
+		TestFrustum4(bounds, i, frustum, resultsOut);
+
+	Bounds box;
+	for (; i < count; ++i)
+	{
+		box.Lower = { bounds.LowerX[i], bounds.LowerY[i], bounds.LowerZ[i] };
+		box.Upper = { bounds.UpperX[i], bounds.UpperY[i], bounds.UpperZ[i] };
+		resultsOut[i] = TestFrustum(box, frustum);
+	}
 }
 
 void ConstructFrustum(const float fieldOfView, const float farPlane, const float nearPlane,
@@ -2,6 +2,8 @@
 #define GEOMETRY_H_
 
 #include <DirectXMath.h>
+#include <limits>
+#include <stdint.h>
 
 struct Bounds
 {
@@ -20,6 +22,26 @@ struct Frustum
 	Plane Planes[6];
 };
 
+#define FRUSTUM_PLANE_MASK_ALL 0x3F
+
+enum FrustumTestResult
+{
+	FRUSTUM_OUTSIDE = 0,
+	FRUSTUM_INTERSECTING = 1,
+	FRUSTUM_INSIDE = 2
+};
+
+// Boxes stored as separate arrays of coordinates, so that several can be tested at once
+struct BoundsStreams
+{
+	const float* LowerX;
+	const float* LowerY;
+	const float* LowerZ;
+	const float* UpperX;
+	const float* UpperY;
+	const float* UpperZ;
+};
+
 void ConstructPlaneFromNormalAndPoint(const DirectX::XMVECTOR& point,
 	const DirectX::XMVECTOR& normal, Plane* planeOut);
 
@@ -27,6 +49,15 @@ void ConstructPlaneFromPoints(const DirectX::XMVECTOR& p1, const DirectX::XMVECT
 	const DirectX::XMVECTOR& p3, Plane* planeOut);
 
 bool IsOutsideFrustum(const Bounds& bounds, const Frustum& frustum);
+FrustumTestResult TestFrustum(const Bounds& bounds, const Frustum& frustum);
+// Tests only the planes set in the mask and clears those the box is entirely behind, so that
+// boxes contained in this one can skip them. The plane that rejected the box last is tested
+// first, and is replaced when another plane rejects the box.
+FrustumTestResult TestFrustum(const Bounds& bounds, const Frustum& frustum, uint32_t* planeMaskInOut,
+	uint8_t* rejectPlaneInOut);
+// Tests count boxes, eight at a time when AVX is available and four at a time otherwise
+void TestFrustumBatch(const BoundsStreams& bounds, const uint32_t count, const Frustum& frustum,
+	FrustumTestResult* resultsOut);
 
 void ConstructFrustum(const float fieldOfView, const float farPlane, const float nearPlane,
 	const DirectX::XMFLOAT3& cameraPosition, const DirectX::XMFLOAT3& cameraTarget,
@@ -34,4 +65,60 @@ void ConstructFrustum(const float fieldOfView, const float farPlane, const float
 
 void TransformBounds(const DirectX::XMMATRIX& matrix, const Bounds& bounds, Bounds* boundsOut);
 
+inline void SetEmptyBounds(Bounds* boundsOut);
+inline void ExpandBounds(Bounds* boundsOut, const Bounds& bounds);
+inline void ExpandBounds(Bounds* boundsOut, const DirectX::XMFLOAT3& point);
+inline void GetBoundsCenter(const Bounds& bounds, DirectX::XMFLOAT3* centerOut);
+inline float GetBoundsHalfArea(const Bounds& bounds);
+
+inline void SetEmptyBounds(Bounds* boundsOut)
+{
+	auto infinity = std::numeric_limits<float>::infinity();
+	boundsOut->Lower = { infinity, infinity, infinity };
+	boundsOut->Upper = { -infinity, -infinity, -infinity };
+}
+
+inline void ExpandBounds(Bounds* boundsOut, const Bounds& bounds)
+{
+	if (boundsOut->Lower.x > bounds.Lower.x)
+		boundsOut->Lower.x = bounds.Lower.x;
+	if (boundsOut->Lower.y > bounds.Lower.y)
+		boundsOut->Lower.y = bounds.Lower.y;
+	if (boundsOut->Lower.z > bounds.Lower.z)
+		boundsOut->Lower.z = bounds.Lower.z;
+
+	if (boundsOut->Upper.x < bounds.Upper.x)
+		boundsOut->Upper.x = bounds.Upper.x;
+	if (boundsOut->Upper.y < bounds.Upper.y)
+		boundsOut->Upper.y = bounds.Upper.y;
+	if (boundsOut->Upper.z < bounds.Upper.z)
+		boundsOut->Upper.z = bounds.Upper.z;
+}
+
+inline void ExpandBounds(Bounds* boundsOut, const DirectX::XMFLOAT3& point)
+{
+	ExpandBounds(boundsOut, { point, point });
+}
+
+inline void GetBoundsCenter(const Bounds& bounds, DirectX::XMFLOAT3* centerOut)
+{
+	centerOut->x = 0.5f * (bounds.Lower.x + bounds.Upper.x);
+	centerOut->y = 0.5f * (bounds.Lower.y + bounds.Upper.y);
+	centerOut->z = 0.5f * (bounds.Lower.z + bounds.Upper.z);
+}
+
+// Half of the surface area of a box, which is all the surface area heuristic needs
+// since it only ever compares ratios of areas.
+inline float GetBoundsHalfArea(const Bounds& bounds)
+{
+	float widthX = bounds.Upper.x - bounds.Lower.x;
+	float widthY = bounds.Upper.y - bounds.Lower.y;
+	float widthZ = bounds.Upper.z - bounds.Lower.z;
+
+	if (widthX < 0.0f || widthY < 0.0f || widthZ < 0.0f)
+		return 0.0f;
+
+	return widthX * widthY + widthY * widthZ + widthZ * widthX;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,500 @@
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace DirectX;
+using namespace std;
+
+#define DEFAULT_HIERARCHY_LEAF_SIZE 3
+#define DEFAULT_HIERARCHY_BIN_COUNT 16
+#define DEFAULT_HIERARCHY_TRAVERSAL_COST 1.0f
+#define DEFAULT_HIERARCHY_INTERSECTION_COST 1.0f
+#define DEFAULT_HIERARCHY_REBUILD_COST_THRESHOLD 0.3f
+#define MAX_HIERARCHY_BIN_COUNT 64
+#define REGION_CHILD_COUNT 3
+// Blobs smaller than this are reduced and partitioned on a single thread
+#define PARALLEL_HIERARCHY_MIN_COUNT 16384
+#define PARALLEL_HIERARCHY_GRAIN_SIZE 4096
+
+struct SAHBin
+{
+	Bounds AABB;
+	size_t Count;
+};
+
+struct SAHBinning
+{
+	Bounds CentroidBounds;
+	// Bins per unit along each axis, zero for axes along which all centroids coincide
+	float Scale[3];
+	size_t BinCount;
+};
+
+inline float GetAxis(const XMFLOAT3& vec, const size_t axis)
+{
+	return (&vec.x)[axis];
+}
+
+inline float GetRegionCentroid(const RegionNode* region, const size_t axis)
+{
+	return 0.5f * (GetAxis(region->AABB.Lower, axis) + GetAxis(region->AABB.Upper, axis));
+}
+
+inline size_t GetLongestAxis(const Bounds& bounds)
+{
+	auto widthX = bounds.Upper.x - bounds.Lower.x;
+	auto widthY = bounds.Upper.y - bounds.Lower.y;
+	auto widthZ = bounds.Upper.z - bounds.Lower.z;
+
+	if (widthX >= widthY && widthX >= widthZ)
+		return MAJOR_AXIS_X;
+	else if (widthY >= widthZ)
+		return MAJOR_AXIS_Y;
+	else
+		return MAJOR_AXIS_Z;
+}
+
+void InitializeRegionNode(RegionNode* region)
+{
+	region->LeafData = nullptr;
+	region->Node1 = nullptr;
+	region->Node2 = nullptr;
+	region->Node3 = nullptr;
+	region->Parent = nullptr;
+	region->FlatIndex = INVALID_FLAT_INDEX;
+	region->bRefitPending = false;
+	region->RejectPlane = 0;
+}
+
+RegionNode* CreateRegionNode(MemoryArena* arena)
+{
+	auto region = arena->New<RegionNode>();
+	InitializeRegionNode(region);
+	return region;
+}
+
+void ComputeBlobBounds(RegionNode** regions, const size_t count, Bounds* boundsOut, Bounds* centroidBoundsOut)
+{
+	SetEmptyBounds(boundsOut);
+	SetEmptyBounds(centroidBoundsOut);
+
+	XMFLOAT3 center;
+	for (size_t i = 0; i < count; ++i)
+	{
+		GetBoundsCenter(regions[i]->AABB, &center);
+		ExpandBounds(boundsOut, regions[i]->AABB);
+		ExpandBounds(centroidBoundsOut, center);
+	}
+}
+
+// Min and max are exact, so merging the bounds of chunks gives the same result as a single pass
+void ComputeBlobBounds(RegionNode** regions, const size_t count, Bounds* boundsOut, Bounds* centroidBoundsOut,
+	WorkerPool* workers)
+{
+	if (workers == nullptr || count < PARALLEL_HIERARCHY_MIN_COUNT)
+	{
+		ComputeBlobBounds(regions, count, boundsOut, centroidBoundsOut);
+		return;
+	}
+
+	auto chunkCount = (count + PARALLEL_HIERARCHY_GRAIN_SIZE - 1) / PARALLEL_HIERARCHY_GRAIN_SIZE;
+	vector<Bounds> chunkBounds(chunkCount);
+	vector<Bounds> chunkCentroidBounds(chunkCount);
+
+	ParallelFor(workers, count, PARALLEL_HIERARCHY_GRAIN_SIZE, [&](size_t begin, size_t end)
+	{
+		auto chunk = begin / PARALLEL_HIERARCHY_GRAIN_SIZE;
+		ComputeBlobBounds(regions + begin, end - begin, &chunkBounds[chunk], &chunkCentroidBounds[chunk]);
+	});
+
+	SetEmptyBounds(boundsOut);
+	SetEmptyBounds(centroidBoundsOut);
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		ExpandBounds(boundsOut, chunkBounds[i]);
+		ExpandBounds(centroidBoundsOut, chunkCentroidBounds[i]);
+	}
+}
+
+inline size_t GetBinIndex(const SAHBinning& binning, const RegionNode* region, const size_t axis)
+{
+	return min(binning.BinCount - 1, static_cast<size_t>(
+		(GetRegionCentroid(region, axis) - GetAxis(binning.CentroidBounds.Lower, axis)) * binning.Scale[axis]));
+}
+
+void FillBins(RegionNode** regions, const size_t count, const SAHBinning& binning, SAHBin* binsOut)
+{
+	for (size_t i = 0; i < 3 * MAX_HIERARCHY_BIN_COUNT; ++i)
+	{
+		SetEmptyBounds(&binsOut[i].AABB);
+		binsOut[i].Count = 0;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			if (binning.Scale[axis] == 0.0f)
+				continue;
+
+			auto bin = &binsOut[axis * MAX_HIERARCHY_BIN_COUNT + GetBinIndex(binning, regions[i], axis)];
+			ExpandBounds(&bin->AABB, regions[i]->AABB);
+			++bin->Count;
+		}
+	}
+}
+
+void FillBins(RegionNode** regions, const size_t count, const SAHBinning& binning, SAHBin* binsOut,
+	WorkerPool* workers)
+{
+	if (workers == nullptr || count < PARALLEL_HIERARCHY_MIN_COUNT)
+	{
+		FillBins(regions, count, binning, binsOut);
+		return;
+	}
+
+	auto chunkCount = (count + PARALLEL_HIERARCHY_GRAIN_SIZE - 1) / PARALLEL_HIERARCHY_GRAIN_SIZE;
+	vector<SAHBin> chunkBins(chunkCount * 3 * MAX_HIERARCHY_BIN_COUNT);
+
+	ParallelFor(workers, count, PARALLEL_HIERARCHY_GRAIN_SIZE, [&](size_t begin, size_t end)
+	{
+		auto chunk = begin / PARALLEL_HIERARCHY_GRAIN_SIZE;
+		FillBins(regions + begin, end - begin, binning, &chunkBins[chunk * 3 * MAX_HIERARCHY_BIN_COUNT]);
+	});
+
+	for (size_t i = 0; i < 3 * MAX_HIERARCHY_BIN_COUNT; ++i)
+	{
+		SetEmptyBounds(&binsOut[i].AABB);
+		binsOut[i].Count = 0;
+
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			auto& bin = chunkBins[chunk * 3 * MAX_HIERARCHY_BIN_COUNT + i];
+			ExpandBounds(&binsOut[i].AABB, bin.AABB);
+			binsOut[i].Count += bin.Count;
+		}
+	}
+}
+
+// Stable, so that the serial and parallel builders produce the same hierarchy
+template <typename Predicate>
+size_t PartitionRegions(RegionNode** regions, const size_t count, Predicate predicate, WorkerPool* workers)
+{
+	if (workers == nullptr || count < PARALLEL_HIERARCHY_MIN_COUNT)
+		return stable_partition(regions, regions + count, predicate) - regions;
+
+	auto chunkCount = (count + PARALLEL_HIERARCHY_GRAIN_SIZE - 1) / PARALLEL_HIERARCHY_GRAIN_SIZE;
+	vector<size_t> lesserOffsets(chunkCount);
+	vector<size_t> greaterOffsets(chunkCount);
+
+	ParallelFor(workers, count, PARALLEL_HIERARCHY_GRAIN_SIZE, [&](size_t begin, size_t end)
+	{
+		size_t lesserCount = 0;
+		for (auto i = begin; i < end; ++i)
+			if (predicate(regions[i]))
+				++lesserCount;
+		lesserOffsets[begin / PARALLEL_HIERARCHY_GRAIN_SIZE] = lesserCount;
+	});
+
+	size_t lesserTotal = 0;
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		auto lesserCount = lesserOffsets[chunk];
+		lesserOffsets[chunk] = lesserTotal;
+		lesserTotal += lesserCount;
+	}
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		greaterOffsets[chunk] = lesserTotal + chunk * PARALLEL_HIERARCHY_GRAIN_SIZE - lesserOffsets[chunk];
+
+	vector<RegionNode*> scratch(count);
+	ParallelFor(workers, count, PARALLEL_HIERARCHY_GRAIN_SIZE, [&](size_t begin, size_t end)
+	{
+		auto chunk = begin / PARALLEL_HIERARCHY_GRAIN_SIZE;
+		auto lesser = lesserOffsets[chunk];
+		auto greater = greaterOffsets[chunk];
+		for (auto i = begin; i < end; ++i)
+		{
+			if (predicate(regions[i]))
+				scratch[lesser++] = regions[i];
+			else
+				scratch[greater++] = regions[i];
+		}
+	});
+
+	ParallelFor(workers, count, PARALLEL_HIERARCHY_GRAIN_SIZE, [&](size_t begin, size_t end)
+	{
+		copy(scratch.begin() + begin, scratch.begin() + end, regions + begin);
+	});
+
+	return lesserTotal;
+}
+
+void CreateHierarchyLeafBucket(RegionNode** regions, const size_t count, RegionNode* baseRegion,
+	MemoryArena* arena)
+{
+	Bounds bounds;
+	Bounds centroidBounds;
+	ComputeBlobBounds(regions, count, &bounds, &centroidBounds);
+	baseRegion->AABB = bounds;
+
+	RegionNode** children[] = { &baseRegion->Node1, &baseRegion->Node2, &baseRegion->Node3 };
+
+	if (count <= REGION_CHILD_COUNT)
+	{
+		for (size_t i = 0; i < REGION_CHILD_COUNT; ++i)
+			*children[i] = (i < count ? regions[i] : nullptr);
+		return;
+	}
+
+	auto axis = GetLongestAxis(centroidBounds);
+	sort(regions, regions + count, [axis](const RegionNode* r1, const RegionNode* r2)
+	{
+		return GetRegionCentroid(r1, axis) < GetRegionCentroid(r2, axis);
+	});
+
+	size_t offset = 0;
+	for (size_t i = 0; i < REGION_CHILD_COUNT; ++i)
+	{
+		auto bucketCount = (count - offset) / (REGION_CHILD_COUNT - i);
+
+		if (bucketCount == 1)
+			*children[i] = regions[offset];
+		else
+		{
+			*children[i] = CreateRegionNode(arena);
+			CreateHierarchyLeafBucket(regions + offset, bucketCount, *children[i], arena);
+		}
+
+		offset += bucketCount;
+	}
+}
+
+void CreateHierarchyFromBlobSAH(RegionNode** regions, const size_t count, RegionNode* baseRegion,
+	MemoryArena* arena, const HierarchyBuildParams& params)
+{
+	auto workers = params.Workers;
+
+	Bounds bounds;
+	Bounds centroidBounds;
+	ComputeBlobBounds(regions, count, &bounds, &centroidBounds, workers);
+	baseRegion->AABB = bounds;
+
+	auto leafSize = max<size_t>(params.LeafSize, 1);
+	auto binCount = min<size_t>(max<size_t>(params.BinCount, 2), MAX_HIERARCHY_BIN_COUNT);
+	auto parentArea = GetBoundsHalfArea(bounds);
+	if (parentArea <= 0.0f)
+		parentArea = 1.0f;
+
+	SAHBinning binning;
+	binning.CentroidBounds = centroidBounds;
+	binning.BinCount = binCount;
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		auto extent = GetAxis(centroidBounds.Upper, axis) - GetAxis(centroidBounds.Lower, axis);
+		binning.Scale[axis] = extent > 0.0f ? static_cast<float>(binCount) / extent : 0.0f;
+	}
+
+	// Small blobs which will never be split are not worth binning
+	SAHBin bins[3 * MAX_HIERARCHY_BIN_COUNT];
+	if (count > 1)
+		FillBins(regions, count, binning, bins, workers);
+
+	// Find the cheapest split plane among the bin boundaries of each axis
+	auto bestCost = numeric_limits<float>::infinity();
+	size_t bestAxis = 0;
+	size_t bestSplit = 0;
+
+	float rightAreas[MAX_HIERARCHY_BIN_COUNT];
+	size_t rightCounts[MAX_HIERARCHY_BIN_COUNT];
+
+	for (size_t axis = 0; axis < 3 && count > 1; ++axis)
+	{
+		if (binning.Scale[axis] == 0.0f)
+			continue;
+
+		auto axisBins = &bins[axis * MAX_HIERARCHY_BIN_COUNT];
+
+		Bounds accumulated;
+		size_t accumulatedCount = 0;
+		SetEmptyBounds(&accumulated);
+		for (size_t i = binCount - 1; i > 0; --i)
+		{
+			ExpandBounds(&accumulated, axisBins[i].AABB);
+			accumulatedCount += axisBins[i].Count;
+			rightAreas[i] = GetBoundsHalfArea(accumulated);
+			rightCounts[i] = accumulatedCount;
+		}
+
+		accumulatedCount = 0;
+		SetEmptyBounds(&accumulated);
+		for (size_t i = 1; i < binCount; ++i)
+		{
+			ExpandBounds(&accumulated, axisBins[i - 1].AABB);
+			accumulatedCount += axisBins[i - 1].Count;
+
+			if (accumulatedCount == 0 || rightCounts[i] == 0)
+				continue;
+
+			auto cost = params.TraversalCost + params.IntersectionCost *
+				(GetBoundsHalfArea(accumulated) * static_cast<float>(accumulatedCount) +
+					rightAreas[i] * static_cast<float>(rightCounts[i])) / parentArea;
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// Keep the blob together if that is cheaper than splitting it, and if it is small enough
+	auto leafCost = params.IntersectionCost * static_cast<float>(count);
+	if (count <= leafSize && (leafCost <= bestCost || bestSplit == 0))
+	{
+		CreateHierarchyLeafBucket(regions, count, baseRegion, arena);
+		return;
+	}
+
+	size_t lesserCount;
+	if (bestSplit != 0)
+	{
+		auto axis = bestAxis;
+		auto split = bestSplit;
+		lesserCount = PartitionRegions(regions, count, [&binning, axis, split](const RegionNode* region)
+		{
+			return GetBinIndex(binning, region, axis) < split;
+		}, workers);
+	}
+	else
+	{
+		// All of the centroids coincide, split the blob down the middle arbitrarily.
+		lesserCount = count / 2;
+	}
+
+	RegionNode** children[] = { &baseRegion->Node1, &baseRegion->Node2 };
+	RegionNode** childRegions[] = { regions, regions + lesserCount };
+	size_t childCounts[] = { lesserCount, count - lesserCount };
+
+	// Subtrees share no regions, so large ones are built as separate tasks
+	TaskGroup group(count >= PARALLEL_HIERARCHY_TASK_SIZE ? workers : nullptr);
+
+	for (size_t i = 0; i < 2; ++i)
+	{
+		if (childCounts[i] == 1)
+		{
+			*children[i] = childRegions[i][0];
+			continue;
+		}
+
+		auto child = CreateRegionNode(arena);
+		*children[i] = child;
+
+		if (workers != nullptr && count >= PARALLEL_HIERARCHY_TASK_SIZE)
+		{
+			auto subtreeRegions = childRegions[i];
+			auto subtreeCount = childCounts[i];
+			group.Run([subtreeRegions, subtreeCount, child, arena, &params]()
+			{
+				CreateHierarchyFromBlobSAH(subtreeRegions, subtreeCount, child, arena, params);
+			});
+		}
+		else
+			CreateHierarchyFromBlobSAH(childRegions[i], childCounts[i], child, arena, params);
+	}
+
+	group.Wait();
+	baseRegion->Node3 = nullptr;
+}
+
+void CreateHierarchyFromBlobSAH(vector<RegionNode*>& regions, RegionNode* baseRegion,
+	MemoryArena* arena, const HierarchyBuildParams& params)
+{
+	if (regions.size() == 0)
+	{
+		SetEmptyBounds(&baseRegion->AABB);
+		baseRegion->Node1 = nullptr;
+		baseRegion->Node2 = nullptr;
+		baseRegion->Node3 = nullptr;
+		return;
+	}
+
+	CreateHierarchyFromBlobSAH(regions.data(), regions.size(), baseRegion, arena, params);
+}
+
+void GetDefaultHierarchyBuildParams(HierarchyBuildParams* paramsOut)
+{
+	paramsOut->Builder = HIERARCHY_BUILDER_SAH;
+	paramsOut->LeafSize = DEFAULT_HIERARCHY_LEAF_SIZE;
+	paramsOut->BinCount = DEFAULT_HIERARCHY_BIN_COUNT;
+	paramsOut->TraversalCost = DEFAULT_HIERARCHY_TRAVERSAL_COST;
+	paramsOut->IntersectionCost = DEFAULT_HIERARCHY_INTERSECTION_COST;
+	paramsOut->bCompileFlatHierarchy = true;
+	paramsOut->RebuildCostThreshold = DEFAULT_HIERARCHY_REBUILD_COST_THRESHOLD;
+	paramsOut->Workers = nullptr;
+}
+
+void ComputeRegionStats(const RegionNode* region, const size_t depth, const float rootArea,
+	const HierarchyBuildParams& params, HierarchyStats* statsOut)
+{
+	if (depth > statsOut->MaxDepth)
+		statsOut->MaxDepth = depth;
+
+	// The leaf referring to a nested zone has the same bounds as the zone's own root region and
+	// is traversed as part of it, so only the root region is counted. Nested zones are part of the
+	// cost of any query that reaches them.
+	if (region->LeafData != nullptr && region->LeafData->IsZone())
+	{
+		ComputeRegionStats(&region->LeafData->Region, depth, rootArea, params, statsOut);
+		return;
+	}
+
+	auto areaRatio = GetBoundsHalfArea(region->AABB) / rootArea;
+
+	if (region->LeafData != nullptr)
+	{
+		++statsOut->LeafCount;
+		statsOut->SAHCost += params.IntersectionCost * areaRatio;
+		return;
+	}
+
+	++statsOut->RegionCount;
+	statsOut->SAHCost += params.TraversalCost * areaRatio;
+
+	if (region->Node1 != nullptr)
+		ComputeRegionStats(region->Node1, depth + 1, rootArea, params, statsOut);
+	if (region->Node2 != nullptr)
+		ComputeRegionStats(region->Node2, depth + 1, rootArea, params, statsOut);
+	if (region->Node3 != nullptr)
+		ComputeRegionStats(region->Node3, depth + 1, rootArea, params, statsOut);
+}
+
+void ComputeHierarchyStats(const SceneNode* zone, const HierarchyBuildParams& params,
+	HierarchyStats* statsOut)
+{
+	statsOut->RegionCount = 0;
+	statsOut->LeafCount = 0;
+	statsOut->MaxDepth = 0;
+	statsOut->SAHCost = 0.0f;
+	statsOut->AllocationCount = 0;
+	statsOut->AllocatedBytes = 0;
+
+	if (!zone->IsZone())
+	{
+		OutputDebugString("Scene node specified is not a zone!\n");
+		return;
+	}
+
+	MemoryArenaStats arenaStats;
+	zone->Ref.ZoneData->HierarchyArena.GetStats(&arenaStats);
+	statsOut->AllocationCount = arenaStats.AllocationCount;
+	statsOut->AllocatedBytes = arenaStats.AllocatedBytes;
+
+	auto rootArea = GetBoundsHalfArea(zone->Region.AABB);
+	if (!(rootArea > 0.0f) || rootArea == numeric_limits<float>::infinity())
+		return;
+
+	ComputeRegionStats(&zone->Region, 0, rootArea, params, statsOut);
+}
\ No newline at end of file
@@ -0,0 +1,620 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <utility>
+
+using namespace DirectX;
+using namespace std;
+
+// Regions waiting to be visited, along with the queries of the packet that reached them
+typedef vector<pair<RegionNode*, uint64_t>> QueryStack;
+
+// Queries are stored as separate arrays of each value, and tested against a region four at a
+// time. Each packet has one bit per query in its masks.
+struct RayPacket
+{
+	float OriginX[SPATIAL_QUERY_PACKET_SIZE];
+	float OriginY[SPATIAL_QUERY_PACKET_SIZE];
+	float OriginZ[SPATIAL_QUERY_PACKET_SIZE];
+	float InverseX[SPATIAL_QUERY_PACKET_SIZE];
+	float InverseY[SPATIAL_QUERY_PACKET_SIZE];
+	float InverseZ[SPATIAL_QUERY_PACKET_SIZE];
+	float MaxDistance[SPATIAL_QUERY_PACKET_SIZE];
+	// Where each ray entered the bounds last tested
+	float EntryDistance[SPATIAL_QUERY_PACKET_SIZE];
+	uint32_t GroupCount;
+	uint64_t ActiveMask;
+
+	inline uint64_t TestBounds(const Bounds& bounds, const uint64_t mask);
+	// The nearest entry of the rays in the mask into the bounds last tested
+	inline float GetNearestDistance(const uint64_t mask) const;
+};
+
+struct SpherePacket
+{
+	float CenterX[SPATIAL_QUERY_PACKET_SIZE];
+	float CenterY[SPATIAL_QUERY_PACKET_SIZE];
+	float CenterZ[SPATIAL_QUERY_PACKET_SIZE];
+	float RadiusSq[SPATIAL_QUERY_PACKET_SIZE];
+	// Squared distance from each center to the bounds last tested
+	float DistanceSq[SPATIAL_QUERY_PACKET_SIZE];
+	uint32_t GroupCount;
+	uint64_t ActiveMask;
+
+	inline uint64_t TestBounds(const Bounds& bounds, const uint64_t mask);
+	// Squared, which orders regions the same
+	inline float GetNearestDistance(const uint64_t mask) const;
+};
+
+struct BoundsPacket
+{
+	float LowerX[SPATIAL_QUERY_PACKET_SIZE];
+	float LowerY[SPATIAL_QUERY_PACKET_SIZE];
+	float LowerZ[SPATIAL_QUERY_PACKET_SIZE];
+	float UpperX[SPATIAL_QUERY_PACKET_SIZE];
+	float UpperY[SPATIAL_QUERY_PACKET_SIZE];
+	float UpperZ[SPATIAL_QUERY_PACKET_SIZE];
+	uint32_t GroupCount;
+	uint64_t ActiveMask;
+
+	inline uint64_t TestBounds(const Bounds& bounds, const uint64_t mask);
+	// Boxes have no order to visit regions in
+	inline float GetNearestDistance(const uint64_t mask) const;
+};
+
+inline XMVECTOR LoadLanes(const float* values, const uint32_t group)
+{
+	return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(values + group * 4));
+}
+
+inline uint64_t GetLaneMask(const XMVECTOR& comparison)
+{
+	XMUINT4 masks;
+	XMStoreUInt4(&masks, comparison);
+	return (masks.x & 1) | (masks.y & 2) | (masks.z & 4) | (masks.w & 8);
+}
+
+inline uint64_t GetPacketMask(const size_t count)
+{
+	return count >= 64 ? ~0ull : (1ull << count) - 1;
+}
+
+// Calls the function with the index of every query set in the mask
+template <typename Function>
+inline void ForEachLane(uint64_t mask, Function function)
+{
+	for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1)
+	{
+		if ((mask & 1) != 0)
+			function(lane);
+	}
+}
+
+inline float RayPacket::GetNearestDistance(const uint64_t mask) const
+{
+	auto nearest = numeric_limits<float>::infinity();
+	ForEachLane(mask, [&](const uint32_t lane) { nearest = min(nearest, EntryDistance[lane]); });
+	return nearest;
+}
+
+inline float SpherePacket::GetNearestDistance(const uint64_t mask) const
+{
+	auto nearest = numeric_limits<float>::infinity();
+	ForEachLane(mask, [&](const uint32_t lane) { nearest = min(nearest, DistanceSq[lane]); });
+	return nearest;
+}
+
+inline float BoundsPacket::GetNearestDistance(const uint64_t mask) const
+{
+	return 0.0f;
+}
+
+// Distance along each lane's ray to the plane of a slab. A ray parallel to the slab that starts
+// on the plane gives 0 * inf, which is replaced with the given infinity to keep it in the slab.
+inline XMVECTOR GetSlabDistance(const XMVECTOR& plane, const XMVECTOR& origin, const XMVECTOR& inverse,
+	const XMVECTOR& infinity)
+{
+	auto distance = XMVectorMultiply(plane - origin, inverse);
+	return XMVectorSelect(distance, infinity, XMVectorIsNaN(distance));
+}
+
+inline uint64_t RayPacket::TestBounds(const Bounds& bounds, const uint64_t mask)
+{
+	auto lowerX = XMVectorReplicate(bounds.Lower.x);
+	auto lowerY = XMVectorReplicate(bounds.Lower.y);
+	auto lowerZ = XMVectorReplicate(bounds.Lower.z);
+	auto upperX = XMVectorReplicate(bounds.Upper.x);
+	auto upperY = XMVectorReplicate(bounds.Upper.y);
+	auto upperZ = XMVectorReplicate(bounds.Upper.z);
+	auto infinity = XMVectorReplicate(numeric_limits<float>::infinity());
+	auto minusInfinity = XMVectorNegate(infinity);
+	uint64_t result = 0;
+
+	for (uint32_t group = 0; group < GroupCount; ++group)
+	{
+		if (((mask >> (group * 4)) & 0xF) == 0)
+			continue;
+
+		// Distances to the planes of each pair of slabs, the ray is inside the box between
+		// the last slab it enters and the first it leaves
+		auto originX = LoadLanes(OriginX, group);
+		auto originY = LoadLanes(OriginY, group);
+		auto originZ = LoadLanes(OriginZ, group);
+		auto inverseX = LoadLanes(InverseX, group);
+		auto inverseY = LoadLanes(InverseY, group);
+		auto inverseZ = LoadLanes(InverseZ, group);
+
+		auto lowerDistX = GetSlabDistance(lowerX, originX, inverseX, minusInfinity);
+		auto upperDistX = GetSlabDistance(upperX, originX, inverseX, infinity);
+		auto lowerDistY = GetSlabDistance(lowerY, originY, inverseY, minusInfinity);
+		auto upperDistY = GetSlabDistance(upperY, originY, inverseY, infinity);
+		auto lowerDistZ = GetSlabDistance(lowerZ, originZ, inverseZ, minusInfinity);
+		auto upperDistZ = GetSlabDistance(upperZ, originZ, inverseZ, infinity);
+
+		auto entry = XMVectorMax(XMVectorMin(lowerDistX, upperDistX), XMVectorMin(lowerDistY, upperDistY));
+		entry = XMVectorMax(entry, XMVectorMax(XMVectorMin(lowerDistZ, upperDistZ), XMVectorZero()));
+		auto exit = XMVectorMin(XMVectorMax(lowerDistX, upperDistX), XMVectorMax(lowerDistY, upperDistY));
+		exit = XMVectorMin(exit, XMVectorMin(XMVectorMax(lowerDistZ, upperDistZ), LoadLanes(MaxDistance, group)));
+
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(EntryDistance + group * 4), entry);
+		result |= GetLaneMask(XMVectorLessOrEqual(entry, exit)) << (group * 4);
+	}
+
+	return result & mask;
+}
+
+// Squared distance from each lane's point to the box, zero for points inside it
+inline XMVECTOR GetBoundsDistanceSq(const Bounds& bounds, const XMVECTOR& x, const XMVECTOR& y,
+	const XMVECTOR& z)
+{
+	auto zero = XMVectorZero();
+	auto distX = XMVectorMax(XMVectorMax(XMVectorReplicate(bounds.Lower.x) - x, x - XMVectorReplicate(bounds.Upper.x)), zero);
+	auto distY = XMVectorMax(XMVectorMax(XMVectorReplicate(bounds.Lower.y) - y, y - XMVectorReplicate(bounds.Upper.y)), zero);
+	auto distZ = XMVectorMax(XMVectorMax(XMVectorReplicate(bounds.Lower.z) - z, z - XMVectorReplicate(bounds.Upper.z)), zero);
+
+	auto distanceSq = XMVectorMultiply(distX, distX);
+	distanceSq = XMVectorMultiplyAdd(distY, distY, distanceSq);
+	return XMVectorMultiplyAdd(distZ, distZ, distanceSq);
+}
+
+inline uint64_t SpherePacket::TestBounds(const Bounds& bounds, const uint64_t mask)
+{
+	uint64_t result = 0;
+
+	for (uint32_t group = 0; group < GroupCount; ++group)
+	{
+		if (((mask >> (group * 4)) & 0xF) == 0)
+			continue;
+
+		auto distanceSq = GetBoundsDistanceSq(bounds, LoadLanes(CenterX, group), LoadLanes(CenterY, group),
+			LoadLanes(CenterZ, group));
+
+		XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(DistanceSq + group * 4), distanceSq);
+		result |= GetLaneMask(XMVectorLessOrEqual(distanceSq, LoadLanes(RadiusSq, group))) << (group * 4);
+	}
+
+	return result & mask;
+}
+
+inline uint64_t BoundsPacket::TestBounds(const Bounds& bounds, const uint64_t mask)
+{
+	auto lowerX = XMVectorReplicate(bounds.Lower.x);
+	auto lowerY = XMVectorReplicate(bounds.Lower.y);
+	auto lowerZ = XMVectorReplicate(bounds.Lower.z);
+	auto upperX = XMVectorReplicate(bounds.Upper.x);
+	auto upperY = XMVectorReplicate(bounds.Upper.y);
+	auto upperZ = XMVectorReplicate(bounds.Upper.z);
+	uint64_t result = 0;
+
+	for (uint32_t group = 0; group < GroupCount; ++group)
+	{
+		if (((mask >> (group * 4)) & 0xF) == 0)
+			continue;
+
+		auto overlap = XMVectorAndInt(XMVectorLessOrEqual(LoadLanes(LowerX, group), upperX),
+			XMVectorGreaterOrEqual(LoadLanes(UpperX, group), lowerX));
+		overlap = XMVectorAndInt(overlap, XMVectorAndInt(XMVectorLessOrEqual(LoadLanes(LowerY, group), upperY),
+			XMVectorGreaterOrEqual(LoadLanes(UpperY, group), lowerY)));
+		overlap = XMVectorAndInt(overlap, XMVectorAndInt(XMVectorLessOrEqual(LoadLanes(LowerZ, group), upperZ),
+			XMVectorGreaterOrEqual(LoadLanes(UpperZ, group), lowerZ)));
+
+		result |= GetLaneMask(overlap) << (group * 4);
+	}
+
+	return result & mask;
+}
+
+// Walks the hierarchy once for the whole packet. Each region is tested against the queries that
+// reached its parent, and mesh leaves are handed to the visitor along with the queries touching
+// them. The visitor may clear queries from the packet's active mask to stop them. Queries that
+// shrink as they find results visit the children nearest to them first.
+template <typename Packet, typename Visitor>
+inline void TraverseHierarchy(SceneNode* zone, Packet& packet, QueryStack& stack, const bool bNearestFirst,
+	Visitor visitLeaf)
+{
+	stack.clear();
+	stack.push_back(make_pair(&zone->Region, packet.ActiveMask));
+
+	while (!stack.empty() && packet.ActiveMask != 0)
+	{
+		auto region = stack.back().first;
+		auto mask = stack.back().second & packet.ActiveMask;
+		stack.pop_back();
+
+		mask = packet.TestBounds(region->AABB, mask);
+		if (mask == 0)
+			continue;
+
+		if (region->LeafData != nullptr)
+		{
+			if (region->LeafData->IsZone())
+				stack.push_back(make_pair(&region->LeafData->Region, mask));
+			else if (region->LeafData->IsMesh())
+				visitLeaf(region->LeafData, mask);
+		}
+
+		if (!bNearestFirst)
+		{
+			if (region->Node3 != nullptr)
+				stack.push_back(make_pair(region->Node3, mask));
+			if (region->Node2 != nullptr)
+				stack.push_back(make_pair(region->Node2, mask));
+			if (region->Node1 != nullptr)
+				stack.push_back(make_pair(region->Node1, mask));
+			continue;
+		}
+
+		// Children are pushed farthest first so that the nearest is visited next
+		RegionNode* children[3] = { region->Node1, region->Node2, region->Node3 };
+		pair<float, pair<RegionNode*, uint64_t>> visits[3];
+		uint32_t visitCount = 0;
+
+		for (auto child : children)
+		{
+			if (child == nullptr)
+				continue;
+
+			auto childMask = packet.TestBounds(child->AABB, mask);
+			if (childMask != 0)
+				visits[visitCount++] = make_pair(packet.GetNearestDistance(childMask), make_pair(child, childMask));
+		}
+
+		sort(visits, visits + visitCount, [](const pair<float, pair<RegionNode*, uint64_t>>& visit1,
+			const pair<float, pair<RegionNode*, uint64_t>>& visit2) { return visit1.first > visit2.first; });
+
+		for (uint32_t i = 0; i < visitCount; ++i)
+			stack.push_back(visits[i].second);
+	}
+}
+
+// Spreads the low ten bits of the value out to every third bit
+inline uint32_t SpreadMortonBits(uint32_t value)
+{
+	value &= 0x3FF;
+	value = (value | (value << 16)) & 0x030000FF;
+	value = (value | (value << 8)) & 0x0300F00F;
+	value = (value | (value << 4)) & 0x030C30C3;
+	value = (value | (value << 2)) & 0x09249249;
+	return value;
+}
+
+// Orders queries along a Morton curve through the points they start from, so that the queries
+// sharing a packet are near each other and visit the same regions
+template <typename GetPoint>
+inline void OrderQueries(const size_t count, GetPoint getPoint, vector<uint32_t>* orderOut)
+{
+	Bounds bounds;
+	SetEmptyBounds(&bounds);
+	for (size_t i = 0; i < count; ++i)
+		ExpandBounds(&bounds, getPoint(i));
+
+	auto getScale = [](const float lower, const float upper)
+	{
+		float extent = upper - lower;
+		return extent > 0.0f && extent < numeric_limits<float>::infinity() ? 1023.0f / extent : 0.0f;
+	};
+
+	float scaleX = getScale(bounds.Lower.x, bounds.Upper.x);
+	float scaleY = getScale(bounds.Lower.y, bounds.Upper.y);
+	float scaleZ = getScale(bounds.Lower.z, bounds.Upper.z);
+
+	vector<pair<uint32_t, uint32_t>> codes(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto point = getPoint(i);
+		auto x = static_cast<uint32_t>((point.x - bounds.Lower.x) * scaleX);
+		auto y = static_cast<uint32_t>((point.y - bounds.Lower.y) * scaleY);
+		auto z = static_cast<uint32_t>((point.z - bounds.Lower.z) * scaleZ);
+		codes[i] = make_pair(SpreadMortonBits(x) | (SpreadMortonBits(y) << 1) | (SpreadMortonBits(z) << 2),
+			static_cast<uint32_t>(i));
+	}
+
+	sort(codes.begin(), codes.end());
+
+	orderOut->resize(count);
+	for (size_t i = 0; i < count; ++i)
+		(*orderOut)[i] = codes[i].second;
+}
+
+inline void LoadRayPacket(const RayQuery* rays, const uint32_t* order, const size_t count, RayPacket* packetOut)
+{
+	auto infinity = numeric_limits<float>::infinity();
+
+	for (size_t lane = 0; lane < SPATIAL_QUERY_PACKET_SIZE; ++lane)
+	{
+		// Unused lanes are given a ray that hits nothing, they are never active anyway
+		RayQuery ray = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f), -1.0f };
+		if (lane < count)
+			ray = rays[order[lane]];
+
+		packetOut->OriginX[lane] = ray.Origin.x;
+		packetOut->OriginY[lane] = ray.Origin.y;
+		packetOut->OriginZ[lane] = ray.Origin.z;
+		packetOut->InverseX[lane] = ray.Direction.x != 0.0f ? 1.0f / ray.Direction.x : infinity;
+		packetOut->InverseY[lane] = ray.Direction.y != 0.0f ? 1.0f / ray.Direction.y : infinity;
+		packetOut->InverseZ[lane] = ray.Direction.z != 0.0f ? 1.0f / ray.Direction.z : infinity;
+		packetOut->MaxDistance[lane] = ray.MaxDistance;
+	}
+
+	packetOut->GroupCount = static_cast<uint32_t>((count + 3) / 4);
+	packetOut->ActiveMask = GetPacketMask(count);
+}
+
+inline void LoadSpherePacket(const SphereQuery* spheres, const uint32_t* order, const size_t count,
+	SpherePacket* packetOut)
+{
+	for (size_t lane = 0; lane < SPATIAL_QUERY_PACKET_SIZE; ++lane)
+	{
+		SphereQuery sphere = { XMFLOAT3(0.0f, 0.0f, 0.0f), -1.0f };
+		if (lane < count)
+			sphere = spheres[order[lane]];
+
+		packetOut->CenterX[lane] = sphere.Center.x;
+		packetOut->CenterY[lane] = sphere.Center.y;
+		packetOut->CenterZ[lane] = sphere.Center.z;
+		packetOut->RadiusSq[lane] = sphere.Radius < 0.0f ? -1.0f : sphere.Radius * sphere.Radius;
+	}
+
+	packetOut->GroupCount = static_cast<uint32_t>((count + 3) / 4);
+	packetOut->ActiveMask = GetPacketMask(count);
+}
+
+inline void LoadBoundsPacket(const Bounds* bounds, const uint32_t* order, const size_t count, BoundsPacket* packetOut)
+{
+	for (size_t lane = 0; lane < SPATIAL_QUERY_PACKET_SIZE; ++lane)
+	{
+		Bounds box;
+		SetEmptyBounds(&box);
+		if (lane < count)
+			box = bounds[order[lane]];
+
+		packetOut->LowerX[lane] = box.Lower.x;
+		packetOut->LowerY[lane] = box.Lower.y;
+		packetOut->LowerZ[lane] = box.Lower.z;
+		packetOut->UpperX[lane] = box.Upper.x;
+		packetOut->UpperY[lane] = box.Upper.y;
+		packetOut->UpperZ[lane] = box.Upper.z;
+	}
+
+	packetOut->GroupCount = static_cast<uint32_t>((count + 3) / 4);
+	packetOut->ActiveMask = GetPacketMask(count);
+}
+
+inline bool IsQueryZone(const SceneNode* zone)
+{
+	if (!zone->IsZone())
+	{
+		OutputDebugString("Spatial queries can only be made on zones!\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Reports the hits of the leaf to the callback, and stops the queries it returns false for
+template <typename Packet>
+inline void ReportLeafHits(SceneNode* node, const uint64_t mask, const uint32_t* order, const float* distances,
+	const SpatialQueryCallback& callback, Packet* packet)
+{
+	ForEachLane(mask, [&](const uint32_t lane)
+	{
+		SpatialQueryHit hit = { node, order[lane], distances != nullptr ? distances[lane] : 0.0f };
+		if (!callback(hit))
+			packet->ActiveMask &= ~(1ull << lane);
+	});
+}
+
+void QueryRays(SceneNode* zone, const RayQuery* rays, const size_t count, const SpatialQueryCallback& callback)
+{
+	if (!IsQueryZone(zone))
+		return;
+
+	RayPacket packet;
+	QueryStack stack;
+	vector<uint32_t> order;
+	OrderQueries(count, [rays](const size_t i) { return rays[i].Origin; }, &order);
+
+	for (size_t first = 0; first < count; first += SPATIAL_QUERY_PACKET_SIZE)
+	{
+		LoadRayPacket(rays, &order[first], min<size_t>(count - first, SPATIAL_QUERY_PACKET_SIZE), &packet);
+
+		TraverseHierarchy(zone, packet, stack, false, [&](SceneNode* node, const uint64_t mask)
+		{
+			ReportLeafHits(node, mask, &order[first], packet.EntryDistance, callback, &packet);
+		});
+	}
+}
+
+void QuerySpheres(SceneNode* zone, const SphereQuery* spheres, const size_t count,
+	const SpatialQueryCallback& callback)
+{
+	if (!IsQueryZone(zone))
+		return;
+
+	SpherePacket packet;
+	QueryStack stack;
+	vector<uint32_t> order;
+	OrderQueries(count, [spheres](const size_t i) { return spheres[i].Center; }, &order);
+
+	for (size_t first = 0; first < count; first += SPATIAL_QUERY_PACKET_SIZE)
+	{
+		LoadSpherePacket(spheres, &order[first], min<size_t>(count - first, SPATIAL_QUERY_PACKET_SIZE), &packet);
+
+		TraverseHierarchy(zone, packet, stack, false, [&](SceneNode* node, const uint64_t mask)
+		{
+			ReportLeafHits(node, mask, &order[first], nullptr, callback, &packet);
+		});
+	}
+}
+
+void QueryBounds(SceneNode* zone, const Bounds* bounds, const size_t count, const SpatialQueryCallback& callback)
+{
+	if (!IsQueryZone(zone))
+		return;
+
+	BoundsPacket packet;
+	QueryStack stack;
+	vector<uint32_t> order;
+	OrderQueries(count, [bounds](const size_t i) { return bounds[i].Lower; }, &order);
+
+	for (size_t first = 0; first < count; first += SPATIAL_QUERY_PACKET_SIZE)
+	{
+		LoadBoundsPacket(bounds, &order[first], min<size_t>(count - first, SPATIAL_QUERY_PACKET_SIZE), &packet);
+
+		TraverseHierarchy(zone, packet, stack, false, [&](SceneNode* node, const uint64_t mask)
+		{
+			ReportLeafHits(node, mask, &order[first], nullptr, callback, &packet);
+		});
+	}
+}
+
+void QueryRaysNearest(SceneNode* zone, const RayQuery* rays, const size_t count, vector<SpatialQueryHit>* hitsOut)
+{
+	hitsOut->resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		SpatialQueryHit hit = { nullptr, static_cast<uint32_t>(i), rays[i].MaxDistance };
+		(*hitsOut)[i] = hit;
+	}
+
+	if (!IsQueryZone(zone))
+		return;
+
+	RayPacket packet;
+	QueryStack stack;
+	vector<uint32_t> order;
+	OrderQueries(count, [rays](const size_t i) { return rays[i].Origin; }, &order);
+
+	for (size_t first = 0; first < count; first += SPATIAL_QUERY_PACKET_SIZE)
+	{
+		LoadRayPacket(rays, &order[first], min<size_t>(count - first, SPATIAL_QUERY_PACKET_SIZE), &packet);
+
+		// Each hit shortens its ray, so that regions behind it are no longer visited
+		TraverseHierarchy(zone, packet, stack, true, [&](SceneNode* node, const uint64_t mask)
+		{
+			ForEachLane(mask, [&](const uint32_t lane)
+			{
+				auto& hit = (*hitsOut)[order[first + lane]];
+				if (hit.Node == nullptr || packet.EntryDistance[lane] < hit.Distance)
+				{
+					hit.Node = node;
+					hit.Distance = packet.EntryDistance[lane];
+					packet.MaxDistance[lane] = hit.Distance;
+				}
+			});
+		});
+	}
+}
+
+inline bool CompareHitDistance(const SpatialQueryHit& hit1, const SpatialQueryHit& hit2)
+{
+	return hit1.Distance < hit2.Distance;
+}
+
+void QueryNearest(SceneNode* zone, const XMFLOAT3* points, const size_t count, const uint32_t k,
+	const float maxDistance, vector<SpatialQueryHit>* hitsOut)
+{
+	hitsOut->clear();
+	if (k == 0 || !IsQueryZone(zone))
+		return;
+
+	vector<SphereQuery> spheres(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		spheres[i].Center = points[i];
+		spheres[i].Radius = maxDistance;
+	}
+
+	SpherePacket packet;
+	QueryStack stack;
+	vector<uint32_t> order;
+	OrderQueries(count, [points](const size_t i) { return points[i]; }, &order);
+
+	// The nearest nodes found so far are kept in a heap for each query with the farthest on top,
+	// and are output in the order the queries were given once every packet is done
+	vector<vector<SpatialQueryHit>> nearest(count);
+
+	auto findNearest = [&](const size_t first, const size_t packetCount)
+	{
+		LoadSpherePacket(spheres.data(), &order[first], packetCount, &packet);
+
+		// Once a query has found k nodes, its sphere shrinks to the farthest of them
+		TraverseHierarchy(zone, packet, stack, true, [&](SceneNode* node, const uint64_t mask)
+		{
+			ForEachLane(mask, [&](const uint32_t lane)
+			{
+				auto& heap = nearest[order[first + lane]];
+				SpatialQueryHit hit = { node, order[first + lane], sqrt(packet.DistanceSq[lane]) };
+
+				if (heap.size() == k)
+				{
+					if (hit.Distance >= heap.front().Distance)
+						return;
+					pop_heap(heap.begin(), heap.end(), CompareHitDistance);
+					heap.pop_back();
+				}
+
+				heap.push_back(hit);
+				push_heap(heap.begin(), heap.end(), CompareHitDistance);
+
+				if (heap.size() == k)
+					packet.RadiusSq[lane] = heap.front().Distance * heap.front().Distance;
+			});
+		});
+	};
+
+	// Queries spread far apart visit children in an order that suits none of them, so they are
+	// made one at a time instead
+	Bounds packetBounds;
+	XMFLOAT3 maxSpread;
+	XMStoreFloat3(&maxSpread, XMVectorScale(XMLoadFloat3(&zone->Region.AABB.Upper) -
+		XMLoadFloat3(&zone->Region.AABB.Lower), SPATIAL_QUERY_NEAREST_MAX_SPREAD));
+
+	for (size_t first = 0; first < count; first += SPATIAL_QUERY_NEAREST_PACKET_SIZE)
+	{
+		auto packetCount = min<size_t>(count - first, SPATIAL_QUERY_NEAREST_PACKET_SIZE);
+
+		SetEmptyBounds(&packetBounds);
+		for (size_t i = 0; i < packetCount; ++i)
+			ExpandBounds(&packetBounds, points[order[first + i]]);
+
+		if (packetBounds.Upper.x - packetBounds.Lower.x <= maxSpread.x &&
+			packetBounds.Upper.y - packetBounds.Lower.y <= maxSpread.y &&
+			packetBounds.Upper.z - packetBounds.Lower.z <= maxSpread.z)
+		{
+			findNearest(first, packetCount);
+			continue;
+		}
+
+		for (size_t i = 0; i < packetCount; ++i)
+			findNearest(first + i, 1);
+	}
+
+	for (auto& heap : nearest)
+	{
+		sort_heap(heap.begin(), heap.end(), CompareHitDistance);
+		hitsOut->insert(hitsOut->end(), heap.begin(), heap.end());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,350 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+using namespace DirectX;
+using namespace std;
+
+inline bool IsBoundsEqual(const Bounds& bounds1, const Bounds& bounds2)
+{
+	return bounds1.Lower.x == bounds2.Lower.x && bounds1.Lower.y == bounds2.Lower.y &&
+		bounds1.Lower.z == bounds2.Lower.z && bounds1.Upper.x == bounds2.Upper.x &&
+		bounds1.Upper.y == bounds2.Upper.y && bounds1.Upper.z == bounds2.Upper.z;
+}
+
+inline float GetRegionCostWeight(const RegionNode* region, const HierarchyBuildParams& params)
+{
+	if (region->LeafData != nullptr && !region->LeafData->IsZone())
+		return params.IntersectionCost;
+	return params.TraversalCost;
+}
+
+void LinkRegionParents(RegionNode* region)
+{
+	RegionNode* children[] = { region->Node1, region->Node2, region->Node3 };
+
+	for (auto child : children)
+	{
+		if (child == nullptr)
+			continue;
+
+		child->Parent = region;
+		if (child->LeafData == nullptr)
+			LinkRegionParents(child);
+	}
+}
+
+// Sums the cost weighted areas of the regions of a zone, without descending into nested zones
+double ComputeRegionAreaSum(const RegionNode* region, const HierarchyBuildParams& params)
+{
+	double sum = GetRegionCostWeight(region, params) * GetBoundsHalfArea(region->AABB);
+
+	if (region->LeafData != nullptr)
+		return sum;
+
+	if (region->Node1 != nullptr)
+		sum += ComputeRegionAreaSum(region->Node1, params);
+	if (region->Node2 != nullptr)
+		sum += ComputeRegionAreaSum(region->Node2, params);
+	if (region->Node3 != nullptr)
+		sum += ComputeRegionAreaSum(region->Node3, params);
+
+	return sum;
+}
+
+void UpdateHierarchyCost(SceneNode* zone)
+{
+	auto refitInfo = &zone->Ref.ZoneData->RefitInfo;
+	auto rootArea = GetBoundsHalfArea(zone->Region.AABB);
+
+	if (rootArea > 0.0f && rootArea != numeric_limits<float>::infinity())
+		refitInfo->CurrentCost = static_cast<float>(refitInfo->WeightedAreaSum / rootArea);
+	else
+		refitInfo->CurrentCost = 0.0f;
+}
+
+void ResetHierarchyRefitInfo(SceneNode* zone, const HierarchyBuildParams& params)
+{
+	auto refitInfo = &zone->Ref.ZoneData->RefitInfo;
+
+	refitInfo->BuildParams = params;
+	refitInfo->WeightedAreaSum = ComputeRegionAreaSum(&zone->Region, params);
+	UpdateHierarchyCost(zone);
+	refitInfo->BuildCost = refitInfo->CurrentCost;
+	refitInfo->RefitCount = 0;
+	refitInfo->RebuildCount = 0;
+}
+
+void RefitZoneRegions(SceneNode* zone, FlatHierarchy* flatHierarchy, const bool bRefitAll);
+
+// Recomputes the bounds of a region from its children, only descending into children
+// whose bounds may have changed. The zone's running area sum is kept up to date as it goes.
+void RefitRegion(RegionNode* region, HierarchyRefitInfo* refitInfo, FlatHierarchy* flatHierarchy,
+	const bool bRefitAll)
+{
+	region->bRefitPending = false;
+
+	Bounds bounds;
+	if (region->LeafData != nullptr)
+	{
+		if (region->LeafData->IsZone())
+		{
+			RefitZoneRegions(region->LeafData, flatHierarchy, false);
+			bounds = region->LeafData->Region.AABB;
+		}
+		else
+			GetVolumeLeafBounds(region->LeafData, &bounds);
+	}
+	else
+	{
+		SetEmptyBounds(&bounds);
+
+		RegionNode* children[] = { region->Node1, region->Node2, region->Node3 };
+		for (auto child : children)
+		{
+			if (child == nullptr)
+				continue;
+
+			if (bRefitAll || child->bRefitPending)
+				RefitRegion(child, refitInfo, flatHierarchy, bRefitAll);
+			ExpandBounds(&bounds, child->AABB);
+		}
+	}
+
+	if (IsBoundsEqual(bounds, region->AABB))
+		return;
+
+	auto weight = GetRegionCostWeight(region, refitInfo->BuildParams);
+	refitInfo->WeightedAreaSum += weight * (GetBoundsHalfArea(bounds) - GetBoundsHalfArea(region->AABB));
+	region->AABB = bounds;
+
+	if (flatHierarchy != nullptr && region->FlatIndex < flatHierarchy->GetSize())
+		flatHierarchy->SetBounds(region->FlatIndex, bounds);
+}
+
+// A nested zone's own array is compiled in the same order as the range its root region starts
+// in the array of the enclosing zone, so its bounds can be copied from there
+void CopyFlatBounds(const FlatHierarchy& source, const uint32_t begin, FlatHierarchy* hierarchyOut)
+{
+	auto count = hierarchyOut->GetSize();
+	if (begin >= source.GetSize() || source.GetSize() - begin < count)
+		return;
+
+	copy_n(source.LowerX.begin() + begin, count, hierarchyOut->LowerX.begin());
+	copy_n(source.LowerY.begin() + begin, count, hierarchyOut->LowerY.begin());
+	copy_n(source.LowerZ.begin() + begin, count, hierarchyOut->LowerZ.begin());
+	copy_n(source.UpperX.begin() + begin, count, hierarchyOut->UpperX.begin());
+	copy_n(source.UpperY.begin() + begin, count, hierarchyOut->UpperY.begin());
+	copy_n(source.UpperZ.begin() + begin, count, hierarchyOut->UpperZ.begin());
+}
+
+// The flat array given is the one the zone's regions are indexed in, which is the array of the
+// outermost compiled zone enclosing them. Without one, a compiled zone indexes its own regions.
+void RefitZoneRegions(SceneNode* zone, FlatHierarchy* flatHierarchy, const bool bRefitAll)
+{
+	if (!bRefitAll && !zone->Region.bRefitPending)
+		return;
+
+	auto compiledHierarchy = &zone->Ref.ZoneData->CompiledHierarchy;
+	if (flatHierarchy == nullptr && !compiledHierarchy->IsEmpty())
+		flatHierarchy = compiledHierarchy;
+
+	auto refitInfo = &zone->Ref.ZoneData->RefitInfo;
+	RefitRegion(&zone->Region, refitInfo, flatHierarchy, bRefitAll);
+	UpdateHierarchyCost(zone);
+	++refitInfo->RefitCount;
+
+	if (flatHierarchy != compiledHierarchy && !compiledHierarchy->IsEmpty())
+		CopyFlatBounds(*flatHierarchy, zone->Region.FlatIndex, compiledHierarchy);
+}
+
+void CollectRegionLeaves(RegionNode* region, vector<RegionNode*>* leavesOut)
+{
+	if (region->LeafData != nullptr)
+	{
+		leavesOut->push_back(region);
+		return;
+	}
+
+	if (region->Node1 != nullptr)
+		CollectRegionLeaves(region->Node1, leavesOut);
+	if (region->Node2 != nullptr)
+		CollectRegionLeaves(region->Node2, leavesOut);
+	if (region->Node3 != nullptr)
+		CollectRegionLeaves(region->Node3, leavesOut);
+}
+
+// Swaps the proxies in a rebuilt hierarchy for the leaf regions they were copied from.
+// Nested zones get new leaf regions in the rebuilt hierarchy's arena.
+RegionNode* ResolveRegionProxy(RegionNode* region, const RegionNode* proxiesBegin, const RegionNode* proxiesEnd,
+	MemoryArena* arena)
+{
+	if (region == nullptr)
+		return nullptr;
+
+	if (region >= proxiesBegin && region < proxiesEnd)
+	{
+		auto leaf = region->LeafData;
+		if (!leaf->IsZone())
+			return &leaf->Region;
+
+		auto zoneRegion = CreateRegionNode(arena);
+		zoneRegion->AABB = leaf->Region.AABB;
+		zoneRegion->LeafData = leaf;
+		leaf->Region.Parent = zoneRegion;
+		return zoneRegion;
+	}
+
+	region->Node1 = ResolveRegionProxy(region->Node1, proxiesBegin, proxiesEnd, arena);
+	region->Node2 = ResolveRegionProxy(region->Node2, proxiesBegin, proxiesEnd, arena);
+	region->Node3 = ResolveRegionProxy(region->Node3, proxiesBegin, proxiesEnd, arena);
+	return region;
+}
+
+void LaunchHierarchyRebuild(SceneNode* zone)
+{
+	auto zoneData = zone->Ref.ZoneData;
+
+	vector<RegionNode*> leaves;
+	CollectRegionLeaves(&zone->Region, &leaves);
+	if (leaves.size() == 0)
+		return;
+
+	auto task = new HierarchyRebuildTask;
+	task->Proxies.resize(leaves.size());
+	for (size_t i = 0; i < leaves.size(); ++i)
+	{
+		InitializeRegionNode(&task->Proxies[i]);
+		task->Proxies[i].AABB = leaves[i]->AABB;
+		task->Proxies[i].LeafData = leaves[i]->LeafData;
+	}
+
+	auto proxies = &task->Proxies;
+	auto arena = &zoneData->RebuildArena;
+	auto params = zoneData->RefitInfo.BuildParams;
+	// Keep the rebuild off the worker pool, it has no deadline and should not delay other work
+	params.Workers = nullptr;
+
+	arena->Reset();
+	task->Result = async(launch::async, [proxies, arena, params]()
+	{
+		vector<RegionNode*> regions;
+		regions.reserve(proxies->size());
+		for (auto& proxy : *proxies)
+			regions.push_back(&proxy);
+
+		auto root = CreateRegionNode(arena);
+		if (params.Builder == HIERARCHY_BUILDER_SAH)
+			CreateHierarchyFromBlobSAH(regions, root, arena, params);
+		else
+			CreateHierarchyFromBlob(regions, root, arena, nullptr);
+		return root;
+	});
+
+	zoneData->PendingRebuild.reset(task);
+}
+
+// Regions which survive the rebuild are refitted in the flat array given, which still has the
+// layout they were compiled with. The array is recompiled afterwards.
+void CommitHierarchyRebuild(SceneNode* zone, FlatHierarchy* flatHierarchy)
+{
+	auto zoneData = zone->Ref.ZoneData;
+	auto task = zoneData->PendingRebuild.get();
+	auto root = task->Result.get();
+	auto proxiesBegin = task->Proxies.data();
+	auto proxiesEnd = proxiesBegin + task->Proxies.size();
+
+	zone->Region.Node1 = ResolveRegionProxy(root->Node1, proxiesBegin, proxiesEnd, &zoneData->RebuildArena);
+	zone->Region.Node2 = ResolveRegionProxy(root->Node2, proxiesBegin, proxiesEnd, &zoneData->RebuildArena);
+	zone->Region.Node3 = ResolveRegionProxy(root->Node3, proxiesBegin, proxiesEnd, &zoneData->RebuildArena);
+	zoneData->PendingRebuild.reset();
+
+	// Nothing refers to the old hierarchy any more, release it all at once
+	zoneData->HierarchyArena.Swap(zoneData->RebuildArena);
+	zoneData->RebuildArena.Reset();
+
+	// The leaves may have moved while the hierarchy was being built
+	LinkRegionParents(&zone->Region);
+	RefitZoneRegions(zone, flatHierarchy, true);
+
+	auto refitCount = zoneData->RefitInfo.RefitCount;
+	auto rebuildCount = zoneData->RefitInfo.RebuildCount;
+	ResetHierarchyRefitInfo(zone, zoneData->RefitInfo.BuildParams);
+	zoneData->RefitInfo.RefitCount = refitCount;
+	zoneData->RefitInfo.RebuildCount = rebuildCount + 1;
+}
+
+void CancelHierarchyRebuild(SceneNode* zone)
+{
+	auto zoneData = zone->Ref.ZoneData;
+	if (zoneData->PendingRebuild == nullptr)
+		return;
+
+	zoneData->PendingRebuild->Result.wait();
+	zoneData->PendingRebuild.reset();
+	zoneData->RebuildArena.Reset();
+}
+
+void RefitSceneGraphHierarchy(SceneNode* zone, const vector<SceneNode*>& changedNodes)
+{
+	if (!zone->IsZone())
+	{
+		OutputDebugString("Scene node specified is not a zone!\n");
+		return;
+	}
+
+	// Flag the path from each changed leaf up to the root of the outermost zone
+	for (auto node : changedNodes)
+	{
+		if (node->Region.LeafData != node)
+			continue;
+
+		for (auto region = &node->Region; region != nullptr && !region->bRefitPending; region = region->Parent)
+			region->bRefitPending = true;
+	}
+
+	// Regions are indexed in the array of the outermost compiled zone, and the bounds of a nested
+	// zone are part of every zone enclosing it, so those are refitted from the outermost zone too
+	SceneNode* outermostZone = zone;
+	FlatHierarchy* flatHierarchy = nullptr;
+	for (auto node = zone; node != nullptr; node = node->Parent)
+	{
+		if (!node->IsZone())
+			continue;
+
+		outermostZone = node;
+		if (!node->Ref.ZoneData->CompiledHierarchy.IsEmpty())
+			flatHierarchy = &node->Ref.ZoneData->CompiledHierarchy;
+	}
+
+	auto zoneData = zone->Ref.ZoneData;
+	auto refitInfo = &zoneData->RefitInfo;
+	bool bRecompile = false;
+
+	if (zoneData->PendingRebuild != nullptr &&
+		zoneData->PendingRebuild->Result.wait_for(chrono::seconds(0)) == future_status::ready)
+	{
+		CommitHierarchyRebuild(zone, flatHierarchy);
+		bRecompile = true;
+	}
+	else
+		RefitZoneRegions(zone, flatHierarchy, false);
+
+	auto threshold = refitInfo->BuildParams.RebuildCostThreshold;
+	if (zoneData->PendingRebuild == nullptr && threshold > 0.0f &&
+		refitInfo->CurrentCost > refitInfo->BuildCost * (1.0f + threshold))
+		LaunchHierarchyRebuild(zone);
+
+	if (bRecompile)
+	{
+		if (!zoneData->CompiledHierarchy.IsEmpty())
+			CompileFlatHierarchy(zone, &zoneData->CompiledHierarchy);
+		RecompileEnclosingFlatHierarchies(zone);
+	}
+
+	// The path above the zone is still flagged, the zone itself is not refitted again
+	if (outermostZone != zone)
+		RefitZoneRegions(outermostZone, flatHierarchy, false);
+}
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include "LightClusters.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+
+// Index of the tile or slice a grid coordinate falls in, clamped to the grid
+inline uint32_t ClampClusterCoordinate(const float value, const uint32_t count)
+{
+	if (!(value > 0.0f))
+		return 0;
+	return value >= static_cast<float>(count) ? count - 1 : static_cast<uint32_t>(value);
+}
+
+// Distance from a coordinate to a span, zero inside it
+inline float GetSpanDistance(const float value, const float lower, const float upper)
+{
+	return max(max(lower - value, value - upper), 0.0f);
+}
+
+LightClusterGrid::LightClusterGrid() :
+	countX(0),
+	countY(0),
+	countZ(0),
+	nearPlane(0.0f),
+	farPlane(0.0f),
+	projectionScaleX(0.0f),
+	projectionScaleY(0.0f),
+	sliceScale(0.0f),
+	lightCount(0),
+	binnedCount(0),
+	maxClusterLights(0),
+	binTime(0.0)
+{
+	ZeroMemory(&boundsProjection, sizeof(boundsProjection));
+}
+
+bool LightClusterGrid::Initialize(const uint32_t countX, const uint32_t countY, const uint32_t countZ)
+{
+	if (countX == 0 || countY == 0 || countZ == 0)
+	{
+		OutputDebugString("Light cluster grid must not be empty!\n");
+		return false;
+	}
+
+	this->countX = countX;
+	this->countY = countY;
+	this->countZ = countZ;
+
+	LightCluster empty = { 0, 0 };
+	clusters.assign(countX * countY * countZ, empty);
+	lightIndices.clear();
+	directionalLights.clear();
+	sliceDepths.clear();
+	columnSpans.clear();
+	rowSpans.clear();
+	return true;
+}
+
+void LightClusterGrid::Destroy()
+{
+	clusters.clear();
+	lightIndices.clear();
+	directionalLights.clear();
+	binRanges.clear();
+	sliceDepths.clear();
+	columnSpans.clear();
+	rowSpans.clear();
+	countX = 0;
+	countY = 0;
+	countZ = 0;
+}
+
+void LightClusterGrid::BuildClusterSpans(const XMFLOAT4X4& projection)
+{
+	boundsProjection = projection;
+	projectionScaleX = projection.m[0][0];
+	projectionScaleY = projection.m[1][1];
+	nearPlane = -projection.m[3][2] / projection.m[2][2];
+	farPlane = projection.m[2][2] * nearPlane / (projection.m[2][2] - 1.0f);
+	sliceScale = countZ / log(farPlane / nearPlane);
+
+	sliceDepths.resize(countZ + 1);
+	for (uint32_t z = 0; z <= countZ; ++z)
+		sliceDepths[z] = nearPlane * pow(farPlane / nearPlane, static_cast<float>(z) / countZ);
+
+	columnSpans.resize(countZ * countX);
+	rowSpans.resize(countZ * countY);
+
+	// The sides of the clusters lean outward, so the spans of a slice hold the sides at both depths
+	for (uint32_t z = 0; z < countZ; ++z)
+	{
+		float sliceNear = sliceDepths[z];
+		float sliceFar = sliceDepths[z + 1];
+
+		for (uint32_t x = 0; x < countX; ++x)
+		{
+			float left = (-1.0f + 2.0f * x / countX) / projectionScaleX;
+			float right = (-1.0f + 2.0f * (x + 1) / countX) / projectionScaleX;
+			auto& span = columnSpans[z * countX + x];
+			span.Lower = min(left * sliceNear, left * sliceFar);
+			span.Upper = max(right * sliceNear, right * sliceFar);
+		}
+
+		// Rows run down the screen, against the direction of y
+		for (uint32_t y = 0; y < countY; ++y)
+		{
+			float top = (1.0f - 2.0f * y / countY) / projectionScaleY;
+			float bottom = (1.0f - 2.0f * (y + 1) / countY) / projectionScaleY;
+			auto& span = rowSpans[z * countY + y];
+			span.Lower = min(bottom * sliceNear, bottom * sliceFar);
+			span.Upper = max(top * sliceNear, top * sliceFar);
+		}
+	}
+}
+
+void LightClusterGrid::BinLights(const vector<SceneNode*>& lights, const XMFLOAT4X4& view, const size_t begin,
+	const size_t end, BinRange* rangeOut) const
+{
+	rangeOut->Entries.clear();
+	rangeOut->ClusterCounts.assign(clusters.size(), 0);
+	rangeOut->BinnedCount = 0;
+
+	auto viewMatrix = XMLoadFloat4x4(&view);
+	float logNear = log(nearPlane);
+
+	for (size_t i = begin; i < end; ++i)
+	{
+		auto light = lights[i]->Ref.LightData;
+		if (light->Type != LIGHT_TYPE_OMNI)
+			continue;
+
+		// The light is placed by its node, and its radius grows with the node's largest scale
+		auto world = XMLoadFloat4x4(&lights[i]->Transform.Global);
+		auto scaleSq = XMVectorMax(XMVector3LengthSq(world.r[0]),
+			XMVectorMax(XMVector3LengthSq(world.r[1]), XMVector3LengthSq(world.r[2])));
+
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMVector3TransformCoord(XMLoadFloat3(&light->Position), world),
+			viewMatrix));
+		float radius = light->Radius * sqrt(XMVectorGetX(scaleSq));
+		float radiusSq = radius * radius;
+
+		float minDepth = max(center.z - radius, nearPlane);
+		float maxDepth = min(center.z + radius, farPlane);
+		if (minDepth > maxDepth)
+			continue;
+
+		TileRange range;
+		if (!GetTileRange(center, radius, minDepth, maxDepth, &range))
+			continue;
+
+		auto beginZ = ClampClusterCoordinate((log(minDepth) - logNear) * sliceScale, countZ);
+		auto endZ = ClampClusterCoordinate((log(maxDepth) - logNear) * sliceScale, countZ);
+
+		auto lightIndex = static_cast<uint32_t>(i);
+		auto entryCount = rangeOut->Entries.size();
+
+		for (auto z = beginZ; z <= endZ; ++z)
+		{
+			// Within a slice the sphere is no wider than its section at the depth nearest its center,
+			// which narrows the tiles of slices away from the center
+			float sliceNear = max(sliceDepths[z], minDepth);
+			float sliceFar = min(sliceDepths[z + 1], maxDepth);
+			float offset = min(max(center.z, sliceNear), sliceFar) - center.z;
+			float sectionRadius = sqrt(max(radiusSq - offset * offset, 0.0f));
+
+			auto sliceRange = range;
+			if (beginZ != endZ && !GetTileRange(center, sectionRadius, sliceNear, sliceFar, &sliceRange))
+				continue;
+
+			// The sphere is tested against the view space bounds of each cluster, which are made of
+			// the spans of its slice, row and column
+			float distanceZ = GetSpanDistance(center.z, sliceDepths[z], sliceDepths[z + 1]);
+			auto columns = &columnSpans[z * countX];
+			auto rows = &rowSpans[z * countY];
+
+			for (auto y = sliceRange.BeginY; y <= sliceRange.EndY; ++y)
+			{
+				float distanceY = GetSpanDistance(center.y, rows[y].Lower, rows[y].Upper);
+				float remainingSq = radiusSq - distanceY * distanceY - distanceZ * distanceZ;
+				if (remainingSq < 0.0f)
+					continue;
+
+				for (auto x = sliceRange.BeginX; x <= sliceRange.EndX; ++x)
+				{
+					float distanceX = GetSpanDistance(center.x, columns[x].Lower, columns[x].Upper);
+					if (distanceX * distanceX > remainingSq)
+						continue;
+
+					auto cluster = GetClusterIndex(x, y, z);
+					rangeOut->Entries.push_back(make_pair(cluster, lightIndex));
+					++rangeOut->ClusterCounts[cluster];
+				}
+			}
+		}
+
+		if (rangeOut->Entries.size() > entryCount)
+			++rangeOut->BinnedCount;
+	}
+}
+
+bool LightClusterGrid::GetTileRange(const XMFLOAT3& center, const float radius, const float minDepth,
+	const float maxDepth, TileRange* rangeOut) const
+{
+	// The screen rectangle of the box around the sphere between the two depths. Each edge of
+	// the box is furthest out at one of them.
+	float inverseMin = 1.0f / minDepth;
+	float inverseMax = 1.0f / maxDepth;
+	float minX = projectionScaleX * min((center.x - radius) * inverseMin, (center.x - radius) * inverseMax);
+	float maxX = projectionScaleX * max((center.x + radius) * inverseMin, (center.x + radius) * inverseMax);
+	float minY = projectionScaleY * min((center.y - radius) * inverseMin, (center.y - radius) * inverseMax);
+	float maxY = projectionScaleY * max((center.y + radius) * inverseMin, (center.y + radius) * inverseMax);
+	if (minX > 1.0f || maxX < -1.0f || minY > 1.0f || maxY < -1.0f)
+		return false;
+
+	rangeOut->BeginX = ClampClusterCoordinate((minX + 1.0f) * 0.5f * countX, countX);
+	rangeOut->EndX = ClampClusterCoordinate((maxX + 1.0f) * 0.5f * countX, countX);
+	rangeOut->BeginY = ClampClusterCoordinate((1.0f - maxY) * 0.5f * countY, countY);
+	rangeOut->EndY = ClampClusterCoordinate((1.0f - minY) * 0.5f * countY, countY);
+	return true;
+}
+
+void LightClusterGrid::Build(const vector<SceneNode*>& lights, const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection, WorkerPool* workers)
+{
+	if (clusters.empty())
+	{
+		OutputDebugString("Light cluster grid was not initialized!\n");
+		return;
+	}
+
+	auto startTime = chrono::steady_clock::now();
+	lightCount = lights.size();
+
+	if (sliceDepths.empty() || memcmp(&projection, &boundsProjection, sizeof(projection)) != 0)
+		BuildClusterSpans(projection);
+
+	directionalLights.clear();
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		if (lights[i]->Ref.LightData->Type == LIGHT_TYPE_DIRECTIONAL)
+			directionalLights.push_back(static_cast<uint32_t>(i));
+	}
+
+	// Each job bins its own range of lights, counting how many each cluster receives
+	auto rangeCount = (lights.size() + LIGHT_CLUSTER_BIN_GRAIN - 1) / LIGHT_CLUSTER_BIN_GRAIN;
+	if (binRanges.size() < rangeCount)
+		binRanges.resize(rangeCount);
+
+	ParallelFor(workers, lights.size(), LIGHT_CLUSTER_BIN_GRAIN, [&](size_t begin, size_t end)
+	{
+		BinLights(lights, view, begin, end, &binRanges[begin / LIGHT_CLUSTER_BIN_GRAIN]);
+	});
+
+	// The counts become where each range starts writing into each cluster, so that the lights
+	// of a cluster stay in the order they were given
+	uint32_t offset = 0;
+	maxClusterLights = 0;
+
+	for (size_t cluster = 0; cluster < clusters.size(); ++cluster)
+	{
+		clusters[cluster].Offset = offset;
+
+		for (size_t range = 0; range < rangeCount; ++range)
+		{
+			auto count = binRanges[range].ClusterCounts[cluster];
+			binRanges[range].ClusterCounts[cluster] = offset;
+			offset += count;
+		}
+
+		clusters[cluster].Count = offset - clusters[cluster].Offset;
+		maxClusterLights = max<size_t>(maxClusterLights, clusters[cluster].Count);
+	}
+
+	lightIndices.resize(offset);
+	binnedCount = 0;
+	for (size_t range = 0; range < rangeCount; ++range)
+		binnedCount += binRanges[range].BinnedCount;
+
+	ParallelFor(workers, rangeCount, 1, [this](size_t begin, size_t end)
+	{
+		for (auto range = begin; range < end; ++range)
+		{
+			auto& binRange = binRanges[range];
+			for (auto& entry : binRange.Entries)
+				lightIndices[binRange.ClusterCounts[entry.first]++] = entry.second;
+		}
+	});
+
+	binTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+}
+
+void LightClusterGrid::Pack(uint32_t* dataOut) const
+{
+	static_assert(sizeof(LightCluster) == 2 * sizeof(uint32_t), "Clusters must be packed as two indices");
+
+	memcpy(dataOut, clusters.data(), sizeof(LightCluster) * clusters.size());
+	memcpy(dataOut + 2 * clusters.size(), lightIndices.data(), sizeof(uint32_t) * lightIndices.size());
+}
+
+void LightClusterGrid::GetStats(LightClusterStats* statsOut) const
+{
+	statsOut->LightCount = lightCount;
+	statsOut->BinnedCount = binnedCount;
+	statsOut->IndexCount = lightIndices.size();
+	statsOut->MaxClusterLights = maxClusterLights;
+	statsOut->BinTime = binTime;
+}
\ No newline at end of file
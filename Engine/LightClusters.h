@@ -0,0 +1,152 @@
+#ifndef LIGHT_CLUSTERS_H_
+#define LIGHT_CLUSTERS_H_
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <DirectXMath.h>
+
+class SceneNode;
+class WorkerPool;
+
+#define DEFAULT_LIGHT_CLUSTERS_X 16
+#define DEFAULT_LIGHT_CLUSTERS_Y 9
+#define DEFAULT_LIGHT_CLUSTERS_Z 24
+// Lights are binned in ranges of this many per job
+#define LIGHT_CLUSTER_BIN_GRAIN 512
+
+// The range of the grid's light indices that belongs to one cluster, laid out for upload as is
+struct LightCluster
+{
+	uint32_t Offset;
+	uint32_t Count;
+};
+
+struct LightClusterStats
+{
+	size_t LightCount;
+	// Omni lights touching at least one cluster, and the indices written for them
+	size_t BinnedCount;
+	size_t IndexCount;
+	size_t MaxClusterLights;
+	// Milliseconds spent binning
+	double BinTime;
+};
+
+// Divides the view frustum into a grid of clusters, tiled evenly across the screen and sliced
+// exponentially in depth, and lists the omni lights whose radius reaches each cluster. Tiles are
+// numbered from the top left of the screen and slices from the near plane, the cluster at
+// (x, y, z) being at (z * countY + y) * countX + x. Directional lights reach every cluster and
+// are listed separately. Indices refer to the light's position in the list given to Build.
+// A light's position and radius are in the space of its node, whose global transform must be
+// up to date.
+class LightClusterGrid
+{
+public:
+	LightClusterGrid();
+
+	bool Initialize(const uint32_t countX, const uint32_t countY, const uint32_t countZ);
+	void Destroy();
+
+	// The projection must be a symmetric left handed perspective, the near and far planes of
+	// which bound the slices. Binning runs on the pool's threads when one is given. Time grows
+	// with the indices written, a few thousand lights crowding the view take several
+	// milliseconds on one thread and need the pool to stay within half a millisecond.
+	void Build(const std::vector<SceneNode*>& lights, const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& projection, WorkerPool* workers);
+
+	inline uint32_t GetClusterIndex(const uint32_t x, const uint32_t y, const uint32_t z) const;
+	inline const std::vector<LightCluster>& GetClusters() const;
+	inline const std::vector<uint32_t>& GetLightIndices() const;
+	inline const std::vector<uint32_t>& GetDirectionalLights() const;
+	void GetStats(LightClusterStats* statsOut) const;
+
+	// Elements written by Pack, the offset and count of every cluster followed by the light
+	// indices, whose offsets count from the first index
+	inline size_t GetPackedSize() const;
+	void Pack(uint32_t* dataOut) const;
+
+protected:
+	// Lights binned by one job, with the number each cluster received
+	struct BinRange
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> Entries;
+		std::vector<uint32_t> ClusterCounts;
+		size_t BinnedCount;
+	};
+
+	struct ClusterSpan
+	{
+		float Lower;
+		float Upper;
+	};
+
+	// Inclusive tile coordinates covered by a light
+	struct TileRange
+	{
+		uint32_t BeginX;
+		uint32_t EndX;
+		uint32_t BeginY;
+		uint32_t EndY;
+	};
+
+	uint32_t countX;
+	uint32_t countY;
+	uint32_t countZ;
+	std::vector<LightCluster> clusters;
+	std::vector<uint32_t> lightIndices;
+	std::vector<uint32_t> directionalLights;
+	std::vector<BinRange> binRanges;
+
+	// View space extents of the clusters, rebuilt when the projection changes. Slices are bounded
+	// by their depths from the near plane to the far plane, columns and rows by their spans in x
+	// and y within each slice.
+	std::vector<float> sliceDepths;
+	std::vector<ClusterSpan> columnSpans;
+	std::vector<ClusterSpan> rowSpans;
+	DirectX::XMFLOAT4X4 boundsProjection;
+	float nearPlane;
+	float farPlane;
+	float projectionScaleX;
+	float projectionScaleY;
+	// Slices per unit of the logarithm of depth
+	float sliceScale;
+
+	size_t lightCount;
+	size_t binnedCount;
+	size_t maxClusterLights;
+	double binTime;
+
+	void BuildClusterSpans(const DirectX::XMFLOAT4X4& projection);
+	void BinLights(const std::vector<SceneNode*>& lights, const DirectX::XMFLOAT4X4& view, const size_t begin,
+		const size_t end, BinRange* rangeOut) const;
+	bool GetTileRange(const DirectX::XMFLOAT3& center, const float radius, const float minDepth,
+		const float maxDepth, TileRange* rangeOut) const;
+};
+
+inline uint32_t LightClusterGrid::GetClusterIndex(const uint32_t x, const uint32_t y, const uint32_t z) const
+{
+	return (z * countY + y) * countX + x;
+}
+
+inline const std::vector<LightCluster>& LightClusterGrid::GetClusters() const
+{
+	return clusters;
+}
+
+inline const std::vector<uint32_t>& LightClusterGrid::GetLightIndices() const
+{
+	return lightIndices;
+}
+
+inline const std::vector<uint32_t>& LightClusterGrid::GetDirectionalLights() const
+{
+	return directionalLights;
+}
+
+inline size_t LightClusterGrid::GetPackedSize() const
+{
+	return 2 * clusters.size() + lightIndices.size();
+}
+
+#endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "MaterialData.h"
 
+static uint32_t nextMaterialSortId = 0;
+
 void MaterialData::Destroy()
 {
 	for (auto buf : PixelConstantBuffers)
@@ -10,5 +12,6 @@ void CreateStandardMaterial(ID3D11ShaderResourceView* albedoView, const bool isT
 {
 	materialOut->Type = MATERIAL_TYPE_STANDARD;
 	materialOut->IsTransparent = isTransparent;
+	materialOut->SortId = nextMaterialSortId++;
 	materialOut->PixelResourceViews.push_back(albedoView);
 }
\ No newline at end of file
@@ -32,6 +32,8 @@ public:
 	std::vector<ID3D11Buffer*> PixelConstantBuffers;
 
 	bool IsTransparent;
+	// Orders draws by material, assigned when the material is created
+	uint32_t SortId;
 
 	void Destroy();
 };
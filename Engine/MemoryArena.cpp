@@ -0,0 +1,167 @@
+#include "MemoryArena.h"
+
+#include <Windows.h>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+MemoryArena::MemoryArena() :
+	MemoryArena(DEFAULT_ARENA_CHUNK_SIZE)
+{
+}
+
+MemoryArena::MemoryArena(const size_t chunkSize) :
+	firstChunk(nullptr),
+	currentChunk(nullptr),
+	chunkSize(chunkSize)
+{
+	stats.AllocationCount = 0;
+	stats.AllocatedBytes = 0;
+	stats.ReservedBytes = 0;
+	stats.ChunkCount = 0;
+}
+
+MemoryArena::~MemoryArena()
+{
+	Destroy();
+}
+
+void MemoryArena::ResetChunk(Chunk* chunk)
+{
+	chunk->Offset.store(0, memory_order_relaxed);
+	chunk->AllocationCount.store(0, memory_order_relaxed);
+	chunk->AllocatedBytes.store(0, memory_order_relaxed);
+}
+
+// Returns null when the allocation does not fit in what is left of the chunk
+void* MemoryArena::AllocateFromChunk(Chunk* chunk, const size_t size, const size_t alignment)
+{
+	auto base = reinterpret_cast<uintptr_t>(chunk + 1);
+	auto offset = chunk->Offset.load(memory_order_relaxed);
+
+	for (;;)
+	{
+		auto address = (base + offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+		if (address + size > base + chunk->Size)
+			return nullptr;
+
+		if (chunk->Offset.compare_exchange_weak(offset, address + size - base, memory_order_relaxed))
+		{
+			chunk->AllocationCount.fetch_add(1, memory_order_relaxed);
+			chunk->AllocatedBytes.fetch_add(size, memory_order_relaxed);
+			return reinterpret_cast<void*>(address);
+		}
+	}
+}
+
+void* MemoryArena::Allocate(const size_t size, const size_t alignment)
+{
+	auto chunk = currentChunk.load(memory_order_acquire);
+	if (chunk != nullptr)
+	{
+		auto memory = AllocateFromChunk(chunk, size, alignment);
+		if (memory != nullptr)
+			return memory;
+	}
+
+	lock_guard<mutex> lock(arenaMutex);
+
+	for (;;)
+	{
+		// Another thread may have moved on to a new chunk while this one waited for the lock
+		chunk = currentChunk.load(memory_order_relaxed);
+		if (chunk != nullptr)
+		{
+			auto memory = AllocateFromChunk(chunk, size, alignment);
+			if (memory != nullptr)
+				return memory;
+		}
+
+		// Move on to the next chunk kept from before the last reset if the allocation fits
+		auto nextChunk = chunk != nullptr ? chunk->Next : firstChunk;
+		if (nextChunk != nullptr && nextChunk->Size >= size + alignment)
+		{
+			ResetChunk(nextChunk);
+			currentChunk.store(nextChunk, memory_order_release);
+			continue;
+		}
+
+		auto newSize = max(chunkSize, size + alignment);
+		auto memory = malloc(sizeof(Chunk) + newSize);
+		if (memory == nullptr)
+		{
+			OutputDebugString("Failed to allocate arena chunk!\n");
+			return nullptr;
+		}
+
+		auto newChunk = new (memory) Chunk;
+		newChunk->Size = newSize;
+		newChunk->Next = nextChunk;
+		ResetChunk(newChunk);
+		if (chunk != nullptr)
+			chunk->Next = newChunk;
+		else
+			firstChunk = newChunk;
+
+		currentChunk.store(newChunk, memory_order_release);
+		stats.ReservedBytes += newSize;
+		++stats.ChunkCount;
+	}
+}
+
+void MemoryArena::Reset()
+{
+	lock_guard<mutex> lock(arenaMutex);
+	currentChunk.store(nullptr, memory_order_relaxed);
+}
+
+void MemoryArena::Destroy()
+{
+	lock_guard<mutex> lock(arenaMutex);
+
+	while (firstChunk != nullptr)
+	{
+		auto next = firstChunk->Next;
+		firstChunk->~Chunk();
+		free(firstChunk);
+		firstChunk = next;
+	}
+
+	currentChunk.store(nullptr, memory_order_relaxed);
+	stats.ReservedBytes = 0;
+	stats.ChunkCount = 0;
+}
+
+void MemoryArena::Swap(MemoryArena& other)
+{
+	lock(arenaMutex, other.arenaMutex);
+	lock_guard<mutex> lock1(arenaMutex, adopt_lock);
+	lock_guard<mutex> lock2(other.arenaMutex, adopt_lock);
+
+	auto otherCurrentChunk = other.currentChunk.load(memory_order_relaxed);
+	other.currentChunk.store(currentChunk.load(memory_order_relaxed), memory_order_relaxed);
+	currentChunk.store(otherCurrentChunk, memory_order_relaxed);
+
+	swap(firstChunk, other.firstChunk);
+	swap(chunkSize, other.chunkSize);
+	swap(stats, other.stats);
+}
+
+void MemoryArena::GetStats(MemoryArenaStats* statsOut) const
+{
+	lock_guard<mutex> lock(arenaMutex);
+	*statsOut = stats;
+
+	// Chunks after the current one are left over from before the last reset
+	statsOut->AllocationCount = 0;
+	statsOut->AllocatedBytes = 0;
+	auto lastChunk = currentChunk.load(memory_order_relaxed);
+	for (auto chunk = firstChunk; lastChunk != nullptr && chunk != nullptr; chunk = chunk->Next)
+	{
+		statsOut->AllocationCount += chunk->AllocationCount.load(memory_order_relaxed);
+		statsOut->AllocatedBytes += chunk->AllocatedBytes.load(memory_order_relaxed);
+		if (chunk == lastChunk)
+			break;
+	}
+}
@@ -0,0 +1,152 @@
+#ifndef MEMORY_ARENA_H_
+#define MEMORY_ARENA_H_
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <stdint.h>
+
+#define DEFAULT_ARENA_CHUNK_SIZE (256 * 1024)
+
+struct MemoryArenaStats
+{
+	// Counted since the arena was last reset
+	size_t AllocationCount;
+	size_t AllocatedBytes;
+	// Memory held by the arena, which is kept across resets
+	size_t ReservedBytes;
+	size_t ChunkCount;
+};
+
+// Linear allocator over a list of chunks. Individual allocations are never freed, instead
+// resetting the arena releases everything at once and keeps the chunks for reuse. Objects
+// created in an arena are not destroyed by it. Threads of a parallel build may share an arena:
+// allocations bump the current chunk's offset without locking, and only moving on to another
+// chunk takes the arena's lock. Resetting, destroying or swapping must not overlap allocations.
+class MemoryArena
+{
+public:
+	MemoryArena();
+	MemoryArena(const size_t chunkSize);
+	~MemoryArena();
+
+	void* Allocate(const size_t size, const size_t alignment);
+	template <typename T>
+	inline T* New();
+
+	void Reset();
+	void Destroy();
+	void Swap(MemoryArena& other);
+	void GetStats(MemoryArenaStats* statsOut) const;
+
+protected:
+	struct Chunk
+	{
+		Chunk* Next;
+		size_t Size;
+		std::atomic<size_t> Offset;
+		// Counted per chunk, so that allocating does not touch any memory shared by all chunks
+		std::atomic<size_t> AllocationCount;
+		std::atomic<size_t> AllocatedBytes;
+	};
+
+	Chunk* firstChunk;
+	std::atomic<Chunk*> currentChunk;
+	size_t chunkSize;
+	// Only the reserved bytes and chunk count are kept here, allocations are counted per chunk
+	MemoryArenaStats stats;
+	mutable std::mutex arenaMutex;
+
+	void* AllocateFromChunk(Chunk* chunk, const size_t size, const size_t alignment);
+	void ResetChunk(Chunk* chunk);
+
+private:
+	MemoryArena(const MemoryArena&);
+	MemoryArena& operator=(const MemoryArena&);
+};
+
+// Allocates container storage from an arena, or from the global heap when there is no arena.
+// Storage from an arena is only released when the arena is reset.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	MemoryArena* Arena;
+
+	ArenaAllocator();
+	ArenaAllocator(MemoryArena* arena);
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other);
+
+	T* allocate(const size_t count);
+	void deallocate(T* ptr, const size_t count);
+};
+
+template <typename T>
+inline T* MemoryArena::New()
+{
+	auto memory = Allocate(sizeof(T), std::alignment_of<T>::value);
+	if (memory == nullptr)
+		return nullptr;
+	return new (memory) T;
+}
+
+template <typename T>
+inline ArenaAllocator<T>::ArenaAllocator() :
+	Arena(nullptr)
+{
+}
+
+template <typename T>
+inline ArenaAllocator<T>::ArenaAllocator(MemoryArena* arena) :
+	Arena(arena)
+{
+}
+
+template <typename T>
+template <typename U>
+inline ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U>& other) :
+	Arena(other.Arena)
+{
+}
+
+template <typename T>
+inline T* ArenaAllocator<T>::allocate(const size_t count)
+{
+	if (Arena != nullptr)
+	{
+		auto memory = Arena->Allocate(count * sizeof(T), std::alignment_of<T>::value);
+		if (memory == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(memory);
+	}
+
+	return static_cast<T*>(::operator new(count * sizeof(T)));
+}
+
+template <typename T>
+inline void ArenaAllocator<T>::deallocate(T* ptr, const size_t count)
+{
+	if (Arena == nullptr)
+		::operator delete(ptr);
+}
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.Arena == b.Arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.Arena != b.Arena;
+}
+
+#endif
\ No newline at end of file
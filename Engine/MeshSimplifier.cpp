@@ -0,0 +1,274 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+// The sum of squared distances to a set of planes, stored as the upper half of a symmetric 4x4 matrix
+struct Quadric
+{
+	double A[10];
+};
+
+struct EdgeCollapse
+{
+	double Cost;
+	// The vertex removed and the vertex it is merged into
+	uint32_t From;
+	uint32_t To;
+	// Stamps of both vertices when the collapse was queued, it is stale once either changes
+	uint32_t FromStamp;
+	uint32_t ToStamp;
+};
+
+inline bool CompareCollapseCost(const EdgeCollapse& c1, const EdgeCollapse& c2)
+{
+	return c1.Cost > c2.Cost;
+}
+
+inline void AddPlane(Quadric* quadric, const double a, const double b, const double c, const double d)
+{
+	quadric->A[0] += a * a;
+	quadric->A[1] += a * b;
+	quadric->A[2] += a * c;
+	quadric->A[3] += a * d;
+	quadric->A[4] += b * b;
+	quadric->A[5] += b * c;
+	quadric->A[6] += b * d;
+	quadric->A[7] += c * c;
+	quadric->A[8] += c * d;
+	quadric->A[9] += d * d;
+}
+
+inline void AddQuadric(Quadric* quadric, const Quadric& other)
+{
+	for (size_t i = 0; i < 10; ++i)
+		quadric->A[i] += other.A[i];
+}
+
+inline double EvaluateQuadric(const Quadric& quadric, const XMFLOAT3& point)
+{
+	double x = point.x;
+	double y = point.y;
+	double z = point.z;
+	auto& a = quadric.A;
+
+	return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+		a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+		a[7] * z * z + 2.0 * a[8] * z + a[9];
+}
+
+inline uint64_t MakeEdgeKey(const uint32_t v0, const uint32_t v1)
+{
+	return (static_cast<uint64_t>(min(v0, v1)) << 32) | max(v0, v1);
+}
+
+// The unnormalized normal of a triangle, its length is twice the triangle's area
+inline XMVECTOR ComputeTriangleNormal(const vector<XMFLOAT3>& positions, const uint32_t i0, const uint32_t i1,
+	const uint32_t i2)
+{
+	auto p0 = XMLoadFloat3(&positions[i0]);
+	return XMVector3Cross(XMLoadFloat3(&positions[i1]) - p0, XMLoadFloat3(&positions[i2]) - p0);
+}
+
+inline bool ContainsVertex(const uint32_t* triangle, const uint32_t vertex)
+{
+	return triangle[0] == vertex || triangle[1] == vertex || triangle[2] == vertex;
+}
+
+// Checks that moving the vertex does not fold over any triangle that remains after the collapse
+inline bool IsCollapseValid(const vector<XMFLOAT3>& positions, const vector<uint32_t>& triangles,
+	const vector<uint32_t>& fromTriangles, const vector<bool>& triangleAlive, const uint32_t from, const uint32_t to)
+{
+	for (auto triangle : fromTriangles)
+	{
+		auto corners = &triangles[triangle * 3];
+		if (!triangleAlive[triangle] || ContainsVertex(corners, to))
+			continue;
+
+		uint32_t moved[3];
+		for (size_t i = 0; i < 3; ++i)
+			moved[i] = corners[i] == from ? to : corners[i];
+
+		auto before = ComputeTriangleNormal(positions, corners[0], corners[1], corners[2]);
+		auto after = ComputeTriangleNormal(positions, moved[0], moved[1], moved[2]);
+
+		float lengthBefore = XMVectorGetX(XMVector3Length(before));
+		if (lengthBefore == 0.0f)
+			continue;
+
+		float lengthAfter = XMVectorGetX(XMVector3Length(after));
+		if (!(XMVectorGetX(XMVector3Dot(before, after)) > MESH_SIMPLIFY_MIN_NORMAL_COS * lengthBefore * lengthAfter))
+			return false;
+	}
+
+	return true;
+}
+
+bool SimplifyMesh(const vector<XMFLOAT3>& positions, const vector<uint32_t>& indices,
+	const size_t targetIndexCount, const float maxError, vector<uint32_t>* indicesOut, float* errorOut)
+{
+	auto vertexCount = positions.size();
+	auto triangleCount = indices.size() / 3;
+
+	vector<uint32_t> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+	vector<bool> triangleAlive(triangleCount, true);
+	vector<vector<uint32_t>> vertexTriangles(vertexCount);
+	vector<Quadric> quadrics(vertexCount);
+	unordered_map<uint64_t, uint32_t> edgeUses;
+
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		auto corners = &triangles[triangle * 3];
+		auto normal = ComputeTriangleNormal(positions, corners[0], corners[1], corners[2]);
+		float length = XMVectorGetX(XMVector3Length(normal));
+
+		for (size_t i = 0; i < 3; ++i)
+		{
+			vertexTriangles[corners[i]].push_back(static_cast<uint32_t>(triangle));
+			++edgeUses[MakeEdgeKey(corners[i], corners[(i + 1) % 3])];
+		}
+
+		// Degenerate triangles have no plane to keep the vertices near
+		if (length == 0.0f)
+			continue;
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVectorScale(normal, 1.0f / length));
+		auto& p = positions[corners[0]];
+		double d = -(static_cast<double>(n.x) * p.x + static_cast<double>(n.y) * p.y + static_cast<double>(n.z) * p.z);
+
+		for (size_t i = 0; i < 3; ++i)
+			AddPlane(&quadrics[corners[i]], n.x, n.y, n.z, d);
+	}
+
+	// Edges with a single triangle are open borders, which is also how texture seams appear since
+	// the vertices on either side are distinct. Edges with more than two are not manifold.
+	vector<bool> locked(vertexCount, false);
+	for (auto& edge : edgeUses)
+	{
+		if (edge.second != 2)
+		{
+			locked[static_cast<uint32_t>(edge.first >> 32)] = true;
+			locked[static_cast<uint32_t>(edge.first)] = true;
+		}
+	}
+
+	vector<uint32_t> stamps(vertexCount, 0);
+	vector<bool> removed(vertexCount, false);
+	vector<EdgeCollapse> heap;
+	auto infinity = numeric_limits<double>::infinity();
+
+	// Queues the cheaper direction of collapsing the edge
+	auto pushCollapse = [&](const uint32_t v0, const uint32_t v1)
+	{
+		if (locked[v0] && locked[v1])
+			return;
+
+		Quadric quadric = quadrics[v0];
+		AddQuadric(&quadric, quadrics[v1]);
+		double cost0 = locked[v0] ? infinity : EvaluateQuadric(quadric, positions[v1]);
+		double cost1 = locked[v1] ? infinity : EvaluateQuadric(quadric, positions[v0]);
+
+		EdgeCollapse collapse;
+		collapse.Cost = min(cost0, cost1);
+		collapse.From = cost0 <= cost1 ? v0 : v1;
+		collapse.To = cost0 <= cost1 ? v1 : v0;
+		collapse.FromStamp = stamps[collapse.From];
+		collapse.ToStamp = stamps[collapse.To];
+
+		heap.push_back(collapse);
+		push_heap(heap.begin(), heap.end(), CompareCollapseCost);
+	};
+
+	for (auto& edge : edgeUses)
+		pushCollapse(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first));
+
+	auto targetTriangleCount = targetIndexCount / 3;
+	auto aliveCount = triangleCount;
+	double maxCost = static_cast<double>(maxError) * maxError;
+	double largestCost = 0.0;
+	vector<uint32_t> neighbors;
+
+	while (aliveCount > targetTriangleCount && !heap.empty())
+	{
+		pop_heap(heap.begin(), heap.end(), CompareCollapseCost);
+		auto collapse = heap.back();
+		heap.pop_back();
+
+		auto from = collapse.From;
+		auto to = collapse.To;
+		if (removed[from] || removed[to] || stamps[from] != collapse.FromStamp || stamps[to] != collapse.ToStamp)
+			continue;
+
+		// Costs only grow as quadrics are merged, so no cheaper collapse remains
+		if (collapse.Cost > maxCost)
+			break;
+
+		if (!IsCollapseValid(positions, triangles, vertexTriangles[from], triangleAlive, from, to))
+			continue;
+
+		// Triangles on the edge disappear, the others are moved onto the remaining vertex
+		for (auto triangle : vertexTriangles[from])
+		{
+			auto corners = &triangles[triangle * 3];
+			if (!triangleAlive[triangle])
+				continue;
+
+			if (ContainsVertex(corners, to))
+			{
+				triangleAlive[triangle] = false;
+				--aliveCount;
+				continue;
+			}
+
+			for (size_t i = 0; i < 3; ++i)
+			{
+				if (corners[i] == from)
+					corners[i] = to;
+			}
+			vertexTriangles[to].push_back(triangle);
+		}
+
+		vertexTriangles[from].clear();
+		AddQuadric(&quadrics[to], quadrics[from]);
+		removed[from] = true;
+		++stamps[to];
+		largestCost = max(largestCost, collapse.Cost);
+
+		auto& toTriangles = vertexTriangles[to];
+		toTriangles.erase(remove_if(toTriangles.begin(), toTriangles.end(),
+			[&triangleAlive](const uint32_t triangle) { return !triangleAlive[triangle]; }), toTriangles.end());
+
+		// Every edge around the remaining vertex has a new cost
+		neighbors.clear();
+		for (auto triangle : toTriangles)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				if (triangles[triangle * 3 + i] != to)
+					neighbors.push_back(triangles[triangle * 3 + i]);
+			}
+		}
+
+		sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		for (auto neighbor : neighbors)
+			pushCollapse(to, neighbor);
+	}
+
+	indicesOut->clear();
+	indicesOut->reserve(aliveCount * 3);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		if (triangleAlive[triangle])
+			indicesOut->insert(indicesOut->end(), &triangles[triangle * 3], &triangles[triangle * 3] + 3);
+	}
+
+	*errorOut = static_cast<float>(sqrt(max(largestCost, 0.0)));
+	return aliveCount < triangleCount;
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef MESH_SIMPLIFIER_H_
+#define MESH_SIMPLIFIER_H_
+
+#include <vector>
+#include <stdint.h>
+#include <DirectXMath.h>
+
+#define DEFAULT_MESH_LOD_LEVELS 4
+#define DEFAULT_MESH_LOD_RATIO 0.5f
+// Largest error of the coarsest level, relative to the radius of the mesh
+#define DEFAULT_MESH_LOD_MAX_ERROR 0.05f
+// A level is only kept if it removes at least this fraction of the triangles of the level before it
+#define MESH_LOD_MIN_REDUCTION 0.1f
+// Collapses that turn a remaining triangle's normal by more than this (as a cosine) are rejected
+#define MESH_SIMPLIFY_MIN_NORMAL_COS 0.2f
+
+// Levels of detail generated for meshes as they are loaded
+struct MeshLodParams
+{
+	// Number of levels including the full mesh, one disables simplification
+	uint32_t LevelCount;
+	// Fraction of the previous level's triangles each level aims to keep
+	float LevelRatio;
+	float MaxError;
+};
+
+// Removes triangles by collapsing edges in order of quadric error until at most targetIndexCount
+// indices remain or the next collapse would exceed maxError. Edges collapse onto one of their end
+// points, so the output indexes the same vertices as the input. Vertices on open borders,
+// including texture seams, never move so that levels sharing a vertex buffer do not crack.
+// Outputs the largest error of any collapse as a distance. Returns false if nothing was removed.
+bool SimplifyMesh(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<uint32_t>& indices,
+	const size_t targetIndexCount, const float maxError, std::vector<uint32_t>* indicesOut, float* errorOut);
+
+#endif
\ No newline at end of file
@@ -1,90 +1,240 @@
 #ifndef OBJECT_POOL_H_
 #define OBJECT_POOL_H_
 
-#include <vector>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+
+#define DEFAULT_OBJECT_POOL_CHUNK_SIZE 1024
+#define OBJECT_POOL_MAX_CHUNKS 4096
+#define INVALID_OBJECT_POOL_SLOT 0xFFFFFFFF
+
+struct ObjectPoolStats
+{
+	size_t LiveCount;
+	size_t PeakCount;
+	size_t Capacity;
+	size_t ChunkCount;
+};
 
+// Hands out objects from chunks that are never moved or freed while the pool exists, so
+// pointers to objects stay valid until they are deallocated. Objects are constructed on
+// allocation and destroyed on deallocation. Alloc and Dealloc may be called from any thread,
+// free slots are kept on a lock free stack and only growing the pool takes a lock.
 template <typename T>
 class ObjectPool
 {
 protected:
-	T* objPtr;
-	std::vector<uint32_t> freeObjs;
-	size_t poolSize;
+	struct Slot
+	{
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Storage;
+		std::atomic<uint32_t> NextFree;
+		uint32_t Index;
+	};
+
+	// The top of the free stack is packed with a counter that changes on every update,
+	// so that a slot popped and pushed back by another thread does not fool the exchange.
+	std::atomic<uint64_t> freeHead;
+	Slot* chunks[OBJECT_POOL_MAX_CHUNKS];
+	std::atomic<uint32_t> chunkCount;
+	uint32_t chunkSize;
+	std::mutex growMutex;
+
+	std::atomic<size_t> liveCount;
+	std::atomic<size_t> peakCount;
+
+	inline Slot* GetSlot(const uint32_t index) const;
+	inline void PushFree(Slot* first, Slot* last);
+	bool Grow();
+	bool AddChunk();
+
+private:
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
 
 public:
-
-	ObjectPool(size_t initialSize);
+	ObjectPool();
+	ObjectPool(const size_t chunkSize);
+	// Releases the pool's memory. Objects still allocated are not destroyed.
 	~ObjectPool();
 
-	void Resize(size_t size);
-	void Grow(size_t size);
-	T* Alloc();
-	void Dealloc(const T* obj);
+	template <typename... Args>
+	T* Alloc(Args&&... args);
+	void Dealloc(T* obj);
+	bool Reserve(const size_t capacity);
+
+	void GetStats(ObjectPoolStats* statsOut) const;
 	size_t GetSize() const;
+	size_t GetCapacity() const;
 };
 
+inline uint64_t MakeObjectPoolHead(const uint32_t index, const uint32_t tag)
+{
+	return (static_cast<uint64_t>(tag) << 32) | index;
+}
+
 template<typename T>
-inline ObjectPool<T>::ObjectPool(size_t initialSize) :
-	objPtr(new T[initialSize]),
-	poolSize(initialSize)
+inline ObjectPool<T>::ObjectPool() :
+	ObjectPool(DEFAULT_OBJECT_POOL_CHUNK_SIZE)
+{
+}
+
+template<typename T>
+inline ObjectPool<T>::ObjectPool(const size_t chunkSize) :
+	freeHead(MakeObjectPoolHead(INVALID_OBJECT_POOL_SLOT, 0)),
+	chunkCount(0),
+	chunkSize(static_cast<uint32_t>(chunkSize > 0 ? chunkSize : 1)),
+	liveCount(0),
+	peakCount(0)
 {
-	freeObjs.reserve(initialSize);
-	for (size_t i = 0; i < initialSize; ++i)
-		freeObjs.push(i);
 }
 
 template<typename T>
 inline ObjectPool<T>::~ObjectPool()
 {
-	delete[] objPtr;
+	auto count = chunkCount.load();
+	for (uint32_t i = 0; i < count; ++i)
+		delete[] chunks[i];
 }
 
 template<typename T>
-inline void ObjectPool<T>::Resize(size_t size)
+inline typename ObjectPool<T>::Slot* ObjectPool<T>::GetSlot(const uint32_t index) const
 {
-	delete[] objPtr;
-	objPtr = new T[size];
+	return &chunks[index / chunkSize][index % chunkSize];
+}
 
-	freeObjs.clear();
-	freeObjs.reserve(size);
-	for (size_t i = 0; i < initialSize; ++i)
-		freeObjs.push(i);
+template<typename T>
+inline void ObjectPool<T>::PushFree(Slot* first, Slot* last)
+{
+	auto head = freeHead.load(std::memory_order_relaxed);
+	do
+	{
+		last->NextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+	}
+	while (!freeHead.compare_exchange_weak(head, MakeObjectPoolHead(first->Index, static_cast<uint32_t>(head >> 32) + 1),
+		std::memory_order_release, std::memory_order_relaxed));
+}
 
-	poolSize = size;
+template<typename T>
+inline bool ObjectPool<T>::Grow()
+{
+	std::lock_guard<std::mutex> lock(growMutex);
+
+	// Another thread may have grown the pool while this one was waiting
+	if (static_cast<uint32_t>(freeHead.load()) != INVALID_OBJECT_POOL_SLOT)
+		return true;
+
+	return AddChunk();
+}
+
+template<typename T>
+inline bool ObjectPool<T>::AddChunk()
+{
+	auto chunkIndex = chunkCount.load();
+	if (chunkIndex >= OBJECT_POOL_MAX_CHUNKS)
+		return false;
+
+	auto chunk = new Slot[chunkSize];
+	for (uint32_t i = 0; i < chunkSize; ++i)
+	{
+		chunk[i].Index = chunkIndex * chunkSize + i;
+		chunk[i].NextFree.store(chunk[i].Index + 1, std::memory_order_relaxed);
+	}
+
+	// The chunk is published before its slots can be popped from the free stack
+	chunks[chunkIndex] = chunk;
+	chunkCount.store(chunkIndex + 1);
+
+	PushFree(&chunk[0], &chunk[chunkSize - 1]);
+	return true;
+}
+
+template<typename T>
+template <typename... Args>
+inline T* ObjectPool<T>::Alloc(Args&&... args)
+{
+	Slot* slot;
+	auto head = freeHead.load(std::memory_order_acquire);
+
+	for (;;)
+	{
+		auto index = static_cast<uint32_t>(head);
+		if (index == INVALID_OBJECT_POOL_SLOT)
+		{
+			if (!Grow())
+				return nullptr;
+			head = freeHead.load(std::memory_order_acquire);
+			continue;
+		}
+
+		// The slot may be taken by another thread before the exchange, in which case the
+		// next index read here is stale but the exchange fails because the counter changed
+		slot = GetSlot(index);
+		auto next = slot->NextFree.load(std::memory_order_relaxed);
+		if (freeHead.compare_exchange_weak(head, MakeObjectPoolHead(next, static_cast<uint32_t>(head >> 32) + 1),
+			std::memory_order_acquire, std::memory_order_acquire))
+			break;
+	}
+
+	auto live = ++liveCount;
+	auto peak = peakCount.load(std::memory_order_relaxed);
+	while (live > peak && !peakCount.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+
+	return new (&slot->Storage) T(std::forward<Args>(args)...);
 }
 
 template<typename T>
-inline void ObjectPool<T>::Grow(size_t size)
+inline void ObjectPool<T>::Dealloc(T* obj)
 {
-	auto newPtr = new T[size];
-	memcpy(newPtr, objPtr, size * sizeof(T));
-	delete[] objPtr;
-	objPtr = newPtr;
+	if (obj == nullptr)
+		return;
 
-	for (size_t i = poolSize; i < size; ++i)
-		freeObjs.push_back(i);
+	obj->~T();
 
-	poolSize = size;
+	// The object's storage is the first member of its slot
+	auto slot = reinterpret_cast<Slot*>(obj);
+	PushFree(slot, slot);
+	--liveCount;
 }
 
 template<typename T>
-inline T * ObjectPool<T>::Alloc()
+inline bool ObjectPool<T>::Reserve(const size_t capacity)
 {
-	auto loc = freeObjs[freeObjs.size() - 1];
-	freeObjs.pop_back();
-	return &objPtr[loc];
+	std::lock_guard<std::mutex> lock(growMutex);
+
+	while (GetCapacity() < capacity)
+	{
+		if (!AddChunk())
+			return false;
+	}
+
+	return true;
 }
 
 template<typename T>
-inline void ObjectPool<T>::Dealloc(const T* obj)
+inline void ObjectPool<T>::GetStats(ObjectPoolStats* statsOut) const
 {
-	freeObjs.push_back(obj - objPtr);
+	statsOut->LiveCount = liveCount.load();
+	statsOut->PeakCount = peakCount.load();
+	statsOut->Capacity = GetCapacity();
+	statsOut->ChunkCount = chunkCount.load();
 }
 
 template<typename T>
 inline size_t ObjectPool<T>::GetSize() const
 {
-	return poolSize;
+	return liveCount.load();
+}
+
+template<typename T>
+inline size_t ObjectPool<T>::GetCapacity() const
+{
+	return static_cast<size_t>(chunkCount.load()) * chunkSize;
 }
 
 #endif
\ No newline at end of file
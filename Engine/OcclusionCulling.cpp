@@ -0,0 +1,459 @@
+#include "OcclusionCulling.h"
+#include "SceneGraph.h"
+#include "StaticMesh.h"
+#include "Terrain.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <limits>
+
+using namespace DirectX;
+using namespace std;
+
+OcclusionBuffer::OcclusionBuffer() :
+	width(0),
+	height(0),
+	bFinished(false),
+	occluderCount(0),
+	triangleCount(0),
+	rasterTime(0.0),
+	testCount(0),
+	culledCount(0)
+{
+}
+
+bool OcclusionBuffer::Initialize(const uint32_t width, const uint32_t height)
+{
+	if (width == 0 || height == 0)
+	{
+		OutputDebugString("Occlusion buffer must not be empty!\n");
+		return false;
+	}
+
+	// Only whole tiles are rasterized, so the buffer is padded to a multiple of the tile size
+	this->width = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE;
+	this->height = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE;
+
+	depthLevels.clear();
+	levelWidths.clear();
+	levelHeights.clear();
+
+	auto levelWidth = this->width;
+	auto levelHeight = this->height;
+
+	for (;;)
+	{
+		depthLevels.push_back(vector<float>(levelWidth * levelHeight, 1.0f));
+		levelWidths.push_back(levelWidth);
+		levelHeights.push_back(levelHeight);
+
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	bFinished = false;
+	return true;
+}
+
+void OcclusionBuffer::Destroy()
+{
+	depthLevels.clear();
+	levelWidths.clear();
+	levelHeights.clear();
+	width = 0;
+	height = 0;
+	bFinished = false;
+}
+
+void OcclusionBuffer::Begin(const XMMATRIX& viewProjection)
+{
+	rasterStart = chrono::steady_clock::now();
+
+	XMStoreFloat4x4(&this->viewProjection, viewProjection);
+	if (!depthLevels.empty())
+		fill(depthLevels[0].begin(), depthLevels[0].end(), 1.0f);
+
+	bFinished = false;
+	occluderCount = 0;
+	triangleCount = 0;
+	testCount = 0;
+	culledCount = 0;
+}
+
+bool OcclusionBuffer::ProjectVertex(const XMVECTOR& position, const XMMATRIX& transform, XMFLOAT3* screenOut) const
+{
+	XMFLOAT4 clip;
+	XMStoreFloat4(&clip, XMVector4Transform(XMVectorSetW(position, 1.0f), transform));
+
+	if (!(clip.w >= OCCLUSION_NEAR_CLIP_W))
+		return false;
+
+	float invW = 1.0f / clip.w;
+	screenOut->x = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(width);
+	screenOut->y = (0.5f - clip.y * invW * 0.5f) * static_cast<float>(height);
+	screenOut->z = clip.z * invW;
+	return true;
+}
+
+// Triangles crossing the near plane are skipped rather than clipped. Leaving out part of
+// an occluder only ever makes fewer objects occluded.
+void OcclusionBuffer::RasterizeOccluder(const OccluderMesh& mesh, const XMMATRIX& world)
+{
+	if (depthLevels.empty())
+		return;
+
+	auto transform = XMMatrixMultiply(world, XMLoadFloat4x4(&viewProjection));
+	XMFLOAT3 screen[3];
+
+	for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+	{
+		bool bProjected = true;
+		for (int j = 0; j < 3 && bProjected; ++j)
+			bProjected = ProjectVertex(XMLoadFloat3(&mesh.Positions[mesh.Indices[i + j]]), transform, &screen[j]);
+
+		if (bProjected)
+			RasterizeTriangle(screen[0], screen[1], screen[2]);
+	}
+
+	triangleCount += mesh.Indices.size() / 3;
+	++occluderCount;
+}
+
+// Uses the same positions and split of cells into triangles as the patch's current mesh
+void OcclusionBuffer::RasterizeTerrainPatch(const TerrainPatch& terrainPatch, const XMMATRIX& world)
+{
+	if (depthLevels.empty())
+		return;
+
+	auto transform = XMMatrixMultiply(world, XMLoadFloat4x4(&viewProjection));
+	auto& heightField = terrainPatch.MipLevels[terrainPatch.CurrentMip];
+	auto extentX = heightField.ExtentX;
+	auto extentY = heightField.ExtentY;
+	auto offset = XMLoadFloat3(&terrainPatch.MeshOffset);
+
+	vector<XMFLOAT3> screen(extentX * extentY);
+	vector<uint8_t> projected(extentX * extentY);
+
+	for (size_t yLoc = 0, i = 0; yLoc < extentY; ++yLoc)
+	{
+		for (size_t xLoc = 0; xLoc < extentX; ++xLoc, ++i)
+		{
+			auto position = XMVectorSet(static_cast<float>(xLoc) * terrainPatch.CellSize.x,
+				heightField.Heights[i] * terrainPatch.CellSize.y,
+				static_cast<float>(yLoc) * terrainPatch.CellSize.z,
+				1.0f);
+
+			projected[i] = ProjectVertex(position + offset, transform, &screen[i]);
+		}
+	}
+
+	for (size_t yLoc = 0; yLoc + 1 < extentY; ++yLoc)
+	{
+		for (size_t xLoc = 1; xLoc < extentX; ++xLoc)
+		{
+			auto i00 = xLoc - 1 + yLoc * extentX;
+			auto i10 = xLoc + yLoc * extentX;
+			auto i01 = xLoc - 1 + (yLoc + 1) * extentX;
+			auto i11 = xLoc + (yLoc + 1) * extentX;
+
+			if (!projected[i00] || !projected[i10] || !projected[i01] || !projected[i11])
+				continue;
+
+			if ((xLoc - 1 + yLoc) % 2 == 0)
+			{
+				RasterizeTriangle(screen[i00], screen[i01], screen[i10]);
+				RasterizeTriangle(screen[i10], screen[i01], screen[i11]);
+			}
+			else
+			{
+				RasterizeTriangle(screen[i01], screen[i11], screen[i00]);
+				RasterizeTriangle(screen[i00], screen[i11], screen[i10]);
+			}
+		}
+	}
+
+	triangleCount += 2 * (extentX - 1) * (extentY - 1);
+	++occluderCount;
+}
+
+bool OcclusionBuffer::RasterizeNode(const SceneNode* node)
+{
+	auto world = XMLoadFloat4x4(&node->Transform.Global);
+
+	if (node->IsStaticMesh() || node->IsStaticMeshInstanced())
+	{
+		auto occluderMesh = node->Ref.StaticMesh->GetOccluderMesh();
+		if (occluderMesh == nullptr)
+			return false;
+
+		RasterizeOccluder(*occluderMesh, world);
+		return true;
+	}
+	else if (node->IsTerrainPatch())
+	{
+		RasterizeTerrainPatch(*node->Ref.TerrainPatch, world);
+		return true;
+	}
+
+	return false;
+}
+
+// Both windings are rasterized, since depth only ever moves nearer. Depth is interpolated
+// linearly in screen space, which is exact for post projection depth.
+void OcclusionBuffer::RasterizeTriangle(const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2)
+{
+	const XMFLOAT3* a = &v0;
+	const XMFLOAT3* b = &v1;
+	const XMFLOAT3* c = &v2;
+
+	float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+	if (area < 0.0f)
+	{
+		swap(b, c);
+		area = -area;
+	}
+
+	if (!(area > 0.0f))
+		return;
+
+	float minX = max(min(min(a->x, b->x), c->x), 0.0f);
+	float minY = max(min(min(a->y, b->y), c->y), 0.0f);
+	float maxX = min(max(max(a->x, b->x), c->x), static_cast<float>(width - 1));
+	float maxY = min(max(max(a->y, b->y), c->y), static_cast<float>(height - 1));
+
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// Edge functions are positive on the inside of each edge, evaluated at pixel centers
+	const XMFLOAT3* edgeStart[3] = { a, b, c };
+	const XMFLOAT3* edgeEnd[3] = { b, c, a };
+	float edgeA[3];
+	float edgeB[3];
+	float edgeC[3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		edgeA[i] = edgeStart[i]->y - edgeEnd[i]->y;
+		edgeB[i] = edgeEnd[i]->x - edgeStart[i]->x;
+		edgeC[i] = -(edgeA[i] * edgeStart[i]->x + edgeB[i] * edgeStart[i]->y);
+	}
+
+	// The weight of each vertex is the edge function of the opposite edge over the area
+	float invArea = 1.0f / area;
+	float depthA = (edgeA[1] * a->z + edgeA[2] * b->z + edgeA[0] * c->z) * invArea;
+	float depthB = (edgeB[1] * a->z + edgeB[2] * b->z + edgeB[0] * c->z) * invArea;
+	float depthC = (edgeC[1] * a->z + edgeC[2] * b->z + edgeC[0] * c->z) * invArea;
+
+	XMVECTOR edgeAVec[3];
+	for (int i = 0; i < 3; ++i)
+		edgeAVec[i] = XMVectorReplicate(edgeA[i]);
+	auto depthAVec = XMVectorReplicate(depthA);
+	auto laneOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	auto zero = XMVectorZero();
+
+	auto& depths = depthLevels[0];
+	auto tileMinX = static_cast<uint32_t>(minX) / OCCLUSION_TILE_SIZE;
+	auto tileMinY = static_cast<uint32_t>(minY) / OCCLUSION_TILE_SIZE;
+	auto tileMaxX = static_cast<uint32_t>(maxX) / OCCLUSION_TILE_SIZE;
+	auto tileMaxY = static_cast<uint32_t>(maxY) / OCCLUSION_TILE_SIZE;
+
+	for (auto tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+	{
+		auto tileTop = tileY * OCCLUSION_TILE_SIZE;
+
+		for (auto tileX = tileMinX; tileX <= tileMaxX; ++tileX)
+		{
+			auto tileLeft = tileX * OCCLUSION_TILE_SIZE;
+
+			// Skip tiles entirely outside any edge, judged by the pixel center furthest inside it
+			bool bOutside = false;
+			for (int i = 0; i < 3 && !bOutside; ++i)
+			{
+				float x = static_cast<float>(tileLeft) + (edgeA[i] > 0.0f ? OCCLUSION_TILE_SIZE - 0.5f : 0.5f);
+				float y = static_cast<float>(tileTop) + (edgeB[i] > 0.0f ? OCCLUSION_TILE_SIZE - 0.5f : 0.5f);
+				bOutside = edgeA[i] * x + edgeB[i] * y + edgeC[i] < 0.0f;
+			}
+
+			if (bOutside)
+				continue;
+
+			for (auto y = tileTop; y < tileTop + OCCLUSION_TILE_SIZE; ++y)
+			{
+				float centerY = static_cast<float>(y) + 0.5f;
+				XMVECTOR edgeRow[3];
+				for (int i = 0; i < 3; ++i)
+					edgeRow[i] = XMVectorReplicate(edgeB[i] * centerY + edgeC[i]);
+				auto depthRow = XMVectorReplicate(depthB * centerY + depthC);
+
+				for (auto x = tileLeft; x < tileLeft + OCCLUSION_TILE_SIZE; x += 4)
+				{
+					auto centerX = XMVectorAdd(XMVectorReplicate(static_cast<float>(x)), laneOffsets);
+
+					auto inside = XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeAVec[0], centerX, edgeRow[0]), zero);
+					inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeAVec[1], centerX, edgeRow[1]), zero));
+					inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorMultiplyAdd(edgeAVec[2], centerX, edgeRow[2]), zero));
+
+					auto pixels = reinterpret_cast<XMFLOAT4*>(&depths[y * width + x]);
+					auto current = XMLoadFloat4(pixels);
+					auto depth = XMVectorMultiplyAdd(depthAVec, centerX, depthRow);
+					XMStoreFloat4(pixels, XMVectorSelect(current, XMVectorMin(current, depth), inside));
+				}
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::BuildDepthHierarchy()
+{
+	for (size_t level = 1; level < depthLevels.size(); ++level)
+	{
+		auto& source = depthLevels[level - 1];
+		auto& destination = depthLevels[level];
+		auto sourceWidth = levelWidths[level - 1];
+		auto sourceHeight = levelHeights[level - 1];
+		auto levelWidth = levelWidths[level];
+		auto levelHeight = levelHeights[level];
+
+		for (uint32_t y = 0; y < levelHeight; ++y)
+		{
+			auto y0 = 2 * y;
+			auto y1 = min(y0 + 1, sourceHeight - 1);
+
+			for (uint32_t x = 0; x < levelWidth; ++x)
+			{
+				auto x0 = 2 * x;
+				auto x1 = min(x0 + 1, sourceWidth - 1);
+
+				destination[y * levelWidth + x] = max(
+					max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+					max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::End()
+{
+	if (depthLevels.empty())
+		return;
+
+	BuildDepthHierarchy();
+	bFinished = true;
+	rasterTime = chrono::duration<double, milli>(chrono::steady_clock::now() - rasterStart).count();
+}
+
+// Starting from the coarsest level the rectangle fits in, texels that are not nearer than the
+// box are refined until either every part of the rectangle is found occluded or a full
+// resolution pixel is not.
+bool OcclusionBuffer::IsRectOccluded(const uint32_t level, const uint32_t minX, const uint32_t minY,
+	const uint32_t maxX, const uint32_t maxY, const float depth) const
+{
+	auto& depths = depthLevels[level];
+	auto levelWidth = levelWidths[level];
+
+	for (auto texelY = minY >> level; texelY <= maxY >> level; ++texelY)
+	{
+		for (auto texelX = minX >> level; texelX <= maxX >> level; ++texelX)
+		{
+			if (depths[texelY * levelWidth + texelX] < depth)
+				continue;
+
+			if (level == 0)
+				return false;
+
+			auto texelMinX = max(minX, texelX << level);
+			auto texelMinY = max(minY, texelY << level);
+			auto texelMaxX = min(maxX, ((texelX + 1) << level) - 1);
+			auto texelMaxY = min(maxY, ((texelY + 1) << level) - 1);
+
+			if (!IsRectOccluded(level - 1, texelMinX, texelMinY, texelMaxX, texelMaxY, depth))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool OcclusionBuffer::IsOccluded(const Bounds& bounds) const
+{
+	if (!bFinished)
+		return false;
+
+	testCount.fetch_add(1, memory_order_relaxed);
+
+	auto transform = XMLoadFloat4x4(&viewProjection);
+	float minX = numeric_limits<float>::infinity();
+	float minY = numeric_limits<float>::infinity();
+	float maxX = -numeric_limits<float>::infinity();
+	float maxY = -numeric_limits<float>::infinity();
+	float minDepth = numeric_limits<float>::infinity();
+
+	// The corners are reached from the transformed lower corner by adding the transformed edges
+	// of the box. The nearest point of a box in front of the camera is one of its corners.
+	auto lower = XMVector4Transform(XMVectorSet(bounds.Lower.x, bounds.Lower.y, bounds.Lower.z, 1.0f), transform);
+	XMVECTOR edges[3] =
+	{
+		XMVectorScale(transform.r[0], bounds.Upper.x - bounds.Lower.x),
+		XMVectorScale(transform.r[1], bounds.Upper.y - bounds.Lower.y),
+		XMVectorScale(transform.r[2], bounds.Upper.z - bounds.Lower.z)
+	};
+
+	for (int i = 0; i < 8; ++i)
+	{
+		auto corner = lower;
+		if ((i & 1) != 0)
+			corner = XMVectorAdd(corner, edges[0]);
+		if ((i & 2) != 0)
+			corner = XMVectorAdd(corner, edges[1]);
+		if ((i & 4) != 0)
+			corner = XMVectorAdd(corner, edges[2]);
+
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, corner);
+		if (!(clip.w >= OCCLUSION_NEAR_CLIP_W))
+			return false;
+
+		float invW = 1.0f / clip.w;
+		float screenX = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(width);
+		float screenY = (0.5f - clip.y * invW * 0.5f) * static_cast<float>(height);
+
+		minX = min(minX, screenX);
+		minY = min(minY, screenY);
+		maxX = max(maxX, screenX);
+		maxY = max(maxY, screenY);
+		minDepth = min(minDepth, clip.z * invW);
+	}
+
+	if (!(minDepth > 0.0f) || maxX < 0.0f || maxY < 0.0f ||
+		minX >= static_cast<float>(width) || minY >= static_cast<float>(height))
+		return false;
+
+	// Grow the rectangle by a pixel, since pixels are only covered by occluders at their centers
+	auto rectMinX = static_cast<uint32_t>(max(minX - 1.0f, 0.0f));
+	auto rectMinY = static_cast<uint32_t>(max(minY - 1.0f, 0.0f));
+	auto rectMaxX = static_cast<uint32_t>(min(maxX + 1.0f, static_cast<float>(width - 1)));
+	auto rectMaxY = static_cast<uint32_t>(min(maxY + 1.0f, static_cast<float>(height - 1)));
+
+	uint32_t level = 0;
+	while (level + 1 < depthLevels.size() &&
+		((rectMaxX >> level) - (rectMinX >> level) > 1 || (rectMaxY >> level) - (rectMinY >> level) > 1))
+		++level;
+
+	if (!IsRectOccluded(level, rectMinX, rectMinY, rectMaxX, rectMaxY, minDepth))
+		return false;
+
+	culledCount.fetch_add(1, memory_order_relaxed);
+	return true;
+}
+
+void OcclusionBuffer::GetStats(OcclusionStats* statsOut) const
+{
+	statsOut->OccluderCount = occluderCount;
+	statsOut->TriangleCount = triangleCount;
+	statsOut->TestCount = testCount.load();
+	statsOut->CulledCount = culledCount.load();
+	statsOut->RasterTime = rasterTime;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef OCCLUSION_CULLING_H_
+#define OCCLUSION_CULLING_H_
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <DirectXMath.h>
+
+#include "Geometry.h"
+
+class SceneNode;
+class TerrainPatch;
+
+#define DEFAULT_OCCLUSION_BUFFER_WIDTH 320
+#define DEFAULT_OCCLUSION_BUFFER_HEIGHT 192
+// Triangles are rasterized in square tiles of this many pixels, which must be a multiple of four
+#define OCCLUSION_TILE_SIZE 8
+// Clip space w below which geometry is treated as crossing the near plane
+#define OCCLUSION_NEAR_CLIP_W 1e-4f
+
+// Simplified triangles standing in for a mesh when it is rasterized as an occluder. The
+// triangles must not cover anything the mesh itself does not, or they would hide visible objects.
+struct OccluderMesh
+{
+	std::vector<DirectX::XMFLOAT3> Positions;
+	std::vector<uint32_t> Indices;
+};
+
+struct OcclusionStats
+{
+	size_t OccluderCount;
+	size_t TriangleCount;
+	size_t TestCount;
+	size_t CulledCount;
+	// Milliseconds spent rasterizing occluders and building the depth hierarchy
+	double RasterTime;
+};
+
+// A low resolution depth buffer that occluders are rasterized into on the CPU, along with a
+// hierarchy of coarser levels that each hold the farthest depth of the texels below them.
+// Boxes are occluded if every texel they cover holds a depth nearer than the nearest point
+// of the box. Occlusion tests may be made from several threads once the buffer is finished.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	bool Initialize(const uint32_t width, const uint32_t height);
+	void Destroy();
+
+	// Clears the buffer for a new view. Occluders are rasterized between Begin and End.
+	void Begin(const DirectX::XMMATRIX& viewProjection);
+	void RasterizeOccluder(const OccluderMesh& mesh, const DirectX::XMMATRIX& world);
+	void RasterizeTerrainPatch(const TerrainPatch& terrainPatch, const DirectX::XMMATRIX& world);
+	bool RasterizeNode(const SceneNode* node);
+	void End();
+
+	bool IsOccluded(const Bounds& bounds) const;
+
+	inline bool HasOccluders() const;
+	inline uint32_t GetWidth() const;
+	inline uint32_t GetHeight() const;
+	inline float GetDepth(const uint32_t x, const uint32_t y) const;
+	void GetStats(OcclusionStats* statsOut) const;
+
+protected:
+	uint32_t width;
+	uint32_t height;
+	// The first level is the full resolution buffer, each following level is half the size
+	std::vector<std::vector<float>> depthLevels;
+	std::vector<uint32_t> levelWidths;
+	std::vector<uint32_t> levelHeights;
+	DirectX::XMFLOAT4X4 viewProjection;
+	bool bFinished;
+
+	size_t occluderCount;
+	size_t triangleCount;
+	double rasterTime;
+	std::chrono::steady_clock::time_point rasterStart;
+	mutable std::atomic<size_t> testCount;
+	mutable std::atomic<size_t> culledCount;
+
+	bool ProjectVertex(const DirectX::XMVECTOR& position, const DirectX::XMMATRIX& transform,
+		DirectX::XMFLOAT3* screenOut) const;
+	void RasterizeTriangle(const DirectX::XMFLOAT3& v0, const DirectX::XMFLOAT3& v1, const DirectX::XMFLOAT3& v2);
+	void BuildDepthHierarchy();
+	bool IsRectOccluded(const uint32_t level, const uint32_t minX, const uint32_t minY,
+		const uint32_t maxX, const uint32_t maxY, const float depth) const;
+
+private:
+	OcclusionBuffer(const OcclusionBuffer&);
+	OcclusionBuffer& operator=(const OcclusionBuffer&);
+};
+
+inline bool OcclusionBuffer::HasOccluders() const
+{
+	return bFinished && occluderCount > 0;
+}
+
+inline uint32_t OcclusionBuffer::GetWidth() const
+{
+	return width;
+}
+
+inline uint32_t OcclusionBuffer::GetHeight() const
+{
+	return height;
+}
+
+inline float OcclusionBuffer::GetDepth(const uint32_t x, const uint32_t y) const
+{
+	return depthLevels[0][y * width + x];
+}
+
+#endif
\ No newline at end of file
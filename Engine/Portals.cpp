@@ -0,0 +1,207 @@
+#include "Portals.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <limits>
+
+using namespace DirectX;
+using namespace std;
+
+inline bool ContainsPoint(const Bounds& bounds, const XMFLOAT3& point)
+{
+	return point.x >= bounds.Lower.x && point.x <= bounds.Upper.x &&
+		point.y >= bounds.Lower.y && point.y <= bounds.Upper.y &&
+		point.z >= bounds.Lower.z && point.z <= bounds.Upper.z;
+}
+
+inline bool ContainsRect(const PortalRect& rect, const PortalRect& other)
+{
+	return other.MinX >= rect.MinX && other.MinY >= rect.MinY &&
+		other.MaxX <= rect.MaxX && other.MaxY <= rect.MaxY;
+}
+
+// The plane where a clip space coordinate equals limit * w. Side is 1 to keep the coordinate
+// below the limit and -1 to keep it above.
+inline void ConstructClipPlane(const XMFLOAT4X4& viewProjection, const int axis, const float limit,
+	const float side, Plane* planeOut)
+{
+	auto& m = viewProjection.m;
+	auto normal = XMVectorSet(
+		side * (m[0][axis] - limit * m[0][3]),
+		side * (m[1][axis] - limit * m[1][3]),
+		side * (m[2][axis] - limit * m[2][3]),
+		0.0f);
+	float offset = side * (m[3][axis] - limit * m[3][3]);
+
+	float length = XMVectorGetX(XMVector3Length(normal));
+	XMStoreFloat3(&planeOut->Normal, XMVectorScale(normal, 1.0f / length));
+	planeOut->Distance = -offset / length;
+}
+
+void AddZonePortal(SceneNode* zone1, SceneNode* zone2, const vector<XMFLOAT3>& points)
+{
+	if (!zone1->IsZone() || !zone2->IsZone())
+	{
+		OutputDebugString("Portals can only link zones!\n");
+		return;
+	}
+
+	if (points.size() < 3)
+	{
+		OutputDebugString("Portal polygons need at least three points!\n");
+		return;
+	}
+
+	ZonePortal portal;
+	portal.Points = points;
+	SetEmptyBounds(&portal.AABB);
+	for (auto& point : points)
+		ExpandBounds(&portal.AABB, point);
+
+	portal.Target = zone2;
+	zone1->Ref.ZoneData->Portals.push_back(portal);
+	portal.Target = zone1;
+	zone2->Ref.ZoneData->Portals.push_back(portal);
+}
+
+void RemoveZonePortals(SceneNode* zone1, SceneNode* zone2)
+{
+	auto& portals1 = zone1->Ref.ZoneData->Portals;
+	portals1.erase(remove_if(portals1.begin(), portals1.end(),
+		[zone2](const ZonePortal& portal) { return portal.Target == zone2; }), portals1.end());
+
+	auto& portals2 = zone2->Ref.ZoneData->Portals;
+	portals2.erase(remove_if(portals2.begin(), portals2.end(),
+		[zone1](const ZonePortal& portal) { return portal.Target == zone1; }), portals2.end());
+}
+
+SceneNode* FindPortalZone(SceneNode* zone, const XMFLOAT3& position)
+{
+	for (auto child : zone->Children)
+	{
+		if (!child->IsZone() || !ContainsPoint(child->Region.AABB, position))
+			continue;
+
+		// Zones without portals may still contain zones with them
+		auto found = FindPortalZone(child, position);
+		if (found != child || IsPortalZone(child))
+			return found;
+	}
+
+	return zone;
+}
+
+bool ClipPortal(const ZonePortal& portal, const XMFLOAT4X4& viewProjection, const PortalRect& rect,
+	PortalRect* rectOut)
+{
+	auto transform = XMLoadFloat4x4(&viewProjection);
+	auto infinity = numeric_limits<float>::infinity();
+	PortalRect projected = { infinity, infinity, -infinity, -infinity };
+	bool bCrossesNear = false;
+	bool bInFront = false;
+
+	for (auto& point : portal.Points)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(point.x, point.y, point.z, 1.0f), transform));
+
+		if (!(clip.w >= PORTAL_NEAR_CLIP_W))
+		{
+			bCrossesNear = true;
+			continue;
+		}
+
+		bInFront = true;
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		projected.MinX = min(projected.MinX, x);
+		projected.MinY = min(projected.MinY, y);
+		projected.MaxX = max(projected.MaxX, x);
+		projected.MaxY = max(projected.MaxY, y);
+	}
+
+	if (!bInFront)
+		return false;
+
+	// Points behind the camera do not project to anywhere meaningful, so a portal crossing
+	// the near plane is treated as covering the whole rectangle
+	if (bCrossesNear)
+	{
+		*rectOut = rect;
+		return true;
+	}
+
+	rectOut->MinX = max(projected.MinX, rect.MinX);
+	rectOut->MinY = max(projected.MinY, rect.MinY);
+	rectOut->MaxX = min(projected.MaxX, rect.MaxX);
+	rectOut->MaxY = min(projected.MaxY, rect.MaxY);
+
+	return rectOut->MinX < rectOut->MaxX && rectOut->MinY < rectOut->MaxY;
+}
+
+void ConstructPortalFrustum(const PortalRect& rect, const XMFLOAT4X4& viewProjection,
+	const Frustum& cameraFrustum, Frustum* frustumOut)
+{
+	*frustumOut = cameraFrustum;
+
+	// The near and far planes are kept, and side planes are only replaced where the rectangle
+	// is narrower than the screen. ConstructFrustum's "left" plane faces +x in view space, which
+	// is the right edge of the screen, so the left edge of the rectangle replaces its "right" plane.
+	if (rect.MaxY < 1.0f)
+		ConstructClipPlane(viewProjection, 1, rect.MaxY, 1.0f, &frustumOut->Planes[2]);
+	if (rect.MinY > -1.0f)
+		ConstructClipPlane(viewProjection, 1, rect.MinY, -1.0f, &frustumOut->Planes[3]);
+	if (rect.MaxX < 1.0f)
+		ConstructClipPlane(viewProjection, 0, rect.MaxX, 1.0f, &frustumOut->Planes[4]);
+	if (rect.MinX > -1.0f)
+		ConstructClipPlane(viewProjection, 0, rect.MinX, -1.0f, &frustumOut->Planes[5]);
+}
+
+void CollectPortalVisits(SceneNode* cameraZone, const Frustum& cameraFrustum, const XMFLOAT4X4& viewProjection,
+	vector<PortalVisit>* visitsOut)
+{
+	visitsOut->clear();
+
+	PortalVisit cameraVisit = { cameraZone, { -1.0f, -1.0f, 1.0f, 1.0f } };
+	visitsOut->push_back(cameraVisit);
+
+	// A zone is visited again whenever it is reached through part of the screen it was not
+	// reached through before. Rectangles only grow, and only ever take their edges from
+	// portals or the screen, so the flood ends once no portal widens any of them.
+	vector<size_t> pending(1, 0);
+
+	while (!pending.empty())
+	{
+		auto visitIndex = pending.back();
+		pending.pop_back();
+
+		auto zone = (*visitsOut)[visitIndex].Zone;
+		auto rect = (*visitsOut)[visitIndex].Rect;
+
+		for (auto& portal : zone->Ref.ZoneData->Portals)
+		{
+			PortalRect portalRect;
+			if (IsOutsideFrustum(portal.AABB, cameraFrustum) ||
+				!ClipPortal(portal, viewProjection, rect, &portalRect))
+				continue;
+
+			auto target = find_if(visitsOut->begin(), visitsOut->end(),
+				[&portal](const PortalVisit& visit) { return visit.Zone == portal.Target; });
+
+			if (target == visitsOut->end())
+			{
+				PortalVisit visit = { portal.Target, portalRect };
+				pending.push_back(visitsOut->size());
+				visitsOut->push_back(visit);
+			}
+			else if (!ContainsRect(target->Rect, portalRect))
+			{
+				target->Rect.MinX = min(target->Rect.MinX, portalRect.MinX);
+				target->Rect.MinY = min(target->Rect.MinY, portalRect.MinY);
+				target->Rect.MaxX = max(target->Rect.MaxX, portalRect.MaxX);
+				target->Rect.MaxY = max(target->Rect.MaxY, portalRect.MaxY);
+				pending.push_back(target - visitsOut->begin());
+			}
+		}
+	}
+}
\ No newline at end of file
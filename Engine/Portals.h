@@ -0,0 +1,57 @@
+#ifndef PORTALS_H_
+#define PORTALS_H_
+
+#include <vector>
+#include <DirectXMath.h>
+
+#include "Geometry.h"
+#include "SceneGraph.h"
+
+// Clip space w below which a portal is treated as crossing the near plane
+#define PORTAL_NEAR_CLIP_W 1e-4f
+
+// A rectangle of the screen in normalized device coordinates
+struct PortalRect
+{
+	float MinX;
+	float MinY;
+	float MaxX;
+	float MaxY;
+};
+
+// A zone reached through portals, along with the part of the screen it is seen through
+struct PortalVisit
+{
+	SceneNode* Zone;
+	PortalRect Rect;
+};
+
+// Adds a portal to both zones, each leading to the other
+void AddZonePortal(SceneNode* zone1, SceneNode* zone2, const std::vector<DirectX::XMFLOAT3>& points);
+void RemoveZonePortals(SceneNode* zone1, SceneNode* zone2);
+
+// Returns the deepest zone with portals below the given zone that contains the position,
+// or the given zone if there is none
+SceneNode* FindPortalZone(SceneNode* zone, const DirectX::XMFLOAT3& position);
+
+// Outputs the part of the rectangle covered by the portal on screen. Returns false if the
+// portal covers none of it.
+bool ClipPortal(const ZonePortal& portal, const DirectX::XMFLOAT4X4& viewProjection, const PortalRect& rect,
+	PortalRect* rectOut);
+// Narrows the side planes of the camera frustum to those of the rectangle
+void ConstructPortalFrustum(const PortalRect& rect, const DirectX::XMFLOAT4X4& viewProjection,
+	const Frustum& cameraFrustum, Frustum* frustumOut);
+
+// Floods out from the camera's zone through every visible portal. Each zone reached is output
+// once, with the union of the rectangles of the portal chains it was reached through.
+void CollectPortalVisits(SceneNode* cameraZone, const Frustum& cameraFrustum,
+	const DirectX::XMFLOAT4X4& viewProjection, std::vector<PortalVisit>* visitsOut);
+
+inline bool IsPortalZone(const SceneNode* node);
+
+inline bool IsPortalZone(const SceneNode* node)
+{
+	return node->IsZone() && !node->Ref.ZoneData->Portals.empty();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "RecordingRenderContext.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+RecordingRenderContext::RecordingRenderContext()
+{
+	ZeroMemory(commandCounts, sizeof(commandCounts));
+}
+
+RecordingRenderContext::~RecordingRenderContext()
+{
+	for (auto buffer : buffers)
+		delete buffer;
+	for (auto query : queries)
+		delete query;
+}
+
+RecordingRenderContext::RecordedBuffer* RecordingRenderContext::FindBuffer(const void* object) const
+{
+	auto it = find(buffers.begin(), buffers.end(), object);
+	return it != buffers.end() ? *it : nullptr;
+}
+
+RecordingRenderContext::RecordedQuery* RecordingRenderContext::FindQuery(const void* object) const
+{
+	auto it = find(queries.begin(), queries.end(), object);
+	return it != queries.end() ? *it : nullptr;
+}
+
+void RecordingRenderContext::Record(const RenderCommandType type, const UINT value0, const UINT value1,
+	const UINT value2, const UINT value3)
+{
+	RenderCommand command = { type, { value0, value1, value2, value3 },
+		static_cast<uint32_t>(commandObjects.size()), 0 };
+	commands.push_back(command);
+	++commandCounts[type];
+}
+
+void RecordingRenderContext::ClearCommands()
+{
+	commands.clear();
+	commandObjects.clear();
+	ZeroMemory(commandCounts, sizeof(commandCounts));
+}
+
+const uint8_t* RecordingRenderContext::GetBufferData(const ID3D11Buffer* buffer, size_t* sizeOut) const
+{
+	auto recordedBuffer = FindBuffer(buffer);
+	if (recordedBuffer == nullptr)
+	{
+		*sizeOut = 0;
+		return nullptr;
+	}
+
+	*sizeOut = recordedBuffer->Data.size();
+	return recordedBuffer->Data.data();
+}
+
+HRESULT RecordingRenderContext::CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+	ID3D11Buffer** bufferOut)
+{
+	auto buffer = new RecordedBuffer;
+	buffer->Desc = *desc;
+	buffer->Data.resize(desc->ByteWidth);
+	if (initialData != nullptr)
+		memcpy(buffer->Data.data(), initialData->pSysMem, desc->ByteWidth);
+
+	buffers.push_back(buffer);
+	*bufferOut = reinterpret_cast<ID3D11Buffer*>(buffer);
+	return S_OK;
+}
+
+HRESULT RecordingRenderContext::CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut)
+{
+	auto query = new RecordedQuery;
+	query->bEnded = false;
+
+	queries.push_back(query);
+	*queryOut = reinterpret_cast<ID3D11Query*>(query);
+	return S_OK;
+}
+
+void RecordingRenderContext::Release(ID3D11DeviceChild* object)
+{
+	auto buffer = find(buffers.begin(), buffers.end(), static_cast<const void*>(object));
+	if (buffer != buffers.end())
+	{
+		delete *buffer;
+		buffers.erase(buffer);
+		return;
+	}
+
+	auto query = find(queries.begin(), queries.end(), static_cast<const void*>(object));
+	if (query != queries.end())
+	{
+		delete *query;
+		queries.erase(query);
+	}
+}
+
+void RecordingRenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4])
+{
+	Record(RENDER_COMMAND_TYPE_CLEAR_RENDER_TARGET);
+	RecordObject(renderTarget);
+}
+
+void RecordingRenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags,
+	FLOAT depth, UINT8 stencil)
+{
+	Record(RENDER_COMMAND_TYPE_CLEAR_DEPTH_STENCIL, clearFlags);
+	RecordObject(depthStencilView);
+}
+
+void RecordingRenderContext::OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+	ID3D11DepthStencilView* depthStencilView)
+{
+	// The depth stencil view follows the render targets
+	Record(RENDER_COMMAND_TYPE_SET_RENDER_TARGETS, 0, viewCount);
+	RecordObjects(renderTargets, viewCount);
+	RecordObject(depthStencilView);
+}
+
+void RecordingRenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	Record(RENDER_COMMAND_TYPE_SET_DEPTH_STENCIL_STATE);
+	RecordObject(state);
+}
+
+void RecordingRenderContext::RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports)
+{
+	Record(RENDER_COMMAND_TYPE_SET_VIEWPORTS, 0, viewportCount);
+}
+
+void RecordingRenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+	Record(RENDER_COMMAND_TYPE_SET_RASTERIZER_STATE);
+	RecordObject(state);
+}
+
+void RecordingRenderContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	Record(RENDER_COMMAND_TYPE_SET_PRIMITIVE_TOPOLOGY, topology);
+}
+
+void RecordingRenderContext::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	Record(RENDER_COMMAND_TYPE_SET_INPUT_LAYOUT);
+	RecordObject(inputLayout);
+}
+
+void RecordingRenderContext::IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+	const UINT* strides, const UINT* offsets)
+{
+	Record(RENDER_COMMAND_TYPE_SET_VERTEX_BUFFERS, startSlot, bufferCount, bufferCount > 0 ? strides[0] : 0,
+		bufferCount > 0 ? offsets[0] : 0);
+	RecordObjects(buffers, bufferCount);
+}
+
+void RecordingRenderContext::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	Record(RENDER_COMMAND_TYPE_SET_INDEX_BUFFER, format, offset);
+	RecordObject(buffer);
+}
+
+void RecordingRenderContext::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	Record(RENDER_COMMAND_TYPE_SET_VERTEX_SHADER);
+	RecordObject(shader);
+}
+
+void RecordingRenderContext::VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	Record(RENDER_COMMAND_TYPE_SET_VERTEX_CONSTANT_BUFFERS, startSlot, bufferCount);
+	RecordObjects(buffers, bufferCount);
+}
+
+void RecordingRenderContext::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	Record(RENDER_COMMAND_TYPE_SET_PIXEL_SHADER);
+	RecordObject(shader);
+}
+
+void RecordingRenderContext::PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	Record(RENDER_COMMAND_TYPE_SET_PIXEL_CONSTANT_BUFFERS, startSlot, bufferCount);
+	RecordObjects(buffers, bufferCount);
+}
+
+void RecordingRenderContext::PSSetShaderResources(UINT startSlot, UINT viewCount,
+	ID3D11ShaderResourceView* const* views)
+{
+	Record(RENDER_COMMAND_TYPE_SET_PIXEL_SHADER_RESOURCES, startSlot, viewCount);
+	RecordObjects(views, viewCount);
+}
+
+void RecordingRenderContext::PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers)
+{
+	Record(RENDER_COMMAND_TYPE_SET_PIXEL_SAMPLERS, startSlot, samplerCount);
+	RecordObjects(samplers, samplerCount);
+}
+
+HRESULT RecordingRenderContext::Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+	D3D11_MAPPED_SUBRESOURCE* mappedOut)
+{
+	Record(RENDER_COMMAND_TYPE_MAP, mapType);
+	RecordObject(resource);
+
+	auto buffer = FindBuffer(resource);
+	if (buffer == nullptr)
+	{
+		OutputDebugString("Only buffers created through the recording context can be mapped!\n");
+		return E_INVALIDARG;
+	}
+
+	mappedOut->pData = buffer->Data.data();
+	mappedOut->RowPitch = static_cast<UINT>(buffer->Data.size());
+	mappedOut->DepthPitch = mappedOut->RowPitch;
+	return S_OK;
+}
+
+void RecordingRenderContext::Unmap(ID3D11Resource* resource, UINT subresource)
+{
+	Record(RENDER_COMMAND_TYPE_UNMAP);
+	RecordObject(resource);
+}
+
+void RecordingRenderContext::Draw(UINT vertexCount, UINT startVertex)
+{
+	Record(RENDER_COMMAND_TYPE_DRAW, vertexCount, 1, startVertex, 0);
+}
+
+void RecordingRenderContext::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex,
+	INT baseVertex, UINT startInstance)
+{
+	Record(RENDER_COMMAND_TYPE_DRAW_INDEXED_INSTANCED, indexCount, instanceCount, startIndex, startInstance);
+}
+
+void RecordingRenderContext::End(ID3D11Asynchronous* query)
+{
+	Record(RENDER_COMMAND_TYPE_END_QUERY);
+	RecordObject(query);
+
+	auto recordedQuery = FindQuery(query);
+	if (recordedQuery != nullptr)
+		recordedQuery->bEnded = true;
+}
+
+HRESULT RecordingRenderContext::GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags)
+{
+	// Nothing runs behind the context, so a query has passed as soon as it has been ended
+	auto recordedQuery = FindQuery(query);
+	if (recordedQuery == nullptr)
+		return E_INVALIDARG;
+
+	if (!recordedQuery->bEnded)
+		return S_FALSE;
+
+	if (data != nullptr && dataSize >= sizeof(BOOL))
+		*static_cast<BOOL*>(data) = TRUE;
+	return S_OK;
+}
+
+HRESULT RecordingRenderContext::Present(UINT syncInterval, UINT flags)
+{
+	Record(RENDER_COMMAND_TYPE_PRESENT, syncInterval);
+	return S_OK;
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#ifndef RECORDING_RENDER_CONTEXT_H_
+#define RECORDING_RENDER_CONTEXT_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "RenderContext.h"
+
+enum RenderCommandType
+{
+	RENDER_COMMAND_TYPE_CLEAR_RENDER_TARGET,
+	RENDER_COMMAND_TYPE_CLEAR_DEPTH_STENCIL,
+	RENDER_COMMAND_TYPE_SET_RENDER_TARGETS,
+	RENDER_COMMAND_TYPE_SET_DEPTH_STENCIL_STATE,
+	RENDER_COMMAND_TYPE_SET_VIEWPORTS,
+	RENDER_COMMAND_TYPE_SET_RASTERIZER_STATE,
+	RENDER_COMMAND_TYPE_SET_PRIMITIVE_TOPOLOGY,
+	RENDER_COMMAND_TYPE_SET_INPUT_LAYOUT,
+	RENDER_COMMAND_TYPE_SET_VERTEX_BUFFERS,
+	RENDER_COMMAND_TYPE_SET_INDEX_BUFFER,
+	RENDER_COMMAND_TYPE_SET_VERTEX_SHADER,
+	RENDER_COMMAND_TYPE_SET_VERTEX_CONSTANT_BUFFERS,
+	RENDER_COMMAND_TYPE_SET_PIXEL_SHADER,
+	RENDER_COMMAND_TYPE_SET_PIXEL_CONSTANT_BUFFERS,
+	RENDER_COMMAND_TYPE_SET_PIXEL_SHADER_RESOURCES,
+	RENDER_COMMAND_TYPE_SET_PIXEL_SAMPLERS,
+	RENDER_COMMAND_TYPE_MAP,
+	RENDER_COMMAND_TYPE_UNMAP,
+	RENDER_COMMAND_TYPE_DRAW,
+	RENDER_COMMAND_TYPE_DRAW_INDEXED_INSTANCED,
+	RENDER_COMMAND_TYPE_END_QUERY,
+	RENDER_COMMAND_TYPE_PRESENT,
+	RENDER_COMMAND_TYPE_COUNT
+};
+
+// One call made on a recording context. The objects it was given are kept in the log's object
+// list, from ObjectOffset on. The values depend on the type:
+//  - binds of several objects: the first slot and the object count, and for vertex buffers the
+//    stride and offset of the first
+//  - draws: the index or vertex count, the instance count, the first index or vertex and the
+//    first instance
+//  - maps: the map type
+//  - clears: the clear flags of depth stencil views
+//  - presents: the sync interval
+struct RenderCommand
+{
+	RenderCommandType Type;
+	UINT Values[4];
+	uint32_t ObjectOffset;
+	uint32_t ObjectCount;
+};
+
+// A context without a device that logs every call made on it, for running and timing the frame
+// on machines without a GPU. Nothing is drawn. Buffers and queries created through it are kept
+// in memory, so that buffer uploads can be read back, and every query has passed once ended.
+// Objects it did not create, such as those of meshes loaded without a device, are only logged.
+class RecordingRenderContext : public IRenderContext
+{
+public:
+	RecordingRenderContext();
+	~RecordingRenderContext();
+
+	HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Buffer** bufferOut) override;
+	HRESULT CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut) override;
+	void Release(ID3D11DeviceChild* object) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth,
+		UINT8 stencil) override;
+	void OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+		ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) override;
+	void RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports) override;
+	void RSSetState(ID3D11RasterizerState* state) override;
+
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+		const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShaderResources(UINT startSlot, UINT viewCount, ID3D11ShaderResourceView* const* views) override;
+	void PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers) override;
+
+	HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+		D3D11_MAPPED_SUBRESOURCE* mappedOut) override;
+	void Unmap(ID3D11Resource* resource, UINT subresource) override;
+
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex,
+		UINT startInstance) override;
+
+	void End(ID3D11Asynchronous* query) override;
+	HRESULT GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags) override;
+
+	HRESULT Present(UINT syncInterval, UINT flags) override;
+
+	// Empties the log, keeping the objects created through the context
+	void ClearCommands();
+
+	inline const std::vector<RenderCommand>& GetCommands() const;
+	inline const void* GetCommandObject(const RenderCommand& command, const uint32_t index) const;
+	// Commands of the type logged since the log was last emptied
+	inline size_t GetCommandCount(const RenderCommandType type) const;
+	// Buffers and queries created through the context that have not been released
+	inline size_t GetObjectCount() const;
+	// The contents of a buffer created through the context, or null for any other object
+	const uint8_t* GetBufferData(const ID3D11Buffer* buffer, size_t* sizeOut) const;
+
+protected:
+	struct RecordedBuffer
+	{
+		D3D11_BUFFER_DESC Desc;
+		std::vector<uint8_t> Data;
+	};
+
+	struct RecordedQuery
+	{
+		bool bEnded;
+	};
+
+	std::vector<RenderCommand> commands;
+	std::vector<const void*> commandObjects;
+	size_t commandCounts[RENDER_COMMAND_TYPE_COUNT];
+	// The context's objects are handed out as pointers to these, cast to the D3D11 type
+	std::vector<RecordedBuffer*> buffers;
+	std::vector<RecordedQuery*> queries;
+
+	// Logs a command, followed by the objects it was given
+	void Record(const RenderCommandType type, const UINT value0 = 0, const UINT value1 = 0,
+		const UINT value2 = 0, const UINT value3 = 0);
+	inline void RecordObject(const void* object);
+	template <typename Object>
+	inline void RecordObjects(Object* const* objects, const UINT count);
+	RecordedBuffer* FindBuffer(const void* object) const;
+	RecordedQuery* FindQuery(const void* object) const;
+};
+
+inline const std::vector<RenderCommand>& RecordingRenderContext::GetCommands() const
+{
+	return commands;
+}
+
+inline const void* RecordingRenderContext::GetCommandObject(const RenderCommand& command, const uint32_t index) const
+{
+	return commandObjects[command.ObjectOffset + index];
+}
+
+inline void RecordingRenderContext::RecordObject(const void* object)
+{
+	commandObjects.push_back(object);
+	++commands.back().ObjectCount;
+}
+
+template <typename Object>
+inline void RecordingRenderContext::RecordObjects(Object* const* objects, const UINT count)
+{
+	for (UINT i = 0; i < count; ++i)
+		RecordObject(objects != nullptr ? objects[i] : nullptr);
+}
+
+inline size_t RecordingRenderContext::GetCommandCount(const RenderCommandType type) const
+{
+	return commandCounts[type];
+}
+
+inline size_t RecordingRenderContext::GetObjectCount() const
+{
+	return buffers.size() + queries.size();
+}
+
+#endif
\ No newline at end of file
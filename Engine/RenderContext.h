@@ -0,0 +1,59 @@
+#ifndef RENDER_CONTEXT_H_
+#define RENDER_CONTEXT_H_
+
+#include <d3d11.h>
+
+// The calls the renderer makes while drawing a frame, named and given as on the D3D11 device
+// context. Buffers and queries written or waited on while drawing are created through the
+// context as well, and must be released through it, since a context without a device hands
+// out objects of its own. Off Windows the types come from the headers in Shim, and only
+// contexts without a device can be built, the one drawing through D3D11 is in D3D11RenderContext.h.
+class IRenderContext
+{
+public:
+	virtual ~IRenderContext() {}
+
+	virtual HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Buffer** bufferOut) = 0;
+	virtual HRESULT CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut) = 0;
+	virtual void Release(ID3D11DeviceChild* object) = 0;
+
+	virtual void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4]) = 0;
+	virtual void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth,
+		UINT8 stencil) = 0;
+	virtual void OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+		ID3D11DepthStencilView* depthStencilView) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) = 0;
+	virtual void RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports) = 0;
+	virtual void RSSetState(ID3D11RasterizerState* state) = 0;
+
+	virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void IASetInputLayout(ID3D11InputLayout* inputLayout) = 0;
+	virtual void IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+		const UINT* strides, const UINT* offsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) = 0;
+
+	virtual void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) = 0;
+	virtual void VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) = 0;
+	virtual void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) = 0;
+	virtual void PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) = 0;
+	virtual void PSSetShaderResources(UINT startSlot, UINT viewCount, ID3D11ShaderResourceView* const* views) = 0;
+	virtual void PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers) = 0;
+
+	virtual HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+		D3D11_MAPPED_SUBRESOURCE* mappedOut) = 0;
+	virtual void Unmap(ID3D11Resource* resource, UINT subresource) = 0;
+
+	virtual void Draw(UINT vertexCount, UINT startVertex) = 0;
+	virtual void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex,
+		UINT startInstance) = 0;
+
+	virtual void End(ID3D11Asynchronous* query) = 0;
+	virtual HRESULT GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags) = 0;
+
+	virtual HRESULT Present(UINT syncInterval, UINT flags) = 0;
+};
+
+#endif
\ No newline at end of file
@@ -1,30 +1,202 @@
 #include "Renderer.h"
 #include "Camera.h"
 #include "SceneGraph.h"
-#include "ContentPackage.h"
-#include "GraphicsDebug.h"
+#include "SceneStore.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <limits>
 #include <sstream>
 
 using namespace std;
 using namespace DirectX;
 
 #define CAMERA_CONSTANT_BUFFER_SIZE sizeof(XMMATRIX) * 2
-#define TERRAIN_PATCH_INSTANCE_CONSTANT_BUFFER_SIZE sizeof(XMMATRIX)
-#define STATIC_MESH_INSTANCE_CONSTANT_BUFFER_SIZE sizeof(XMMATRIX)
 
-#define SAFE_RELEASE(x) if (x != nullptr) x->Release();
+// Whether neighbouring static mesh nodes are drawn together, sharing material, mesh and level of detail
+inline bool IsSameBatch(const SceneNode* first, const SceneNode* second)
+{
+	return first->MaterialData == second->MaterialData && first->Ref.StaticMesh == second->Ref.StaticMesh &&
+		first->LodLevel == second->LodLevel;
+}
+
+// Whether the packet draws on from where the previous one stopped, with everything else the same,
+// as the parts of a batch split between chunks do
+inline bool IsSameDraw(const DrawPacket& previous, const DrawPacket& packet)
+{
+	return previous.Pipeline == packet.Pipeline && previous.VertexBuffer == packet.VertexBuffer &&
+		previous.IndexBuffer == packet.IndexBuffer && previous.IndexOffset == packet.IndexOffset &&
+		previous.IndexCount == packet.IndexCount && previous.ResourceViews == packet.ResourceViews &&
+		previous.ConstantBuffers == packet.ConstantBuffers &&
+		previous.FirstInstance + previous.InstanceCount == packet.FirstInstance;
+}
+
+// Sorts the entries by key a byte at a time from the least significant, skipping bytes that every
+// key shares. Entries move between the two buffers, and end up in the first.
+inline void RadixSortDrawEntries(vector<DrawSortEntry>& entries, vector<DrawSortEntry>& scratch)
+{
+	uint32_t counts[8][256] = {};
+	for (auto& entry : entries)
+	{
+		for (uint32_t digit = 0; digit < 8; ++digit)
+			++counts[digit][(entry.Key >> (digit * 8)) & 0xFF];
+	}
+
+	scratch.resize(entries.size());
+
+	for (uint32_t digit = 0; digit < 8; ++digit)
+	{
+		auto shift = digit * 8;
+		if (counts[digit][(entries[0].Key >> shift) & 0xFF] == entries.size())
+			continue;
+
+		uint32_t offsets[256];
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			offsets[i] = offset;
+			offset += counts[digit][i];
+		}
+
+		for (auto& entry : entries)
+			scratch[offsets[(entry.Key >> shift) & 0xFF]++] = entry;
+		entries.swap(scratch);
+	}
+}
 
-bool CompareMaterials(SceneNode* n1, SceneNode* n2)
+// The coarsest level whose error covers at most the given number of pixels
+inline uint32_t FindMeshLod(const StaticMesh* mesh, const float screenRadius, const float maxPixelError)
 {
-	return n1->MaterialData < n2->MaterialData;
+	uint32_t level = 0;
+	while (level + 1 < mesh->GetLodCount() && mesh->GetLod(level + 1).Error * screenRadius <= maxPixelError)
+		++level;
+	return level;
 }
 
-bool CompareMeshes(SceneNode* n1, SceneNode* n2)
+inline void PushVisibleMesh(SceneNode* node, NodeCollection& nodes)
 {
-	return n1->Ref.StaticMesh < n2->Ref.StaticMesh;
+	if (node->IsStaticMesh())
+		nodes.StaticMeshes.push_back(node);
+	else if (node->IsStaticMeshInstanced())
+		nodes.InstancedStaticMeshes.push_back(node);
+	else if (node->IsTerrainPatch())
+		nodes.TerrainPatches.push_back(node);
+}
+
+inline void AppendNodeCollection(const NodeCollection& source, NodeCollection& nodes)
+{
+	nodes.StaticMeshes.insert(nodes.StaticMeshes.end(), source.StaticMeshes.begin(), source.StaticMeshes.end());
+	nodes.InstancedStaticMeshes.insert(nodes.InstancedStaticMeshes.end(),
+		source.InstancedStaticMeshes.begin(), source.InstancedStaticMeshes.end());
+	nodes.TerrainPatches.insert(nodes.TerrainPatches.end(), source.TerrainPatches.begin(), source.TerrainPatches.end());
+	nodes.Lights.insert(nodes.Lights.end(), source.Lights.begin(), source.Lights.end());
+}
+
+// Collects every mesh below a region that is entirely inside the frustum, without testing
+inline void PushVisibleRegion(RegionNode* region, const bool bSkipPortalZones, NodeCollection& nodes)
+{
+	if (region->LeafData != nullptr)
+	{
+		if (region->LeafData->IsZone())
+		{
+			if (!bSkipPortalZones || !IsPortalZone(region->LeafData))
+				PushVisibleRegion(&region->LeafData->Region, bSkipPortalZones, nodes);
+		}
+		else if (region->LeafData->IsMesh())
+			PushVisibleMesh(region->LeafData, nodes);
+	}
+
+	if (region->Node1 != nullptr)
+		PushVisibleRegion(region->Node1, bSkipPortalZones, nodes);
+	if (region->Node2 != nullptr)
+		PushVisibleRegion(region->Node2, bSkipPortalZones, nodes);
+	if (region->Node3 != nullptr)
+		PushVisibleRegion(region->Node3, bSkipPortalZones, nodes);
+}
+
+inline void PushVisibleRange(const FlatHierarchy& hierarchy, const uint32_t begin, const uint32_t end,
+	const bool bSkipPortalZones, NodeCollection& nodes)
+{
+	for (auto i = begin; i < end; ++i)
+	{
+		auto leaf = hierarchy.LeafData[i];
+		if (leaf == nullptr)
+			continue;
+
+		if (leaf->IsMesh())
+			PushVisibleMesh(leaf, nodes);
+		else if (bSkipPortalZones && IsPortalZone(leaf))
+			i = hierarchy.SkipIndices[i] - 1;
+	}
+}
+
+// Entries of a store's hierarchy that are not leaves, and leaves whose node was destroyed since
+// the hierarchy was built, have no valid handle and are skipped
+inline void PushVisibleHandle(const SceneStore& store, const NodeHandle handle, NodeHandleCollection* nodesOut)
+{
+	if (!store.IsValid(handle))
+		return;
+
+	switch (GetNodeHandleType(handle))
+	{
+	case NODE_TYPE_STATIC_MESH:
+		nodesOut->StaticMeshes.push_back(handle);
+		break;
+	case NODE_TYPE_STATIC_MESH_INSTANCED:
+		nodesOut->InstancedStaticMeshes.push_back(handle);
+		break;
+	case NODE_TYPE_TERRAIN_PATCH:
+		nodesOut->TerrainPatches.push_back(handle);
+		break;
+	default:
+		break;
+	}
+}
+
+// Calls the function with the index of every view set in the mask
+template <typename Function>
+inline void ForEachView(uint32_t mask, Function function)
+{
+	for (uint32_t view = 0; mask != 0; ++view, mask >>= 1)
+	{
+		if ((mask & 1) != 0)
+			function(view);
+	}
+}
+
+// Tests the bounds with the planes each view in the mask still has to test, narrowing the plane
+// masks. Views that reject the bounds or find them entirely inside leave the mask with an empty
+// plane mask, the latter after being handed the whole region. Returns whether any mask changed.
+template <typename InsideFunction>
+inline bool TestFrustumViews(const Bounds& bounds, const Frustum* frusta, uint32_t* viewMaskInOut,
+	uint8_t* planeMasksInOut, uint8_t* rejectPlanesInOut, InsideFunction onInside)
+{
+	bool bNarrowed = false;
+
+	ForEachView(*viewMaskInOut, [&](const uint32_t view)
+	{
+		uint32_t planeMask = planeMasksInOut[view];
+		auto result = TestFrustum(bounds, frusta[view], &planeMask, &rejectPlanesInOut[view]);
+
+		if (result == FRUSTUM_INSIDE)
+			onInside(view);
+		if (result != FRUSTUM_INTERSECTING)
+		{
+			planeMask = 0;
+			*viewMaskInOut &= ~(1u << view);
+		}
+
+		if (planeMask != planeMasksInOut[view])
+		{
+			planeMasksInOut[view] = static_cast<uint8_t>(planeMask);
+			bNarrowed = true;
+		}
+	});
+
+	return bNarrowed;
 }
 
 template <typename CacheData>
@@ -88,6 +260,8 @@ Renderer::Renderer() :
 	swapChain(nullptr),
 	device(nullptr),
 	deviceContext(nullptr),
+	d3dContext(nullptr),
+	context(nullptr),
 	forwardRenderTarget(nullptr),
 	forwardDepthStencilView(nullptr),
 	forwardDepthStencilTexture(nullptr),
@@ -96,18 +270,18 @@ Renderer::Renderer() :
 	defaultRasterState(nullptr),
 	wireframeRasterState(nullptr),
 	samplerStateLinearStaticMesh(nullptr),
+	samplerStateTerrainPatch(nullptr),
 	inputLayoutTerrainPatch(nullptr),
-	inputLayoutStaticMesh(nullptr),
 	inputLayoutStaticMeshInstanced(nullptr),
 	pixelShaderDeferredComposite(nullptr),
 	vertexShaderBlit(nullptr),
 	pixelShaderStaticMesh(nullptr),
 	vertexShaderStaticMeshInstanced(nullptr),
+	vertexShaderTerrainPatch(nullptr),
+	pixelShaderTerrainPatch(nullptr),
 	inputLayoutBlit(nullptr),
 	bufferBlitVertices(nullptr),
-	bufferStaticMeshInstanceConstants(nullptr),
 	bufferCameraConstants(nullptr),
-	bufferTerrainPatchInstanceConstants(nullptr),
 	samplerStateBlit(nullptr),
 	internalContent(nullptr),
 	deferredDepthStencilBuffer(nullptr),
@@ -124,716 +298,868 @@ Renderer::Renderer() :
 	GetInputElementLayoutBlit(&elementLayoutBlit);
 	GetInputElementLayoutTerrainPatch(&elementLayoutTerrainPatch);
 
+	deferredBufferFormats =
+	{
+		DXGI_FORMAT_R8G8B8A8_UNORM,
+		DXGI_FORMAT_R8G8B8A8_UNORM
+	};
+
 	InitParameters.bLoadTerrainPatchShaders = true;
+	CullingParameters.Layout = CULLING_LAYOUT_FLAT;
+	CullingParameters.Workers = nullptr;
+	CullingParameters.bOcclusionCulling = false;
+	CullingParameters.bPortalCulling = false;
+	CullingParameters.bCoherentCulling = false;
+	bSkipPortalZones = false;
+
+	visibilityCut.Hierarchy = nullptr;
+	visibilityCut.Generation = 0;
+	visibilityCut.FullSize = 0;
+	visibilityCut.FullTime = 0.0;
+	visibilityCut.FrameCount = 0;
+	ZeroMemory(&coherentCullingStats, sizeof(coherentCullingStats));
+
+	LodParameters.bEnabled = true;
+	LodParameters.MaxPixelError = DEFAULT_LOD_MAX_PIXEL_ERROR;
+	LodParameters.Hysteresis = DEFAULT_LOD_HYSTERESIS;
+	ZeroMemory(&meshLodStats, sizeof(meshLodStats));
+
+	ShadowParameters.bEnabled = false;
+
+	DrawParameters.Workers = nullptr;
+	drawPacketChunkCount = 0;
+	ZeroMemory(&drawStats, sizeof(drawStats));
+	transformBuffer = nullptr;
+	transformOffset = 0;
+	lightClusterBuffer = nullptr;
+	lightClusterBufferSize = 0;
+}
+
+bool Renderer::Initialize(IRenderContext* context, const RenderParams& params)
+{
+	// Without a device there are no shaders, states or targets to create, they are bound as null
+	renderParameters = params;
+	stateFilter.Initialize(context);
+	this->context = &stateFilter;
+
+	deferredShaderViews.assign(deferredBufferFormats.size(), nullptr);
+	deferredRenderTargets.assign(deferredBufferFormats.size(), nullptr);
+
+	return InitFrameResources();
 }
 
-bool Renderer::Initialize(HWND hWindow, const RenderParams& params)
+bool Renderer::InitFrameResources()
 {
 	bool result;
-	result = InitWindow(hWindow, params);
+	result = InitConstantBuffers();
 	if (!result)
 		return false;
 
-	result = InitRenderTarget();
+	result = occlusionBuffer.Initialize(DEFAULT_OCCLUSION_BUFFER_WIDTH, DEFAULT_OCCLUSION_BUFFER_HEIGHT);
 	if (!result)
 		return false;
 
-	result = InitDeferredTargets();
+	result = lightClusters.Initialize(DEFAULT_LIGHT_CLUSTERS_X, DEFAULT_LIGHT_CLUSTERS_Y, DEFAULT_LIGHT_CLUSTERS_Z);
 	if (!result)
 		return false;
 
-	result = InitRenderObjects();
+	result = instanceRing.Initialize(context, DEFAULT_INSTANCE_RING_SIZE);
 	if (!result)
 		return false;
 
-	internalContent = new ContentPackage(this);
-
-	result = InitInternalShaders();
-	if (!result)
-		return false;
+	return true;
+}
 
-	result = InitInternalVertexBuffers();
-	if (!result)
-		return false;
+bool Renderer::InitConstantBuffers()
+{
+	D3D11_BUFFER_DESC cameraBufferDesc;
+	ZeroMemory(&cameraBufferDesc, sizeof(cameraBufferDesc));
+	cameraBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cameraBufferDesc.ByteWidth = CAMERA_CONSTANT_BUFFER_SIZE;
+	cameraBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	cameraBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
 
-	result = InitConstantBuffers();
-	if (!result)
+	// Written every frame, so created through the context like the instance ring
+	HRESULT result = context->CreateBuffer(&cameraBufferDesc, nullptr, &bufferCameraConstants);
+	if (FAILED(result))
 		return false;
 
-	NameObjectsDebug();
-
 	return true;
 }
 
-bool Renderer::InitWindow(const HWND hWindow, const RenderParams& params)
+bool Renderer::Reset(const RenderParams& params)
 {
-	renderParameters = params;
-
-	IDXGIFactory* factory;
-	HRESULT result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&factory);
+	if (params.Extent.Width == renderParameters.Extent.Width &&
+		params.Extent.Height == renderParameters.Extent.Height &&
+		params.Windowed == renderParameters.Windowed)
+		return true;
 
-	IDXGIAdapter* adapter;
-	result = factory->EnumAdapters(0, &adapter);
+	if (params.Extent.Width == 0 || params.Extent.Height == 0)
+		return false;
 
-	IDXGIOutput* adapterOutput;
-	result = adapter->EnumOutputs(0, &adapterOutput);
+	// Without a swap chain there are no targets to resize
+	if (swapChain == nullptr)
+	{
+		renderParameters = params;
+		return true;
+	}
 
-	UINT modeCount;
-	result = adapterOutput->GetDisplayModeList(DXGI_FORMAT_R8G8B8A8_UNORM,
-		DXGI_ENUM_MODES_INTERLACED, &modeCount, nullptr);
+#ifdef _WIN32
+	return ResizeSwapChain(params);
+#else
+	return false;
+#endif
+}
 
-	DXGI_MODE_DESC* modeDescriptions = new DXGI_MODE_DESC[modeCount];
-	result = adapterOutput->GetDisplayModeList(DXGI_FORMAT_R8G8B8A8_UNORM,
-		DXGI_ENUM_MODES_INTERLACED, &modeCount, modeDescriptions);
+void Renderer::CollectVisibleNodes(RegionNode* node, const Frustum& cameraFrustum, uint32_t planeMask,
+	NodeCollection& nodes)
+{
+	if (bSkipPortalZones && node->LeafData != nullptr && IsPortalZone(node->LeafData))
+		return;
 
-	DXGI_MODE_DESC* descMatch = nullptr;
+	auto result = TestFrustum(node->AABB, cameraFrustum, &planeMask, &node->RejectPlane);
+	if (result == FRUSTUM_OUTSIDE || IsOccluded(node->AABB))
+		return;
 
-	for (UINT i = 0; i < modeCount; ++i)
+	// Regions inside the frustum are still descended to test their children for occlusion,
+	// but with no planes left to test against
+	if (result == FRUSTUM_INSIDE && !CullingParameters.bOcclusionCulling)
 	{
-		DXGI_MODE_DESC* desc = &modeDescriptions[i];
-
-		if (desc->Width == params.Extent.Width && desc->Height == params.Extent.Height)
-		{
-			OutputDebugString("Found compatible display mode!\n");
-			descMatch = desc;
-			break;
-		}
+		PushVisibleRegion(node, bSkipPortalZones, nodes);
+		return;
 	}
 
-	if (descMatch == nullptr)
+	if (node->LeafData != nullptr)
 	{
-		OutputDebugString("No DXGI mode match found - using a default!\n");
-		descMatch = modeDescriptions;
+		if (node->LeafData->IsZone())
+			CollectVisibleNodes(node->LeafData, cameraFrustum, planeMask, nodes);
+		else if (node->LeafData->IsMesh())
+			PushVisibleMesh(node->LeafData, nodes);
 	}
 
-	DXGI_ADAPTER_DESC adapterDesc;
-	result = adapter->GetDesc(&adapterDesc);
-
-	adapterOutput->Release();
-	adapter->Release();
-	factory->Release();
-
-	DXGI_SWAP_CHAIN_DESC swapChainDesc;
-	ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
-
-	swapChainDesc.Windowed = params.Windowed;
-	swapChainDesc.BufferCount = 2;
-	swapChainDesc.BufferDesc = *descMatch;
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapChainDesc.OutputWindow = hWindow;
-	swapChainDesc.SampleDesc.Count = 1;
-	swapChainDesc.SampleDesc.Quality = 0;
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-
-	delete[] modeDescriptions;
-
-	UINT deviceCreationFlags = 0;
-#ifdef ENABLE_DIRECT3D_DEBUG
-	deviceCreationFlags |= D3D11_CREATE_DEVICE_DEBUG;
-#endif
-
-	if (!renderParameters.Windowed)
-		swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
-
-	OutputDebugString("Creating device and swap chain...\n");
-
-	D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
-	result = D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-		deviceCreationFlags, &featureLevel, 1, D3D11_SDK_VERSION, &swapChainDesc,
-		&swapChain, &device, nullptr, &deviceContext);
+	if (node->Node1 != nullptr)
+		CollectVisibleNodes(node->Node1, cameraFrustum, planeMask, nodes);
+	if (node->Node2 != nullptr)
+		CollectVisibleNodes(node->Node2, cameraFrustum, planeMask, nodes);
+	if (node->Node3 != nullptr)
+		CollectVisibleNodes(node->Node3, cameraFrustum, planeMask, nodes);
+}
 
-	if (FAILED(result))
+void Renderer::CollectVisibleNodes(SceneNode* node, const Frustum& cameraFrustum, uint32_t planeMask,
+	NodeCollection& nodes)
+{
+	if (!node->IsZone())
 	{
-		OutputDebugString("Failed to create device and swap chain!\n");
-		return false;
+		OutputDebugString("Attempted static mesh collection on non-zone node!\n");
+		return;
 	}
 
-	OutputDebugString("Device and swap chain created successfully!\n");
+	auto compiledHierarchy = &node->Ref.ZoneData->CompiledHierarchy;
 
-	return true;
+	if (CullingParameters.Layout == CULLING_LAYOUT_FLAT && !compiledHierarchy->IsEmpty())
+		CollectVisibleNodes(*compiledHierarchy, 0, compiledHierarchy->GetSize(), cameraFrustum, planeMask, nodes, nullptr);
+	else
+		CollectVisibleNodes(&node->Region, cameraFrustum, planeMask, nodes);
 }
 
-bool Renderer::InitRenderTarget()
+// Appends the entries where collection stops descending to the cut if there is one
+void Renderer::CollectVisibleNodes(FlatHierarchy& hierarchy, const uint32_t begin, const uint32_t end,
+	const Frustum& cameraFrustum, uint32_t planeMask, NodeCollection& nodes, vector<VisibilityCutEntry>* cutOut)
 {
-	OutputDebugString("Creating render target view for back buffer...\n");
+	// Plane masks of the enclosing entries that narrowed the mask, restored once their
+	// subtrees are left. The mask loses a plane every time, so six entries are enough.
+	struct
+	{
+		uint32_t End;
+		uint32_t PlaneMask;
+	} maskStack[6];
+	int maskDepth = 0;
 
-	ID3D11Texture2D* backBuffer;
-	HRESULT result = swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&backBuffer);
-	result = device->CreateRenderTargetView(backBuffer, nullptr, &forwardRenderTarget);
-	result = backBuffer->Release();
+	Bounds bounds;
+	uint32_t index = begin;
 
-	OutputDebugString("Creating depth texture...\n");
+	while (index < end)
+	{
+		while (maskDepth > 0 && index >= maskStack[maskDepth - 1].End)
+			planeMask = maskStack[--maskDepth].PlaneMask;
 
-	D3D11_TEXTURE2D_DESC depthTextureDesc;
-	ZeroMemory(&depthTextureDesc, sizeof(depthTextureDesc));
+		auto leaf = hierarchy.LeafData[index];
+		if (bSkipPortalZones && leaf != nullptr && IsPortalZone(leaf))
+		{
+			index = hierarchy.SkipIndices[index];
+			continue;
+		}
 
-	depthTextureDesc.Width = renderParameters.Extent.Width;
-	depthTextureDesc.Height = renderParameters.Extent.Height;
-	depthTextureDesc.MipLevels = 1;
-	depthTextureDesc.ArraySize = 1;
-	depthTextureDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-	depthTextureDesc.SampleDesc.Count = 1;
-	depthTextureDesc.SampleDesc.Quality = 0;
-	depthTextureDesc.Usage = D3D11_USAGE_DEFAULT;
-	depthTextureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	depthTextureDesc.CPUAccessFlags = 0;
-	depthTextureDesc.MiscFlags = 0;
+		hierarchy.GetBounds(index, &bounds);
 
-	result = device->CreateTexture2D(&depthTextureDesc, nullptr, &forwardDepthStencilTexture);
+		auto childPlaneMask = planeMask;
+		auto result = TestFrustum(bounds, cameraFrustum, &childPlaneMask, &hierarchy.RejectPlanes[index]);
 
-	if (FAILED(result))
-		return false;
+		if (result == FRUSTUM_OUTSIDE || IsOccluded(bounds))
+		{
+			if (cutOut != nullptr)
+				cutOut->push_back({ index, FRUSTUM_OUTSIDE });
+			index = hierarchy.SkipIndices[index];
+			continue;
+		}
 
-	OutputDebugString("Creating depth stencil view...\n");
+		if (result == FRUSTUM_INSIDE && !CullingParameters.bOcclusionCulling)
+		{
+			if (cutOut != nullptr)
+				cutOut->push_back({ index, FRUSTUM_INSIDE });
+			PushVisibleRange(hierarchy, index, hierarchy.SkipIndices[index], bSkipPortalZones, nodes);
+			index = hierarchy.SkipIndices[index];
+			continue;
+		}
 
-	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
-	ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
+		if (leaf != nullptr && leaf->IsMesh())
+			PushVisibleMesh(leaf, nodes);
 
-	depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	depthStencilViewDesc.Texture2D.MipSlice = 0;
+		if (cutOut != nullptr && hierarchy.SkipIndices[index] == index + 1)
+			cutOut->push_back({ index, FRUSTUM_INTERSECTING });
 
-	result = device->CreateDepthStencilView(forwardDepthStencilTexture, &depthStencilViewDesc, &forwardDepthStencilView);
+		auto subtreeSize = hierarchy.SkipIndices[index] - index - 1;
+		if (subtreeSize > 1 && subtreeSize <= FLAT_CULLING_BATCH_SIZE)
+		{
+			CollectVisibleNodesBatched(hierarchy, index + 1, hierarchy.SkipIndices[index], cameraFrustum, nodes, cutOut);
+			index = hierarchy.SkipIndices[index];
+			continue;
+		}
 
-	if (FAILED(result))
-		return false;
+		if (childPlaneMask != planeMask)
+		{
+			maskStack[maskDepth].End = hierarchy.SkipIndices[index];
+			maskStack[maskDepth].PlaneMask = planeMask;
+			++maskDepth;
+			planeMask = childPlaneMask;
+		}
 
-	return true;
+		++index;
+	}
 }
 
-bool Renderer::InitDeferredTargets()
+// Tests every entry of a small subtree against all planes at once, then walks the entries with
+// those results exactly as the traversal above would. Entries below a rejected one are tested for
+// nothing, but the test is cheaper than walking the subtree one entry at a time. Planes the
+// enclosing entries were inside of are inside for their children too, so the results are the same.
+void Renderer::CollectVisibleNodesBatched(FlatHierarchy& hierarchy, const uint32_t begin, const uint32_t end,
+	const Frustum& cameraFrustum, NodeCollection& nodes, vector<VisibilityCutEntry>* cutOut)
 {
-	deferredBufferFormats =
+	FrustumTestResult results[FLAT_CULLING_BATCH_SIZE];
+	BoundsStreams streams =
 	{
-		DXGI_FORMAT_R8G8B8A8_UNORM,
-		DXGI_FORMAT_R8G8B8A8_UNORM
+		hierarchy.LowerX.data() + begin, hierarchy.LowerY.data() + begin, hierarchy.LowerZ.data() + begin,
+		hierarchy.UpperX.data() + begin, hierarchy.UpperY.data() + begin, hierarchy.UpperZ.data() + begin
 	};
+	TestFrustumBatch(streams, end - begin, cameraFrustum, results);
 
-	HRESULT result;
-
-	for (auto format : deferredBufferFormats)
-	{
-		D3D11_TEXTURE2D_DESC deferredBufferDesc;
-		deferredBufferDesc.ArraySize = 1;
-		deferredBufferDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-		deferredBufferDesc.CPUAccessFlags = 0;
-		deferredBufferDesc.MipLevels = 1;
-		deferredBufferDesc.MiscFlags = 0;
-		deferredBufferDesc.SampleDesc.Count = 1;
-		deferredBufferDesc.SampleDesc.Quality = 0;
-		deferredBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		deferredBufferDesc.Width = renderParameters.Extent.Width;
-		deferredBufferDesc.Height = renderParameters.Extent.Height;
-		deferredBufferDesc.Format = format;
-
-		ID3D11Texture2D* deferredBuffer;
-		result = device->CreateTexture2D(&deferredBufferDesc, nullptr, &deferredBuffer);
-		if (FAILED(result))
-			return false;
-
-		deferredBuffers.push_back(deferredBuffer);
-
-		ID3D11ShaderResourceView* resourceView;
-		result = device->CreateShaderResourceView(deferredBuffer, nullptr, &resourceView);
-		if (FAILED(result))
-			return false;
-
-		deferredShaderViews.push_back(resourceView);
-
-		ID3D11RenderTargetView* renderTargetView;
-		result = device->CreateRenderTargetView(deferredBuffer, nullptr, &renderTargetView);
-		if (FAILED(result))
-			return false;
-
-		deferredRenderTargets.push_back(renderTargetView);
-
-#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
-		SetDebugObjectName(deferredBuffer, "Deferred Buffer");
-		SetDebugObjectName(resourceView, "Deferred Shader Resource View");
-		SetDebugObjectName(renderTargetView, "Deferred Render Target View");
-#endif
-	}
-
-	DXGI_FORMAT depthTextureFormat = DXGI_FORMAT_R32_TYPELESS;
-	DXGI_FORMAT depthResourceViewFormat = DXGI_FORMAT_R32_FLOAT;
-	DXGI_FORMAT depthViewFormat = DXGI_FORMAT_D32_FLOAT;
-
-	D3D11_TEXTURE2D_DESC deferredBufferDesc;
-	deferredBufferDesc.ArraySize = 1;
-	deferredBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-	deferredBufferDesc.CPUAccessFlags = 0;
-	deferredBufferDesc.MipLevels = 1;
-	deferredBufferDesc.MiscFlags = 0;
-	deferredBufferDesc.SampleDesc.Count = 1;
-	deferredBufferDesc.SampleDesc.Quality = 0;
-	deferredBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	deferredBufferDesc.Width = renderParameters.Extent.Width;
-	deferredBufferDesc.Height = renderParameters.Extent.Height;
-	deferredBufferDesc.Format = depthTextureFormat;
-
-	result = device->CreateTexture2D(&deferredBufferDesc, nullptr, &deferredDepthStencilBuffer);
-
-	if (FAILED(result))
-		return false;
-
-	D3D11_SHADER_RESOURCE_VIEW_DESC resourceViewDesc;
-	ZeroMemory(&resourceViewDesc, sizeof(resourceViewDesc));
-	resourceViewDesc.Format = depthResourceViewFormat;
-	resourceViewDesc.Texture2D.MipLevels = 1;
-	resourceViewDesc.Texture2D.MostDetailedMip = 0;
-	resourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-
-	result = device->CreateShaderResourceView(deferredDepthStencilBuffer, &resourceViewDesc, &deferredDepthShaderView);
+	Bounds bounds;
+	uint32_t index = begin;
 
-	if (FAILED(result))
-		return false;
+	while (index < end)
+	{
+		auto leaf = hierarchy.LeafData[index];
+		auto skipIndex = hierarchy.SkipIndices[index];
+		if (bSkipPortalZones && leaf != nullptr && IsPortalZone(leaf))
+		{
+			index = skipIndex;
+			continue;
+		}
 
-	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
-	ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
+		auto result = results[index - begin];
+		if (result != FRUSTUM_OUTSIDE && CullingParameters.bOcclusionCulling)
+		{
+			hierarchy.GetBounds(index, &bounds);
+			if (IsOccluded(bounds))
+				result = FRUSTUM_OUTSIDE;
+		}
 
-	depthStencilViewDesc.Format = depthViewFormat;
-	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	depthStencilViewDesc.Texture2D.MipSlice = 0;
+		if (result == FRUSTUM_OUTSIDE)
+		{
+			if (cutOut != nullptr)
+				cutOut->push_back({ index, FRUSTUM_OUTSIDE });
+			index = skipIndex;
+			continue;
+		}
 
-	result = device->CreateDepthStencilView(deferredDepthStencilBuffer, &depthStencilViewDesc, &deferredDepthStencilView);
+		if (result == FRUSTUM_INSIDE && !CullingParameters.bOcclusionCulling)
+		{
+			if (cutOut != nullptr)
+				cutOut->push_back({ index, FRUSTUM_INSIDE });
+			PushVisibleRange(hierarchy, index, skipIndex, bSkipPortalZones, nodes);
+			index = skipIndex;
+			continue;
+		}
 
-	if (FAILED(result))
-		return false;
+		if (leaf != nullptr && leaf->IsMesh())
+			PushVisibleMesh(leaf, nodes);
 
-#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
-	SetDebugObjectName(deferredDepthStencilBuffer, "Deferred Depth Stencil Buffer");
-	SetDebugObjectName(deferredDepthShaderView, "Deferred Depth Stencil Shader Resource View");
-	SetDebugObjectName(deferredDepthStencilView, "Deferred Depth Stencil View");
-#endif
+		if (cutOut != nullptr && skipIndex == index + 1)
+			cutOut->push_back({ index, FRUSTUM_INTERSECTING });
 
-	DXGI_FORMAT lightFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+		++index;
+	}
+}
 
-	D3D11_TEXTURE2D_DESC lightBufferDesc;
-	lightBufferDesc.ArraySize = 1;
-	lightBufferDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	lightBufferDesc.CPUAccessFlags = 0;
-	lightBufferDesc.MipLevels = 1;
-	lightBufferDesc.MiscFlags = 0;
-	lightBufferDesc.SampleDesc.Count = 1;
-	lightBufferDesc.SampleDesc.Quality = 0;
-	lightBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	lightBufferDesc.Width = renderParameters.Extent.Width;
-	lightBufferDesc.Height = renderParameters.Extent.Height;
-	lightBufferDesc.Format = lightFormat;
+inline bool IsFrustumCoherent(const Frustum& frustum, const Frustum& previousFrustum)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		auto& plane = frustum.Planes[i];
+		auto& previousPlane = previousFrustum.Planes[i];
 
-	result = device->CreateTexture2D(&lightBufferDesc, nullptr, &lightTexture);
+		float cosine = plane.Normal.x * previousPlane.Normal.x + plane.Normal.y * previousPlane.Normal.y +
+			plane.Normal.z * previousPlane.Normal.z;
+		if (!(cosine >= COHERENT_CULLING_MIN_PLANE_COS) ||
+			!(fabs(plane.Distance - previousPlane.Distance) <= COHERENT_CULLING_MAX_PLANE_SHIFT))
+			return false;
+	}
 
-	if (FAILED(result))
-		return false;
+	return true;
+}
 
-	result = device->CreateRenderTargetView(lightTexture, nullptr, &lightRenderTarget);
+void Renderer::CollectVisibleNodes(SceneNode* sceneRoot, const Frustum* frusta, const uint32_t viewCount,
+	NodeCollection* nodesOut)
+{
+	if (!sceneRoot->IsZone())
+	{
+		OutputDebugString("Attempted static mesh collection on non-zone node!\n");
+		return;
+	}
 
-	if (FAILED(result))
-		return false;
+	if (viewCount == 0 || viewCount > MAX_CULLING_VIEWS)
+	{
+		OutputDebugString("Invalid number of views to collect!\n");
+		return;
+	}
 
-	result = device->CreateShaderResourceView(lightTexture, nullptr, &lightShaderView);
+	auto& compiledHierarchy = sceneRoot->Ref.ZoneData->CompiledHierarchy;
 
-	if (FAILED(result))
-		return false;
-
-	return true;
+	if (CullingParameters.Layout == CULLING_LAYOUT_FLAT && !compiledHierarchy.IsEmpty())
+		CollectVisibleNodes(compiledHierarchy, frusta, viewCount, nodesOut);
+	else
+	{
+		// The last rejecting plane of each view is kept for the whole walk rather than per region,
+		// as the walk may run alongside another collection that owns the cached ones
+		uint8_t planeMasks[MAX_CULLING_VIEWS];
+		uint8_t rejectPlanes[MAX_CULLING_VIEWS] = {};
+		fill(planeMasks, planeMasks + viewCount, static_cast<uint8_t>(FRUSTUM_PLANE_MASK_ALL));
+
+		auto viewMask = viewCount == MAX_CULLING_VIEWS ? ~0u : (1u << viewCount) - 1;
+		CollectVisibleNodes(&sceneRoot->Region, frusta, viewMask, planeMasks, rejectPlanes, nodesOut);
+	}
 }
 
-bool Renderer::InitRenderObjects()
+void Renderer::CollectVisibleNodes(RegionNode* node, const Frustum* frusta, uint32_t viewMask,
+	const uint8_t* planeMasks, uint8_t* rejectPlanes, NodeCollection* nodesOut)
 {
-	OutputDebugString("Creating depth stencil state...\n");
-
-	D3D11_DEPTH_STENCIL_DESC depthStencilDesc;
-	ZeroMemory(&depthStencilDesc, sizeof(depthStencilDesc));
+	uint8_t childPlaneMasks[MAX_CULLING_VIEWS];
+	ForEachView(viewMask, [&](const uint32_t view) { childPlaneMasks[view] = planeMasks[view]; });
 
-	depthStencilDesc.DepthEnable = true;
-	depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-	depthStencilDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	TestFrustumViews(node->AABB, frusta, &viewMask, childPlaneMasks, rejectPlanes,
+		[&](const uint32_t view) { PushVisibleRegion(node, false, nodesOut[view]); });
 
-	depthStencilDesc.StencilEnable = true;
-	depthStencilDesc.StencilReadMask = 0xFF;
-	depthStencilDesc.StencilWriteMask = 0xFF;
+	if (viewMask == 0)
+		return;
 
-	depthStencilDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-	depthStencilDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_INCR;
-	depthStencilDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-	depthStencilDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	if (node->LeafData != nullptr)
+	{
+		if (node->LeafData->IsZone())
+			CollectVisibleNodes(&node->LeafData->Region, frusta, viewMask, childPlaneMasks, rejectPlanes, nodesOut);
+		else if (node->LeafData->IsMesh())
+			ForEachView(viewMask, [&](const uint32_t view) { PushVisibleMesh(node->LeafData, nodesOut[view]); });
+	}
 
-	depthStencilDesc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-	depthStencilDesc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_DECR;
-	depthStencilDesc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-	depthStencilDesc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	if (node->Node1 != nullptr)
+		CollectVisibleNodes(node->Node1, frusta, viewMask, childPlaneMasks, rejectPlanes, nodesOut);
+	if (node->Node2 != nullptr)
+		CollectVisibleNodes(node->Node2, frusta, viewMask, childPlaneMasks, rejectPlanes, nodesOut);
+	if (node->Node3 != nullptr)
+		CollectVisibleNodes(node->Node3, frusta, viewMask, childPlaneMasks, rejectPlanes, nodesOut);
+}
 
-	HRESULT result = device->CreateDepthStencilState(&depthStencilDesc, &defaultDepthStencilState);
+void Renderer::CollectVisibleNodes(const FlatHierarchy& hierarchy, const Frustum* frusta, const uint32_t viewCount,
+	NodeCollection* nodesOut)
+{
+	// Views and plane masks of the enclosing entries that narrowed them, restored once their
+	// subtrees are left. Each entry clears at least one plane of a view, so six per view are enough.
+	struct MaskState
+	{
+		uint32_t End;
+		uint32_t ViewMask;
+		uint8_t PlaneMasks[MAX_CULLING_VIEWS];
+	};
+	MaskState maskStack[MAX_CULLING_VIEWS * 6];
+	int maskDepth = 0;
 
-	if (FAILED(result))
-		return false;
+	MaskState state;
+	state.ViewMask = viewCount == MAX_CULLING_VIEWS ? ~0u : (1u << viewCount) - 1;
+	fill(state.PlaneMasks, state.PlaneMasks + viewCount, static_cast<uint8_t>(FRUSTUM_PLANE_MASK_ALL));
 
-	depthStencilDesc.DepthEnable = false;
-	depthStencilDesc.StencilEnable = false;
+	uint8_t rejectPlanes[MAX_CULLING_VIEWS] = {};
+	auto end = hierarchy.GetSize();
+	Bounds bounds;
+	uint32_t index = 0;
 
-	result = device->CreateDepthStencilState(&depthStencilDesc, &blitDepthStencilState);
+	while (index < end)
+	{
+		while (maskDepth > 0 && index >= maskStack[maskDepth - 1].End)
+			state = maskStack[--maskDepth];
 
-	if (FAILED(result))
-		return false;
+		auto skipIndex = hierarchy.SkipIndices[index];
+		hierarchy.GetBounds(index, &bounds);
 
-	OutputDebugString("Creating raster state...\n");
+		MaskState childState = state;
+		auto bNarrowed = TestFrustumViews(bounds, frusta, &childState.ViewMask, childState.PlaneMasks, rejectPlanes,
+			[&](const uint32_t view) { PushVisibleRange(hierarchy, index, skipIndex, false, nodesOut[view]); });
 
-	D3D11_RASTERIZER_DESC rasterDesc;
-	rasterDesc.AntialiasedLineEnable = false;
-	rasterDesc.CullMode = D3D11_CULL_BACK;
-	rasterDesc.DepthBias = 0;
-	rasterDesc.DepthBiasClamp = 0.0f;
-	rasterDesc.DepthClipEnable = true;
-	rasterDesc.FillMode = D3D11_FILL_SOLID;
-	rasterDesc.FrontCounterClockwise = false;
-	rasterDesc.MultisampleEnable = false;
-	rasterDesc.ScissorEnable = false;
-	rasterDesc.SlopeScaledDepthBias = 0.0f;
+		if (childState.ViewMask == 0)
+		{
+			index = skipIndex;
+			continue;
+		}
 
-	result = device->CreateRasterizerState(&rasterDesc, &defaultRasterState);
+		auto leaf = hierarchy.LeafData[index];
+		if (leaf != nullptr && leaf->IsMesh())
+			ForEachView(childState.ViewMask, [&](const uint32_t view) { PushVisibleMesh(leaf, nodesOut[view]); });
 
-	if (FAILED(result))
-		return false;
+		if (bNarrowed)
+		{
+			state.End = skipIndex;
+			maskStack[maskDepth++] = state;
+			state = childState;
+		}
 
-	rasterDesc.FillMode = D3D11_FILL_WIREFRAME;
-	result = device->CreateRasterizerState(&rasterDesc, &wireframeRasterState);
+		++index;
+	}
+}
 
-	if (FAILED(result))
-		return false;
+void Renderer::CollectVisibleNodes(const SceneStore& store, const Frustum& cameraFrustum,
+	NodeHandleCollection* nodesOut)
+{
+	// Plane masks of the enclosing entries that narrowed the mask, as for a zone's flat hierarchy
+	struct
+	{
+		uint32_t End;
+		uint32_t PlaneMask;
+	} maskStack[6];
+	int maskDepth = 0;
+
+	// The last rejecting plane is kept for the whole walk rather than per entry, as the store is
+	// only read
+	auto& hierarchy = store.Hierarchy;
+	uint32_t planeMask = FRUSTUM_PLANE_MASK_ALL;
+	uint8_t rejectPlane = 0;
+	auto end = hierarchy.GetSize();
+	Bounds bounds;
+	uint32_t index = 0;
+
+	while (index < end)
+	{
+		while (maskDepth > 0 && index >= maskStack[maskDepth - 1].End)
+			planeMask = maskStack[--maskDepth].PlaneMask;
 
-	OutputDebugString("Creating linear sampler state...\n");
+		auto skipIndex = hierarchy.SkipIndices[index];
+		hierarchy.GetBounds(index, &bounds);
 
-	D3D11_SAMPLER_DESC samplerDesc;
-	ZeroMemory(&samplerDesc, sizeof(samplerDesc));
-	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-	samplerDesc.MinLOD = 0;
-	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		auto childPlaneMask = planeMask;
+		auto result = TestFrustum(bounds, cameraFrustum, &childPlaneMask, &rejectPlane);
 
-	result = device->CreateSamplerState(&samplerDesc, &samplerStateLinearStaticMesh);
+		if (result == FRUSTUM_OUTSIDE)
+		{
+			index = skipIndex;
+			continue;
+		}
 
-	if (FAILED(result))
-		return false;
+		if (result == FRUSTUM_INSIDE)
+		{
+			for (auto i = index; i < skipIndex; ++i)
+				PushVisibleHandle(store, store.HierarchyHandles[i], nodesOut);
+			index = skipIndex;
+			continue;
+		}
 
-	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
-	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		PushVisibleHandle(store, store.HierarchyHandles[index], nodesOut);
 
-	result = device->CreateSamplerState(&samplerDesc, &samplerStateBlit);
+		if (childPlaneMask != planeMask)
+		{
+			maskStack[maskDepth].End = skipIndex;
+			maskStack[maskDepth].PlaneMask = planeMask;
+			++maskDepth;
+			planeMask = childPlaneMask;
+		}
 
-	if (FAILED(result))
-		return false;
+		++index;
+	}
 
-	return true;
+	// Lights are kept out of the hierarchy, their table is culled in a single pass instead
+	vector<uint32_t> visibleLights;
+	CullNodeTable(store.Lights, cameraFrustum, &visibleLights);
+	for (auto denseIndex : visibleLights)
+		nodesOut->Lights.push_back(store.Lights.GetHandle(denseIndex));
 }
 
-bool Renderer::InitInternalShaders()
+// Retests each entry of the previous frame's cut with every plane, as the planes an entry's
+// ancestors were inside of may have changed, and descends below only the entries that are now
+// intersecting. The subtrees of the entries cover the hierarchy in order, so the nodes are
+// collected in the same order as when starting from the root.
+void Renderer::CollectVisibleNodesCoherent(SceneNode* sceneRoot, const Frustum& cameraFrustum, NodeCollection& nodes)
 {
-	bool result;
-	HRESULT hr;
+	auto startTime = chrono::steady_clock::now();
+	auto& hierarchy = sceneRoot->Ref.ZoneData->CompiledHierarchy;
 
-	BytecodeBlob staticMeshBytecode;
-	result = internalContent->LoadVertexShader(STATIC_MESH_VERTEX_SHADER_LOCATION, &vertexShaderStaticMesh,
-		&staticMeshBytecode);
+	coherentCullingStats.RetestedCount = 0;
+	coherentCullingStats.ReusedCount = 0;
+	coherentCullingStats.TimeSaved = 0.0;
 
-	if (!result)
-		return false;
-
-	hr = device->CreateInputLayout(elementLayoutStaticMesh.Desc, elementLayoutStaticMesh.AttributeCount,
-		staticMeshBytecode.Bytecode, staticMeshBytecode.BytecodeLength,
-		&inputLayoutStaticMesh);
-	staticMeshBytecode.Destroy();
+	if (CullingParameters.Layout != CULLING_LAYOUT_FLAT || hierarchy.IsEmpty())
+	{
+		CollectVisibleNodes(sceneRoot, cameraFrustum, FRUSTUM_PLANE_MASK_ALL, nodes);
+		visibilityCut.Entries.clear();
+		visibilityCut.Hierarchy = nullptr;
+		coherentCullingStats.CutSize = 0;
+		coherentCullingStats.bFullTraversal = true;
+		coherentCullingStats.CollectTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+		return;
+	}
 
-	if (FAILED(hr))
-		return false;
+	bool bFullTraversal = visibilityCut.Hierarchy != &hierarchy ||
+		visibilityCut.Generation != hierarchy.Generation ||
+		visibilityCut.Entries.empty() ||
+		visibilityCut.FrameCount >= COHERENT_CULLING_REFRESH_FRAMES ||
+		visibilityCut.Entries.size() > COHERENT_CULLING_MAX_CUT_GROWTH * visibilityCut.FullSize ||
+		!IsFrustumCoherent(cameraFrustum, visibilityCut.CameraFrustum);
 
-	// Load instanced static mesh shaders
-	BytecodeBlob staticMeshInstancedBytecode;
-	result = internalContent->LoadVertexShader(STATIC_MESH_INSTANCED_VERTEX_SHADER_LOCATION, &vertexShaderStaticMeshInstanced,
-		&staticMeshInstancedBytecode);
+	nextVisibilityCut.clear();
 
-	if (!result)
-		return false;
+	if (bFullTraversal)
+		CollectVisibleNodes(hierarchy, 0, hierarchy.GetSize(), cameraFrustum, FRUSTUM_PLANE_MASK_ALL, nodes, &nextVisibilityCut);
+	else
+	{
+		Bounds bounds;
 
-	hr = device->CreateInputLayout(elementLayoutStaticMeshInstanced.Desc, elementLayoutStaticMeshInstanced.AttributeCount,
-		staticMeshInstancedBytecode.Bytecode, staticMeshInstancedBytecode.BytecodeLength,
-		&inputLayoutStaticMeshInstanced);
-	staticMeshInstancedBytecode.Destroy();
+		for (auto& entry : visibilityCut.Entries)
+		{
+			auto index = entry.Index;
+			auto end = hierarchy.SkipIndices[index];
+			uint32_t planeMask = FRUSTUM_PLANE_MASK_ALL;
 
-	if (FAILED(hr))
-		return false;
+			hierarchy.GetBounds(index, &bounds);
+			auto result = TestFrustum(bounds, cameraFrustum, &planeMask, &hierarchy.RejectPlanes[index]);
 
-	result = internalContent->LoadPixelShader(STATIC_MESH_PIXEL_SHADER_LOCATION, &pixelShaderStaticMesh);
+			if (result == entry.Result)
+				++coherentCullingStats.ReusedCount;
 
-	if (!result)
-		return false;
+			if (result == FRUSTUM_OUTSIDE)
+				nextVisibilityCut.push_back({ index, FRUSTUM_OUTSIDE });
+			else if (result == FRUSTUM_INSIDE)
+			{
+				nextVisibilityCut.push_back({ index, FRUSTUM_INSIDE });
+				PushVisibleRange(hierarchy, index, end, false, nodes);
+			}
+			else if (end == index + 1)
+			{
+				nextVisibilityCut.push_back({ index, FRUSTUM_INTERSECTING });
+				auto leaf = hierarchy.LeafData[index];
+				if (leaf != nullptr && leaf->IsMesh())
+					PushVisibleMesh(leaf, nodes);
+			}
+			else
+				CollectVisibleNodes(hierarchy, index + 1, end, cameraFrustum, planeMask, nodes, &nextVisibilityCut);
+		}
 
-	// Load blit shaders
-	result = internalContent->LoadPixelShader(DEFERRED_COMPOSITE_PIXEL_SHADER_LOCATION, &pixelShaderDeferredComposite);
+		coherentCullingStats.RetestedCount = visibilityCut.Entries.size();
+	}
 
-	if (!result)
-		return false;
+	swap(visibilityCut.Entries, nextVisibilityCut);
+	visibilityCut.CameraFrustum = cameraFrustum;
 
-	BytecodeBlob vertexShaderBytecode;
-	result = internalContent->LoadVertexShader(BLIT_VERTEX_SHADER_LOCATION, &vertexShaderBlit, &vertexShaderBytecode);
+	auto collectTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
 
-	if (!result)
-		return false;
+	if (bFullTraversal)
+	{
+		visibilityCut.Hierarchy = &hierarchy;
+		visibilityCut.Generation = hierarchy.Generation;
+		visibilityCut.FullSize = visibilityCut.Entries.size();
+		visibilityCut.FullTime = collectTime;
+		visibilityCut.FrameCount = 0;
+	}
+	else
+	{
+		++visibilityCut.FrameCount;
+		coherentCullingStats.TimeSaved = visibilityCut.FullTime - collectTime;
+	}
 
-	hr = device->CreateInputLayout(elementLayoutBlit.Desc, elementLayoutBlit.AttributeCount,
-		vertexShaderBytecode.Bytecode, vertexShaderBytecode.BytecodeLength,
-		&inputLayoutBlit);
-	vertexShaderBytecode.Destroy();
+	coherentCullingStats.CutSize = visibilityCut.Entries.size();
+	coherentCullingStats.bFullTraversal = bFullTraversal;
+	coherentCullingStats.CollectTime = collectTime;
+}
 
-	if (FAILED(hr))
-		return false;
+// Replaces a task with tasks for each of its children, in the order they are visited when
+// collecting serially. Returns false if the task is kept as it is.
+bool Renderer::SplitVisibilityTask(const VisibilityTask& task, const Frustum& cameraFrustum,
+	vector<VisibilityTask>& tasksOut)
+{
+	auto planeMask = task.PlaneMask;
+	VisibilityTask childTask = task;
 
-	// Load terrain patch shaders
-	if (InitParameters.bLoadTerrainPatchShaders)
+	if (task.Hierarchy != nullptr)
 	{
-		BytecodeBlob terrainPatchBytecode;
-		result = internalContent->LoadVertexShader(TERRAIN_PATCH_VERTEX_SHADER_LOCATION, &vertexShaderTerrainPatch,
-			&terrainPatchBytecode);
+		auto& hierarchy = *task.Hierarchy;
+		auto index = task.FlatIndex;
+		auto end = hierarchy.SkipIndices[index];
 
-		if (!result)
+		if (end == index + 1)
+		{
+			tasksOut.push_back(task);
 			return false;
+		}
 
-		hr = device->CreateInputLayout(elementLayoutTerrainPatch.Desc, elementLayoutTerrainPatch.AttributeCount,
-			terrainPatchBytecode.Bytecode, terrainPatchBytecode.BytecodeLength,
-			&inputLayoutTerrainPatch);
-		terrainPatchBytecode.Destroy();
+		Bounds bounds;
+		hierarchy.GetBounds(index, &bounds);
 
-		if (FAILED(hr))
+		auto result = TestFrustum(bounds, cameraFrustum, &planeMask, &hierarchy.RejectPlanes[index]);
+		if (result == FRUSTUM_OUTSIDE || IsOccluded(bounds))
+			return true;
+		if (result == FRUSTUM_INSIDE && !CullingParameters.bOcclusionCulling)
+		{
+			tasksOut.push_back(task);
 			return false;
+		}
 
-		result = internalContent->LoadPixelShader(TERRAIN_PATCH_PIXEL_SHADER_LOCATION, &pixelShaderTerrainPatch);
+		childTask.PlaneMask = planeMask;
+		for (auto child = index + 1; child < end; child = hierarchy.SkipIndices[child])
+		{
+			childTask.FlatIndex = child;
+			tasksOut.push_back(childTask);
+		}
 
-		if (!result)
-			return false;
+		return true;
 	}
 
-	return true;
-}
+	auto region = task.Region;
+	auto leaf = region->LeafData;
 
-bool Renderer::InitConstantBuffers()
-{
-	D3D11_BUFFER_DESC cameraBufferDesc;
-	ZeroMemory(&cameraBufferDesc, sizeof(cameraBufferDesc));
-	cameraBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cameraBufferDesc.ByteWidth = CAMERA_CONSTANT_BUFFER_SIZE;
-	cameraBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cameraBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	// Nested zones are only entered when they are also collected from their regions
+	bool bSplitZone = leaf != nullptr && leaf->IsZone() &&
+		(CullingParameters.Layout != CULLING_LAYOUT_FLAT || leaf->Ref.ZoneData->CompiledHierarchy.IsEmpty());
 
-	HRESULT result = device->CreateBuffer(&cameraBufferDesc, nullptr, &bufferCameraConstants);
-	if (FAILED(result))
+	if (leaf != nullptr && !bSplitZone)
+	{
+		tasksOut.push_back(task);
 		return false;
+	}
 
-	D3D11_BUFFER_DESC terrainPatchBufferDesc;
-	ZeroMemory(&terrainPatchBufferDesc, sizeof(terrainPatchBufferDesc));
-	terrainPatchBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	terrainPatchBufferDesc.ByteWidth = TERRAIN_PATCH_INSTANCE_CONSTANT_BUFFER_SIZE;
-	terrainPatchBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	terrainPatchBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-
-	result = device->CreateBuffer(&terrainPatchBufferDesc, nullptr, &bufferTerrainPatchInstanceConstants);
-	if (FAILED(result))
+	auto result = TestFrustum(region->AABB, cameraFrustum, &planeMask, &region->RejectPlane);
+	if (result == FRUSTUM_OUTSIDE || IsOccluded(region->AABB))
+		return true;
+	if (result == FRUSTUM_INSIDE && !CullingParameters.bOcclusionCulling)
+	{
+		tasksOut.push_back(task);
 		return false;
+	}
 
-	D3D11_BUFFER_DESC staticMeshBufferDesc = terrainPatchBufferDesc;
-	staticMeshBufferDesc.ByteWidth = STATIC_MESH_INSTANCE_CONSTANT_BUFFER_SIZE;
+	childTask.PlaneMask = planeMask;
+	if (bSplitZone)
+	{
+		childTask.Region = &leaf->Region;
+		tasksOut.push_back(childTask);
+		return true;
+	}
 
-	result = device->CreateBuffer(&staticMeshBufferDesc, nullptr, &bufferStaticMeshInstanceConstants);
-	if (FAILED(result))
-		return false;
+	for (auto child : { region->Node1, region->Node2, region->Node3 })
+	{
+		if (child != nullptr)
+		{
+			childTask.Region = child;
+			tasksOut.push_back(childTask);
+		}
+	}
 
 	return true;
 }
 
-bool Renderer::InitInternalVertexBuffers()
+// Occluders of the zone and its nested zones. Those outside of the frustum cover none of the buffer.
+void Renderer::RasterizeOccluders(SceneNode* zone, const Frustum& cameraFrustum)
 {
-	float blitBufferData[] =
+	for (auto occluder : zone->Ref.ZoneData->Occluders)
 	{
-		-1.0f, 1.0f,
-		0.0f, 0.0f,
-
-		1.0f, 1.0f,
-		1.0f, 0.0f,
-
-		-1.0f, -1.0f,
-		0.0f, 1.0f,
-
-		-1.0f, -1.0f,
-		0.0f, 1.0f,
+		if (!IsOutsideFrustum(occluder->Region.AABB, cameraFrustum))
+			occlusionBuffer.RasterizeNode(occluder);
+	}
 
-		1.0f, 1.0f,
-		1.0f, 0.0f,
+	for (auto child : zone->Children)
+	{
+		if (child->IsZone())
+			RasterizeOccluders(child, cameraFrustum);
+	}
+}
 
-		1.0f, -1.0f,
-		1.0f, 1.0f
-	};
+void Renderer::CollectVisibleNodesParallel(SceneNode* sceneRoot, const Frustum& cameraFrustum, NodeCollection& nodes)
+{
+	auto workers = CullingParameters.Workers;
+	auto compiledHierarchy = &sceneRoot->Ref.ZoneData->CompiledHierarchy;
+	bool bFlat = CullingParameters.Layout == CULLING_LAYOUT_FLAT && !compiledHierarchy->IsEmpty();
+
+	VisibilityTask rootTask;
+	rootTask.Region = bFlat ? nullptr : &sceneRoot->Region;
+	rootTask.Hierarchy = bFlat ? compiledHierarchy : nullptr;
+	rootTask.FlatIndex = 0;
+	rootTask.PlaneMask = FRUSTUM_PLANE_MASK_ALL;
+
+	visibilityTasks.clear();
+	visibilityTasks.push_back(rootTask);
+
+	// Split the hierarchy a level at a time until there is enough work to spread across the
+	// threads. Tasks stay in depth first order, so concatenating their results in task order
+	// gives the same collection as a serial pass regardless of the number of threads.
+	auto taskCount = (workers->GetThreadCount() + 1) * PARALLEL_CULLING_TASKS_PER_THREAD;
+	bool bSplit = true;
+
+	while (bSplit && visibilityTasks.size() < taskCount)
+	{
+		bSplit = false;
+		splitVisibilityTasks.clear();
 
-	D3D11_BUFFER_DESC blitBufferDesc;
-	blitBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	blitBufferDesc.ByteWidth = sizeof(blitBufferData);
-	blitBufferDesc.CPUAccessFlags = 0;
-	blitBufferDesc.MiscFlags = 0;
-	blitBufferDesc.StructureByteStride = 0;
-	blitBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		for (auto& task : visibilityTasks)
+			bSplit |= SplitVisibilityTask(task, cameraFrustum, splitVisibilityTasks);
 
-	D3D11_SUBRESOURCE_DATA subData;
-	ZeroMemory(&subData, sizeof(subData));
-	subData.pSysMem = blitBufferData;
+		swap(visibilityTasks, splitVisibilityTasks);
+	}
 
-	HRESULT hr = device->CreateBuffer(&blitBufferDesc, &subData, &bufferBlitVertices);
-	if (FAILED(hr))
-		return false;
+	if (visibilityTaskNodes.size() < visibilityTasks.size())
+		visibilityTaskNodes.resize(visibilityTasks.size());
 
-	return true;
-}
+	ParallelFor(workers, visibilityTasks.size(), 1, [this, &cameraFrustum](size_t begin, size_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& task = visibilityTasks[i];
+			auto& taskNodes = visibilityTaskNodes[i];
 
-void Renderer::NameObjectsDebug()
-{
-#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
-	SetDebugObjectName(forwardRenderTarget, "Back Buffer Render Target");
-
-	SetDebugObjectName(bufferBlitVertices, "Blit Vertices Vertex Buffer");
-	SetDebugObjectName(bufferCameraConstants, "Camera Constants Buffer");
-	SetDebugObjectName(bufferStaticMeshInstanceConstants, "Static Mesh Instance Constant Buffer");
-	SetDebugObjectName(bufferTerrainPatchInstanceConstants, "Terrain Patch Instance Constant Buffer");
-
-	SetDebugObjectName(vertexShaderBlit, "Blit Vertex Shader");
-	SetDebugObjectName(vertexShaderStaticMesh, "Static Mesh Vertex Shader");
-	SetDebugObjectName(vertexShaderStaticMeshInstanced, "Instanced Static Mesh Vertex Shader");
-	SetDebugObjectName(vertexShaderTerrainPatch, "Terrain Patch Vertex Shader");
-	SetDebugObjectName(pixelShaderDeferredComposite, "Blit Pixel Shader");
-	SetDebugObjectName(pixelShaderStaticMesh, "Static Mesh Pixel Shader");
-	SetDebugObjectName(pixelShaderTerrainPatch, "Terrain Patch Pixel Shader");
-
-	SetDebugObjectName(forwardDepthStencilView, "Default Depth Stencil View");
-	SetDebugObjectName(forwardDepthStencilTexture, "Depth Stencil Texture");
-	SetDebugObjectName(defaultDepthStencilState, "Forward Pass Depth Stencil State");
-	SetDebugObjectName(defaultRasterState, "Forward Pass Raster State");
-	SetDebugObjectName(wireframeRasterState, "Wireframe Raster State");
-	SetDebugObjectName(samplerStateLinearStaticMesh, "Linear Static Mesh Sampler");
-	SetDebugObjectName(samplerStateBlit, "Blit Sampler");
-	SetDebugObjectName(samplerStateTerrainPatch, "Terrain Patch Sampler");
-
-	SetDebugObjectName(inputLayoutStaticMesh, "Static Mesh Layout");
-	SetDebugObjectName(inputLayoutStaticMeshInstanced, "Static Mesh Instanced Layout");
-	SetDebugObjectName(inputLayoutBlit, "Blit Layout");
-	SetDebugObjectName(inputLayoutTerrainPatch, "Terrain Patch Layout");
-#endif
-}
+			taskNodes.StaticMeshes.clear();
+			taskNodes.InstancedStaticMeshes.clear();
+			taskNodes.TerrainPatches.clear();
+			taskNodes.Lights.clear();
 
-void Renderer::DestroyRenderTarget()
-{
-	SAFE_RELEASE(forwardDepthStencilView);
-	SAFE_RELEASE(forwardDepthStencilTexture);
-	SAFE_RELEASE(forwardRenderTarget);
-}
+			if (task.Hierarchy != nullptr)
+			{
+				CollectVisibleNodes(*task.Hierarchy, task.FlatIndex, task.Hierarchy->SkipIndices[task.FlatIndex],
+					cameraFrustum, task.PlaneMask, taskNodes, nullptr);
+			}
+			else
+				CollectVisibleNodes(task.Region, cameraFrustum, task.PlaneMask, taskNodes);
+		}
+	});
 
-void Renderer::DestroyDeferredTargets()
-{
-	for (auto resourceView : deferredShaderViews)
-		resourceView->Release();
-	for (auto targetView : deferredRenderTargets)
-		targetView->Release();
-	for (auto targetBuffer : deferredBuffers)
-		targetBuffer->Release();
-
-	deferredShaderViews.clear();
-	deferredRenderTargets.clear();
-	deferredBuffers.clear();
-
-	SAFE_RELEASE(deferredDepthShaderView);
-	SAFE_RELEASE(deferredDepthStencilView);
-	SAFE_RELEASE(deferredDepthStencilBuffer);
-
-	SAFE_RELEASE(lightRenderTarget);
-	SAFE_RELEASE(lightShaderView);
-	SAFE_RELEASE(lightTexture);
+	for (size_t i = 0; i < visibilityTasks.size(); ++i)
+		AppendNodeCollection(visibilityTaskNodes[i], nodes);
 }
 
-bool Renderer::Reset(const RenderParams& params)
+// Each zone reached through portals is collected once, with the frustum narrowed to the part
+// of the screen it was reached through
+void Renderer::CollectVisibleNodesPortals(SceneNode* sceneRoot, const XMFLOAT3& cameraPosition,
+	const Frustum& cameraFrustum, const XMFLOAT4X4& viewProjection, NodeCollection& nodes)
 {
-	if (params.Extent.Width == renderParameters.Extent.Width &&
-		params.Extent.Height == renderParameters.Extent.Height &&
-		params.Windowed == renderParameters.Windowed)
-		return true;
-
-	if (params.Extent.Width == 0 || params.Extent.Height == 0)
-		return false;
+	auto cameraZone = FindPortalZone(sceneRoot, cameraPosition);
 
-	if (!bDisposed)
+	// Outside of every portal zone, with no portals to look through, the zones with portals can
+	// only be seen from outside, so they are collected along with the rest of the scene
+	if (!IsPortalZone(cameraZone))
 	{
-		DestroyRenderTarget();
-		DestroyDeferredTargets();
-
-		if (renderParameters.Windowed != params.Windowed)
-			swapChain->SetFullscreenState(!params.Windowed, nullptr);
+		CollectVisibleNodes(sceneRoot, cameraFrustum, FRUSTUM_PLANE_MASK_ALL, nodes);
+		return;
+	}
 
-		renderParameters = params;
+	CollectPortalVisits(cameraZone, cameraFrustum, viewProjection, &portalVisits);
 
-		HRESULT result = swapChain->ResizeBuffers(2, renderParameters.Extent.Width,
-			renderParameters.Extent.Height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+	bSkipPortalZones = true;
 
-		if (FAILED(result))
-			return false;
+	for (auto& visit : portalVisits)
+	{
+		Frustum zoneFrustum;
+		ConstructPortalFrustum(visit.Rect, viewProjection, cameraFrustum, &zoneFrustum);
+		CollectVisibleNodes(visit.Zone, zoneFrustum, FRUSTUM_PLANE_MASK_ALL, nodes);
+	}
 
-		if (!InitRenderTarget())
-			return false;
+	bSkipPortalZones = false;
+}
 
-		if (!InitDeferredTargets())
-			return false;
+// Gathers the lights of the zone and of every zone nested in it
+inline void CollectSceneLights(SceneNode* zone, vector<SceneNode*>& lights)
+{
+	auto& zoneLights = zone->Ref.ZoneData->Lights;
+	lights.insert(lights.end(), zoneLights.begin(), zoneLights.end());
 
-		return true;
+	for (auto child : zone->Children)
+	{
+		if (child->IsZone())
+			CollectSceneLights(child, lights);
 	}
-	else
-		return false;
 }
 
-void Renderer::CollectVisibleNodes(RegionNode* node, const Frustum& cameraFrustum, NodeCollection& nodes)
+void Renderer::PrepareShadowCascades(SceneNode* sceneRoot, ICamera* camera, const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection, TaskGroup& tasks)
 {
-	if (IsOutsideFrustum(node->AABB, cameraFrustum))
-		return;
+	auto shadowInfo = camera->GetShadowInfo();
 
-	if (node->LeafData != nullptr)
+	const LightData* sun = nullptr;
+	for (auto light : sceneLights)
 	{
-		if (node->LeafData->IsZone())
-			CollectVisibleNodes(node->LeafData, cameraFrustum, nodes);
-		else if (node->LeafData->IsMesh())
+		if (light->Ref.LightData->Type == LIGHT_TYPE_DIRECTIONAL)
 		{
-			if (node->LeafData->IsStaticMesh())
-				nodes.StaticMeshes.push_back(node->LeafData);
-			else if (node->LeafData->IsStaticMeshInstanced())
-				nodes.InstancedStaticMeshes.push_back(node->LeafData);
-			else if (node->LeafData->IsTerrainPatch())
-				nodes.TerrainPatches.push_back(node->LeafData);
+			sun = light->Ref.LightData;
+			break;
 		}
 	}
 
-	if (node->Node1 != nullptr)
-		CollectVisibleNodes(node->Node1, cameraFrustum, nodes);
-	if (node->Node2 != nullptr)
-		CollectVisibleNodes(node->Node2, cameraFrustum, nodes);
-	if (node->Node3 != nullptr)
-		CollectVisibleNodes(node->Node3, cameraFrustum, nodes);
-}
+	if (sun == nullptr || shadowInfo == nullptr)
+	{
+		shadowCascades.clear();
+		return;
+	}
 
-void Renderer::CollectVisibleNodes(SceneNode* node, const Frustum& cameraFrustum, NodeCollection& nodes)
-{
-	if (!node->IsZone())
+	// Fitting is cheap, so only collecting the casters is left to the task. The cascades are
+	// collected together in one walk of the hierarchy.
+	shadowCascades.resize(min<size_t>(shadowInfo->Cascades.size(), MAX_CULLING_VIEWS));
+	shadowCasterFrusta.clear();
+	vector<ShadowCascade*> fittedCascades;
+
+	for (size_t i = 0; i < shadowCascades.size(); ++i)
 	{
-		OutputDebugString("Attempted static mesh collection on non-zone node!\n");
+		if (FitShadowCascade(view, projection, shadowInfo->Cascades[i], sun->Direction, sceneRoot->Region.AABB,
+			&shadowCascades[i]))
+		{
+			shadowCasterFrusta.push_back(shadowCascades[i].CasterVolume);
+			fittedCascades.push_back(&shadowCascades[i]);
+		}
+	}
+
+	if (fittedCascades.empty())
 		return;
+
+	shadowCasterNodes.resize(fittedCascades.size());
+	for (auto& nodes : shadowCasterNodes)
+	{
+		nodes.StaticMeshes.clear();
+		nodes.InstancedStaticMeshes.clear();
+		nodes.TerrainPatches.clear();
 	}
 
-	CollectVisibleNodes(&node->Region, cameraFrustum, nodes);
+	tasks.Run([this, sceneRoot, fittedCascades]()
+	{
+		CollectVisibleNodes(sceneRoot, shadowCasterFrusta.data(), static_cast<uint32_t>(fittedCascades.size()),
+			shadowCasterNodes.data());
+
+		for (size_t i = 0; i < fittedCascades.size(); ++i)
+		{
+			auto& nodes = shadowCasterNodes[i];
+			auto& casters = fittedCascades[i]->Casters;
+			casters.insert(casters.end(), nodes.StaticMeshes.begin(), nodes.StaticMeshes.end());
+			casters.insert(casters.end(), nodes.InstancedStaticMeshes.begin(), nodes.InstancedStaticMeshes.end());
+			casters.insert(casters.end(), nodes.TerrainPatches.begin(), nodes.TerrainPatches.end());
+		}
+	});
 }
 
 void Renderer::DeferredRenderPass(SceneNode* sceneRoot, ICamera* camera,
@@ -841,10 +1167,10 @@ void Renderer::DeferredRenderPass(SceneNode* sceneRoot, ICamera* camera,
 {
 	// Deferred pass
 	FLOAT clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-	deviceContext->ClearRenderTargetView(renderTargets[0], clearColor);
-	deviceContext->ClearDepthStencilView(deferredDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
-	deviceContext->OMSetRenderTargets(renderTargets.size(), renderTargets.data(), depthStencilView);
-	deviceContext->OMSetDepthStencilState(defaultDepthStencilState, 0);
+	context->ClearRenderTargetView(renderTargets[0], clearColor);
+	context->ClearDepthStencilView(deferredDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	context->OMSetRenderTargets(renderTargets.size(), renderTargets.data(), depthStencilView);
+	context->OMSetDepthStencilState(defaultDepthStencilState, 0);
 
 	// Compute the camera frustum
 	Frustum cameraFrustum;
@@ -856,18 +1182,59 @@ void Renderer::DeferredRenderPass(SceneNode* sceneRoot, ICamera* camera,
 	camera->GetProjectionMatrix(&transforms[1], renderParameters.Extent);
 
 	D3D11_MAPPED_SUBRESOURCE mappedSubRes;
-	deviceContext->Map(bufferCameraConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubRes);
+	context->Map(bufferCameraConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubRes);
 	memcpy(mappedSubRes.pData, transforms, sizeof(transforms));
-	deviceContext->Unmap(bufferCameraConstants, 0);
+	context->Unmap(bufferCameraConstants, 0);
+
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMLoadFloat4x4(&transforms[0]), XMLoadFloat4x4(&transforms[1])));
+
+	// Rasterize the occluders before any regions are tested against them
+	if (CullingParameters.bOcclusionCulling)
+	{
+		occlusionBuffer.Begin(XMLoadFloat4x4(&viewProjection));
+		RasterizeOccluders(sceneRoot, cameraFrustum);
+		occlusionBuffer.End();
+	}
+
+	// Shadow casters are collected alongside the visible meshes
+	sceneLights.clear();
+	CollectSceneLights(sceneRoot, sceneLights);
+
+	TaskGroup shadowTasks(CullingParameters.Workers);
+	if (ShadowParameters.bEnabled)
+		PrepareShadowCascades(sceneRoot, camera, transforms[0], transforms[1], shadowTasks);
+	else
+		shadowCascades.clear();
 
 	// Collect all of the visible meshes
+	XMFLOAT3 cameraPosition;
+	camera->GetPosition(&cameraPosition);
+
 	NodeCollection nodes;
-	CollectVisibleNodes(sceneRoot, cameraFrustum, nodes);
+	if (CullingParameters.bPortalCulling)
+		CollectVisibleNodesPortals(sceneRoot, cameraPosition, cameraFrustum, viewProjection, nodes);
+	else if (CullingParameters.bCoherentCulling && !CullingParameters.bOcclusionCulling)
+		CollectVisibleNodesCoherent(sceneRoot, cameraFrustum, nodes);
+	else if (CullingParameters.Workers != nullptr)
+		CollectVisibleNodesParallel(sceneRoot, cameraFrustum, nodes);
+	else
+		CollectVisibleNodes(sceneRoot, cameraFrustum, FRUSTUM_PLANE_MASK_ALL, nodes);
+
+	shadowTasks.Wait();
+
+	// The projection's y scale maps a unit length at unit distance to half the screen height
+	SelectMeshLods(nodes, cameraPosition, transforms[1].m[1][1] * 0.5f * renderParameters.Extent.Height);
 	SortMeshNodes(nodes, camera);
 
-	RenderStaticMeshes(nodes.StaticMeshes.begin(), nodes.StaticMeshes.end());
-	RenderStaticMeshesInstanced(nodes.InstancedStaticMeshes.begin(), nodes.InstancedStaticMeshes.end());
-	RenderTerrainPatches(nodes.TerrainPatches.begin(), nodes.TerrainPatches.end());
+	// Every transformation drawn goes up in one write, ahead of the draws that read it
+	ZeroMemory(&drawStats, sizeof(drawStats));
+	if (!UploadTransforms(nodes))
+		return;
+
+	// The draws are prepared in chunks across the workers, then issued from this thread alone
+	BuildDrawPackets(nodes);
+	SubmitDrawPackets();
 }
 
 void Renderer::LightRenderPass(SceneNode* sceneRoot, ICamera* camera, 
@@ -880,11 +1247,20 @@ void Renderer::LightRenderPass(SceneNode* sceneRoot, ICamera* camera,
 		shaderResourceViews.push_back(deferredResourceViews[i]);
 	shaderResourceViews.push_back(deferredDepthResourceView);
 
-	deviceContext->OMSetRenderTargets(1, &renderTarget, nullptr);
-	deviceContext->OMSetDepthStencilState(blitDepthStencilState, 0);
+	context->OMSetRenderTargets(1, &renderTarget, nullptr);
+	context->OMSetDepthStencilState(blitDepthStencilState, 0);
 
 	FLOAT color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	deviceContext->ClearRenderTargetView(renderTarget, color);
+	context->ClearRenderTargetView(renderTarget, color);
+
+	// Bin the lights of every zone, gathered by the deferred pass, into clusters of the view
+	XMFLOAT4X4 view;
+	XMFLOAT4X4 projection;
+	camera->GetViewMatrix(&view);
+	camera->GetProjectionMatrix(&projection, renderParameters.Extent);
+
+	lightClusters.Build(sceneLights, view, projection, CullingParameters.Workers);
+	UploadLightClusters();
 }
 
 void Renderer::ForwardRenderPass(SceneNode* sceneRoot, ICamera* camera,
@@ -900,222 +1276,319 @@ void Renderer::ForwardRenderPass(SceneNode* sceneRoot, ICamera* camera,
 	shaderResourceViews.push_back(deferredDepthResourceView);
 	shaderResourceViews.push_back(lightResourceView);
 
-	deviceContext->OMSetRenderTargets(1, &renderTarget, depthStencilView);
-	deviceContext->OMSetDepthStencilState(blitDepthStencilState, 0);
+	context->OMSetRenderTargets(1, &renderTarget, depthStencilView);
+	context->OMSetDepthStencilState(blitDepthStencilState, 0);
 
 	UINT stride = elementLayoutBlit.Stride;
 	UINT offset = 0;
 
-	deviceContext->VSSetShader(vertexShaderBlit, nullptr, 0);
-	deviceContext->PSSetShader(pixelShaderDeferredComposite, nullptr, 0);
-	deviceContext->PSSetShaderResources(0, shaderResourceViews.size(), shaderResourceViews.data());
-	deviceContext->PSSetSamplers(0, 1, &samplerStateBlit);
+	context->VSSetShader(vertexShaderBlit, nullptr, 0);
+	context->PSSetShader(pixelShaderDeferredComposite, nullptr, 0);
+	context->PSSetShaderResources(0, shaderResourceViews.size(), shaderResourceViews.data());
+	context->PSSetSamplers(0, 1, &samplerStateBlit);
 
-	deviceContext->IASetInputLayout(inputLayoutBlit);
-	deviceContext->IASetVertexBuffers(0, 1, &bufferBlitVertices, &stride, &offset);
+	context->IASetInputLayout(inputLayoutBlit);
+	context->IASetVertexBuffers(0, 1, &bufferBlitVertices, &stride, &offset);
 
-	deviceContext->Draw(6, 0);
+	context->Draw(6, 0);
 }
 
 void Renderer::ClearPixelShaderResources(const size_t resourceCount)
 {
 	unique_ptr<ID3D11ShaderResourceView*[]> resourceViews(new ID3D11ShaderResourceView*[resourceCount]);
 	ZeroMemory(resourceViews.get(), sizeof(ID3D11ShaderResourceView*) * resourceCount);
-	deviceContext->PSSetShaderResources(0, resourceCount, resourceViews.get());
+	context->PSSetShaderResources(0, resourceCount, resourceViews.get());
 }
 
-void Renderer::RenderStaticMeshes(vector<SceneNode*>::iterator& begin, vector<SceneNode*>::iterator& end)
+bool Renderer::UploadTransforms(const NodeCollection& nodes)
 {
-	// Set primitive topology and input layout for static meshes
-	deviceContext->IASetInputLayout(inputLayoutStaticMesh);
+	instanceCache.Clear();
+
+	for (auto node : nodes.StaticMeshes)
+		instanceCache.Push(node->Transform.Global);
+	for (auto node : nodes.InstancedStaticMeshes)
+		instanceCache.Push(node->Transform.Global);
+	for (auto node : nodes.TerrainPatches)
+		instanceCache.Push(node->Transform.Global);
+
+	if (instanceCache.GetSize() == 0)
+		return false;
 
-	deviceContext->VSSetShader(vertexShaderStaticMesh, nullptr, 0);
-	deviceContext->PSSetShader(pixelShaderStaticMesh, nullptr, 0);
-	deviceContext->PSSetSamplers(0, 1, &samplerStateLinearStaticMesh);
+	return instanceRing.Write(instanceCache.GetData(), sizeof(XMFLOAT4X4) * instanceCache.GetSize(),
+		&transformBuffer, &transformOffset);
+}
+
+bool Renderer::UploadLightClusters()
+{
+	auto size = lightClusters.GetPackedSize();
+	if (size > lightClusterBufferSize)
+	{
+		if (lightClusterBuffer != nullptr)
+			context->Release(lightClusterBuffer);
+		lightClusterBuffer = nullptr;
+		lightClusterBufferSize = 0;
+
+		D3D11_BUFFER_DESC clusterBufferDesc;
+		ZeroMemory(&clusterBufferDesc, sizeof(clusterBufferDesc));
+		clusterBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		clusterBufferDesc.ByteWidth = static_cast<UINT>(2 * size * sizeof(uint32_t));
+		clusterBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		clusterBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		clusterBufferDesc.StructureByteStride = sizeof(uint32_t);
+		clusterBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+
+		HRESULT result = context->CreateBuffer(&clusterBufferDesc, nullptr, &lightClusterBuffer);
+		if (FAILED(result))
+		{
+			OutputDebugString("Failed to create the light cluster buffer!\n");
+			return false;
+		}
 
-	ID3D11Buffer* vertexShaderConstantBuffers[] = { bufferCameraConstants, bufferStaticMeshInstanceConstants };
-	deviceContext->VSSetConstantBuffers(0, 2, vertexShaderConstantBuffers);
+		lightClusterBufferSize = 2 * size;
+	}
 
+	// Nothing of the last frame's lights is kept, so the whole buffer is discarded
 	D3D11_MAPPED_SUBRESOURCE mappedSubRes;
+	if (FAILED(context->Map(lightClusterBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubRes)))
+		return false;
+
+	lightClusters.Pack(static_cast<uint32_t*>(mappedSubRes.pData));
+	context->Unmap(lightClusterBuffer, 0);
+	return true;
+}
+
+void Renderer::BuildDrawPackets(const NodeCollection& nodes)
+{
+	// Every list is cut into chunks of its own, built into packets on the workers and submitted
+	// in the order of the lists
+	auto staticChunkCount = (nodes.StaticMeshes.size() + DRAW_PACKET_CHUNK_SIZE - 1) / DRAW_PACKET_CHUNK_SIZE;
+	auto instancedChunkCount = (nodes.InstancedStaticMeshes.size() + DRAW_PACKET_CHUNK_SIZE - 1) / DRAW_PACKET_CHUNK_SIZE;
+	auto terrainChunkCount = (nodes.TerrainPatches.size() + DRAW_PACKET_CHUNK_SIZE - 1) / DRAW_PACKET_CHUNK_SIZE;
+
+	drawPacketChunkCount = staticChunkCount + instancedChunkCount + terrainChunkCount;
+	if (drawPacketChunks.size() < drawPacketChunkCount)
+		drawPacketChunks.resize(drawPacketChunkCount);
 
-	auto it = begin;
+	auto instancedBegin = static_cast<UINT>(nodes.StaticMeshes.size());
+	auto terrainBegin = instancedBegin + static_cast<UINT>(nodes.InstancedStaticMeshes.size());
 
-	while (it != end)
+	TaskGroup tasks(DrawParameters.Workers);
+	for (size_t i = 0; i < staticChunkCount; ++i)
 	{
-		// Begin material for this batch
-		auto currentMaterial = (*it)->MaterialData;
-		auto endMaterialIt = upper_bound(it, end, *it, CompareMaterials);
+		tasks.Run([this, &nodes, i]()
+		{
+			auto& meshes = nodes.StaticMeshes;
+			BuildStaticMeshPackets(meshes, i * DRAW_PACKET_CHUNK_SIZE,
+				min((i + 1) * DRAW_PACKET_CHUNK_SIZE, meshes.size()), 0, drawPacketChunks[i]);
+		});
+	}
 
-		if (currentMaterial->Type == MATERIAL_TYPE_STANDARD)
+	for (size_t i = 0; i < instancedChunkCount; ++i)
+	{
+		tasks.Run([this, &nodes, i, instancedBegin, staticChunkCount]()
 		{
-			if (currentMaterial->PixelResourceViews.size() > 0)
-				deviceContext->PSSetShaderResources(0, currentMaterial->PixelResourceViews.size(), currentMaterial->PixelResourceViews.data());
-			if (currentMaterial->PixelConstantBuffers.size() > 0)
-				deviceContext->PSSetConstantBuffers(0, currentMaterial->PixelConstantBuffers.size(), currentMaterial->PixelConstantBuffers.data());
-		}
+			auto& meshes = nodes.InstancedStaticMeshes;
+			BuildStaticMeshPackets(meshes, i * DRAW_PACKET_CHUNK_SIZE,
+				min((i + 1) * DRAW_PACKET_CHUNK_SIZE, meshes.size()), instancedBegin,
+				drawPacketChunks[staticChunkCount + i]);
+		});
+	}
 
-		while (it != endMaterialIt)
+	for (size_t i = 0; i < terrainChunkCount; ++i)
+	{
+		tasks.Run([this, &nodes, i, terrainBegin, staticChunkCount, instancedChunkCount]()
 		{
-			// Begin mesh for this batch
-			auto currentMesh = (*it)->Ref.StaticMesh;
-			auto endMeshIt = upper_bound(it, endMaterialIt, *it, CompareMeshes);
-			auto vertexBuffer = currentMesh->GetVertexBuffer();
-			auto indexBuffer = currentMesh->GetIndexBuffer();
-			UINT stride = elementLayoutStaticMesh.Stride;
-			UINT offset = 0;
-
-			// Bind mesh vertex and index buffers
-			deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-			deviceContext->IASetIndexBuffer(indexBuffer, currentMesh->GetIndexFormat(), 0);
-
-			for (; it != endMeshIt; ++it)
-			{
-				deviceContext->Map(bufferStaticMeshInstanceConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubRes);
-				memcpy(mappedSubRes.pData, &(*it)->Transform.Global, sizeof((*it)->Transform.Global));
-				deviceContext->Unmap(bufferStaticMeshInstanceConstants, 0);
+			auto& patches = nodes.TerrainPatches;
+			BuildTerrainPatchPackets(patches, i * DRAW_PACKET_CHUNK_SIZE,
+				min((i + 1) * DRAW_PACKET_CHUNK_SIZE, patches.size()), terrainBegin,
+				drawPacketChunks[staticChunkCount + instancedChunkCount + i]);
+		});
+	}
 
-				deviceContext->DrawIndexed(currentMesh->GetIndexCount(), 0, 0);
-			}
+	tasks.Wait();
+}
+
+void Renderer::BuildStaticMeshPackets(const vector<SceneNode*>& nodes, const size_t begin, const size_t end,
+	const UINT firstTransform, vector<DrawPacket>& packetsOut)
+{
+	packetsOut.clear();
+
+	// Batches crossing the edges of the chunk are cut there, and joined again when submitted
+	auto it = nodes.begin() + begin;
+	auto endIt = nodes.begin() + end;
+
+	while (it != endIt)
+	{
+		auto material = (*it)->MaterialData;
+		auto mesh = (*it)->Ref.StaticMesh;
+		auto& lod = mesh->GetLod((*it)->LodLevel);
+		auto batchEndIt = find_if(it + 1, endIt, [it](SceneNode* node) { return !IsSameBatch(*it, node); });
+
+		DrawPacket packet;
+		packet.Pipeline = DRAW_PIPELINE_STATIC_MESH;
+		packet.VertexBuffer = mesh->GetVertexBuffer();
+		packet.IndexBuffer = mesh->GetIndexBuffer();
+		packet.IndexFormat = mesh->GetIndexFormat();
+		packet.ResourceViews = nullptr;
+		packet.ConstantBuffers = nullptr;
+		packet.ResourceViewCount = 0;
+		packet.ConstantBufferCount = 0;
+		packet.IndexCount = static_cast<UINT>(lod.IndexCount);
+		packet.IndexOffset = static_cast<UINT>(lod.IndexOffset);
+
+		if (material->Type == MATERIAL_TYPE_STANDARD)
+		{
+			packet.ResourceViews = material->PixelResourceViews.data();
+			packet.ConstantBuffers = material->PixelConstantBuffers.data();
+			packet.ResourceViewCount = static_cast<uint32_t>(material->PixelResourceViews.size());
+			packet.ConstantBufferCount = static_cast<uint32_t>(material->PixelConstantBuffers.size());
 		}
+
+		// Every node reads its transformation from the frame's shared stream by instance, so the
+		// whole batch is one draw starting at the transformation of its first node
+		packet.InstanceCount = static_cast<UINT>(batchEndIt - it);
+		packet.FirstInstance = firstTransform + static_cast<UINT>(it - nodes.begin());
+		packetsOut.push_back(packet);
+
+		it = batchEndIt;
+	}
+}
+
+void Renderer::BuildTerrainPatchPackets(const vector<SceneNode*>& nodes, const size_t begin, const size_t end,
+	const UINT firstTransform, vector<DrawPacket>& packetsOut)
+{
+	packetsOut.clear();
+
+	for (size_t i = begin; i < end; ++i)
+	{
+		auto terrainPatch = nodes[i]->Ref.TerrainPatch;
+
+		DrawPacket packet;
+		packet.Pipeline = DRAW_PIPELINE_TERRAIN_PATCH;
+		packet.VertexBuffer = terrainPatch->MeshData.VertexBuffer;
+		packet.IndexBuffer = terrainPatch->MeshData.IndexBuffer;
+		packet.IndexFormat = DXGI_FORMAT_R16_UINT;
+		packet.ResourceViews = &terrainPatch->MaterialData.Albedo;
+		packet.ConstantBuffers = nullptr;
+		packet.ResourceViewCount = 1;
+		packet.ConstantBufferCount = 0;
+		packet.IndexCount = static_cast<UINT>(terrainPatch->MeshData.IndexCount);
+		packet.IndexOffset = 0;
+		packet.InstanceCount = 1;
+		packet.FirstInstance = firstTransform + static_cast<UINT>(i);
+		packetsOut.push_back(packet);
 	}
 }
 
-void Renderer::RenderStaticMeshesInstanced(vector<SceneNode*>::iterator& begin, vector<SceneNode*>::iterator& end)
+void Renderer::BindDrawPipeline(const DrawPipeline pipeline)
 {
-	// Set primitive topology and input layout for static meshes
-	deviceContext->IASetInputLayout(inputLayoutStaticMeshInstanced);
+	if (pipeline == DRAW_PIPELINE_STATIC_MESH)
+	{
+		context->IASetInputLayout(inputLayoutStaticMeshInstanced);
+		context->VSSetShader(vertexShaderStaticMeshInstanced, nullptr, 0);
+		context->PSSetShader(pixelShaderStaticMesh, nullptr, 0);
+	}
+	else
+	{
+		context->IASetInputLayout(inputLayoutTerrainPatch);
+		context->VSSetShader(vertexShaderTerrainPatch, nullptr, 0);
+		context->PSSetShader(pixelShaderTerrainPatch, nullptr, 0);
+	}
+
+	context->PSSetSamplers(0, 1, &samplerStateLinearStaticMesh);
+	context->VSSetConstantBuffers(0, 1, &bufferCameraConstants);
 
-	// Set material stage parameters
-	deviceContext->VSSetShader(vertexShaderStaticMeshInstanced, nullptr, 0);
-	deviceContext->PSSetShader(pixelShaderStaticMesh, nullptr, 0);
-	deviceContext->PSSetSamplers(0, 1, &samplerStateLinearStaticMesh);
-	deviceContext->VSSetConstantBuffers(0, 1, &bufferCameraConstants);
+	// Bind the frame's transformations
+	UINT transformStride = sizeof(XMFLOAT4X4);
+	context->IASetVertexBuffers(1, 1, &transformBuffer, &transformStride, &transformOffset);
+}
 
-	auto it = begin;
+void Renderer::SubmitDrawPackets()
+{
+	auto pipeline = DRAW_PIPELINE_COUNT;
+	bool bBindBuffers = true;
+	ID3D11Buffer* vertexBuffer = nullptr;
+	ID3D11Buffer* indexBuffer = nullptr;
+	ID3D11ShaderResourceView* const* resourceViews = nullptr;
+	ID3D11Buffer* const* constantBuffers = nullptr;
+	UINT stride = 0;
+	UINT offset = 0;
 
-	while (it != end)
+	auto submitPacket = [&](const DrawPacket& packet)
 	{
-		// Begin material for this batch
-		auto currentMaterial = (*it)->MaterialData;
-		auto endMaterialIt = upper_bound(it, end, *it, CompareMaterials);
+		if (packet.Pipeline != pipeline)
+		{
+			pipeline = packet.Pipeline;
+			BindDrawPipeline(pipeline);
+			stride = pipeline == DRAW_PIPELINE_STATIC_MESH ? elementLayoutStaticMeshInstanced.Stride :
+				elementLayoutTerrainPatch.Stride;
+			bBindBuffers = true;
+		}
 
-		if (currentMaterial->Type == MATERIAL_TYPE_STANDARD)
+		if (bBindBuffers || packet.VertexBuffer != vertexBuffer)
 		{
-			if (currentMaterial->PixelResourceViews.size() > 0)
-				deviceContext->PSSetShaderResources(0, currentMaterial->PixelResourceViews.size(), currentMaterial->PixelResourceViews.data());
-			if (currentMaterial->PixelConstantBuffers.size() > 0)
-				deviceContext->PSSetConstantBuffers(0, currentMaterial->PixelConstantBuffers.size(), currentMaterial->PixelConstantBuffers.data());
+			vertexBuffer = packet.VertexBuffer;
+			context->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
 		}
 
-		while (it != endMaterialIt)
+		if (bBindBuffers || packet.IndexBuffer != indexBuffer)
 		{
-			// Begin mesh for this batch
-			auto currentMesh = (*it)->Ref.StaticMesh;
-			auto endMeshIt = upper_bound(it, endMaterialIt, *it, CompareMeshes);
-			auto vertexBuffer = currentMesh->GetVertexBuffer();
-			auto indexBuffer = currentMesh->GetIndexBuffer();
-			UINT stride = elementLayoutStaticMeshInstanced.Stride;
-			UINT offset = 0;
-
-			// Bind mesh vertex and index buffers
-			deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-			deviceContext->IASetIndexBuffer(indexBuffer, currentMesh->GetIndexFormat(), 0);
-
-			// Collect instance transformation
-			instanceCache.Clear();
-
-			for (; it != endMeshIt; ++it)
-				instanceCache.Push((*it)->Transform.Global);
-
-			// Create transformation instance vertex buffer
-			ID3D11Buffer* instanceBuffer;
-
-			D3D11_BUFFER_DESC bufferDesc;
-			bufferDesc.Usage = D3D11_USAGE_DEFAULT;
-			bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-			bufferDesc.ByteWidth = sizeof(XMFLOAT4X4) * instanceCache.GetSize();
-			bufferDesc.CPUAccessFlags = 0;
-			bufferDesc.MiscFlags = 0;
-			bufferDesc.StructureByteStride = 0;
-
-			D3D11_SUBRESOURCE_DATA subData;
-			ZeroMemory(&subData, sizeof(subData));
-			subData.pSysMem = instanceCache.GetData();
-
-			HRESULT result = device->CreateBuffer(&bufferDesc, &subData, &instanceBuffer);
-			if (FAILED(result))
-				OutputDebugString("Failed to create instance buffer!\n");
-
-			// Bind the created buffer
-			UINT instanceStride = sizeof(XMFLOAT4X4);
-			deviceContext->IASetVertexBuffers(1, 1, &instanceBuffer, &instanceStride, &offset);
-
-			// Draw instances
-			deviceContext->DrawIndexedInstanced(currentMesh->GetIndexCount(), instanceCache.GetSize(), 0, 0, 0);
-
-			// Clean up
-			instanceBuffer->Release();
+			indexBuffer = packet.IndexBuffer;
+			context->IASetIndexBuffer(indexBuffer, packet.IndexFormat, 0);
 		}
-	}
-}
 
-void Renderer::RenderTerrainPatches(vector<SceneNode*>::iterator& begin, vector<SceneNode*>::iterator& end)
-{
-	// Set input layout for static meshes
-	deviceContext->IASetInputLayout(inputLayoutTerrainPatch);
+		bBindBuffers = false;
 
-	deviceContext->VSSetShader(vertexShaderTerrainPatch, nullptr, 0);
-	deviceContext->PSSetShader(pixelShaderTerrainPatch, nullptr, 0);
-	deviceContext->PSSetSamplers(0, 1, &samplerStateLinearStaticMesh);
+		if (packet.ResourceViewCount > 0 && packet.ResourceViews != resourceViews)
+		{
+			resourceViews = packet.ResourceViews;
+			context->PSSetShaderResources(0, packet.ResourceViewCount, resourceViews);
+		}
 
-	ID3D11Buffer* vertexShaderConstantBuffers[] = { bufferCameraConstants, bufferTerrainPatchInstanceConstants };
-	deviceContext->VSSetConstantBuffers(0, 2, vertexShaderConstantBuffers);
+		if (packet.ConstantBufferCount > 0 && packet.ConstantBuffers != constantBuffers)
+		{
+			constantBuffers = packet.ConstantBuffers;
+			context->PSSetConstantBuffers(0, packet.ConstantBufferCount, constantBuffers);
+		}
 
-	D3D11_MAPPED_SUBRESOURCE mappedSubRes;
+		context->DrawIndexedInstanced(packet.IndexCount, packet.InstanceCount, packet.IndexOffset, 0,
+			packet.FirstInstance);
 
-	for (auto it = begin; it != end; ++it)
-	{
-		auto terrainNode = *it;
+		++drawStats.DrawCount;
+		if (packet.InstanceCount > 1)
+			drawStats.InstancedNodeCount += packet.InstanceCount;
+	};
 
-		UINT stride = elementLayoutTerrainPatch.Stride;
-		UINT offset = 0;
+	// Each packet is held back until the next shows it does not continue into another chunk
+	DrawPacket pending;
+	bool bPending = false;
 
-		deviceContext->IASetVertexBuffers(0, 1, &terrainNode->Ref.TerrainPatch->MeshData.VertexBuffer, &stride, &offset);
-		deviceContext->IASetIndexBuffer(terrainNode->Ref.TerrainPatch->MeshData.IndexBuffer, DXGI_FORMAT_R16_UINT, offset);
-		deviceContext->PSSetShaderResources(0, 1, &terrainNode->Ref.TerrainPatch->MaterialData.Albedo);
+	for (size_t chunk = 0; chunk < drawPacketChunkCount; ++chunk)
+	{
+		for (auto& packet : drawPacketChunks[chunk])
+		{
+			if (bPending && IsSameDraw(pending, packet))
+			{
+				pending.InstanceCount += packet.InstanceCount;
+				continue;
+			}
 
-		deviceContext->Map(bufferTerrainPatchInstanceConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubRes);
-		memcpy(mappedSubRes.pData, &terrainNode->Transform.Global, sizeof(terrainNode->Transform.Global));
-		deviceContext->Unmap(bufferTerrainPatchInstanceConstants, 0);
+			if (bPending)
+				submitPacket(pending);
 
-		deviceContext->DrawIndexed(terrainNode->Ref.TerrainPatch->MeshData.IndexCount, 0, 0);
+			pending = packet;
+			bPending = true;
+		}
 	}
+
+	if (bPending)
+		submitPacket(pending);
 }
 
 void Renderer::SortMeshNodes(NodeCollection& nodes, ICamera* camera)
 {
-	// Get camera position
-	XMFLOAT3 cameraPosition;
-	camera->GetPosition(&cameraPosition);
-	XMVECTOR cameraPositionVec = XMLoadFloat3(&cameraPosition);
-
-	auto compareDistance = [&camera, &cameraPositionVec](SceneNode* n1, SceneNode* n2)
-	{
-		float d1;
-		float d2;
-		XMStoreFloat(&d1, XMVector3LengthSq(cameraPositionVec - 0.5f *
-			(XMLoadFloat3(&n1->Region.AABB.Lower) +
-				XMLoadFloat3(&n1->Region.AABB.Upper))));
-		XMStoreFloat(&d2, XMVector3LengthSq(cameraPositionVec - 0.5f *
-			(XMLoadFloat3(&n2->Region.AABB.Lower) +
-				XMLoadFloat3(&n2->Region.AABB.Upper))));
-		return d1 < d2;
-	};
-
-	auto isOpaque = [](SceneNode* n)
-	{
-		return !n->MaterialData->IsTransparent;
-	};
+	XMFLOAT4X4 view;
+	camera->GetViewMatrix(&view);
 
 	auto compareLights = [](SceneNode* n1, SceneNode* n2)
 	{
@@ -1123,19 +1596,114 @@ void Renderer::SortMeshNodes(NodeCollection& nodes, ICamera* camera)
 	};
 
 	// Reorder the visible meshes for batching
-	auto sortStaticMeshCollection = [&compareDistance, &isOpaque](vector<SceneNode*>& collection)
+	SortDrawNodes(nodes.StaticMeshes, view, true);
+	SortDrawNodes(nodes.InstancedStaticMeshes, view, true);
+	SortDrawNodes(nodes.TerrainPatches, view, false);
+
+	sort(nodes.Lights.begin(), nodes.Lights.end(), compareLights);
+}
+
+// Batched keys hold, from the most significant bit, whether the material is transparent, the
+// material, the mesh, the level of detail and the view depth of the node's center. Depth is
+// quantized over the range of the collection and reversed for transparent nodes, so that they
+// are drawn back to front within their batches and opaque nodes front to back.
+void Renderer::SortDrawNodes(vector<SceneNode*>& collection, const XMFLOAT4X4& view, const bool bBatched)
+{
+	if (collection.size() < 2)
+		return;
+
+	drawSortDepths.resize(collection.size());
+	auto minDepth = numeric_limits<float>::infinity();
+	auto maxDepth = -minDepth;
+
+	for (size_t i = 0; i < collection.size(); ++i)
 	{
-		sort(collection.begin(), collection.end(), compareDistance);
-		stable_sort(collection.begin(), collection.end(), CompareMeshes);
-		stable_sort(collection.begin(), collection.end(), CompareMaterials);
-		stable_partition(collection.begin(), collection.end(), isOpaque);
-	};
+		auto& bounds = collection[i]->Region.AABB;
+		auto depth = 0.5f * (bounds.Lower.x + bounds.Upper.x) * view.m[0][2] +
+			0.5f * (bounds.Lower.y + bounds.Upper.y) * view.m[1][2] +
+			0.5f * (bounds.Lower.z + bounds.Upper.z) * view.m[2][2] + view.m[3][2];
+
+		drawSortDepths[i] = depth;
+		minDepth = min(minDepth, depth);
+		maxDepth = max(maxDepth, depth);
+	}
 
-	sortStaticMeshCollection(nodes.StaticMeshes);
-	sortStaticMeshCollection(nodes.InstancedStaticMeshes);
+	const uint64_t depthMax = (1ull << DRAW_SORT_DEPTH_BITS) - 1;
+	auto depthScale = maxDepth > minDepth ? static_cast<float>(depthMax) / (maxDepth - minDepth) : 0.0f;
 
-	sort(nodes.TerrainPatches.begin(), nodes.TerrainPatches.end(), compareDistance);
-	sort(nodes.Lights.begin(), nodes.Lights.end(), compareLights);
+	drawSortEntries.resize(collection.size());
+
+	for (size_t i = 0; i < collection.size(); ++i)
+	{
+		auto node = collection[i];
+		// Rounding may carry the deepest node one past the field
+		auto depth = min(static_cast<uint64_t>((drawSortDepths[i] - minDepth) * depthScale), depthMax);
+		uint64_t key = depth;
+
+		if (bBatched)
+		{
+			auto material = node->MaterialData;
+			uint64_t lodLevel = min<uint32_t>(node->LodLevel, (1u << DRAW_SORT_LOD_BITS) - 1);
+			uint64_t meshId = node->Ref.StaticMesh->GetSortId() & ((1u << DRAW_SORT_MESH_BITS) - 1);
+			uint64_t materialId = material->SortId & ((1u << DRAW_SORT_MATERIAL_BITS) - 1);
+
+			if (material->IsTransparent)
+				key = depthMax - depth;
+
+			key |= lodLevel << DRAW_SORT_DEPTH_BITS;
+			key |= meshId << (DRAW_SORT_DEPTH_BITS + DRAW_SORT_LOD_BITS);
+			key |= materialId << (DRAW_SORT_DEPTH_BITS + DRAW_SORT_LOD_BITS + DRAW_SORT_MESH_BITS);
+			key |= static_cast<uint64_t>(material->IsTransparent) << 63;
+		}
+
+		drawSortEntries[i].Key = key;
+		drawSortEntries[i].Node = node;
+	}
+
+	RadixSortDrawEntries(drawSortEntries, drawSortScratch);
+
+	for (size_t i = 0; i < collection.size(); ++i)
+		collection[i] = drawSortEntries[i].Node;
+}
+
+void Renderer::SelectMeshLods(NodeCollection& nodes, const XMFLOAT3& cameraPosition, const float projectionScale)
+{
+	ZeroMemory(&meshLodStats, sizeof(meshLodStats));
+	auto cameraPositionVec = XMLoadFloat3(&cameraPosition);
+
+	auto selectLods = [&](vector<SceneNode*>& collection)
+	{
+		for (auto node : collection)
+		{
+			auto mesh = node->Ref.StaticMesh;
+			auto lodCount = static_cast<uint32_t>(mesh->GetLodCount());
+			node->LodLevel = min(node->LodLevel, lodCount - 1);
+
+			auto lower = XMLoadFloat3(&node->Region.AABB.Lower);
+			auto upper = XMLoadFloat3(&node->Region.AABB.Upper);
+			float radius = 0.5f * XMVectorGetX(XMVector3Length(upper - lower));
+			float distance = XMVectorGetX(XMVector3Length(0.5f * (lower + upper) - cameraPositionVec));
+
+			if (!LodParameters.bEnabled || lodCount == 1 || distance <= radius)
+				node->LodLevel = 0;
+			else
+			{
+				// The node keeps its level while the level picked at a slightly larger and a
+				// slightly smaller size are on either side of it
+				float screenRadius = radius * projectionScale / distance;
+				auto finest = FindMeshLod(mesh, screenRadius * (1.0f + LodParameters.Hysteresis), LodParameters.MaxPixelError);
+				auto coarsest = FindMeshLod(mesh, screenRadius * (1.0f - LodParameters.Hysteresis), LodParameters.MaxPixelError);
+				node->LodLevel = max(finest, min(node->LodLevel, coarsest));
+			}
+
+			++meshLodStats.MeshCount;
+			meshLodStats.TriangleCount += mesh->GetLod(node->LodLevel).IndexCount / 3;
+			meshLodStats.FullTriangleCount += mesh->GetLod(0).IndexCount / 3;
+		}
+	};
+
+	selectLods(nodes.StaticMeshes);
+	selectLods(nodes.InstancedStaticMeshes);
 }
 
 void Renderer::RenderFrame(SceneNode* sceneRoot, ICamera* camera)
@@ -1149,6 +1717,10 @@ void Renderer::RenderFrame(SceneNode* sceneRoot, ICamera* camera)
 		return;
 	}
 
+	// The device context may have been bound to around the renderer since the last frame
+	stateFilter.Invalidate();
+	stateFilter.ResetStats();
+
 	if (sceneRoot != nullptr)
 	{
 		// Prepare the viewport
@@ -1161,9 +1733,11 @@ void Renderer::RenderFrame(SceneNode* sceneRoot, ICamera* camera)
 		viewport.TopLeftY = 0.0f;
 
 		// Set render state
-		deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		deviceContext->RSSetViewports(1, &viewport);
-		deviceContext->RSSetState(defaultRasterState);
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->RSSetViewports(1, &viewport);
+		context->RSSetState(defaultRasterState);
+
+		instanceRing.BeginFrame();
 
 		DeferredRenderPass(sceneRoot, camera, deferredRenderTargets, deferredDepthStencilView);
 		LightRenderPass(sceneRoot, camera, deferredShaderViews, deferredDepthShaderView, 
@@ -1171,17 +1745,19 @@ void Renderer::RenderFrame(SceneNode* sceneRoot, ICamera* camera)
 		ForwardRenderPass(sceneRoot, camera, deferredShaderViews, deferredDepthShaderView,
 			lightShaderView, forwardRenderTarget, forwardDepthStencilView);
 		ClearPixelShaderResources(deferredShaderViews.size() + 2);
+
+		instanceRing.EndFrame();
 	}
 
 	if (renderParameters.UseVSync)
-		swapChain->Present(1, 0);
+		context->Present(1, 0);
 	else
-		swapChain->Present(0, 0);
+		context->Present(0, 0);
 }
 
 void Renderer::OnResize()
 {
-	swapChain->Present(0, 0);
+	context->Present(0, 0);
 }
 
 void Renderer::Destroy()
@@ -1190,35 +1766,17 @@ void Renderer::Destroy()
 
 	bDisposed = true;
 
-	// Delete the internal content
-	if (internalContent != nullptr)
-	{
-		internalContent->Destroy();
-		delete internalContent;
-	}
+	occlusionBuffer.Destroy();
+	lightClusters.Destroy();
+	instanceRing.Destroy();
 
-	if (swapChain != nullptr && IsFullscreen())
-		swapChain->SetFullscreenState(FALSE, nullptr);
-
-	SAFE_RELEASE(bufferBlitVertices);
-	SAFE_RELEASE(bufferCameraConstants);
-	SAFE_RELEASE(bufferTerrainPatchInstanceConstants);
-	SAFE_RELEASE(bufferStaticMeshInstanceConstants);
-	SAFE_RELEASE(inputLayoutBlit);
-	SAFE_RELEASE(inputLayoutStaticMesh);
-	SAFE_RELEASE(inputLayoutStaticMeshInstanced);
-	SAFE_RELEASE(inputLayoutTerrainPatch);
-	SAFE_RELEASE(samplerStateLinearStaticMesh);
-	SAFE_RELEASE(defaultRasterState);
-	SAFE_RELEASE(wireframeRasterState);
-	SAFE_RELEASE(defaultDepthStencilState);
-	SAFE_RELEASE(blitDepthStencilState);
-	SAFE_RELEASE(samplerStateBlit);
-
-	DestroyDeferredTargets();
-	DestroyRenderTarget();
-
-	SAFE_RELEASE(swapChain);
-	SAFE_RELEASE(deviceContext);
-	SAFE_RELEASE(device);
+	if (bufferCameraConstants != nullptr)
+		context->Release(bufferCameraConstants);
+	if (lightClusterBuffer != nullptr)
+		context->Release(lightClusterBuffer);
+
+#ifdef _WIN32
+	// Everything created on the device, which only a renderer given a window has
+	DestroyDevice();
+#endif
 }
\ No newline at end of file
@@ -1,19 +1,47 @@
 #ifndef RENDERER_H_
 #define RENDERER_H_
 
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#include <d3d11.h>
 #include <vector>
 
 #include "RenderWindow.h"
 #include "Geometry.h"
 #include "InputElementDesc.h"
+#include "OcclusionCulling.h"
+#include "Portals.h"
+#include "LightClusters.h"
+#include "ShadowCascades.h"
+#include "RingBuffer.h"
+#include "RenderContext.h"
+#include "StateFilterRenderContext.h"
 
 #define BLIT_VERTEX_COUNT 4
 #define DEFAULT_INSTANCE_CACHE_SIZE 256
+#define PARALLEL_CULLING_TASKS_PER_THREAD 8
+// Views that can be collected in one walk of the hierarchy, one bit of a mask each
+#define MAX_CULLING_VIEWS 32
+// Intersecting subtrees of the flat hierarchy with at most this many entries below their root
+// have all of those entries tested in one batch
+#define FLAT_CULLING_BATCH_SIZE 32
+// Coherent culling starts over from the root when any frustum plane turns further than this
+// cosine or moves further than this distance since the last frame
+#define COHERENT_CULLING_MIN_PLANE_COS 0.995f
+#define COHERENT_CULLING_MAX_PLANE_SHIFT 4.0f
+// ...or when the cut has grown by this factor or is this many frames old
+#define COHERENT_CULLING_MAX_CUT_GROWTH 2
+#define COHERENT_CULLING_REFRESH_FRAMES 60
+// Meshes are drawn at the coarsest level of detail whose error covers at most this many pixels
+#define DEFAULT_LOD_MAX_PIXEL_ERROR 1.0f
+// A node only changes level once its screen size is this fraction past the point of switching
+#define DEFAULT_LOD_HYSTERESIS 0.1f
+// Fields of the draw sort keys below the transparency bit, from the most significant. Ids are
+// truncated to their fields, which only costs batching when two of them end up sharing one.
+#define DRAW_SORT_MATERIAL_BITS 16
+#define DRAW_SORT_MESH_BITS 16
+#define DRAW_SORT_LOD_BITS 4
+#define DRAW_SORT_DEPTH_BITS 27
+// Visible nodes of a kind prepared into draw packets by one job
+#define DRAW_PACKET_CHUNK_SIZE 256
 
-#define STATIC_MESH_VERTEX_SHADER_LOCATION "StaticMeshVertex.cso"
 #define STATIC_MESH_INSTANCED_VERTEX_SHADER_LOCATION "StaticMeshInstancedVertex.cso"
 #define STATIC_MESH_PIXEL_SHADER_LOCATION "StaticMeshPixel.cso"
 #define TERRAIN_PATCH_VERTEX_SHADER_LOCATION "TerrainPatchVertex.cso"
@@ -23,9 +51,15 @@
 
 struct RegionNode;
 class SceneNode;
+class FlatHierarchy;
 class ICamera;
 class BytecodeBlob;
 class ContentPackage;
+class WorkerPool;
+class TaskGroup;
+class D3D11RenderContext;
+class SceneStore;
+struct NodeHandleCollection;
 
 enum RenderPassType
 {
@@ -34,6 +68,12 @@ enum RenderPassType
 	RENDER_PASS_TYPE_SHADOW_MAP
 };
 
+enum CullingLayout
+{
+	CULLING_LAYOUT_TREE,
+	CULLING_LAYOUT_FLAT
+};
+
 enum RenderTargetIndex
 {
 	RENDER_TARGET_INDEX_ALBEDO = 0,
@@ -70,15 +110,124 @@ struct NodeCollection
 	std::vector<SceneNode*> Lights;
 };
 
+// A subtree of the region hierarchy collected by one task of a parallel visibility pass.
+// Tree subtrees are given by their region, flat subtrees by their index in the hierarchy.
+struct VisibilityTask
+{
+	RegionNode* Region;
+	FlatHierarchy* Hierarchy;
+	uint32_t FlatIndex;
+	uint32_t PlaneMask;
+};
+
+// An entry of the flat hierarchy where collection stopped descending, either because the entry
+// was outside or inside the frustum, or because it was a leaf
+struct VisibilityCutEntry
+{
+	uint32_t Index;
+	FrustumTestResult Result;
+};
+
+// The cut through the hierarchy left by the last collection. Every leaf is below exactly one of
+// its entries, so the next frame can retest the cut instead of starting from the root.
+struct VisibilityCut
+{
+	std::vector<VisibilityCutEntry> Entries;
+	const FlatHierarchy* Hierarchy;
+	uint32_t Generation;
+	Frustum CameraFrustum;
+	// Size of the cut and milliseconds taken by the last collection from the root
+	size_t FullSize;
+	double FullTime;
+	uint32_t FrameCount;
+};
+
+struct CoherentCullingStats
+{
+	size_t CutSize;
+	// Entries of the previous cut that were retested, and those whose result did not change
+	size_t RetestedCount;
+	size_t ReusedCount;
+	bool bFullTraversal;
+	// Milliseconds spent collecting, and estimated as saved compared to starting from the root
+	double CollectTime;
+	double TimeSaved;
+};
+
+// A visible node with the key it is drawn in the order of
+struct DrawSortEntry
+{
+	uint64_t Key;
+	SceneNode* Node;
+};
+
+enum DrawPipeline
+{
+	DRAW_PIPELINE_STATIC_MESH,
+	DRAW_PIPELINE_TERRAIN_PATCH,
+	DRAW_PIPELINE_COUNT
+};
+
+// One draw call with everything it binds, prepared ahead of submission. The views and constant
+// buffers are bound to the pixel shader from the first slot, and left as they were when empty.
+struct DrawPacket
+{
+	DrawPipeline Pipeline;
+	ID3D11Buffer* VertexBuffer;
+	ID3D11Buffer* IndexBuffer;
+	DXGI_FORMAT IndexFormat;
+	ID3D11ShaderResourceView* const* ResourceViews;
+	ID3D11Buffer* const* ConstantBuffers;
+	uint32_t ResourceViewCount;
+	uint32_t ConstantBufferCount;
+	UINT IndexCount;
+	UINT IndexOffset;
+	// Instances drawn, starting at this transformation of the frame
+	UINT InstanceCount;
+	UINT FirstInstance;
+};
+
+struct DrawStats
+{
+	// Draw calls made for meshes and terrain patches, and the nodes drawn with others in one call
+	size_t DrawCount;
+	size_t InstancedNodeCount;
+};
+
+struct MeshLodStats
+{
+	size_t MeshCount;
+	// Triangles drawn at the selected levels, and those the full meshes would have drawn
+	size_t TriangleCount;
+	size_t FullTriangleCount;
+};
+
 class Renderer
 {
 public:
 	bool Initialize(HWND hWindow, const RenderParams& params);
+	// Renders every frame through the context without creating a device or window, as with a
+	// recording context on machines without a GPU. Internal shaders, states and targets are left
+	// null, and the context must outlive the renderer's Destroy.
+	bool Initialize(IRenderContext* context, const RenderParams& params);
 	bool Reset(const RenderParams& params);
 	void RenderFrame(SceneNode* sceneRoot, ICamera* camera);
 	void OnResize();
 	void Destroy();
 
+	// Collects the nodes visible to each of up to MAX_CULLING_VIEWS frusta in a single walk of the
+	// hierarchy, into one collection per view. A region is only left behind once every view has
+	// rejected it. Neither occlusion nor portals are taken into account, and the hierarchy is only
+	// read, so this may run while another collection is in progress. Only the loads of the bounds
+	// are shared between views, so this is no faster than a walk per view unless the hierarchy
+	// falls out of cache and few nodes are visible.
+	void CollectVisibleNodes(SceneNode* sceneRoot, const Frustum* frusta, const uint32_t viewCount,
+		NodeCollection* nodesOut);
+	// Collects the handles of the store's meshes and terrain patches whose entries of the store's
+	// hierarchy intersect the frustum, and of its lights whose bounds do. As above, neither occlusion
+	// nor portals are taken into account and the store is only read.
+	void CollectVisibleNodes(const SceneStore& store, const Frustum& cameraFrustum, NodeHandleCollection* nodesOut);
+
 	inline void SetMoveSizeEntered(const bool value);
 
 	inline RenderParams GetRenderParams() const;
@@ -86,6 +235,19 @@ public:
 	inline bool IsWindowed() const;
 	inline bool MoveSizeEntered() const;
 	inline ID3D11Device* GetDevice() const;
+	inline void GetOcclusionStats(OcclusionStats* statsOut) const;
+	// What the last frame's coherent collection reused from the one before
+	inline void GetCoherentCullingStats(CoherentCullingStats* statsOut) const;
+	inline void GetMeshLodStats(MeshLodStats* statsOut) const;
+	// The lights of the last frame binned into clusters of the camera's view
+	inline const LightClusterGrid* GetLightClusters() const;
+	// The cascades of the first directional light fitted to the last frame's view, with their casters
+	inline const std::vector<ShadowCascade>& GetShadowCascades() const;
+	// Sizes of the ring the transformations of the drawn nodes are written into
+	inline const RingBufferStats& GetInstanceRingStats() const;
+	inline void GetDrawStats(DrawStats* statsOut) const;
+	// Binds of the last frame passed on to the context, and those dropped as redundant
+	inline void GetStateFilterStats(StateFilterStats* statsOut) const;
 
 	inline const InputElementLayout* GetElementLayoutStaticMesh() const;
 	inline const InputElementLayout* GetElementLayoutStaticMeshInstanced() const;
@@ -99,19 +261,83 @@ public:
 		bool bLoadTerrainPatchShaders;
 	} InitParameters;
 
-protected:
-	void CollectVisibleNodes(RegionNode* node, const Frustum& cameraFrustum, NodeCollection& nodes);
-	void CollectVisibleNodes(SceneNode* node, const Frustum& cameraFrustum, NodeCollection& nodes);
+	struct
+	{
+		CullingLayout Layout;
+		// Visibility is collected on the pool's threads when set
+		WorkerPool* Workers;
+		// Nodes flagged as occluders hide the regions behind them
+		bool bOcclusionCulling;
+		// Zones with portals are only collected when seen through a chain of portals
+		// from the camera's zone
+		bool bPortalCulling;
+		// Visibility starts from the previous frame's cut through the flat hierarchy while the
+		// camera moves little, on the calling thread. Off by default, and not used with occlusion
+		// or portal culling.
+		bool bCoherentCulling;
+	} CullingParameters;
+
+	struct
+	{
+		// Visible meshes are drawn at a level of detail picked from their size on screen
+		bool bEnabled;
+		float MaxPixelError;
+		float Hysteresis;
+	} LodParameters;
 
+	struct
+	{
+		// The camera's shadow cascades are fitted to the view, and their casters collected in one
+		// walk of the hierarchy on the culling workers while the view is culled
+		bool bEnabled;
+	} ShadowParameters;
+
+	struct
+	{
+		// Draw packets are prepared on the pool's threads when set, and submitted on the calling one
+		WorkerPool* Workers;
+	} DrawParameters;
+
+protected:
+	void CollectVisibleNodes(RegionNode* node, const Frustum& cameraFrustum, uint32_t planeMask,
+		NodeCollection& nodes);
+	void CollectVisibleNodes(SceneNode* node, const Frustum& cameraFrustum, uint32_t planeMask,
+		NodeCollection& nodes);
+	void CollectVisibleNodes(FlatHierarchy& hierarchy, const uint32_t begin, const uint32_t end,
+		const Frustum& cameraFrustum, uint32_t planeMask, NodeCollection& nodes,
+		std::vector<VisibilityCutEntry>* cutOut);
+	void CollectVisibleNodesBatched(FlatHierarchy& hierarchy, const uint32_t begin, const uint32_t end,
+		const Frustum& cameraFrustum, NodeCollection& nodes, std::vector<VisibilityCutEntry>* cutOut);
+	void CollectVisibleNodes(RegionNode* node, const Frustum* frusta, uint32_t viewMask, const uint8_t* planeMasks,
+		uint8_t* rejectPlanes, NodeCollection* nodesOut);
+	void CollectVisibleNodes(const FlatHierarchy& hierarchy, const Frustum* frusta, const uint32_t viewCount,
+		NodeCollection* nodesOut);
+	void CollectVisibleNodesCoherent(SceneNode* sceneRoot, const Frustum& cameraFrustum, NodeCollection& nodes);
+	void CollectVisibleNodesParallel(SceneNode* sceneRoot, const Frustum& cameraFrustum, NodeCollection& nodes);
+	void CollectVisibleNodesPortals(SceneNode* sceneRoot, const DirectX::XMFLOAT3& cameraPosition,
+		const Frustum& cameraFrustum, const DirectX::XMFLOAT4X4& viewProjection, NodeCollection& nodes);
+	bool SplitVisibilityTask(const VisibilityTask& task, const Frustum& cameraFrustum,
+		std::vector<VisibilityTask>& tasksOut);
+	void RasterizeOccluders(SceneNode* zone, const Frustum& cameraFrustum);
+	void PrepareShadowCascades(SceneNode* sceneRoot, ICamera* camera, const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& projection, TaskGroup& tasks);
+	inline bool IsOccluded(const Bounds& bounds) const;
+
+	// Creation and release of the device and what is drawn with it, in RendererDevice.cpp, which is
+	// only built on Windows
 	bool InitWindow(const HWND hWindow, const RenderParams& params);
 	bool InitRenderTarget();
 	bool InitDeferredTargets();
 	bool InitRenderObjects();
 	bool InitInternalShaders();
 	bool InitConstantBuffers();
+	// Objects written or waited on while drawing, created through the render context
+	bool InitFrameResources();
 	bool InitInternalVertexBuffers();
 
 	void NameObjectsDebug();
+	bool ResizeSwapChain(const RenderParams& params);
+	void DestroyDevice();
 
 	void DeferredRenderPass(SceneNode* sceneRoot, ICamera* camera,
 		const std::vector<ID3D11RenderTargetView*>& renderTargets, 
@@ -129,16 +355,68 @@ protected:
 
 	void ClearPixelShaderResources(const size_t resourceCount);
 
-	void RenderStaticMeshes(std::vector<SceneNode*>::iterator& begin, std::vector<SceneNode*>::iterator& end);
-	void RenderStaticMeshesInstanced(std::vector<SceneNode*>::iterator& begin, std::vector<SceneNode*>::iterator& end);
-	void RenderTerrainPatches(std::vector<SceneNode*>::iterator& begin, std::vector<SceneNode*>::iterator& end);
+	// Writes the transformations of the nodes to draw into the instance ring, static meshes first,
+	// then instanced static meshes and terrain patches. Draws read them by their instance index.
+	bool UploadTransforms(const NodeCollection& nodes);
+	// Writes the packed clusters and light indices of the frame into the light cluster buffer,
+	// replacing it with one twice the size needed when they no longer fit
+	bool UploadLightClusters();
+	// Prepares the draws of the visible nodes as packets, in chunks spread across the draw workers
+	void BuildDrawPackets(const NodeCollection& nodes);
+	// Packets of the nodes in a chunk, where draws read transformations from firstTransform on
+	void BuildStaticMeshPackets(const std::vector<SceneNode*>& nodes, const size_t begin, const size_t end,
+		const UINT firstTransform, std::vector<DrawPacket>& packetsOut);
+	void BuildTerrainPatchPackets(const std::vector<SceneNode*>& nodes, const size_t begin, const size_t end,
+		const UINT firstTransform, std::vector<DrawPacket>& packetsOut);
+	void BindDrawPipeline(const DrawPipeline pipeline);
+	// Issues the packets in order, joining those that continue one another into one draw and
+	// binding only what differs from the packet before
+	void SubmitDrawPackets();
 	void SortMeshNodes(NodeCollection& nodes, ICamera* camera);
+	// Orders the nodes by packed keys, by state and then by depth when batched and only by depth
+	// otherwise
+	void SortDrawNodes(std::vector<SceneNode*>& collection, const DirectX::XMFLOAT4X4& view, const bool bBatched);
+	// Picks each mesh's level of detail from the pixels covered by its bounding sphere, where
+	// projectionScale is the pixels covered by a unit length at unit distance
+	void SelectMeshLods(NodeCollection& nodes, const DirectX::XMFLOAT3& cameraPosition, const float projectionScale);
 
 	void DestroyRenderTarget();
 	void DestroyDeferredTargets();
 
 private:
 	ResizingCache<DirectX::XMFLOAT4X4> instanceCache;
+	InstanceRingBuffer instanceRing;
+	// Where the frame's transformations were written
+	ID3D11Buffer* transformBuffer;
+	UINT transformOffset;
+	DrawStats drawStats;
+	// Packets of the frame, one list per chunk in submission order. Lists past the count are kept
+	// for their memory.
+	std::vector<std::vector<DrawPacket>> drawPacketChunks;
+	size_t drawPacketChunkCount;
+	std::vector<VisibilityTask> visibilityTasks;
+	std::vector<VisibilityTask> splitVisibilityTasks;
+	std::vector<NodeCollection> visibilityTaskNodes;
+	OcclusionBuffer occlusionBuffer;
+	std::vector<PortalVisit> portalVisits;
+	VisibilityCut visibilityCut;
+	std::vector<VisibilityCutEntry> nextVisibilityCut;
+	CoherentCullingStats coherentCullingStats;
+	MeshLodStats meshLodStats;
+	LightClusterGrid lightClusters;
+	// The packed clusters the light pass reads, rewritten every frame, and its size in elements
+	ID3D11Buffer* lightClusterBuffer;
+	size_t lightClusterBufferSize;
+	std::vector<SceneNode*> sceneLights;
+	std::vector<ShadowCascade> shadowCascades;
+	std::vector<Frustum> shadowCasterFrusta;
+	std::vector<NodeCollection> shadowCasterNodes;
+	std::vector<DrawSortEntry> drawSortEntries;
+	std::vector<DrawSortEntry> drawSortScratch;
+	std::vector<float> drawSortDepths;
+	// Set while zones reached through portals are collected, so that nested zones with
+	// portals are left for their own visit
+	bool bSkipPortalZones;
 	bool bMoveSizeEntered;
 	bool bDisposed;
 	int frameCount;
@@ -147,6 +425,11 @@ private:
 	IDXGISwapChain* swapChain;
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
+	// Every call made while drawing goes through the context, which filters out redundant binds
+	// before passing them on to the device context, unless the renderer was given another
+	D3D11RenderContext* d3dContext;
+	StateFilterRenderContext stateFilter;
+	IRenderContext* context;
 
 	std::vector<DXGI_FORMAT> deferredBufferFormats;
 	std::vector<ID3D11Texture2D*> deferredBuffers;
@@ -167,11 +450,8 @@ private:
 
 	ID3D11Buffer* bufferBlitVertices;
 	ID3D11Buffer* bufferCameraConstants;
-	ID3D11Buffer* bufferStaticMeshInstanceConstants;
-	ID3D11Buffer* bufferTerrainPatchInstanceConstants;
 
 	ID3D11VertexShader* vertexShaderBlit;
-	ID3D11VertexShader* vertexShaderStaticMesh;
 	ID3D11VertexShader* vertexShaderStaticMeshInstanced;
 	ID3D11VertexShader* vertexShaderTerrainPatch;
 	ID3D11PixelShader* pixelShaderDeferredComposite; 
@@ -191,7 +471,6 @@ private:
 	InputElementLayout elementLayoutBlit;
 	InputElementLayout elementLayoutTerrainPatch;
 
-	ID3D11InputLayout* inputLayoutStaticMesh;
 	ID3D11InputLayout* inputLayoutStaticMeshInstanced;
 	ID3D11InputLayout* inputLayoutBlit;
 	ID3D11InputLayout* inputLayoutTerrainPatch;
@@ -214,6 +493,22 @@ inline void Renderer::SetMoveSizeEntered(const bool value)
 { bMoveSizeEntered = value; }
 inline ID3D11Device* Renderer::GetDevice() const			
 { return device; }
+inline void Renderer::GetOcclusionStats(OcclusionStats* statsOut) const
+{ occlusionBuffer.GetStats(statsOut); }
+inline void Renderer::GetCoherentCullingStats(CoherentCullingStats* statsOut) const
+{ *statsOut = coherentCullingStats; }
+inline void Renderer::GetMeshLodStats(MeshLodStats* statsOut) const
+{ *statsOut = meshLodStats; }
+inline const LightClusterGrid* Renderer::GetLightClusters() const
+{ return &lightClusters; }
+inline const std::vector<ShadowCascade>& Renderer::GetShadowCascades() const
+{ return shadowCascades; }
+inline const RingBufferStats& Renderer::GetInstanceRingStats() const
+{ return instanceRing.GetStats(); }
+inline void Renderer::GetDrawStats(DrawStats* statsOut) const
+{ *statsOut = drawStats; }
+inline void Renderer::GetStateFilterStats(StateFilterStats* statsOut) const
+{ stateFilter.GetStats(statsOut); }
 inline const InputElementLayout* Renderer::GetElementLayoutStaticMesh() const
 { return &elementLayoutStaticMesh; }
 inline const InputElementLayout* Renderer::GetElementLayoutStaticMeshInstanced() const
@@ -222,5 +517,7 @@ inline const InputElementLayout* Renderer::GetElementLayoutBlit() const
 { return &elementLayoutBlit; }
 inline const InputElementLayout* Renderer::GetElementLayoutTerrainPatch() const
 { return &elementLayoutTerrainPatch; }
+inline bool Renderer::IsOccluded(const Bounds& bounds) const
+{ return CullingParameters.bOcclusionCulling && occlusionBuffer.HasOccluders() && occlusionBuffer.IsOccluded(bounds); }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,655 @@
+#include "Renderer.h"
+#include "D3D11RenderContext.h"
+#include "ContentPackage.h"
+#include "GraphicsDebug.h"
+
+using namespace std;
+using namespace DirectX;
+
+#define SAFE_RELEASE(x) if (x != nullptr) x->Release();
+
+// Creation of the device, swap chain and everything drawn with that the render context cannot
+// create, for renderers given a window. Only built on Windows.
+
+bool Renderer::Initialize(HWND hWindow, const RenderParams& params)
+{
+	bool result;
+	result = InitWindow(hWindow, params);
+	if (!result)
+		return false;
+
+	result = InitRenderTarget();
+	if (!result)
+		return false;
+
+	result = InitDeferredTargets();
+	if (!result)
+		return false;
+
+	result = InitRenderObjects();
+	if (!result)
+		return false;
+
+	internalContent = new ContentPackage(this);
+
+	result = InitInternalShaders();
+	if (!result)
+		return false;
+
+	result = InitInternalVertexBuffers();
+	if (!result)
+		return false;
+
+	result = InitFrameResources();
+	if (!result)
+		return false;
+
+	NameObjectsDebug();
+
+	return true;
+}
+
+bool Renderer::InitWindow(const HWND hWindow, const RenderParams& params)
+{
+	renderParameters = params;
+
+	IDXGIFactory* factory;
+	HRESULT result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&factory);
+
+	IDXGIAdapter* adapter;
+	result = factory->EnumAdapters(0, &adapter);
+
+	IDXGIOutput* adapterOutput;
+	result = adapter->EnumOutputs(0, &adapterOutput);
+
+	UINT modeCount;
+	result = adapterOutput->GetDisplayModeList(DXGI_FORMAT_R8G8B8A8_UNORM,
+		DXGI_ENUM_MODES_INTERLACED, &modeCount, nullptr);
+
+	DXGI_MODE_DESC* modeDescriptions = new DXGI_MODE_DESC[modeCount];
+	result = adapterOutput->GetDisplayModeList(DXGI_FORMAT_R8G8B8A8_UNORM,
+		DXGI_ENUM_MODES_INTERLACED, &modeCount, modeDescriptions);
+
+	DXGI_MODE_DESC* descMatch = nullptr;
+
+	for (UINT i = 0; i < modeCount; ++i)
+	{
+		DXGI_MODE_DESC* desc = &modeDescriptions[i];
+
+		if (desc->Width == params.Extent.Width && desc->Height == params.Extent.Height)
+		{
+			OutputDebugString("Found compatible display mode!\n");
+			descMatch = desc;
+			break;
+		}
+	}
+
+	if (descMatch == nullptr)
+	{
+		OutputDebugString("No DXGI mode match found - using a default!\n");
+		descMatch = modeDescriptions;
+	}
+
+	DXGI_ADAPTER_DESC adapterDesc;
+	result = adapter->GetDesc(&adapterDesc);
+
+	adapterOutput->Release();
+	adapter->Release();
+	factory->Release();
+
+	DXGI_SWAP_CHAIN_DESC swapChainDesc;
+	ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
+
+	swapChainDesc.Windowed = params.Windowed;
+	swapChainDesc.BufferCount = 2;
+	swapChainDesc.BufferDesc = *descMatch;
+	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	swapChainDesc.OutputWindow = hWindow;
+	swapChainDesc.SampleDesc.Count = 1;
+	swapChainDesc.SampleDesc.Quality = 0;
+	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+
+	delete[] modeDescriptions;
+
+	UINT deviceCreationFlags = 0;
+#ifdef ENABLE_DIRECT3D_DEBUG
+	deviceCreationFlags |= D3D11_CREATE_DEVICE_DEBUG;
+#endif
+
+	if (!renderParameters.Windowed)
+		swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+
+	OutputDebugString("Creating device and swap chain...\n");
+
+	D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+	result = D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
+		deviceCreationFlags, &featureLevel, 1, D3D11_SDK_VERSION, &swapChainDesc,
+		&swapChain, &device, nullptr, &deviceContext);
+
+	if (FAILED(result))
+	{
+		OutputDebugString("Failed to create device and swap chain!\n");
+		return false;
+	}
+
+	OutputDebugString("Device and swap chain created successfully!\n");
+
+	d3dContext = new D3D11RenderContext();
+	d3dContext->Initialize(device, deviceContext, swapChain);
+	stateFilter.Initialize(d3dContext);
+	context = &stateFilter;
+
+	return true;
+}
+
+bool Renderer::InitRenderTarget()
+{
+	OutputDebugString("Creating render target view for back buffer...\n");
+
+	ID3D11Texture2D* backBuffer;
+	HRESULT result = swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&backBuffer);
+	result = device->CreateRenderTargetView(backBuffer, nullptr, &forwardRenderTarget);
+	result = backBuffer->Release();
+
+	OutputDebugString("Creating depth texture...\n");
+
+	D3D11_TEXTURE2D_DESC depthTextureDesc;
+	ZeroMemory(&depthTextureDesc, sizeof(depthTextureDesc));
+
+	depthTextureDesc.Width = renderParameters.Extent.Width;
+	depthTextureDesc.Height = renderParameters.Extent.Height;
+	depthTextureDesc.MipLevels = 1;
+	depthTextureDesc.ArraySize = 1;
+	depthTextureDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthTextureDesc.SampleDesc.Count = 1;
+	depthTextureDesc.SampleDesc.Quality = 0;
+	depthTextureDesc.Usage = D3D11_USAGE_DEFAULT;
+	depthTextureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	depthTextureDesc.CPUAccessFlags = 0;
+	depthTextureDesc.MiscFlags = 0;
+
+	result = device->CreateTexture2D(&depthTextureDesc, nullptr, &forwardDepthStencilTexture);
+
+	if (FAILED(result))
+		return false;
+
+	OutputDebugString("Creating depth stencil view...\n");
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
+	ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
+
+	depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	depthStencilViewDesc.Texture2D.MipSlice = 0;
+
+	result = device->CreateDepthStencilView(forwardDepthStencilTexture, &depthStencilViewDesc, &forwardDepthStencilView);
+
+	if (FAILED(result))
+		return false;
+
+	return true;
+}
+
+bool Renderer::InitDeferredTargets()
+{
+	HRESULT result;
+
+	for (auto format : deferredBufferFormats)
+	{
+		D3D11_TEXTURE2D_DESC deferredBufferDesc;
+		deferredBufferDesc.ArraySize = 1;
+		deferredBufferDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		deferredBufferDesc.CPUAccessFlags = 0;
+		deferredBufferDesc.MipLevels = 1;
+		deferredBufferDesc.MiscFlags = 0;
+		deferredBufferDesc.SampleDesc.Count = 1;
+		deferredBufferDesc.SampleDesc.Quality = 0;
+		deferredBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		deferredBufferDesc.Width = renderParameters.Extent.Width;
+		deferredBufferDesc.Height = renderParameters.Extent.Height;
+		deferredBufferDesc.Format = format;
+
+		ID3D11Texture2D* deferredBuffer;
+		result = device->CreateTexture2D(&deferredBufferDesc, nullptr, &deferredBuffer);
+		if (FAILED(result))
+			return false;
+
+		deferredBuffers.push_back(deferredBuffer);
+
+		ID3D11ShaderResourceView* resourceView;
+		result = device->CreateShaderResourceView(deferredBuffer, nullptr, &resourceView);
+		if (FAILED(result))
+			return false;
+
+		deferredShaderViews.push_back(resourceView);
+
+		ID3D11RenderTargetView* renderTargetView;
+		result = device->CreateRenderTargetView(deferredBuffer, nullptr, &renderTargetView);
+		if (FAILED(result))
+			return false;
+
+		deferredRenderTargets.push_back(renderTargetView);
+
+#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
+		SetDebugObjectName(deferredBuffer, "Deferred Buffer");
+		SetDebugObjectName(resourceView, "Deferred Shader Resource View");
+		SetDebugObjectName(renderTargetView, "Deferred Render Target View");
+#endif
+	}
+
+	DXGI_FORMAT depthTextureFormat = DXGI_FORMAT_R32_TYPELESS;
+	DXGI_FORMAT depthResourceViewFormat = DXGI_FORMAT_R32_FLOAT;
+	DXGI_FORMAT depthViewFormat = DXGI_FORMAT_D32_FLOAT;
+
+	D3D11_TEXTURE2D_DESC deferredBufferDesc;
+	deferredBufferDesc.ArraySize = 1;
+	deferredBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	deferredBufferDesc.CPUAccessFlags = 0;
+	deferredBufferDesc.MipLevels = 1;
+	deferredBufferDesc.MiscFlags = 0;
+	deferredBufferDesc.SampleDesc.Count = 1;
+	deferredBufferDesc.SampleDesc.Quality = 0;
+	deferredBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	deferredBufferDesc.Width = renderParameters.Extent.Width;
+	deferredBufferDesc.Height = renderParameters.Extent.Height;
+	deferredBufferDesc.Format = depthTextureFormat;
+
+	result = device->CreateTexture2D(&deferredBufferDesc, nullptr, &deferredDepthStencilBuffer);
+
+	if (FAILED(result))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC resourceViewDesc;
+	ZeroMemory(&resourceViewDesc, sizeof(resourceViewDesc));
+	resourceViewDesc.Format = depthResourceViewFormat;
+	resourceViewDesc.Texture2D.MipLevels = 1;
+	resourceViewDesc.Texture2D.MostDetailedMip = 0;
+	resourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+
+	result = device->CreateShaderResourceView(deferredDepthStencilBuffer, &resourceViewDesc, &deferredDepthShaderView);
+
+	if (FAILED(result))
+		return false;
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
+	ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
+
+	depthStencilViewDesc.Format = depthViewFormat;
+	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	depthStencilViewDesc.Texture2D.MipSlice = 0;
+
+	result = device->CreateDepthStencilView(deferredDepthStencilBuffer, &depthStencilViewDesc, &deferredDepthStencilView);
+
+	if (FAILED(result))
+		return false;
+
+#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
+	SetDebugObjectName(deferredDepthStencilBuffer, "Deferred Depth Stencil Buffer");
+	SetDebugObjectName(deferredDepthShaderView, "Deferred Depth Stencil Shader Resource View");
+	SetDebugObjectName(deferredDepthStencilView, "Deferred Depth Stencil View");
+#endif
+
+	DXGI_FORMAT lightFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	D3D11_TEXTURE2D_DESC lightBufferDesc;
+	lightBufferDesc.ArraySize = 1;
+	lightBufferDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	lightBufferDesc.CPUAccessFlags = 0;
+	lightBufferDesc.MipLevels = 1;
+	lightBufferDesc.MiscFlags = 0;
+	lightBufferDesc.SampleDesc.Count = 1;
+	lightBufferDesc.SampleDesc.Quality = 0;
+	lightBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	lightBufferDesc.Width = renderParameters.Extent.Width;
+	lightBufferDesc.Height = renderParameters.Extent.Height;
+	lightBufferDesc.Format = lightFormat;
+
+	result = device->CreateTexture2D(&lightBufferDesc, nullptr, &lightTexture);
+
+	if (FAILED(result))
+		return false;
+
+	result = device->CreateRenderTargetView(lightTexture, nullptr, &lightRenderTarget);
+
+	if (FAILED(result))
+		return false;
+
+	result = device->CreateShaderResourceView(lightTexture, nullptr, &lightShaderView);
+
+	if (FAILED(result))
+		return false;
+
+	return true;
+}
+
+bool Renderer::InitRenderObjects()
+{
+	OutputDebugString("Creating depth stencil state...\n");
+
+	D3D11_DEPTH_STENCIL_DESC depthStencilDesc;
+	ZeroMemory(&depthStencilDesc, sizeof(depthStencilDesc));
+
+	depthStencilDesc.DepthEnable = true;
+	depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthStencilDesc.DepthFunc = D3D11_COMPARISON_LESS;
+
+	depthStencilDesc.StencilEnable = true;
+	depthStencilDesc.StencilReadMask = 0xFF;
+	depthStencilDesc.StencilWriteMask = 0xFF;
+
+	depthStencilDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	depthStencilDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_INCR;
+	depthStencilDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	depthStencilDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+
+	depthStencilDesc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	depthStencilDesc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_DECR;
+	depthStencilDesc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	depthStencilDesc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+
+	HRESULT result = device->CreateDepthStencilState(&depthStencilDesc, &defaultDepthStencilState);
+
+	if (FAILED(result))
+		return false;
+
+	depthStencilDesc.DepthEnable = false;
+	depthStencilDesc.StencilEnable = false;
+
+	result = device->CreateDepthStencilState(&depthStencilDesc, &blitDepthStencilState);
+
+	if (FAILED(result))
+		return false;
+
+	OutputDebugString("Creating raster state...\n");
+
+	D3D11_RASTERIZER_DESC rasterDesc;
+	rasterDesc.AntialiasedLineEnable = false;
+	rasterDesc.CullMode = D3D11_CULL_BACK;
+	rasterDesc.DepthBias = 0;
+	rasterDesc.DepthBiasClamp = 0.0f;
+	rasterDesc.DepthClipEnable = true;
+	rasterDesc.FillMode = D3D11_FILL_SOLID;
+	rasterDesc.FrontCounterClockwise = false;
+	rasterDesc.MultisampleEnable = false;
+	rasterDesc.ScissorEnable = false;
+	rasterDesc.SlopeScaledDepthBias = 0.0f;
+
+	result = device->CreateRasterizerState(&rasterDesc, &defaultRasterState);
+
+	if (FAILED(result))
+		return false;
+
+	rasterDesc.FillMode = D3D11_FILL_WIREFRAME;
+	result = device->CreateRasterizerState(&rasterDesc, &wireframeRasterState);
+
+	if (FAILED(result))
+		return false;
+
+	OutputDebugString("Creating linear sampler state...\n");
+
+	D3D11_SAMPLER_DESC samplerDesc;
+	ZeroMemory(&samplerDesc, sizeof(samplerDesc));
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+	result = device->CreateSamplerState(&samplerDesc, &samplerStateLinearStaticMesh);
+
+	if (FAILED(result))
+		return false;
+
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+
+	result = device->CreateSamplerState(&samplerDesc, &samplerStateBlit);
+
+	if (FAILED(result))
+		return false;
+
+	return true;
+}
+
+bool Renderer::InitInternalShaders()
+{
+	bool result;
+	HRESULT hr;
+
+	// Load static mesh shaders, every mesh reads its transformation from the instance stream
+	BytecodeBlob staticMeshInstancedBytecode;
+	result = internalContent->LoadVertexShader(STATIC_MESH_INSTANCED_VERTEX_SHADER_LOCATION, &vertexShaderStaticMeshInstanced,
+		&staticMeshInstancedBytecode);
+
+	if (!result)
+		return false;
+
+	hr = device->CreateInputLayout(elementLayoutStaticMeshInstanced.Desc, elementLayoutStaticMeshInstanced.AttributeCount,
+		staticMeshInstancedBytecode.Bytecode, staticMeshInstancedBytecode.BytecodeLength,
+		&inputLayoutStaticMeshInstanced);
+	staticMeshInstancedBytecode.Destroy();
+
+	if (FAILED(hr))
+		return false;
+
+	result = internalContent->LoadPixelShader(STATIC_MESH_PIXEL_SHADER_LOCATION, &pixelShaderStaticMesh);
+
+	if (!result)
+		return false;
+
+	// Load blit shaders
+	result = internalContent->LoadPixelShader(DEFERRED_COMPOSITE_PIXEL_SHADER_LOCATION, &pixelShaderDeferredComposite);
+
+	if (!result)
+		return false;
+
+	BytecodeBlob vertexShaderBytecode;
+	result = internalContent->LoadVertexShader(BLIT_VERTEX_SHADER_LOCATION, &vertexShaderBlit, &vertexShaderBytecode);
+
+	if (!result)
+		return false;
+
+	hr = device->CreateInputLayout(elementLayoutBlit.Desc, elementLayoutBlit.AttributeCount,
+		vertexShaderBytecode.Bytecode, vertexShaderBytecode.BytecodeLength,
+		&inputLayoutBlit);
+	vertexShaderBytecode.Destroy();
+
+	if (FAILED(hr))
+		return false;
+
+	// Load terrain patch shaders
+	if (InitParameters.bLoadTerrainPatchShaders)
+	{
+		BytecodeBlob terrainPatchBytecode;
+		result = internalContent->LoadVertexShader(TERRAIN_PATCH_VERTEX_SHADER_LOCATION, &vertexShaderTerrainPatch,
+			&terrainPatchBytecode);
+
+		if (!result)
+			return false;
+
+		hr = device->CreateInputLayout(elementLayoutTerrainPatch.Desc, elementLayoutTerrainPatch.AttributeCount,
+			terrainPatchBytecode.Bytecode, terrainPatchBytecode.BytecodeLength,
+			&inputLayoutTerrainPatch);
+		terrainPatchBytecode.Destroy();
+
+		if (FAILED(hr))
+			return false;
+
+		result = internalContent->LoadPixelShader(TERRAIN_PATCH_PIXEL_SHADER_LOCATION, &pixelShaderTerrainPatch);
+
+		if (!result)
+			return false;
+	}
+
+	return true;
+}
+
+bool Renderer::InitInternalVertexBuffers()
+{
+	float blitBufferData[] =
+	{
+		-1.0f, 1.0f,
+		0.0f, 0.0f,
+
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+
+		-1.0f, -1.0f,
+		0.0f, 1.0f,
+
+		-1.0f, -1.0f,
+		0.0f, 1.0f,
+
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+
+		1.0f, -1.0f,
+		1.0f, 1.0f
+	};
+
+	D3D11_BUFFER_DESC blitBufferDesc;
+	blitBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	blitBufferDesc.ByteWidth = sizeof(blitBufferData);
+	blitBufferDesc.CPUAccessFlags = 0;
+	blitBufferDesc.MiscFlags = 0;
+	blitBufferDesc.StructureByteStride = 0;
+	blitBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+	D3D11_SUBRESOURCE_DATA subData;
+	ZeroMemory(&subData, sizeof(subData));
+	subData.pSysMem = blitBufferData;
+
+	HRESULT hr = device->CreateBuffer(&blitBufferDesc, &subData, &bufferBlitVertices);
+	if (FAILED(hr))
+		return false;
+
+	return true;
+}
+
+void Renderer::NameObjectsDebug()
+{
+#if defined(ENABLE_DIRECT3D_DEBUG) && defined(ENABLE_NAMED_OBJECTS)
+	SetDebugObjectName(forwardRenderTarget, "Back Buffer Render Target");
+
+	SetDebugObjectName(bufferBlitVertices, "Blit Vertices Vertex Buffer");
+	SetDebugObjectName(bufferCameraConstants, "Camera Constants Buffer");
+
+	SetDebugObjectName(vertexShaderBlit, "Blit Vertex Shader");
+	SetDebugObjectName(vertexShaderStaticMeshInstanced, "Instanced Static Mesh Vertex Shader");
+	SetDebugObjectName(vertexShaderTerrainPatch, "Terrain Patch Vertex Shader");
+	SetDebugObjectName(pixelShaderDeferredComposite, "Blit Pixel Shader");
+	SetDebugObjectName(pixelShaderStaticMesh, "Static Mesh Pixel Shader");
+	SetDebugObjectName(pixelShaderTerrainPatch, "Terrain Patch Pixel Shader");
+
+	SetDebugObjectName(forwardDepthStencilView, "Default Depth Stencil View");
+	SetDebugObjectName(forwardDepthStencilTexture, "Depth Stencil Texture");
+	SetDebugObjectName(defaultDepthStencilState, "Forward Pass Depth Stencil State");
+	SetDebugObjectName(defaultRasterState, "Forward Pass Raster State");
+	SetDebugObjectName(wireframeRasterState, "Wireframe Raster State");
+	SetDebugObjectName(samplerStateLinearStaticMesh, "Linear Static Mesh Sampler");
+	SetDebugObjectName(samplerStateBlit, "Blit Sampler");
+	SetDebugObjectName(samplerStateTerrainPatch, "Terrain Patch Sampler");
+
+	SetDebugObjectName(inputLayoutStaticMeshInstanced, "Static Mesh Instanced Layout");
+	SetDebugObjectName(inputLayoutBlit, "Blit Layout");
+	SetDebugObjectName(inputLayoutTerrainPatch, "Terrain Patch Layout");
+#endif
+}
+
+void Renderer::DestroyRenderTarget()
+{
+	SAFE_RELEASE(forwardDepthStencilView);
+	SAFE_RELEASE(forwardDepthStencilTexture);
+	SAFE_RELEASE(forwardRenderTarget);
+}
+
+void Renderer::DestroyDeferredTargets()
+{
+	for (auto resourceView : deferredShaderViews)
+		SAFE_RELEASE(resourceView);
+	for (auto targetView : deferredRenderTargets)
+		SAFE_RELEASE(targetView);
+	for (auto targetBuffer : deferredBuffers)
+		SAFE_RELEASE(targetBuffer);
+
+	deferredShaderViews.clear();
+	deferredRenderTargets.clear();
+	deferredBuffers.clear();
+
+	SAFE_RELEASE(deferredDepthShaderView);
+	SAFE_RELEASE(deferredDepthStencilView);
+	SAFE_RELEASE(deferredDepthStencilBuffer);
+
+	SAFE_RELEASE(lightRenderTarget);
+	SAFE_RELEASE(lightShaderView);
+	SAFE_RELEASE(lightTexture);
+}
+
+bool Renderer::ResizeSwapChain(const RenderParams& params)
+{
+	if (!bDisposed)
+	{
+		DestroyRenderTarget();
+		DestroyDeferredTargets();
+
+		if (renderParameters.Windowed != params.Windowed)
+			swapChain->SetFullscreenState(!params.Windowed, nullptr);
+
+		renderParameters = params;
+
+		HRESULT result = swapChain->ResizeBuffers(2, renderParameters.Extent.Width,
+			renderParameters.Extent.Height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+
+		if (FAILED(result))
+			return false;
+
+		if (!InitRenderTarget())
+			return false;
+
+		if (!InitDeferredTargets())
+			return false;
+
+		return true;
+	}
+	else
+		return false;
+}
+
+void Renderer::DestroyDevice()
+{
+	// Delete the internal content
+	if (internalContent != nullptr)
+	{
+		internalContent->Destroy();
+		delete internalContent;
+		internalContent = nullptr;
+	}
+
+	if (swapChain != nullptr && IsFullscreen())
+		swapChain->SetFullscreenState(FALSE, nullptr);
+
+	SAFE_RELEASE(bufferBlitVertices);
+	SAFE_RELEASE(inputLayoutBlit);
+	SAFE_RELEASE(inputLayoutStaticMeshInstanced);
+	SAFE_RELEASE(inputLayoutTerrainPatch);
+	SAFE_RELEASE(samplerStateLinearStaticMesh);
+	SAFE_RELEASE(defaultRasterState);
+	SAFE_RELEASE(wireframeRasterState);
+	SAFE_RELEASE(defaultDepthStencilState);
+	SAFE_RELEASE(blitDepthStencilState);
+	SAFE_RELEASE(samplerStateBlit);
+
+	DestroyDeferredTargets();
+	DestroyRenderTarget();
+
+	SAFE_RELEASE(swapChain);
+	SAFE_RELEASE(deviceContext);
+	SAFE_RELEASE(device);
+
+	delete d3dContext;
+	d3dContext = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "RingBuffer.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+RingAllocator::RingAllocator() :
+	capacity(0),
+	head(0),
+	tail(0),
+	usedBytes(0),
+	frameBytes(0)
+{
+	ZeroMemory(&stats, sizeof(stats));
+}
+
+void RingAllocator::Initialize(const size_t capacity)
+{
+	Grow(capacity);
+	ZeroMemory(&stats, sizeof(stats));
+	stats.Capacity = capacity;
+}
+
+void RingAllocator::Grow(const size_t capacity)
+{
+	this->capacity = capacity;
+	head = 0;
+	tail = 0;
+	usedBytes = 0;
+	frameBytes = 0;
+	frames.clear();
+
+	stats.Capacity = capacity;
+	++stats.GrowCount;
+}
+
+bool RingAllocator::Allocate(const size_t size, const size_t alignment, size_t* offsetOut)
+{
+	if (size > capacity)
+		return false;
+
+	// An empty ring starts over, so that no range has to wrap. Frames still in flight are empty
+	// then, and end where the ring now starts.
+	if (usedBytes == 0)
+	{
+		head = 0;
+		tail = 0;
+		for (auto& frame : frames)
+			frame.End = 0;
+	}
+
+	auto offset = (head + alignment - 1) / alignment * alignment;
+	size_t takenBytes;
+
+	// Unless the head has wrapped behind the oldest range, the free space runs from the head to
+	// the end of the ring and on from the start to the tail
+	if (head > tail || usedBytes == 0)
+	{
+		if (offset + size <= capacity)
+			takenBytes = offset + size - head;
+		else if (size <= tail)
+		{
+			takenBytes = capacity - head + size;
+			offset = 0;
+			++stats.WrapCount;
+		}
+		else
+			return false;
+	}
+	else if (offset + size <= tail)
+		takenBytes = offset + size - head;
+	else
+		return false;
+
+	head = offset + size;
+	usedBytes += takenBytes;
+	frameBytes += takenBytes;
+	stats.InFlightHighWater = max(stats.InFlightHighWater, usedBytes);
+
+	*offsetOut = offset;
+	return true;
+}
+
+void RingAllocator::EndFrame(const uint64_t fence)
+{
+	FrameMark mark = { fence, head, frameBytes };
+	frames.push_back(mark);
+
+	stats.FrameBytes = frameBytes;
+	stats.FrameHighWater = max(stats.FrameHighWater, frameBytes);
+	frameBytes = 0;
+}
+
+void RingAllocator::Retire(const uint64_t completedFence)
+{
+	size_t retiredCount = 0;
+	while (retiredCount < frames.size() && frames[retiredCount].Fence <= completedFence)
+	{
+		usedBytes -= frames[retiredCount].Bytes;
+		tail = frames[retiredCount].End;
+		++retiredCount;
+	}
+
+	frames.erase(frames.begin(), frames.begin() + retiredCount);
+}
+
+InstanceRingBuffer::InstanceRingBuffer() :
+	context(nullptr),
+	buffer(nullptr),
+	nextFence(1),
+	completedFence(0),
+	bDiscardNext(true)
+{
+	ZeroMemory(fenceQueries, sizeof(fenceQueries));
+}
+
+bool InstanceRingBuffer::Initialize(IRenderContext* context, const size_t capacity)
+{
+	if (capacity == 0)
+	{
+		OutputDebugString("Instance ring buffer must not be empty!\n");
+		return false;
+	}
+
+	this->context = context;
+
+	D3D11_QUERY_DESC queryDesc;
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	queryDesc.MiscFlags = 0;
+
+	for (auto& query : fenceQueries)
+	{
+		HRESULT result = context->CreateQuery(&queryDesc, &query);
+		if (FAILED(result))
+		{
+			OutputDebugString("Failed to create instance ring buffer fence!\n");
+			return false;
+		}
+	}
+
+	allocator.Initialize(capacity);
+	return CreateBuffer(capacity);
+}
+
+void InstanceRingBuffer::Destroy()
+{
+	for (auto& query : fenceQueries)
+	{
+		if (query != nullptr)
+			context->Release(query);
+		query = nullptr;
+	}
+
+	if (buffer != nullptr)
+		context->Release(buffer);
+	buffer = nullptr;
+}
+
+bool InstanceRingBuffer::CreateBuffer(const size_t capacity)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(bufferDesc));
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.ByteWidth = static_cast<UINT>(capacity);
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+
+	ID3D11Buffer* newBuffer;
+	HRESULT result = context->CreateBuffer(&bufferDesc, nullptr, &newBuffer);
+	if (FAILED(result))
+	{
+		OutputDebugString("Failed to create instance ring buffer!\n");
+		return false;
+	}
+
+	if (buffer != nullptr)
+		context->Release(buffer);
+
+	buffer = newBuffer;
+	bDiscardNext = true;
+	return true;
+}
+
+// A query that fails, as when the device is lost, counts as passed so that the ring never waits on it
+bool InstanceRingBuffer::PollFence(const uint64_t fence, const bool bWait)
+{
+	auto query = fenceQueries[fence % INSTANCE_RING_MAX_FRAMES];
+	BOOL bPassed = FALSE;
+	HRESULT result;
+
+	do
+	{
+		result = context->GetData(query, &bPassed, sizeof(bPassed), bWait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	}
+	while (bWait && result == S_FALSE);
+
+	return result != S_FALSE;
+}
+
+void InstanceRingBuffer::BeginFrame()
+{
+	// Every frame in flight holds one of the queries, so the oldest is waited for when all are taken
+	while (completedFence + 1 < nextFence)
+	{
+		auto bWait = nextFence - completedFence - 1 >= INSTANCE_RING_MAX_FRAMES;
+		if (!PollFence(completedFence + 1, bWait))
+			break;
+		++completedFence;
+	}
+
+	allocator.Retire(completedFence);
+}
+
+bool InstanceRingBuffer::Write(const void* data, const size_t size, ID3D11Buffer** bufferOut, UINT* offsetOut)
+{
+	size_t offset;
+	if (!allocator.Allocate(size, INSTANCE_RING_ALIGNMENT, &offset))
+	{
+		auto capacity = allocator.GetCapacity() * 2;
+		while (capacity < size)
+			capacity *= 2;
+
+		if (!CreateBuffer(capacity))
+			return false;
+
+		allocator.Grow(capacity);
+		allocator.Allocate(size, INSTANCE_RING_ALIGNMENT, &offset);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedSubRes;
+	auto mapType = bDiscardNext ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	HRESULT result = context->Map(buffer, 0, mapType, 0, &mappedSubRes);
+	if (FAILED(result))
+	{
+		OutputDebugString("Failed to map instance ring buffer!\n");
+		return false;
+	}
+
+	memcpy(static_cast<uint8_t*>(mappedSubRes.pData) + offset, data, size);
+	context->Unmap(buffer, 0);
+	bDiscardNext = false;
+
+	*bufferOut = buffer;
+	*offsetOut = static_cast<UINT>(offset);
+	return true;
+}
+
+void InstanceRingBuffer::EndFrame()
+{
+	context->End(fenceQueries[nextFence % INSTANCE_RING_MAX_FRAMES]);
+	allocator.EndFrame(nextFence);
+	++nextFence;
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "RenderContext.h"
+
+// Bytes of the instance ring created with the renderer, it doubles whenever a frame runs out
+#define DEFAULT_INSTANCE_RING_SIZE (1 << 20)
+// Allocations start at multiples of this many bytes
+#define INSTANCE_RING_ALIGNMENT 16
+// Frames that can be in flight before the ring waits for the oldest to finish
+#define INSTANCE_RING_MAX_FRAMES 4
+
+struct RingBufferStats
+{
+	size_t Capacity;
+	// Bytes taken by the last finished frame and the most by any frame, including the end of the
+	// ring skipped over when wrapping
+	size_t FrameBytes;
+	size_t FrameHighWater;
+	// The most bytes taken at once by the frames in flight and the one being written
+	size_t InFlightHighWater;
+	size_t WrapCount;
+	size_t GrowCount;
+};
+
+// Hands out ranges of a ring of bytes for a frame at a time. Each finished frame is marked with a
+// fence value and its ranges stay in use until that fence is retired, so nothing still read by a
+// frame in flight is handed out again. Only offsets are tracked, the memory lives elsewhere.
+class RingAllocator
+{
+public:
+	RingAllocator();
+
+	void Initialize(const size_t capacity);
+	// Drops every range, as when the memory has been replaced, keeping the stats
+	void Grow(const size_t capacity);
+
+	// Returns false when the ring has no room left outside the frames in flight. When the range
+	// does not fit before the end of the ring, it starts over at the beginning and the skipped end
+	// counts as used by the frame.
+	bool Allocate(const size_t size, const size_t alignment, size_t* offsetOut);
+	void EndFrame(const uint64_t fence);
+	// Frees the ranges of every frame whose fence is at most the given one
+	void Retire(const uint64_t completedFence);
+
+	inline size_t GetCapacity() const;
+	inline size_t GetUsedBytes() const;
+	inline size_t GetFramesInFlight() const;
+	inline const RingBufferStats& GetStats() const;
+
+protected:
+	struct FrameMark
+	{
+		uint64_t Fence;
+		size_t End;
+		size_t Bytes;
+	};
+
+	size_t capacity;
+	size_t head;
+	size_t tail;
+	size_t usedBytes;
+	size_t frameBytes;
+	// Finished frames still in flight, from the oldest
+	std::vector<FrameMark> frames;
+	RingBufferStats stats;
+};
+
+// A dynamic vertex buffer the renderer writes each frame's instance data into, instead of
+// creating a buffer per batch. Writes are mapped without overwriting, which the allocator makes
+// safe by waiting on event queries issued at the end of each frame before reusing its ranges.
+// The buffer is discarded only once after being created. When a frame runs out of room, the
+// buffer is replaced with one twice the size, the old one being kept alive by the runtime for as
+// long as the draws that read it.
+class InstanceRingBuffer
+{
+public:
+	InstanceRingBuffer();
+
+	bool Initialize(IRenderContext* context, const size_t capacity);
+	void Destroy();
+
+	void BeginFrame();
+	// Copies the data into the ring, returning the buffer and offset to bind it at
+	bool Write(const void* data, const size_t size, ID3D11Buffer** bufferOut, UINT* offsetOut);
+	void EndFrame();
+
+	inline const RingBufferStats& GetStats() const;
+
+protected:
+	IRenderContext* context;
+	ID3D11Buffer* buffer;
+	ID3D11Query* fenceQueries[INSTANCE_RING_MAX_FRAMES];
+	RingAllocator allocator;
+	// The next fence to issue, and the last one the GPU is known to have passed
+	uint64_t nextFence;
+	uint64_t completedFence;
+	bool bDiscardNext;
+
+	bool CreateBuffer(const size_t capacity);
+	bool PollFence(const uint64_t fence, const bool bWait);
+};
+
+inline size_t RingAllocator::GetCapacity() const
+{
+	return capacity;
+}
+
+inline size_t RingAllocator::GetUsedBytes() const
+{
+	return usedBytes;
+}
+
+inline size_t RingAllocator::GetFramesInFlight() const
+{
+	return frames.size();
+}
+
+inline const RingBufferStats& RingAllocator::GetStats() const
+{
+	return stats;
+}
+
+inline const RingBufferStats& InstanceRingBuffer::GetStats() const
+{
+	return allocator.GetStats();
+}
+
+#endif
\ No newline at end of file
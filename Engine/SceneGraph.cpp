@@ -1,5 +1,7 @@
 #include "SceneGraph.h"
+#include "ThreadPool.h"
 
+#include <cassert>
 #include <stack>
 #include <limits>
 
@@ -57,20 +59,84 @@ void UpdateTransforms(SceneNode* node, const XMMATRIX& transform)
 	XMMATRIX matrix = XMLoadFloat4x4(&node->Transform.Local);
 	matrix = XMMatrixMultiply(matrix, transform);
 	XMStoreFloat4x4(&node->Transform.Global, matrix);
+	node->Flags &= ~(NODE_FLAG_TRANSFORM_DIRTY | NODE_FLAG_CHILD_DIRTY);
 
 	for (auto child : node->Children)
 		UpdateTransforms(child, matrix);
 }
 
-void CollectZoneLeaves(SceneNode* node, std::vector<SceneNode*>* leaves, std::vector<SceneNode*>* lights)
+void UpdateDirtySubtree(SceneNode* node, const XMMATRIX& transform, const bool bParentChanged,
+	vector<SceneNode*>* changedNodesOut)
+{
+	bool bChanged = bParentChanged || (node->Flags & NODE_FLAG_TRANSFORM_DIRTY) != 0;
+	bool bChildDirty = (node->Flags & NODE_FLAG_CHILD_DIRTY) != 0;
+	node->Flags &= ~(NODE_FLAG_TRANSFORM_DIRTY | NODE_FLAG_CHILD_DIRTY);
+
+	XMMATRIX matrix;
+	if (bChanged)
+	{
+		matrix = XMLoadFloat4x4(&node->Transform.Local);
+		matrix = XMMatrixMultiply(matrix, transform);
+		XMStoreFloat4x4(&node->Transform.Global, matrix);
+
+		if (changedNodesOut != nullptr)
+			changedNodesOut->push_back(node);
+	}
+	else if (bChildDirty)
+		matrix = XMLoadFloat4x4(&node->Transform.Global);
+	else
+		return;
+
+	for (auto child : node->Children)
+		UpdateDirtySubtree(child, matrix, bChanged, changedNodesOut);
+}
+
+void UpdateDirtyTransforms(SceneNode* node, vector<SceneNode*>* changedNodesOut)
+{
+	if (node->Parent != nullptr)
+		UpdateDirtySubtree(node, XMLoadFloat4x4(&node->Parent->Transform.Global), false, changedNodesOut);
+	else
+		UpdateDirtySubtree(node, XMMatrixIdentity(), false, changedNodesOut);
+}
+
+void MarkTransformDirty(SceneNode* node)
+{
+	node->Flags |= NODE_FLAG_TRANSFORM_DIRTY;
+
+	// Stop at the first ancestor already flagged, everything above it is flagged as well
+	for (auto parent = node->Parent; parent != nullptr && (parent->Flags & NODE_FLAG_CHILD_DIRTY) == 0;
+		parent = parent->Parent)
+		parent->Flags |= NODE_FLAG_CHILD_DIRTY;
+}
+
+void SetLocalTransform(SceneNode* node, const XMFLOAT4X4& transform)
+{
+	node->Transform.Local = transform;
+	MarkTransformDirty(node);
+}
+
+void AttachSceneNode(SceneNode* parent, SceneNode* child)
+{
+	parent->Children.push_back(child);
+	child->Parent = parent;
+	MarkTransformDirty(child);
+}
+
+void CollectZoneLeaves(SceneNode* node, std::vector<SceneNode*>* leaves, std::vector<SceneNode*>* lights,
+	std::vector<SceneNode*>* occluders)
 {
 	lights->clear();
+	occluders->clear();
 
 	for (auto child : node->Children)
 	{
 		// Collect static meshes and zones.
 		if (child->IsMesh())
+		{
 			leaves->push_back(child);
+			if ((child->Flags & NODE_FLAG_OCCLUDER) != 0)
+				occluders->push_back(child);
+		}
 		else if (child->IsZone())
 			leaves->push_back(child);
 		else if (child->IsLight())
@@ -91,7 +157,8 @@ void GetVolumeLeafBounds(SceneNode* node, Bounds* boundsOut)
 	}
 }
 
-void CreateHierarchyFromBlob(vector<RegionNode*> regions, RegionNode* baseRegion)
+void CreateHierarchyFromBlob(const vector<RegionNode*>& regions, RegionNode* baseRegion, MemoryArena* arena,
+	WorkerPool* workers)
 {
 	// Compute bounding box of the blob
 	auto infinity = numeric_limits<float>::infinity();
@@ -196,47 +263,46 @@ void CreateHierarchyFromBlob(vector<RegionNode*> regions, RegionNode* baseRegion
 		}
 	}
 
-	// Handle blob 1
-	if (lesserBlob.size() == 0)
-		baseRegion->Node1 = nullptr;
-	else if (lesserBlob.size() == 1)
-		baseRegion->Node1 = lesserBlob[0];
-	else
-	{
-		baseRegion->Node1 = new RegionNode;
-		baseRegion->Node1->LeafData = nullptr;
-		CreateHierarchyFromBlob(lesserBlob, baseRegion->Node1);
-	}
+	// The blobs share no regions, so large ones are built as separate tasks
+	TaskGroup group(regions.size() >= PARALLEL_HIERARCHY_TASK_SIZE ? workers : nullptr);
+	RegionNode** children[] = { &baseRegion->Node1, &baseRegion->Node2, &baseRegion->Node3 };
+	vector<RegionNode*>* blobs[] = { &lesserBlob, &centerBlob, &greaterBlob };
 
-	// Handle blob 2
-	if (centerBlob.size() == 0)
-		baseRegion->Node2 = nullptr;
-	else if (centerBlob.size() == 1)
-		baseRegion->Node2 = centerBlob[0];
-	else
+	for (size_t i = 0; i < 3; ++i)
 	{
-		baseRegion->Node2 = new RegionNode;
-		baseRegion->Node2->LeafData = nullptr;
-		CreateHierarchyFromBlob(centerBlob, baseRegion->Node2);
-	}
+		auto blob = blobs[i];
 
-	// Handle blob 3
-	if (greaterBlob.size() == 0)
-		baseRegion->Node3 = nullptr;
-	else if (greaterBlob.size() == 1)
-		baseRegion->Node3 = greaterBlob[0];
-	else
-	{
-		baseRegion->Node3 = new RegionNode;
-		baseRegion->Node3->LeafData = nullptr;
-		CreateHierarchyFromBlob(greaterBlob, baseRegion->Node3);
+		if (blob->size() == 0)
+			*children[i] = nullptr;
+		else if (blob->size() == 1)
+			*children[i] = (*blob)[0];
+		else
+		{
+			auto child = CreateRegionNode(arena);
+			*children[i] = child;
+			group.Run([blob, child, arena, workers]() { CreateHierarchyFromBlob(*blob, child, arena, workers); });
+		}
 	}
+
+	group.Wait();
 }
 
 void DestroyHierarchyRegion(RegionNode* node, const bool bDestroyChildrenHierarchies)
 {
-	if (bDestroyChildrenHierarchies && node->LeafData != nullptr && node->LeafData->IsZone())
-		DestroySceneGraphHierarchy(node->LeafData, true);
+	if (node->LeafData != nullptr)
+	{
+		// Mesh leaf regions belong to their scene nodes, only detach them from the hierarchy
+		if (!node->LeafData->IsZone())
+		{
+			node->LeafData = nullptr;
+			node->Parent = nullptr;
+			return;
+		}
+
+		if (bDestroyChildrenHierarchies)
+			DestroySceneGraphHierarchy(node->LeafData, true);
+		node->LeafData->Region.Parent = nullptr;
+	}
 	else
 	{
 		if (node->Node1 != nullptr)
@@ -247,13 +313,16 @@ void DestroyHierarchyRegion(RegionNode* node, const bool bDestroyChildrenHierarc
 			DestroyHierarchyRegion(node->Node3, bDestroyChildrenHierarchies);
 	}
 
-	delete node;
+	// The region itself belongs to the zone's hierarchy arena
 }
 
 void DestroySceneGraphHierarchy(SceneNode* zone, const bool bDestroyChildrenHierarchies)
 {
 	if (zone->IsZone())
 	{
+		CancelHierarchyRebuild(zone);
+		zone->Ref.ZoneData->CompiledHierarchy.Clear();
+
 		if (zone->Region.Node1 != nullptr)
 		{
 			DestroyHierarchyRegion(zone->Region.Node1, bDestroyChildrenHierarchies);
@@ -271,22 +340,26 @@ void DestroySceneGraphHierarchy(SceneNode* zone, const bool bDestroyChildrenHier
 			DestroyHierarchyRegion(zone->Region.Node3, bDestroyChildrenHierarchies);
 			zone->Region.Node3 = nullptr;
 		}
+
+		zone->Ref.ZoneData->HierarchyArena.Reset();
 	}
 }
 
 void BuildSceneGraphHierarchy(SceneNode* zone, const bool bRebuildChildrenZones)
 {
-	if (!zone->IsZone())
-	{
-		OutputDebugString("Scene node specified is not a zone!\n");
-		return;
-	}
+	HierarchyBuildParams params;
+	GetDefaultHierarchyBuildParams(&params);
+	BuildSceneGraphHierarchy(zone, bRebuildChildrenZones, params);
+}
 
+void BuildZoneHierarchy(SceneNode* zone, const bool bRebuildChildrenZones,
+	const HierarchyBuildParams& params)
+{
 	DestroySceneGraphHierarchy(zone, bRebuildChildrenZones);
 
 	ZoneData* zoneData = zone->Ref.ZoneData;
 	vector<SceneNode*> leaves;
-	CollectZoneLeaves(zone, &leaves, &zoneData->Lights);
+	CollectZoneLeaves(zone, &leaves, &zoneData->Lights, &zoneData->Occluders);
 
 	vector<RegionNode*> leafRegions;
 	for (auto leaf : leaves)
@@ -295,23 +368,98 @@ void BuildSceneGraphHierarchy(SceneNode* zone, const bool bRebuildChildrenZones)
 
 		// Rebuild children
 		if (bRebuildChildrenZones && leaf->IsZone())
-			BuildSceneGraphHierarchy(leaf, true);
+			BuildZoneHierarchy(leaf, true, params);
 
 		// Update region
 		GetVolumeLeafBounds(leaf, &bounds);
-		leaf->Region.AABB = bounds;
 
-		auto region = new RegionNode{ bounds, nullptr, nullptr, nullptr, leaf };
-		leafRegions.push_back(region);
+		if (leaf->IsZone())
+		{
+			auto region = CreateRegionNode(&zoneData->HierarchyArena);
+			region->AABB = bounds;
+			region->LeafData = leaf;
+			leaf->Region.Parent = region;
+			leafRegions.push_back(region);
+		}
+		else
+		{
+			InitializeRegionNode(&leaf->Region);
+			leaf->Region.AABB = bounds;
+			leaf->Region.LeafData = leaf;
+			leafRegions.push_back(&leaf->Region);
+		}
 	}
 
-	CreateHierarchyFromBlob(leafRegions, &zone->Region);
+	if (params.Builder == HIERARCHY_BUILDER_SAH)
+		CreateHierarchyFromBlobSAH(leafRegions, &zone->Region, &zoneData->HierarchyArena, params);
+	else
+		CreateHierarchyFromBlob(leafRegions, &zone->Region, &zoneData->HierarchyArena, params.Workers);
+
+	LinkRegionParents(&zone->Region);
+	ResetHierarchyRefitInfo(zone, params);
 }
 
-SceneNode* CreateSceneGraph(ZoneData* zoneData)
+void BuildSceneGraphHierarchy(SceneNode* zone, const bool bRebuildChildrenZones,
+	const HierarchyBuildParams& params)
 {
+	if (!zone->IsZone())
+	{
+		OutputDebugString("Scene node specified is not a zone!\n");
+		return;
+	}
+
+	BuildZoneHierarchy(zone, bRebuildChildrenZones, params);
+
+	// The zone's flat array includes any nested zones. An array left over from an earlier
+	// build would refer to regions that no longer exist.
+	auto compiledHierarchy = &zone->Ref.ZoneData->CompiledHierarchy;
+	if (params.bCompileFlatHierarchy)
+		CompileFlatHierarchy(zone, compiledHierarchy);
+	else
+		compiledHierarchy->Clear();
+
+	RecompileEnclosingFlatHierarchies(zone);
+}
+
+SceneNode* AllocateSceneNode(MemoryArena* arena, SceneNodePool* pool)
+{
+	SceneNode* node;
+
+	if (arena != nullptr)
+	{
+		node = arena->New<SceneNode>();
+		node->Children = SceneNodeList(ArenaAllocator<SceneNode*>(arena));
+		node->Flags = NODE_FLAG_TRANSFORM_DIRTY | NODE_FLAG_ARENA_ALLOCATED;
+	}
+	else if (pool != nullptr)
+	{
+		node = pool->Alloc();
+		if (node == nullptr)
+		{
+			OutputDebugString("Scene node pool is full!\n");
+			return nullptr;
+		}
+		node->Flags = NODE_FLAG_TRANSFORM_DIRTY | NODE_FLAG_POOL_ALLOCATED;
+	}
+	else
+	{
+		node = new SceneNode;
+		node->Flags = NODE_FLAG_TRANSFORM_DIRTY;
+	}
+
+	InitializeRegionNode(&node->Region);
+	node->Parent = nullptr;
+	node->LodLevel = 0;
+
+	return node;
+}
+
+SceneNode* InitializeSceneGraph(SceneNode* node)
+{
+	if (node == nullptr)
+		return nullptr;
+
 	auto infinity = numeric_limits<float>::infinity();
-	auto node = CreateZone(zoneData);
 	node->Region.AABB =
 	{
 		{ -infinity, -infinity, -infinity },
@@ -320,39 +468,25 @@ SceneNode* CreateSceneGraph(ZoneData* zoneData)
 	return node;
 }
 
-void DestroySceneGraph(SceneNode* sceneNode)
+SceneNode* InitializeStaticMeshNode(SceneNode* node, StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform,
+	const NodeType type)
 {
-	if (sceneNode->IsZone())
-		DestroySceneGraphHierarchy(sceneNode, true);
+	if (node == nullptr)
+		return nullptr;
 
-	for (auto child : sceneNode->Children)
-		DestroySceneGraph(child);
-
-	delete sceneNode;
-}
-
-SceneNode* CreateStaticMeshNode(StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform)
-{
-	auto node = new SceneNode;
 	node->MaterialData = material;
 	node->Ref.StaticMesh = mesh;
 	node->Transform.Local = transform;
-	node->Type = NODE_TYPE_STATIC_MESH;
+	node->Type = type;
 
 	return node;
 }
 
-SceneNode* CreateStaticMeshInstancedNode(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform)
+SceneNode* InitializeLightNode(SceneNode* node, LightData* data)
 {
-	auto node = CreateStaticMeshNode(mesh, material, transform);
-	node->Type = NODE_TYPE_STATIC_MESH_INSTANCED;
-
-	return node;
-}
+	if (node == nullptr)
+		return nullptr;
 
-SceneNode* CreateLightNode(LightType type, LightData* data)
-{
-	auto node = new SceneNode;
 	node->MaterialData = nullptr;
 	node->Ref.LightData = data;
 	XMStoreFloat4x4(&node->Transform.Local, XMMatrixIdentity());
@@ -361,9 +495,11 @@ SceneNode* CreateLightNode(LightType type, LightData* data)
 	return node;
 }
 
-SceneNode* CreateTerrainPatchNode(TerrainPatch* terrainPatch, const XMFLOAT4X4& transform)
+SceneNode* InitializeTerrainPatchNode(SceneNode* node, TerrainPatch* terrainPatch, const XMFLOAT4X4& transform)
 {
-	auto node = new SceneNode;
+	if (node == nullptr)
+		return nullptr;
+
 	node->MaterialData = nullptr;
 	node->Ref.TerrainPatch = terrainPatch;
 	node->Transform.Local = transform;
@@ -372,14 +508,11 @@ SceneNode* CreateTerrainPatchNode(TerrainPatch* terrainPatch, const XMFLOAT4X4&
 	return node;
 }
 
-SceneNode* CreateZone(ZoneData* zoneData)
+SceneNode* InitializeZone(SceneNode* node, ZoneData* zoneData)
 {
-	auto node = new SceneNode;
+	if (node == nullptr)
+		return nullptr;
 
-	node->Region.LeafData = nullptr;
-	node->Region.Node1 = nullptr;
-	node->Region.Node2 = nullptr;
-	node->Region.Node3 = nullptr;
 	node->Ref.ZoneData = zoneData;
 	node->Type = NODE_TYPE_ZONE;
 
@@ -388,3 +521,62 @@ SceneNode* CreateZone(ZoneData* zoneData)
 
 	return node;
 }
+
+SceneNode* CreateSceneGraph(ZoneData* zoneData, MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeSceneGraph(CreateZone(zoneData, arena, pool));
+}
+
+void DestroySceneGraph(SceneNode* sceneNode, SceneNodePool* pool)
+{
+	if (sceneNode->IsZone())
+		DestroySceneGraphHierarchy(sceneNode, true);
+
+	for (auto child : sceneNode->Children)
+		DestroySceneGraph(child, pool);
+
+	if ((sceneNode->Flags & NODE_FLAG_ARENA_ALLOCATED) != 0)
+		sceneNode->~SceneNode();
+	else if ((sceneNode->Flags & NODE_FLAG_POOL_ALLOCATED) != 0)
+	{
+		if (pool != nullptr)
+			pool->Dealloc(sceneNode);
+		else
+		{
+			OutputDebugString("Scene node allocated from a pool destroyed without it!\n");
+			sceneNode->~SceneNode();
+		}
+	}
+	else
+		delete sceneNode;
+}
+
+SceneNode* CreateStaticMeshNode(StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform,
+	MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeStaticMeshNode(AllocateSceneNode(arena, pool), mesh, material, transform,
+		NODE_TYPE_STATIC_MESH);
+}
+
+SceneNode* CreateStaticMeshInstancedNode(StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform,
+	MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeStaticMeshNode(AllocateSceneNode(arena, pool), mesh, material, transform,
+		NODE_TYPE_STATIC_MESH_INSTANCED);
+}
+
+SceneNode* CreateLightNode(LightType type, LightData* data, MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeLightNode(AllocateSceneNode(arena, pool), data);
+}
+
+SceneNode* CreateTerrainPatchNode(TerrainPatch* terrainPatch, const XMFLOAT4X4& transform,
+	MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeTerrainPatchNode(AllocateSceneNode(arena, pool), terrainPatch, transform);
+}
+
+SceneNode* CreateZone(ZoneData* zoneData, MemoryArena* arena, SceneNodePool* pool)
+{
+	return InitializeZone(AllocateSceneNode(arena, pool), zoneData);
+}
\ No newline at end of file
@@ -3,12 +3,19 @@
 
 #include <DirectXMath.h>
 #include <vector>
+#include <memory>
+#include <future>
+#include <functional>
 
 #include "StaticMesh.h"
 #include "MaterialData.h"
 #include "Terrain.h"
+#include "FlatHierarchy.h"
+#include "MemoryArena.h"
+#include "ObjectPool.h"
 
 class SceneNode;
+class WorkerPool;
 
 enum MajorAxis
 {
@@ -43,12 +50,77 @@ enum NodeTypeRange
 	NODE_TYPE_RANGE_MESH_END = NODE_TYPE_TERRAIN_PATCH
 };
 
+enum NodeFlags
+{
+	// The node's local transform has changed since its global transform was last updated
+	NODE_FLAG_TRANSFORM_DIRTY = 1 << 0,
+	// Some descendant of the node has a dirty transform
+	NODE_FLAG_CHILD_DIRTY = 1 << 1,
+	// The node was created in a memory arena and is released along with the arena
+	NODE_FLAG_ARENA_ALLOCATED = 1 << 2,
+	// The node was allocated from a scene node pool and is returned to it when destroyed
+	NODE_FLAG_POOL_ALLOCATED = 1 << 3,
+	// The node is rasterized into the occlusion buffer to hide the nodes behind it
+	NODE_FLAG_OCCLUDER = 1 << 4
+};
+
 struct NodeTransform
 {
 	DirectX::XMFLOAT4X4 Local;
 	DirectX::XMFLOAT4X4 Global;
 };
 
+enum HierarchyBuilder
+{
+	HIERARCHY_BUILDER_MIDPOINT,
+	HIERARCHY_BUILDER_SAH
+};
+
+// Subtrees smaller than this are built by the task that created them
+#define PARALLEL_HIERARCHY_TASK_SIZE 1024
+
+struct HierarchyBuildParams
+{
+	HierarchyBuilder Builder;
+	// The largest number of leaves the SAH builder may keep together under one
+	// region instead of splitting them further
+	size_t LeafSize;
+	size_t BinCount;
+	float TraversalCost;
+	float IntersectionCost;
+	// Whether to compile the zone's hierarchy into its flat array after building it
+	bool bCompileFlatHierarchy;
+	// How far the SAH cost of a refitted hierarchy may rise above its cost when it was
+	// built, relative to that cost, before it is rebuilt in the background. Zero disables rebuilds.
+	float RebuildCostThreshold;
+	// Worker threads to build large zones with, the hierarchy is the same as when built without them
+	WorkerPool* Workers;
+};
+
+struct HierarchyStats
+{
+	size_t RegionCount;
+	size_t LeafCount;
+	size_t MaxDepth;
+	// Expected cost of a query against the hierarchy, relative to the root's area
+	float SAHCost;
+	// Allocations made from the zone's hierarchy arena
+	size_t AllocationCount;
+	size_t AllocatedBytes;
+};
+
+#define INVALID_FLAT_INDEX 0xFFFFFFFF
+
+// Spatial queries are made in packets of up to this many, which walk the hierarchy together
+#define SPATIAL_QUERY_PACKET_SIZE 64
+// Nearest queries each shrink on their own, so fewer of them share a packet
+#define SPATIAL_QUERY_NEAREST_PACKET_SIZE 16
+// ...and are made one at a time when a packet's points spread over more than this fraction of
+// the zone on any axis
+#define SPATIAL_QUERY_NEAREST_MAX_SPREAD 0.05f
+
+// Leaf regions of meshes are embedded in the mesh's scene node. Nested zones are referred
+// to by a separate leaf region, which is the parent of the zone's own region.
 struct RegionNode
 {
 	Bounds AABB;
@@ -56,8 +128,60 @@ struct RegionNode
 	RegionNode* Node2;
 	RegionNode* Node3;
 	SceneNode* LeafData;
+	RegionNode* Parent;
+	// Index of the region in the flat array of the outermost zone it was compiled into
+	uint32_t FlatIndex;
+	bool bRefitPending;
+	// Frustum plane that rejected the region when it was last culled
+	uint8_t RejectPlane;
 };
 
+// A hierarchy being rebuilt on a worker thread. The builder only sees copies of the zone's
+// leaf regions, which are swapped for the real leaf regions when the result is committed.
+struct HierarchyRebuildTask
+{
+	std::vector<RegionNode> Proxies;
+	std::future<RegionNode*> Result;
+};
+
+struct HierarchyRefitInfo
+{
+	HierarchyBuildParams BuildParams;
+	// SAH costs of the zone's own regions, nested zones are not included
+	float BuildCost;
+	float CurrentCost;
+	double WeightedAreaSum;
+	size_t RefitCount;
+	size_t RebuildCount;
+};
+
+struct RayQuery
+{
+	DirectX::XMFLOAT3 Origin;
+	// Need not be normalized, distances along the ray are in multiples of its length
+	DirectX::XMFLOAT3 Direction;
+	float MaxDistance;
+};
+
+struct SphereQuery
+{
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+};
+
+struct SpatialQueryHit
+{
+	SceneNode* Node;
+	// Index of the query in the batch it was made in
+	uint32_t QueryIndex;
+	// Distance along the ray to where it enters the node's bounds, or from the point to the
+	// bounds for nearest queries. Zero for sphere and box queries.
+	float Distance;
+};
+
+// Returns false to stop the query the hit belongs to, the other queries of the batch carry on
+typedef std::function<bool(const SpatialQueryHit& hit)> SpatialQueryCallback;
+
 enum LightType
 {
 	LIGHT_TYPE_DIRECTIONAL,
@@ -67,17 +191,41 @@ enum LightType
 struct LightData
 {
 	LightType Type;
+	// Relative to the light's node
 	DirectX::XMFLOAT3 Position;
 	DirectX::XMFLOAT3 Direction;
 	float Radius;
 };
 
+// A convex polygon through which one zone looks into another. Points are in world space.
+struct ZonePortal
+{
+	std::vector<DirectX::XMFLOAT3> Points;
+	Bounds AABB;
+	SceneNode* Target;
+};
+
 struct ZoneData
 {
 	std::string Name;
 	std::vector<SceneNode*> Lights;
+	// Direct children flagged as occluders, collected when the hierarchy is built
+	std::vector<SceneNode*> Occluders;
+	// Portals leading out of the zone. When portal culling is enabled, a zone with portals is only
+	// seen through them and is left out when the zone containing it is collected.
+	std::vector<ZonePortal> Portals;
+	FlatHierarchy CompiledHierarchy;
+	HierarchyRefitInfo RefitInfo;
+	std::unique_ptr<HierarchyRebuildTask> PendingRebuild;
+	// The regions of the zone's hierarchy, released all at once when it is destroyed. A background
+	// rebuild builds into the second arena, and the two are swapped when the result is committed.
+	MemoryArena HierarchyArena;
+	MemoryArena RebuildArena;
 };
 
+typedef std::vector<SceneNode*, ArenaAllocator<SceneNode*>> SceneNodeList;
+typedef ObjectPool<SceneNode> SceneNodePool;
+
 union NodeRef
 {
 	StaticMesh* StaticMesh;
@@ -90,12 +238,16 @@ union NodeRef
 class SceneNode
 {
 public:
-	std::vector<SceneNode*> Children;
+	SceneNodeList Children;
+	SceneNode* Parent;
 	RegionNode Region;
 	NodeTransform Transform;
 	MaterialData* MaterialData;
 	NodeType Type;
 	NodeRef Ref;
+	uint32_t Flags;
+	// Level of detail the node was last drawn with, kept so that levels do not flicker
+	uint32_t LodLevel;
 
 	inline bool IsZone() const;
 	inline bool IsMesh() const;
@@ -131,20 +283,64 @@ inline bool SceneNode::IsLight() const
 }
 
 void UpdateTransforms(SceneNode* node, const DirectX::XMMATRIX& transform);
+// Updates the global transforms of dirty nodes and their descendants only, appending every
+// node whose global transform changed to the given list if there is one
+void UpdateDirtyTransforms(SceneNode* node, std::vector<SceneNode*>* changedNodesOut);
+void MarkTransformDirty(SceneNode* node);
+void SetLocalTransform(SceneNode* node, const DirectX::XMFLOAT4X4& transform);
+void AttachSceneNode(SceneNode* parent, SceneNode* child);
 void CollectZoneLeaves(SceneNode* node, std::vector<SceneNode*>* leaves,
-	std::vector<SceneNode*>* omniLights, SceneNode** directionalLight);
+	std::vector<SceneNode*>* lights, std::vector<SceneNode*>* occluders);
 void GetVolumeLeafBounds(SceneNode* node, Bounds* boundsOut);
-void CreateHierarchyFromBlob(std::vector<RegionNode*> regions, RegionNode* baseRegion);
+void CreateHierarchyFromBlob(const std::vector<RegionNode*>& regions, RegionNode* baseRegion,
+	MemoryArena* arena, WorkerPool* workers);
+void CreateHierarchyFromBlobSAH(std::vector<RegionNode*>& regions, RegionNode* baseRegion,
+	MemoryArena* arena, const HierarchyBuildParams& params);
 void DestroyHierarchyRegion(RegionNode* node, const bool bDestroyChildrenHierarchies);
 void DestroySceneGraphHierarchy(SceneNode* zone, const bool bDestroyChildrenHierarchies);
 void BuildSceneGraphHierarchy(SceneNode* zone, const bool bRebuildChildrenZones);
+void BuildSceneGraphHierarchy(SceneNode* zone, const bool bRebuildChildrenZones,
+	const HierarchyBuildParams& params);
+void GetDefaultHierarchyBuildParams(HierarchyBuildParams* paramsOut);
+void InitializeRegionNode(RegionNode* region);
+RegionNode* CreateRegionNode(MemoryArena* arena);
+void LinkRegionParents(RegionNode* region);
+void ResetHierarchyRefitInfo(SceneNode* zone, const HierarchyBuildParams& params);
+// Refits the hierarchy of a zone to the current bounds of the given nodes, whose global
+// transforms must already be up to date. The zones enclosing a nested zone are refitted with it. Scene nodes must not be added to or removed from
+// the zone while a background rebuild is pending, rebuilding or destroying the hierarchy cancels it.
+void RefitSceneGraphHierarchy(SceneNode* zone, const std::vector<SceneNode*>& changedNodes);
+void CancelHierarchyRebuild(SceneNode* zone);
+void ComputeHierarchyStats(const SceneNode* zone, const HierarchyBuildParams& params,
+	HierarchyStats* statsOut);
+
+// Report every mesh node whose bounds a query touches, in the zone and the zones nested in it,
+// in no particular order. The zone's hierarchy must have been built.
+void QueryRays(SceneNode* zone, const RayQuery* rays, const size_t count, const SpatialQueryCallback& callback);
+void QuerySpheres(SceneNode* zone, const SphereQuery* spheres, const size_t count,
+	const SpatialQueryCallback& callback);
+void QueryBounds(SceneNode* zone, const Bounds* bounds, const size_t count, const SpatialQueryCallback& callback);
+// Outputs the first mesh bounds each ray enters, with a null node for rays that hit nothing
+void QueryRaysNearest(SceneNode* zone, const RayQuery* rays, const size_t count,
+	std::vector<SpatialQueryHit>* hitsOut);
+// Outputs up to k mesh nodes within maxDistance of each point by distance to their bounds,
+// grouped by query in batch order and nearest first within each query
+void QueryNearest(SceneNode* zone, const DirectX::XMFLOAT3* points, const size_t count, const uint32_t k,
+	const float maxDistance, std::vector<SpatialQueryHit>* hitsOut);
 
-SceneNode* CreateSceneGraph(ZoneData* zoneData);
-void DestroySceneGraph(SceneNode* sceneNode);
-SceneNode* CreateStaticMeshNode(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform);
-SceneNode* CreateStaticMeshInstancedNode(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform);
-SceneNode* CreateLightNode(LightType type, LightData* data);
-SceneNode* CreateTerrainPatchNode(TerrainPatch* terrainPatch, const DirectX::XMFLOAT4X4& transform);
-SceneNode* CreateZone(ZoneData* zoneData);
+// Nodes are created on the heap unless an arena or a pool is given. Nodes created in an arena are
+// not freed by DestroySceneGraph, resetting the arena releases them. Pools may be shared by threads
+// creating nodes concurrently, and nodes allocated from a pool are returned to the pool they are
+// destroyed with.
+SceneNode* CreateSceneGraph(ZoneData* zoneData, MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
+void DestroySceneGraph(SceneNode* sceneNode, SceneNodePool* pool = nullptr);
+SceneNode* CreateStaticMeshNode(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform,
+	MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
+SceneNode* CreateStaticMeshInstancedNode(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform,
+	MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
+SceneNode* CreateLightNode(LightType type, LightData* data, MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
+SceneNode* CreateTerrainPatchNode(TerrainPatch* terrainPatch, const DirectX::XMFLOAT4X4& transform,
+	MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
+SceneNode* CreateZone(ZoneData* zoneData, MemoryArena* arena = nullptr, SceneNodePool* pool = nullptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+NodeHandle SceneStore::CreateStaticMesh(StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform)
+{
+	return StaticMeshes.Insert(mesh, material, transform);
+}
+
+NodeHandle SceneStore::CreateStaticMeshInstanced(StaticMesh* mesh, MaterialData* material, const XMFLOAT4X4& transform)
+{
+	return InstancedStaticMeshes.Insert(mesh, material, transform);
+}
+
+NodeHandle SceneStore::CreateTerrainPatch(TerrainPatch* terrainPatch, const XMFLOAT4X4& transform)
+{
+	return TerrainPatches.Insert(terrainPatch, nullptr, transform);
+}
+
+NodeHandle SceneStore::CreateLight(LightData* light, const XMFLOAT4X4& transform)
+{
+	return Lights.Insert(light, nullptr, transform);
+}
+
+bool SceneStore::Destroy(const NodeHandle handle)
+{
+	return Dispatch(handle, [handle](auto& table)
+	{
+		return table.Remove(handle);
+	});
+}
+
+bool SceneStore::IsValid(const NodeHandle handle) const
+{
+	return Dispatch(handle, [handle](const auto& table)
+	{
+		return table.Find(handle) != INVALID_NODE_INDEX;
+	});
+}
+
+bool SceneStore::SetTransform(const NodeHandle handle, const XMFLOAT4X4& transform)
+{
+	return Dispatch(handle, [handle, &transform](auto& table)
+	{
+		auto denseIndex = table.Find(handle);
+		if (denseIndex == INVALID_NODE_INDEX)
+			return false;
+
+		table.SetTransform(denseIndex, transform);
+		return true;
+	});
+}
+
+bool SceneStore::GetBounds(const NodeHandle handle, Bounds* boundsOut) const
+{
+	return Dispatch(handle, [handle, boundsOut](const auto& table)
+	{
+		auto denseIndex = table.Find(handle);
+		if (denseIndex == INVALID_NODE_INDEX)
+			return false;
+
+		table.GetBounds(denseIndex, boundsOut);
+		return true;
+	});
+}
+
+size_t SceneStore::GetNodeCount() const
+{
+	return StaticMeshes.GetSize() + InstancedStaticMeshes.GetSize() +
+		TerrainPatches.GetSize() + Lights.GetSize();
+}
+
+size_t SceneStore::GetMemoryUsage() const
+{
+	return StaticMeshes.GetMemoryUsage() + InstancedStaticMeshes.GetMemoryUsage() +
+		TerrainPatches.GetMemoryUsage() + Lights.GetMemoryUsage() +
+		(Hierarchy.LowerX.capacity() + Hierarchy.LowerY.capacity() + Hierarchy.LowerZ.capacity() +
+		Hierarchy.UpperX.capacity() + Hierarchy.UpperY.capacity() + Hierarchy.UpperZ.capacity()) * sizeof(float) +
+		(Hierarchy.SkipIndices.capacity() + HierarchyHandles.capacity()) * sizeof(uint32_t) +
+		Hierarchy.LeafData.capacity() * sizeof(SceneNode*) + Hierarchy.RejectPlanes.capacity();
+}
+
+void SceneStore::Clear()
+{
+	StaticMeshes.Clear();
+	InstancedStaticMeshes.Clear();
+	TerrainPatches.Clear();
+	Lights.Clear();
+	Hierarchy.Clear();
+	HierarchyHandles.clear();
+}
+
+// Leaf regions are built from copies of the nodes' bounds, as for a background rebuild, and are
+// told apart from the regions the builder created by their address
+template <NodeType Type>
+void AppendHierarchyProxies(const NodeTable<Type>& table, vector<RegionNode>& proxies,
+	vector<NodeHandle>& proxyHandles)
+{
+	auto size = table.GetSize();
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		RegionNode proxy;
+		InitializeRegionNode(&proxy);
+		table.GetBounds(i, &proxy.AABB);
+		proxies.push_back(proxy);
+		proxyHandles.push_back(table.GetHandle(i));
+	}
+}
+
+void CompileStoreRegion(const RegionNode* region, const vector<RegionNode>& proxies,
+	const vector<NodeHandle>& proxyHandles, SceneStore* store)
+{
+	auto& hierarchy = store->Hierarchy;
+	auto index = hierarchy.Push(region->AABB, nullptr);
+
+	if (region >= proxies.data() && region < proxies.data() + proxies.size())
+		store->HierarchyHandles.push_back(proxyHandles[region - proxies.data()]);
+	else
+		store->HierarchyHandles.push_back(INVALID_NODE_HANDLE);
+
+	if (region->Node1 != nullptr)
+		CompileStoreRegion(region->Node1, proxies, proxyHandles, store);
+	if (region->Node2 != nullptr)
+		CompileStoreRegion(region->Node2, proxies, proxyHandles, store);
+	if (region->Node3 != nullptr)
+		CompileStoreRegion(region->Node3, proxies, proxyHandles, store);
+
+	hierarchy.SkipIndices[index] = hierarchy.GetSize();
+}
+
+void BuildSceneStoreHierarchy(SceneStore* store)
+{
+	HierarchyBuildParams params;
+	GetDefaultHierarchyBuildParams(&params);
+	BuildSceneStoreHierarchy(store, params);
+}
+
+void BuildSceneStoreHierarchy(SceneStore* store, const HierarchyBuildParams& params)
+{
+	store->Hierarchy.Clear();
+	store->HierarchyHandles.clear();
+
+	auto leafCount = store->StaticMeshes.GetSize() + store->InstancedStaticMeshes.GetSize() +
+		store->TerrainPatches.GetSize();
+	if (leafCount == 0)
+		return;
+
+	vector<RegionNode> proxies;
+	vector<NodeHandle> proxyHandles;
+	proxies.reserve(leafCount);
+	proxyHandles.reserve(leafCount);
+	AppendHierarchyProxies(store->StaticMeshes, proxies, proxyHandles);
+	AppendHierarchyProxies(store->InstancedStaticMeshes, proxies, proxyHandles);
+	AppendHierarchyProxies(store->TerrainPatches, proxies, proxyHandles);
+
+	vector<RegionNode*> regions;
+	regions.reserve(leafCount);
+	for (auto& proxy : proxies)
+		regions.push_back(&proxy);
+
+	// The regions are only needed until they are compiled
+	store->HierarchyArena.Reset();
+	auto root = CreateRegionNode(&store->HierarchyArena);
+	if (params.Builder == HIERARCHY_BUILDER_SAH)
+		CreateHierarchyFromBlobSAH(regions, root, &store->HierarchyArena, params);
+	else
+		CreateHierarchyFromBlob(regions, root, &store->HierarchyArena, params.Workers);
+
+	CompileStoreRegion(root, proxies, proxyHandles, store);
+}
\ No newline at end of file
@@ -0,0 +1,456 @@
+#ifndef SCENE_STORE_H_
+#define SCENE_STORE_H_
+
+#include <vector>
+#include <limits>
+#include <stdint.h>
+#include <DirectXMath.h>
+
+#include "SceneGraph.h"
+
+// Handles refer to a slot of the table for their node type. The generation of a slot changes
+// whenever its node is destroyed, so handles to destroyed nodes are recognized as stale.
+typedef uint32_t NodeHandle;
+
+#define NODE_HANDLE_INDEX_BITS 22
+#define NODE_HANDLE_TYPE_BITS 3
+#define NODE_HANDLE_GENERATION_BITS 7
+#define NODE_HANDLE_INDEX_MASK ((1u << NODE_HANDLE_INDEX_BITS) - 1)
+#define NODE_HANDLE_TYPE_MASK ((1u << NODE_HANDLE_TYPE_BITS) - 1)
+#define NODE_HANDLE_GENERATION_MASK ((1u << NODE_HANDLE_GENERATION_BITS) - 1)
+#define INVALID_NODE_HANDLE 0
+#define INVALID_NODE_INDEX 0xFFFFFFFF
+
+static_assert(NODE_TYPE_END_ENUM <= (1 << NODE_HANDLE_TYPE_BITS), "Node types do not fit in a node handle!");
+
+inline NodeHandle MakeNodeHandle(const uint32_t index, const NodeType type, const uint32_t generation)
+{
+	return index | (static_cast<uint32_t>(type) << NODE_HANDLE_INDEX_BITS) |
+		(generation << (NODE_HANDLE_INDEX_BITS + NODE_HANDLE_TYPE_BITS));
+}
+
+inline uint32_t GetNodeHandleIndex(const NodeHandle handle)
+{
+	return handle & NODE_HANDLE_INDEX_MASK;
+}
+
+inline NodeType GetNodeHandleType(const NodeHandle handle)
+{
+	return static_cast<NodeType>((handle >> NODE_HANDLE_INDEX_BITS) & NODE_HANDLE_TYPE_MASK);
+}
+
+inline uint32_t GetNodeHandleGeneration(const NodeHandle handle)
+{
+	return handle >> (NODE_HANDLE_INDEX_BITS + NODE_HANDLE_TYPE_BITS);
+}
+
+// Describes each type of node kept in a scene store, so that tables can compute
+// the bounds of their nodes without going through the scene node function table.
+template <NodeType Type>
+struct NodeTypeTraits;
+
+template <>
+struct NodeTypeTraits<NODE_TYPE_STATIC_MESH>
+{
+	typedef StaticMesh Resource;
+	static const bool bHasMaterial = true;
+
+	static inline void GetWorldBounds(const StaticMesh* mesh, const DirectX::XMFLOAT4X4& transform,
+		Bounds* boundsOut)
+	{
+		mesh->GetMeshBounds(boundsOut);
+		TransformBounds(DirectX::XMLoadFloat4x4(&transform), *boundsOut, boundsOut);
+	}
+};
+
+template <>
+struct NodeTypeTraits<NODE_TYPE_STATIC_MESH_INSTANCED> : public NodeTypeTraits<NODE_TYPE_STATIC_MESH>
+{
+};
+
+template <>
+struct NodeTypeTraits<NODE_TYPE_TERRAIN_PATCH>
+{
+	typedef TerrainPatch Resource;
+	static const bool bHasMaterial = false;
+
+	static inline void GetWorldBounds(const TerrainPatch* terrainPatch, const DirectX::XMFLOAT4X4& transform,
+		Bounds* boundsOut)
+	{
+		terrainPatch->GetBounds(boundsOut);
+		TransformBounds(DirectX::XMLoadFloat4x4(&transform), *boundsOut, boundsOut);
+	}
+};
+
+template <>
+struct NodeTypeTraits<NODE_TYPE_LIGHT>
+{
+	typedef LightData Resource;
+	static const bool bHasMaterial = false;
+
+	static inline void GetWorldBounds(const LightData* light, const DirectX::XMFLOAT4X4& transform,
+		Bounds* boundsOut)
+	{
+		if (light->Type == LIGHT_TYPE_OMNI)
+		{
+			DirectX::XMFLOAT3 center;
+			DirectX::XMStoreFloat3(&center, DirectX::XMVector3TransformCoord(
+				DirectX::XMLoadFloat3(&light->Position), DirectX::XMLoadFloat4x4(&transform)));
+			boundsOut->Lower = DirectX::XMFLOAT3(center.x - light->Radius, center.y - light->Radius, center.z - light->Radius);
+			boundsOut->Upper = DirectX::XMFLOAT3(center.x + light->Radius, center.y + light->Radius, center.z + light->Radius);
+		}
+		else
+		{
+			auto infinity = std::numeric_limits<float>::infinity();
+			boundsOut->Lower = DirectX::XMFLOAT3(-infinity, -infinity, -infinity);
+			boundsOut->Upper = DirectX::XMFLOAT3(infinity, infinity, infinity);
+		}
+	}
+};
+
+// Nodes of a single type, packed into dense columns. Removing a node moves the last node
+// into its place, so dense indices are only stable until the next removal.
+template <NodeType Type>
+class NodeTable
+{
+public:
+	typedef NodeTypeTraits<Type> Traits;
+	typedef typename Traits::Resource Resource;
+
+	std::vector<DirectX::XMFLOAT4X4> Transforms;
+	std::vector<float> LowerX;
+	std::vector<float> LowerY;
+	std::vector<float> LowerZ;
+	std::vector<float> UpperX;
+	std::vector<float> UpperY;
+	std::vector<float> UpperZ;
+	std::vector<Resource*> Resources;
+	// Empty for node types without materials
+	std::vector<MaterialData*> Materials;
+	std::vector<uint32_t> Slots;
+
+	NodeTable();
+
+	NodeHandle Insert(Resource* resource, MaterialData* material, const DirectX::XMFLOAT4X4& transform);
+	bool Remove(const NodeHandle handle);
+	void Clear();
+	void SetTransform(const uint32_t denseIndex, const DirectX::XMFLOAT4X4& transform);
+	void UpdateBounds(const uint32_t denseIndex);
+
+	inline uint32_t Find(const NodeHandle handle) const;
+	inline NodeHandle GetHandle(const uint32_t denseIndex) const;
+	inline uint32_t GetSize() const;
+	inline void GetBounds(const uint32_t denseIndex, Bounds* boundsOut) const;
+	// Bytes reserved by the columns and the slots, used or not
+	inline size_t GetMemoryUsage() const;
+
+protected:
+	// Indexed by slot. The dense index of a free slot is the next free slot instead.
+	std::vector<uint32_t> denseIndices;
+	std::vector<uint8_t> generations;
+	uint32_t freeSlot;
+
+	inline void SetBounds(const uint32_t denseIndex, const Bounds& bounds);
+	void MoveDense(const uint32_t from, const uint32_t to);
+};
+
+// Handles of the nodes of a store collected by a query, by node type
+struct NodeHandleCollection
+{
+	std::vector<NodeHandle> StaticMeshes;
+	std::vector<NodeHandle> InstancedStaticMeshes;
+	std::vector<NodeHandle> TerrainPatches;
+	std::vector<NodeHandle> Lights;
+};
+
+// Scene nodes kept in one table per node type rather than as individual scene nodes. The
+// meshes and terrain patches of the store are grouped into a hierarchy of their own, which
+// is only rebuilt on request: nodes created or moved since are left out or culled with their
+// old bounds, and the handles of nodes destroyed since are skipped.
+class SceneStore
+{
+public:
+	NodeTable<NODE_TYPE_STATIC_MESH> StaticMeshes;
+	NodeTable<NODE_TYPE_STATIC_MESH_INSTANCED> InstancedStaticMeshes;
+	NodeTable<NODE_TYPE_TERRAIN_PATCH> TerrainPatches;
+	NodeTable<NODE_TYPE_LIGHT> Lights;
+	// Compiled by BuildSceneStoreHierarchy. Its leaf data is always null, the node of each
+	// leaf entry is given by the handle at the same index instead.
+	FlatHierarchy Hierarchy;
+	// INVALID_NODE_HANDLE for the entries that are not leaves
+	std::vector<NodeHandle> HierarchyHandles;
+	// The regions the hierarchy is built in before it is compiled, kept across builds
+	MemoryArena HierarchyArena;
+
+	NodeHandle CreateStaticMesh(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform);
+	NodeHandle CreateStaticMeshInstanced(StaticMesh* mesh, MaterialData* material, const DirectX::XMFLOAT4X4& transform);
+	NodeHandle CreateTerrainPatch(TerrainPatch* terrainPatch, const DirectX::XMFLOAT4X4& transform);
+	NodeHandle CreateLight(LightData* light, const DirectX::XMFLOAT4X4& transform);
+
+	bool Destroy(const NodeHandle handle);
+	bool IsValid(const NodeHandle handle) const;
+	bool SetTransform(const NodeHandle handle, const DirectX::XMFLOAT4X4& transform);
+	bool GetBounds(const NodeHandle handle, Bounds* boundsOut) const;
+	size_t GetNodeCount() const;
+	// Bytes reserved by the tables and the hierarchy
+	size_t GetMemoryUsage() const;
+	void Clear();
+
+protected:
+	template <typename Function>
+	bool Dispatch(const NodeHandle handle, Function function);
+	template <typename Function>
+	bool Dispatch(const NodeHandle handle, Function function) const;
+};
+
+// Builds a hierarchy over the current bounds of the store's meshes and terrain patches with the
+// same builders as a zone, and compiles it into the store's flat array
+void BuildSceneStoreHierarchy(SceneStore* store);
+void BuildSceneStoreHierarchy(SceneStore* store, const HierarchyBuildParams& params);
+
+// Appends the dense indices of all nodes in a table whose bounds intersect the frustum
+template <NodeType Type>
+void CullNodeTable(const NodeTable<Type>& table, const Frustum& frustum, std::vector<uint32_t>* visibleOut);
+
+template<NodeType Type>
+inline NodeTable<Type>::NodeTable() :
+	freeSlot(INVALID_NODE_INDEX)
+{
+}
+
+template<NodeType Type>
+inline NodeHandle NodeTable<Type>::Insert(Resource* resource, MaterialData* material,
+	const DirectX::XMFLOAT4X4& transform)
+{
+	uint32_t slot;
+	if (freeSlot != INVALID_NODE_INDEX)
+	{
+		slot = freeSlot;
+		freeSlot = denseIndices[slot];
+	}
+	else
+	{
+		if (denseIndices.size() > NODE_HANDLE_INDEX_MASK)
+		{
+			OutputDebugString("Node table is full!\n");
+			return INVALID_NODE_HANDLE;
+		}
+
+		slot = static_cast<uint32_t>(denseIndices.size());
+		denseIndices.push_back(0);
+		generations.push_back(0);
+	}
+
+	auto denseIndex = GetSize();
+	denseIndices[slot] = denseIndex;
+
+	Transforms.push_back(transform);
+	LowerX.push_back(0.0f);
+	LowerY.push_back(0.0f);
+	LowerZ.push_back(0.0f);
+	UpperX.push_back(0.0f);
+	UpperY.push_back(0.0f);
+	UpperZ.push_back(0.0f);
+	Resources.push_back(resource);
+	if (Traits::bHasMaterial)
+		Materials.push_back(material);
+	Slots.push_back(slot);
+
+	UpdateBounds(denseIndex);
+	return MakeNodeHandle(slot, Type, generations[slot]);
+}
+
+template<NodeType Type>
+inline bool NodeTable<Type>::Remove(const NodeHandle handle)
+{
+	auto denseIndex = Find(handle);
+	if (denseIndex == INVALID_NODE_INDEX)
+		return false;
+
+	auto slot = Slots[denseIndex];
+	auto lastIndex = GetSize() - 1;
+	if (denseIndex != lastIndex)
+		MoveDense(lastIndex, denseIndex);
+
+	Transforms.pop_back();
+	LowerX.pop_back();
+	LowerY.pop_back();
+	LowerZ.pop_back();
+	UpperX.pop_back();
+	UpperY.pop_back();
+	UpperZ.pop_back();
+	Resources.pop_back();
+	if (Traits::bHasMaterial)
+		Materials.pop_back();
+	Slots.pop_back();
+
+	generations[slot] = static_cast<uint8_t>((generations[slot] + 1) & NODE_HANDLE_GENERATION_MASK);
+	denseIndices[slot] = freeSlot;
+	freeSlot = slot;
+	return true;
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::Clear()
+{
+	// Every slot becomes free, but generations are kept so that old handles remain stale
+	for (auto slot : Slots)
+	{
+		generations[slot] = static_cast<uint8_t>((generations[slot] + 1) & NODE_HANDLE_GENERATION_MASK);
+		denseIndices[slot] = freeSlot;
+		freeSlot = slot;
+	}
+
+	Transforms.clear();
+	LowerX.clear();
+	LowerY.clear();
+	LowerZ.clear();
+	UpperX.clear();
+	UpperY.clear();
+	UpperZ.clear();
+	Resources.clear();
+	Materials.clear();
+	Slots.clear();
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::SetTransform(const uint32_t denseIndex, const DirectX::XMFLOAT4X4& transform)
+{
+	Transforms[denseIndex] = transform;
+	UpdateBounds(denseIndex);
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::UpdateBounds(const uint32_t denseIndex)
+{
+	Bounds bounds;
+	Traits::GetWorldBounds(Resources[denseIndex], Transforms[denseIndex], &bounds);
+	SetBounds(denseIndex, bounds);
+}
+
+template<NodeType Type>
+inline uint32_t NodeTable<Type>::Find(const NodeHandle handle) const
+{
+	auto slot = GetNodeHandleIndex(handle);
+
+	if (GetNodeHandleType(handle) != Type || slot >= generations.size() ||
+		generations[slot] != GetNodeHandleGeneration(handle))
+		return INVALID_NODE_INDEX;
+
+	return denseIndices[slot];
+}
+
+template<NodeType Type>
+inline NodeHandle NodeTable<Type>::GetHandle(const uint32_t denseIndex) const
+{
+	auto slot = Slots[denseIndex];
+	return MakeNodeHandle(slot, Type, generations[slot]);
+}
+
+template<NodeType Type>
+inline uint32_t NodeTable<Type>::GetSize() const
+{
+	return static_cast<uint32_t>(Slots.size());
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::GetBounds(const uint32_t denseIndex, Bounds* boundsOut) const
+{
+	boundsOut->Lower.x = LowerX[denseIndex];
+	boundsOut->Lower.y = LowerY[denseIndex];
+	boundsOut->Lower.z = LowerZ[denseIndex];
+	boundsOut->Upper.x = UpperX[denseIndex];
+	boundsOut->Upper.y = UpperY[denseIndex];
+	boundsOut->Upper.z = UpperZ[denseIndex];
+}
+
+template<NodeType Type>
+inline size_t NodeTable<Type>::GetMemoryUsage() const
+{
+	return Transforms.capacity() * sizeof(DirectX::XMFLOAT4X4) +
+		(LowerX.capacity() + LowerY.capacity() + LowerZ.capacity() +
+		UpperX.capacity() + UpperY.capacity() + UpperZ.capacity()) * sizeof(float) +
+		Resources.capacity() * sizeof(Resource*) + Materials.capacity() * sizeof(MaterialData*) +
+		(Slots.capacity() + denseIndices.capacity()) * sizeof(uint32_t) + generations.capacity();
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::SetBounds(const uint32_t denseIndex, const Bounds& bounds)
+{
+	LowerX[denseIndex] = bounds.Lower.x;
+	LowerY[denseIndex] = bounds.Lower.y;
+	LowerZ[denseIndex] = bounds.Lower.z;
+	UpperX[denseIndex] = bounds.Upper.x;
+	UpperY[denseIndex] = bounds.Upper.y;
+	UpperZ[denseIndex] = bounds.Upper.z;
+}
+
+template<NodeType Type>
+inline void NodeTable<Type>::MoveDense(const uint32_t from, const uint32_t to)
+{
+	Transforms[to] = Transforms[from];
+	LowerX[to] = LowerX[from];
+	LowerY[to] = LowerY[from];
+	LowerZ[to] = LowerZ[from];
+	UpperX[to] = UpperX[from];
+	UpperY[to] = UpperY[from];
+	UpperZ[to] = UpperZ[from];
+	Resources[to] = Resources[from];
+	if (Traits::bHasMaterial)
+		Materials[to] = Materials[from];
+	Slots[to] = Slots[from];
+
+	denseIndices[Slots[to]] = to;
+}
+
+template <typename Function>
+inline bool SceneStore::Dispatch(const NodeHandle handle, Function function)
+{
+	switch (GetNodeHandleType(handle))
+	{
+	case NODE_TYPE_STATIC_MESH:
+		return function(StaticMeshes);
+	case NODE_TYPE_STATIC_MESH_INSTANCED:
+		return function(InstancedStaticMeshes);
+	case NODE_TYPE_TERRAIN_PATCH:
+		return function(TerrainPatches);
+	case NODE_TYPE_LIGHT:
+		return function(Lights);
+	default:
+		return false;
+	}
+}
+
+template <typename Function>
+inline bool SceneStore::Dispatch(const NodeHandle handle, Function function) const
+{
+	switch (GetNodeHandleType(handle))
+	{
+	case NODE_TYPE_STATIC_MESH:
+		return function(StaticMeshes);
+	case NODE_TYPE_STATIC_MESH_INSTANCED:
+		return function(InstancedStaticMeshes);
+	case NODE_TYPE_TERRAIN_PATCH:
+		return function(TerrainPatches);
+	case NODE_TYPE_LIGHT:
+		return function(Lights);
+	default:
+		return false;
+	}
+}
+
+template <NodeType Type>
+inline void CullNodeTable(const NodeTable<Type>& table, const Frustum& frustum, std::vector<uint32_t>* visibleOut)
+{
+	Bounds bounds;
+	auto size = table.GetSize();
+
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		table.GetBounds(i, &bounds);
+		if (!IsOutsideFrustum(bounds, frustum))
+			visibleOut->push_back(i);
+	}
+}
+
+#endif
\ No newline at end of file
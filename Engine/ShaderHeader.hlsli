@@ -6,17 +6,11 @@ struct VSInputStaticMeshInstanced
 	matrix world : INSTANCE;
 };
 
-struct VSInputStaticMesh
-{
-	float3 position : POSITION;
-	float2 uv : TEXCOORD;
-	float3 normal : NORMAL;
-};
-
 struct VSInputTerrainPatch
 {
 	float3 position : POSITION;
 	float3 normal : NORMAL;
+	matrix world : INSTANCE;
 };
 
 struct VSInputBlit
@@ -0,0 +1,107 @@
+#include "ShadowCascades.h"
+#include "SceneGraph.h"
+#include "Camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+void ComputeCascadeSplits(const float nearPlane, const float farPlane, const uint32_t cascadeCount,
+	const float splitBlend, CameraShadowInfo* infoOut)
+{
+	infoOut->Cascades.resize(cascadeCount);
+	float previous = nearPlane;
+
+	for (uint32_t i = 0; i < cascadeCount; ++i)
+	{
+		float fraction = static_cast<float>(i + 1) / cascadeCount;
+		float logSplit = nearPlane * pow(farPlane / nearPlane, fraction);
+		float uniformSplit = nearPlane + (farPlane - nearPlane) * fraction;
+
+		auto& cascade = infoOut->Cascades[i];
+		cascade.NearPlane = previous;
+		cascade.FarPlane = i + 1 == cascadeCount ? farPlane : splitBlend * logSplit + (1.0f - splitBlend) * uniformSplit;
+		previous = cascade.FarPlane;
+	}
+}
+
+// The plane of a light space box face in world space, where the light's view is a rotation
+inline void ConstructLightSpacePlane(const XMFLOAT4X4& lightView, const uint32_t axis, const float sign,
+	const float distance, Plane* planeOut)
+{
+	planeOut->Normal = XMFLOAT3(sign * lightView.m[0][axis], sign * lightView.m[1][axis], sign * lightView.m[2][axis]);
+	planeOut->Distance = sign * distance;
+}
+
+bool FitShadowCascade(const XMFLOAT4X4& cameraView, const XMFLOAT4X4& cameraProjection,
+	const ShadowCascadeInfo& split, const XMFLOAT3& lightDirection, const Bounds& sceneBounds,
+	ShadowCascade* cascadeOut)
+{
+	cascadeOut->NearPlane = split.NearPlane;
+	cascadeOut->FarPlane = split.FarPlane;
+	cascadeOut->Casters.clear();
+	SetEmptyBounds(&cascadeOut->ReceiverBounds);
+	SetEmptyBounds(&cascadeOut->CasterBounds);
+
+	// The light looks along its direction from the origin, so its view only rotates
+	auto direction = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	auto up = fabs(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	auto lightView = XMMatrixLookToLH(XMVectorZero(), direction, up);
+	XMStoreFloat4x4(&cascadeOut->View, lightView);
+
+	// Corners of the slice of the view between the split's planes, taken from view space to
+	// light space
+	auto cameraToLight = XMMatrixMultiply(XMMatrixInverse(nullptr, XMLoadFloat4x4(&cameraView)), lightView);
+	Bounds receivers;
+	SetEmptyBounds(&receivers);
+
+	for (auto depth : { split.NearPlane, split.FarPlane })
+	{
+		float x = depth / cameraProjection.m[0][0];
+		float y = depth / cameraProjection.m[1][1];
+
+		for (uint32_t corner = 0; corner < 4; ++corner)
+		{
+			auto point = XMVectorSet((corner & 1) != 0 ? x : -x, (corner & 2) != 0 ? y : -y, depth, 1.0f);
+			XMFLOAT3 lightPoint;
+			XMStoreFloat3(&lightPoint, XMVector3TransformCoord(point, cameraToLight));
+			ExpandBounds(&receivers, lightPoint);
+		}
+	}
+
+	// Nothing outside the scene receives shadows or casts them
+	Bounds scene;
+	TransformBounds(lightView, sceneBounds, &scene);
+
+	receivers.Lower.x = max(receivers.Lower.x, scene.Lower.x);
+	receivers.Lower.y = max(receivers.Lower.y, scene.Lower.y);
+	receivers.Lower.z = max(receivers.Lower.z, scene.Lower.z);
+	receivers.Upper.x = min(receivers.Upper.x, scene.Upper.x);
+	receivers.Upper.y = min(receivers.Upper.y, scene.Upper.y);
+	receivers.Upper.z = min(receivers.Upper.z, scene.Upper.z);
+
+	if (!(receivers.Lower.x <= receivers.Upper.x && receivers.Lower.y <= receivers.Upper.y &&
+		receivers.Lower.z <= receivers.Upper.z))
+		return false;
+
+	// Casters outside the view still shadow it if they are between the receivers and the light
+	auto& casters = cascadeOut->CasterBounds;
+	casters = receivers;
+	casters.Lower.z = scene.Lower.z;
+
+	cascadeOut->ReceiverBounds = receivers;
+	XMStoreFloat4x4(&cascadeOut->Projection, XMMatrixOrthographicOffCenterLH(casters.Lower.x, casters.Upper.x,
+		casters.Lower.y, casters.Upper.y, casters.Lower.z, casters.Upper.z));
+
+	auto& volume = cascadeOut->CasterVolume;
+	ConstructLightSpacePlane(cascadeOut->View, 2, -1.0f, casters.Lower.z, &volume.Planes[0]);
+	ConstructLightSpacePlane(cascadeOut->View, 2, 1.0f, casters.Upper.z, &volume.Planes[1]);
+	ConstructLightSpacePlane(cascadeOut->View, 0, -1.0f, casters.Lower.x, &volume.Planes[2]);
+	ConstructLightSpacePlane(cascadeOut->View, 0, 1.0f, casters.Upper.x, &volume.Planes[3]);
+	ConstructLightSpacePlane(cascadeOut->View, 1, -1.0f, casters.Lower.y, &volume.Planes[4]);
+	ConstructLightSpacePlane(cascadeOut->View, 1, 1.0f, casters.Upper.y, &volume.Planes[5]);
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef SHADOW_CASCADES_H_
+#define SHADOW_CASCADES_H_
+
+#include <vector>
+#include <stdint.h>
+#include <DirectXMath.h>
+
+#include "Geometry.h"
+
+class SceneNode;
+struct CameraShadowInfo;
+struct ShadowCascadeInfo;
+
+#define DEFAULT_SHADOW_CASCADE_COUNT 4
+// Blend between uniform splits at zero and logarithmic splits at one
+#define DEFAULT_SHADOW_SPLIT_BLEND 0.75f
+
+// The part of the view covered by one cascade of a directional light's shadow map
+struct ShadowCascade
+{
+	// Distances along the view the cascade covers
+	float NearPlane;
+	float FarPlane;
+	// The light's view, looking along its direction, and an orthographic projection fitted to the
+	// cascade's casters and receivers
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	// Light space bounds of the receivers, which is the slice of the view frustum that holds any
+	// of the scene. Caster bounds extend them back toward the light to the edge of the scene.
+	Bounds ReceiverBounds;
+	Bounds CasterBounds;
+	// The caster bounds in world space
+	Frustum CasterVolume;
+	std::vector<SceneNode*> Casters;
+};
+
+// Splits the distance between the planes into cascades, blending between splits spaced evenly
+// and splits spaced by a constant ratio
+void ComputeCascadeSplits(const float nearPlane, const float farPlane, const uint32_t cascadeCount,
+	const float splitBlend, CameraShadowInfo* infoOut);
+
+// Fits the cascade to the part of the camera's view between the split's planes, along with the
+// scene behind it toward the light. The projection must be a symmetric left handed perspective.
+// The light direction is the direction the light travels. Returns false if no part of the scene
+// is in the split, in which case the cascade has nothing to draw.
+bool FitShadowCascade(const DirectX::XMFLOAT4X4& cameraView, const DirectX::XMFLOAT4X4& cameraProjection,
+	const ShadowCascadeInfo& split, const DirectX::XMFLOAT3& lightDirection, const Bounds& sceneBounds,
+	ShadowCascade* cascadeOut);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,471 @@
+#ifndef SHIM_DIRECTX_MATH_H_
+#define SHIM_DIRECTX_MATH_H_
+
+#ifdef _WIN32
+#error The shim headers stand in for the Windows SDK off Windows only
+#endif
+
+// The part of DirectXMath the engine uses, for building the engine off Windows. Vectors are SSE
+// registers as with the real library on x86, matrices are rows of them and multiply row vectors
+// from the right, and every function gives the results its DirectXMath namesake would.
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <cmath>
+#include <stdint.h>
+
+namespace DirectX
+{
+
+const float XM_PI = 3.141592654f;
+const float XM_2PI = 6.283185307f;
+const float XM_1DIVPI = 0.318309886f;
+const float XM_1DIV2PI = 0.159154943f;
+const float XM_PIDIV2 = 1.570796327f;
+const float XM_PIDIV4 = 0.785398163f;
+
+typedef __m128 XMVECTOR;
+typedef const XMVECTOR FXMVECTOR;
+typedef const XMVECTOR& CXMVECTOR;
+
+struct XMMATRIX
+{
+	XMVECTOR r[4];
+
+	XMMATRIX() = default;
+	XMMATRIX(FXMVECTOR r0, FXMVECTOR r1, FXMVECTOR r2, FXMVECTOR r3) : r{ r0, r1, r2, r3 } {}
+};
+
+typedef const XMMATRIX& FXMMATRIX;
+typedef const XMMATRIX& CXMMATRIX;
+
+struct XMFLOAT2
+{
+	float x;
+	float y;
+
+	XMFLOAT2() = default;
+	XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+};
+
+struct XMFLOAT3
+{
+	float x;
+	float y;
+	float z;
+
+	XMFLOAT3() = default;
+	XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	explicit XMFLOAT3(const float* array) : x(array[0]), y(array[1]), z(array[2]) {}
+};
+
+struct XMFLOAT4
+{
+	float x;
+	float y;
+	float z;
+	float w;
+
+	XMFLOAT4() = default;
+	XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	explicit XMFLOAT4(const float* array) : x(array[0]), y(array[1]), z(array[2]), w(array[3]) {}
+};
+
+struct XMUINT4
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+	uint32_t w;
+
+	XMUINT4() = default;
+	XMUINT4(uint32_t _x, uint32_t _y, uint32_t _z, uint32_t _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+struct XMFLOAT4X4
+{
+	union
+	{
+		struct
+		{
+			float _11, _12, _13, _14;
+			float _21, _22, _23, _24;
+			float _31, _32, _33, _34;
+			float _41, _42, _43, _44;
+		};
+		float m[4][4];
+	};
+
+	XMFLOAT4X4() = default;
+};
+
+// Loads and stores
+
+inline XMVECTOR XMLoadFloat3(const XMFLOAT3* source)
+{
+	return _mm_set_ps(0.0f, source->z, source->y, source->x);
+}
+
+inline XMVECTOR XMLoadFloat4(const XMFLOAT4* source)
+{
+	return _mm_loadu_ps(&source->x);
+}
+
+inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4* source)
+{
+	return XMMATRIX(_mm_loadu_ps(source->m[0]), _mm_loadu_ps(source->m[1]), _mm_loadu_ps(source->m[2]),
+		_mm_loadu_ps(source->m[3]));
+}
+
+inline void XMStoreFloat(float* destination, FXMVECTOR v)
+{
+	_mm_store_ss(destination, v);
+}
+
+inline void XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v)
+{
+	float values[4];
+	_mm_storeu_ps(values, v);
+	destination->x = values[0];
+	destination->y = values[1];
+	destination->z = values[2];
+}
+
+inline void XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v)
+{
+	_mm_storeu_ps(&destination->x, v);
+}
+
+inline void XMStoreUInt4(XMUINT4* destination, FXMVECTOR v)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&destination->x), _mm_castps_si128(v));
+}
+
+inline void XMStoreFloat4x4(XMFLOAT4X4* destination, FXMMATRIX m)
+{
+	for (int i = 0; i < 4; ++i)
+		_mm_storeu_ps(destination->m[i], m.r[i]);
+}
+
+// Vectors
+
+inline XMVECTOR XMVectorZero()
+{
+	return _mm_setzero_ps();
+}
+
+inline XMVECTOR XMVectorSet(float x, float y, float z, float w)
+{
+	return _mm_set_ps(w, z, y, x);
+}
+
+inline XMVECTOR XMVectorReplicate(float value)
+{
+	return _mm_set1_ps(value);
+}
+
+inline XMVECTOR XMVectorTrueInt()
+{
+	return _mm_castsi128_ps(_mm_set1_epi32(-1));
+}
+
+inline XMVECTOR XMVectorFalseInt()
+{
+	return _mm_setzero_ps();
+}
+
+inline float XMVectorGetX(FXMVECTOR v)
+{
+	return _mm_cvtss_f32(v);
+}
+
+inline float XMVectorGetY(FXMVECTOR v)
+{
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+
+inline float XMVectorGetZ(FXMVECTOR v)
+{
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+inline float XMVectorGetW(FXMVECTOR v)
+{
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+inline XMVECTOR XMVectorSetW(FXMVECTOR v, float w)
+{
+	float values[4];
+	_mm_storeu_ps(values, v);
+	values[3] = w;
+	return _mm_loadu_ps(values);
+}
+
+inline XMVECTOR XMVectorAdd(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_add_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorSubtract(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_sub_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorMultiply(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_mul_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorMultiplyAdd(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR v3)
+{
+	return _mm_add_ps(_mm_mul_ps(v1, v2), v3);
+}
+
+inline XMVECTOR XMVectorScale(FXMVECTOR v, float scale)
+{
+	return _mm_mul_ps(v, _mm_set1_ps(scale));
+}
+
+inline XMVECTOR XMVectorNegate(FXMVECTOR v)
+{
+	return _mm_sub_ps(_mm_setzero_ps(), v);
+}
+
+inline XMVECTOR XMVectorMin(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_min_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorMax(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_max_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorGreater(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_cmpgt_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorGreaterOrEqual(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_cmpge_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorLess(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_cmplt_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorLessOrEqual(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_cmple_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorIsNaN(FXMVECTOR v)
+{
+	return _mm_cmpneq_ps(v, v);
+}
+
+inline XMVECTOR XMVectorAndInt(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_and_ps(v1, v2);
+}
+
+inline XMVECTOR XMVectorOrInt(FXMVECTOR v1, FXMVECTOR v2)
+{
+	return _mm_or_ps(v1, v2);
+}
+
+// Takes each component from the second vector where the control is set, and from the first elsewhere
+inline XMVECTOR XMVectorSelect(FXMVECTOR v1, FXMVECTOR v2, FXMVECTOR control)
+{
+	return _mm_or_ps(_mm_andnot_ps(control, v1), _mm_and_ps(control, v2));
+}
+
+// Three component operations, whose scalar results are replicated across the vector
+
+inline XMVECTOR XMVector3Dot(FXMVECTOR v1, FXMVECTOR v2)
+{
+	auto product = _mm_mul_ps(v1, v2);
+	auto y = _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1));
+	auto z = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2));
+	auto sum = _mm_add_ss(_mm_add_ss(product, y), z);
+	return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+inline XMVECTOR XMVector3LengthSq(FXMVECTOR v)
+{
+	return XMVector3Dot(v, v);
+}
+
+inline XMVECTOR XMVector3Length(FXMVECTOR v)
+{
+	return _mm_sqrt_ps(XMVector3Dot(v, v));
+}
+
+inline XMVECTOR XMVector3Normalize(FXMVECTOR v)
+{
+	auto length = XMVector3Length(v);
+	auto result = _mm_div_ps(v, length);
+	// Zero length vectors normalize to zero, as with DirectXMath
+	return _mm_and_ps(result, _mm_cmpneq_ps(length, _mm_setzero_ps()));
+}
+
+inline XMVECTOR XMVector3Cross(FXMVECTOR v1, FXMVECTOR v2)
+{
+	auto v1YZX = _mm_shuffle_ps(v1, v1, _MM_SHUFFLE(3, 0, 2, 1));
+	auto v2ZXY = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 1, 0, 2));
+	auto v1ZXY = _mm_shuffle_ps(v1, v1, _MM_SHUFFLE(3, 1, 0, 2));
+	auto v2YZX = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 0, 2, 1));
+	auto result = _mm_sub_ps(_mm_mul_ps(v1YZX, v2ZXY), _mm_mul_ps(v1ZXY, v2YZX));
+	return _mm_and_ps(result, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+}
+
+inline XMVECTOR XMVector4Transform(FXMVECTOR v, FXMMATRIX m)
+{
+	auto result = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), m.r[0]);
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), m.r[1]));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), m.r[2]));
+	return _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), m.r[3]));
+}
+
+// Transforms the point with w taken as one, and divides the result by its w
+inline XMVECTOR XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m)
+{
+	auto result = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), m.r[0]);
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), m.r[1]));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), m.r[2]));
+	result = _mm_add_ps(result, m.r[3]);
+	return _mm_div_ps(result, _mm_shuffle_ps(result, result, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+// Matrices
+
+inline XMMATRIX XMMatrixSet(float m00, float m01, float m02, float m03, float m10, float m11, float m12, float m13,
+	float m20, float m21, float m22, float m23, float m30, float m31, float m32, float m33)
+{
+	return XMMATRIX(XMVectorSet(m00, m01, m02, m03), XMVectorSet(m10, m11, m12, m13),
+		XMVectorSet(m20, m21, m22, m23), XMVectorSet(m30, m31, m32, m33));
+}
+
+inline XMMATRIX XMMatrixIdentity()
+{
+	return XMMatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+inline XMMATRIX XMMatrixMultiply(FXMMATRIX m1, CXMMATRIX m2)
+{
+	XMMATRIX result;
+	for (int i = 0; i < 4; ++i)
+		result.r[i] = XMVector4Transform(m1.r[i], m2);
+	return result;
+}
+
+inline XMMATRIX XMMatrixTranspose(FXMMATRIX m)
+{
+	XMMATRIX result = m;
+	_MM_TRANSPOSE4_PS(result.r[0], result.r[1], result.r[2], result.r[3]);
+	return result;
+}
+
+inline XMMATRIX XMMatrixTranslation(float offsetX, float offsetY, float offsetZ)
+{
+	return XMMatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		offsetX, offsetY, offsetZ, 1.0f);
+}
+
+inline XMMATRIX XMMatrixScaling(float scaleX, float scaleY, float scaleZ)
+{
+	return XMMatrixSet(scaleX, 0.0f, 0.0f, 0.0f, 0.0f, scaleY, 0.0f, 0.0f, 0.0f, 0.0f, scaleZ, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// The general inverse by cofactors, with the determinant written out when asked for
+inline XMMATRIX XMMatrixInverse(XMVECTOR* determinantOut, FXMMATRIX m)
+{
+	XMFLOAT4X4 source;
+	XMStoreFloat4x4(&source, m);
+	const float* a = &source.m[0][0];
+	float inverse[16];
+
+	inverse[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+	inverse[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+	inverse[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+	inverse[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+	inverse[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+	inverse[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+	inverse[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+	inverse[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+	inverse[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+	inverse[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+	inverse[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+	inverse[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+	inverse[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+	inverse[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+	inverse[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+	inverse[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+	float determinant = a[0] * inverse[0] + a[1] * inverse[4] + a[2] * inverse[8] + a[3] * inverse[12];
+	if (determinantOut != nullptr)
+		*determinantOut = _mm_set1_ps(determinant);
+
+	float scale = 1.0f / determinant;
+	for (auto& value : inverse)
+		value *= scale;
+
+	return XMMATRIX(_mm_loadu_ps(inverse), _mm_loadu_ps(inverse + 4), _mm_loadu_ps(inverse + 8),
+		_mm_loadu_ps(inverse + 12));
+}
+
+inline XMMATRIX XMMatrixLookToLH(FXMVECTOR eyePosition, FXMVECTOR eyeDirection, FXMVECTOR upDirection)
+{
+	auto r2 = XMVector3Normalize(eyeDirection);
+	auto r0 = XMVector3Normalize(XMVector3Cross(upDirection, r2));
+	auto r1 = XMVector3Cross(r2, r0);
+	auto negativeEye = XMVectorNegate(eyePosition);
+
+	auto transposed = XMMatrixTranspose(XMMATRIX(r0, r1, r2, _mm_setzero_ps()));
+	transposed.r[3] = XMVectorSet(XMVectorGetX(XMVector3Dot(r0, negativeEye)),
+		XMVectorGetX(XMVector3Dot(r1, negativeEye)), XMVectorGetX(XMVector3Dot(r2, negativeEye)), 1.0f);
+	return transposed;
+}
+
+inline XMMATRIX XMMatrixLookAtLH(FXMVECTOR eyePosition, FXMVECTOR focusPosition, FXMVECTOR upDirection)
+{
+	return XMMatrixLookToLH(eyePosition, _mm_sub_ps(focusPosition, eyePosition), upDirection);
+}
+
+inline XMMATRIX XMMatrixPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+{
+	float height = cosf(0.5f * fovAngleY) / sinf(0.5f * fovAngleY);
+	float width = height / aspectRatio;
+	float range = farZ / (farZ - nearZ);
+
+	return XMMatrixSet(width, 0.0f, 0.0f, 0.0f, 0.0f, height, 0.0f, 0.0f, 0.0f, 0.0f, range, 1.0f,
+		0.0f, 0.0f, -range * nearZ, 0.0f);
+}
+
+inline XMMATRIX XMMatrixOrthographicOffCenterLH(float viewLeft, float viewRight, float viewBottom, float viewTop,
+	float nearZ, float farZ)
+{
+	float reciprocalWidth = 1.0f / (viewRight - viewLeft);
+	float reciprocalHeight = 1.0f / (viewTop - viewBottom);
+	float range = 1.0f / (farZ - nearZ);
+
+	return XMMatrixSet(reciprocalWidth + reciprocalWidth, 0.0f, 0.0f, 0.0f,
+		0.0f, reciprocalHeight + reciprocalHeight, 0.0f, 0.0f,
+		0.0f, 0.0f, range, 0.0f,
+		-(viewLeft + viewRight) * reciprocalWidth, -(viewTop + viewBottom) * reciprocalHeight, -range * nearZ, 1.0f);
+}
+
+// GCC and Clang give the SSE vector type its arithmetic operators, including those with a scalar,
+// so only the matrix needs them
+inline XMMATRIX operator*(FXMMATRIX m1, CXMMATRIX m2)
+{
+	return XMMatrixMultiply(m1, m2);
+}
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SHIM_WINDOWS_H_
+#define SHIM_WINDOWS_H_
+
+#ifdef _WIN32
+#error The shim headers stand in for the Windows SDK off Windows only
+#endif
+
+// The Windows types and helpers the engine uses outside of its window and device code, for
+// building the engine off Windows. Windows and instances are opaque handles nothing can be made of.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef int32_t HRESULT;
+typedef int32_t INT;
+typedef uint32_t UINT;
+typedef uint8_t UINT8;
+typedef int32_t BOOL;
+typedef float FLOAT;
+typedef uint8_t BYTE;
+typedef uint32_t DWORD;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef size_t SIZE_T;
+typedef const char* LPCSTR;
+
+typedef struct HWND__* HWND;
+typedef struct HINSTANCE__* HINSTANCE;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+
+// Without a debugger to send them to, the messages go to the standard error
+inline void OutputDebugString(LPCSTR message)
+{
+	fputs(message, stderr);
+}
+
+#endif
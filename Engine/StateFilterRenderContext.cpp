@@ -0,0 +1,327 @@
+#include "StateFilterRenderContext.h"
+
+#include <cstring>
+
+// No object lives at this address and no count or enum takes this value
+#define UNKNOWN_OBJECT reinterpret_cast<const void*>(~static_cast<uintptr_t>(0))
+#define UNKNOWN_VALUE 0xFFFFFFFF
+
+inline void InvalidateSlots(const void** slots, const UINT slotCount)
+{
+	for (UINT i = 0; i < slotCount; ++i)
+		slots[i] = UNKNOWN_OBJECT;
+}
+
+// Stores the objects bound to a range of slots, returning whether any of them changed. Ranges
+// reaching past the tracked slots always count as changed, and leave the slots they cover unknown.
+template <typename Object>
+inline bool UpdateSlots(const void** slots, const UINT slotCount, const UINT startSlot, const UINT count,
+	Object* const* objects)
+{
+	if (startSlot + count > slotCount)
+	{
+		if (startSlot < slotCount)
+			InvalidateSlots(slots + startSlot, slotCount - startSlot);
+		return true;
+	}
+
+	bool bChanged = false;
+	for (UINT i = 0; i < count; ++i)
+	{
+		const void* object = objects != nullptr ? objects[i] : nullptr;
+		if (slots[startSlot + i] != object)
+		{
+			slots[startSlot + i] = object;
+			bChanged = true;
+		}
+	}
+
+	return bChanged;
+}
+
+StateFilterRenderContext::StateFilterRenderContext() :
+	context(nullptr)
+{
+	Invalidate();
+	ResetStats();
+}
+
+void StateFilterRenderContext::Initialize(IRenderContext* context)
+{
+	this->context = context;
+	Invalidate();
+}
+
+void StateFilterRenderContext::Invalidate()
+{
+	renderTargetCount = UNKNOWN_VALUE;
+	InvalidateSlots(renderTargets, STATE_FILTER_RENDER_TARGET_SLOTS);
+	depthStencilView = UNKNOWN_OBJECT;
+	InvalidateShaderResources();
+
+	depthStencilState = UNKNOWN_OBJECT;
+	stencilRef = UNKNOWN_VALUE;
+	viewportCount = UNKNOWN_VALUE;
+	rasterizerState = UNKNOWN_OBJECT;
+	primitiveTopology = UNKNOWN_VALUE;
+	inputLayout = UNKNOWN_OBJECT;
+	indexBuffer = UNKNOWN_OBJECT;
+	indexFormat = UNKNOWN_VALUE;
+	indexOffset = UNKNOWN_VALUE;
+	vertexShader = UNKNOWN_OBJECT;
+	pixelShader = UNKNOWN_OBJECT;
+
+	for (auto& binding : vertexBuffers)
+	{
+		binding.Buffer = UNKNOWN_OBJECT;
+		binding.Stride = UNKNOWN_VALUE;
+		binding.Offset = UNKNOWN_VALUE;
+	}
+
+	InvalidateSlots(vertexConstantBuffers, STATE_FILTER_CONSTANT_BUFFER_SLOTS);
+	InvalidateSlots(pixelConstantBuffers, STATE_FILTER_CONSTANT_BUFFER_SLOTS);
+	InvalidateSlots(pixelSamplers, STATE_FILTER_SAMPLER_SLOTS);
+}
+
+void StateFilterRenderContext::InvalidateShaderResources()
+{
+	InvalidateSlots(pixelShaderResources, STATE_FILTER_SHADER_RESOURCE_SLOTS);
+}
+
+void StateFilterRenderContext::ResetStats()
+{
+	ZeroMemory(&stats, sizeof(stats));
+}
+
+HRESULT StateFilterRenderContext::CreateBuffer(const D3D11_BUFFER_DESC* desc,
+	const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** bufferOut)
+{
+	return context->CreateBuffer(desc, initialData, bufferOut);
+}
+
+HRESULT StateFilterRenderContext::CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut)
+{
+	return context->CreateQuery(desc, queryOut);
+}
+
+void StateFilterRenderContext::Release(ID3D11DeviceChild* object)
+{
+	Invalidate();
+	context->Release(object);
+}
+
+void StateFilterRenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4])
+{
+	context->ClearRenderTargetView(renderTarget, color);
+}
+
+void StateFilterRenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags,
+	FLOAT depth, UINT8 stencil)
+{
+	context->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil);
+}
+
+void StateFilterRenderContext::OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+	ID3D11DepthStencilView* depthStencilView)
+{
+	bool bChanged = viewCount != renderTargetCount || depthStencilView != this->depthStencilView;
+	bChanged |= UpdateSlots(this->renderTargets, STATE_FILTER_RENDER_TARGET_SLOTS, 0, viewCount, renderTargets);
+
+	if (!Issue(STATE_BIND_TYPE_RENDER_TARGETS, bChanged))
+		return;
+
+	renderTargetCount = viewCount;
+	this->depthStencilView = depthStencilView;
+	InvalidateShaderResources();
+
+	context->OMSetRenderTargets(viewCount, renderTargets, depthStencilView);
+}
+
+void StateFilterRenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	if (!Issue(STATE_BIND_TYPE_DEPTH_STENCIL_STATE, state != depthStencilState || stencilRef != this->stencilRef))
+		return;
+
+	depthStencilState = state;
+	this->stencilRef = stencilRef;
+	context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateFilterRenderContext::RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports)
+{
+	bool bChanged = viewportCount != this->viewportCount || viewportCount > STATE_FILTER_VIEWPORT_SLOTS ||
+		memcmp(viewports, this->viewports, sizeof(D3D11_VIEWPORT) * viewportCount) != 0;
+
+	if (!Issue(STATE_BIND_TYPE_VIEWPORTS, bChanged))
+		return;
+
+	if (viewportCount <= STATE_FILTER_VIEWPORT_SLOTS)
+	{
+		this->viewportCount = viewportCount;
+		memcpy(this->viewports, viewports, sizeof(D3D11_VIEWPORT) * viewportCount);
+	}
+	else
+		this->viewportCount = UNKNOWN_VALUE;
+
+	context->RSSetViewports(viewportCount, viewports);
+}
+
+void StateFilterRenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+	if (!Issue(STATE_BIND_TYPE_RASTERIZER_STATE, state != rasterizerState))
+		return;
+
+	rasterizerState = state;
+	context->RSSetState(state);
+}
+
+void StateFilterRenderContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (!Issue(STATE_BIND_TYPE_PRIMITIVE_TOPOLOGY, static_cast<UINT>(topology) != primitiveTopology))
+		return;
+
+	primitiveTopology = topology;
+	context->IASetPrimitiveTopology(topology);
+}
+
+void StateFilterRenderContext::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	if (!Issue(STATE_BIND_TYPE_INPUT_LAYOUT, inputLayout != this->inputLayout))
+		return;
+
+	this->inputLayout = inputLayout;
+	context->IASetInputLayout(inputLayout);
+}
+
+void StateFilterRenderContext::IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+	const UINT* strides, const UINT* offsets)
+{
+	bool bChanged = false;
+
+	if (startSlot + bufferCount > STATE_FILTER_VERTEX_BUFFER_SLOTS)
+	{
+		for (UINT slot = startSlot; slot < STATE_FILTER_VERTEX_BUFFER_SLOTS; ++slot)
+			vertexBuffers[slot].Buffer = UNKNOWN_OBJECT;
+		bChanged = true;
+	}
+	else
+	{
+		for (UINT i = 0; i < bufferCount; ++i)
+		{
+			auto& binding = vertexBuffers[startSlot + i];
+			if (binding.Buffer != buffers[i] || binding.Stride != strides[i] || binding.Offset != offsets[i])
+			{
+				binding.Buffer = buffers[i];
+				binding.Stride = strides[i];
+				binding.Offset = offsets[i];
+				bChanged = true;
+			}
+		}
+	}
+
+	if (Issue(STATE_BIND_TYPE_VERTEX_BUFFERS, bChanged))
+		context->IASetVertexBuffers(startSlot, bufferCount, buffers, strides, offsets);
+}
+
+void StateFilterRenderContext::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	bool bChanged = buffer != indexBuffer || static_cast<UINT>(format) != indexFormat || offset != indexOffset;
+	if (!Issue(STATE_BIND_TYPE_INDEX_BUFFER, bChanged))
+		return;
+
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void StateFilterRenderContext::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	// Class instances are not tracked, so shaders bound with them leave the shader unknown
+	if (!Issue(STATE_BIND_TYPE_VERTEX_SHADER, shader != vertexShader || classInstanceCount > 0))
+		return;
+
+	vertexShader = classInstanceCount > 0 ? UNKNOWN_OBJECT : shader;
+	context->VSSetShader(shader, classInstances, classInstanceCount);
+}
+
+void StateFilterRenderContext::VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	bool bChanged = UpdateSlots(vertexConstantBuffers, STATE_FILTER_CONSTANT_BUFFER_SLOTS, startSlot, bufferCount,
+		buffers);
+	if (Issue(STATE_BIND_TYPE_VERTEX_CONSTANT_BUFFERS, bChanged))
+		context->VSSetConstantBuffers(startSlot, bufferCount, buffers);
+}
+
+void StateFilterRenderContext::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+	UINT classInstanceCount)
+{
+	if (!Issue(STATE_BIND_TYPE_PIXEL_SHADER, shader != pixelShader || classInstanceCount > 0))
+		return;
+
+	pixelShader = classInstanceCount > 0 ? UNKNOWN_OBJECT : shader;
+	context->PSSetShader(shader, classInstances, classInstanceCount);
+}
+
+void StateFilterRenderContext::PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers)
+{
+	bool bChanged = UpdateSlots(pixelConstantBuffers, STATE_FILTER_CONSTANT_BUFFER_SLOTS, startSlot, bufferCount,
+		buffers);
+	if (Issue(STATE_BIND_TYPE_PIXEL_CONSTANT_BUFFERS, bChanged))
+		context->PSSetConstantBuffers(startSlot, bufferCount, buffers);
+}
+
+void StateFilterRenderContext::PSSetShaderResources(UINT startSlot, UINT viewCount,
+	ID3D11ShaderResourceView* const* views)
+{
+	bool bChanged = UpdateSlots(pixelShaderResources, STATE_FILTER_SHADER_RESOURCE_SLOTS, startSlot, viewCount,
+		views);
+	if (Issue(STATE_BIND_TYPE_PIXEL_SHADER_RESOURCES, bChanged))
+		context->PSSetShaderResources(startSlot, viewCount, views);
+}
+
+void StateFilterRenderContext::PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers)
+{
+	bool bChanged = UpdateSlots(pixelSamplers, STATE_FILTER_SAMPLER_SLOTS, startSlot, samplerCount, samplers);
+	if (Issue(STATE_BIND_TYPE_PIXEL_SAMPLERS, bChanged))
+		context->PSSetSamplers(startSlot, samplerCount, samplers);
+}
+
+HRESULT StateFilterRenderContext::Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType,
+	UINT mapFlags, D3D11_MAPPED_SUBRESOURCE* mappedOut)
+{
+	return context->Map(resource, subresource, mapType, mapFlags, mappedOut);
+}
+
+void StateFilterRenderContext::Unmap(ID3D11Resource* resource, UINT subresource)
+{
+	context->Unmap(resource, subresource);
+}
+
+void StateFilterRenderContext::Draw(UINT vertexCount, UINT startVertex)
+{
+	context->Draw(vertexCount, startVertex);
+}
+
+void StateFilterRenderContext::DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex,
+	INT baseVertex, UINT startInstance)
+{
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void StateFilterRenderContext::End(ID3D11Asynchronous* query)
+{
+	context->End(query);
+}
+
+HRESULT StateFilterRenderContext::GetData(ID3D11Asynchronous* query, void* data, UINT dataSize,
+	UINT getDataFlags)
+{
+	return context->GetData(query, data, dataSize, getDataFlags);
+}
+
+HRESULT StateFilterRenderContext::Present(UINT syncInterval, UINT flags)
+{
+	return context->Present(syncInterval, flags);
+}
\ No newline at end of file
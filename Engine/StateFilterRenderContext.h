@@ -0,0 +1,155 @@
+#ifndef STATE_FILTER_RENDER_CONTEXT_H_
+#define STATE_FILTER_RENDER_CONTEXT_H_
+
+#include <stdint.h>
+
+#include "RenderContext.h"
+
+// Slots of each stage whose bindings are tracked, binds reaching past them are always passed on
+#define STATE_FILTER_VERTEX_BUFFER_SLOTS 16
+#define STATE_FILTER_CONSTANT_BUFFER_SLOTS 14
+#define STATE_FILTER_SHADER_RESOURCE_SLOTS 32
+#define STATE_FILTER_SAMPLER_SLOTS 16
+#define STATE_FILTER_RENDER_TARGET_SLOTS 8
+#define STATE_FILTER_VIEWPORT_SLOTS 16
+
+enum StateBindType
+{
+	STATE_BIND_TYPE_RENDER_TARGETS,
+	STATE_BIND_TYPE_DEPTH_STENCIL_STATE,
+	STATE_BIND_TYPE_VIEWPORTS,
+	STATE_BIND_TYPE_RASTERIZER_STATE,
+	STATE_BIND_TYPE_PRIMITIVE_TOPOLOGY,
+	STATE_BIND_TYPE_INPUT_LAYOUT,
+	STATE_BIND_TYPE_VERTEX_BUFFERS,
+	STATE_BIND_TYPE_INDEX_BUFFER,
+	STATE_BIND_TYPE_VERTEX_SHADER,
+	STATE_BIND_TYPE_VERTEX_CONSTANT_BUFFERS,
+	STATE_BIND_TYPE_PIXEL_SHADER,
+	STATE_BIND_TYPE_PIXEL_CONSTANT_BUFFERS,
+	STATE_BIND_TYPE_PIXEL_SHADER_RESOURCES,
+	STATE_BIND_TYPE_PIXEL_SAMPLERS,
+	STATE_BIND_TYPE_COUNT
+};
+
+struct StateFilterStats
+{
+	// Binds passed on to the context, and those dropped for binding what was already bound
+	size_t IssuedCount[STATE_BIND_TYPE_COUNT];
+	size_t FilteredCount[STATE_BIND_TYPE_COUNT];
+};
+
+// Sits in front of another context and drops binds that would not change its state, passing on
+// every other call. Only what was bound through the filter is known, so it must be invalidated
+// whenever the context may have been changed around it. Binding render targets makes the shader
+// resources unknown, since the device unbinds the inputs of resources bound as outputs, and nulls
+// inputs bound while their resource is still an output. Releasing an object makes everything
+// unknown, as a new object could take its place.
+class StateFilterRenderContext : public IRenderContext
+{
+public:
+	StateFilterRenderContext();
+
+	void Initialize(IRenderContext* context);
+	// Forgets the bound state, so that the next bind of every kind is passed on
+	void Invalidate();
+	void ResetStats();
+
+	inline void GetStats(StateFilterStats* statsOut) const;
+
+	HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Buffer** bufferOut) override;
+	HRESULT CreateQuery(const D3D11_QUERY_DESC* desc, ID3D11Query** queryOut) override;
+	void Release(ID3D11DeviceChild* object) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT color[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth,
+		UINT8 stencil) override;
+	void OMSetRenderTargets(UINT viewCount, ID3D11RenderTargetView* const* renderTargets,
+		ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) override;
+	void RSSetViewports(UINT viewportCount, const D3D11_VIEWPORT* viewports) override;
+	void RSSetState(ID3D11RasterizerState* state) override;
+
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetVertexBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers,
+		const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void VSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances,
+		UINT classInstanceCount) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT bufferCount, ID3D11Buffer* const* buffers) override;
+	void PSSetShaderResources(UINT startSlot, UINT viewCount, ID3D11ShaderResourceView* const* views) override;
+	void PSSetSamplers(UINT startSlot, UINT samplerCount, ID3D11SamplerState* const* samplers) override;
+
+	HRESULT Map(ID3D11Resource* resource, UINT subresource, D3D11_MAP mapType, UINT mapFlags,
+		D3D11_MAPPED_SUBRESOURCE* mappedOut) override;
+	void Unmap(ID3D11Resource* resource, UINT subresource) override;
+
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex,
+		UINT startInstance) override;
+
+	void End(ID3D11Asynchronous* query) override;
+	HRESULT GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags) override;
+
+	HRESULT Present(UINT syncInterval, UINT flags) override;
+
+protected:
+	struct VertexBufferBinding
+	{
+		const void* Buffer;
+		UINT Stride;
+		UINT Offset;
+	};
+
+	IRenderContext* context;
+	StateFilterStats stats;
+
+	// Bound state, where unknown objects and values are held as ones that are never bound
+	UINT renderTargetCount;
+	const void* renderTargets[STATE_FILTER_RENDER_TARGET_SLOTS];
+	const void* depthStencilView;
+	const void* depthStencilState;
+	UINT stencilRef;
+	UINT viewportCount;
+	D3D11_VIEWPORT viewports[STATE_FILTER_VIEWPORT_SLOTS];
+	const void* rasterizerState;
+	UINT primitiveTopology;
+	const void* inputLayout;
+	VertexBufferBinding vertexBuffers[STATE_FILTER_VERTEX_BUFFER_SLOTS];
+	const void* indexBuffer;
+	UINT indexFormat;
+	UINT indexOffset;
+	const void* vertexShader;
+	const void* vertexConstantBuffers[STATE_FILTER_CONSTANT_BUFFER_SLOTS];
+	const void* pixelShader;
+	const void* pixelConstantBuffers[STATE_FILTER_CONSTANT_BUFFER_SLOTS];
+	const void* pixelShaderResources[STATE_FILTER_SHADER_RESOURCE_SLOTS];
+	const void* pixelSamplers[STATE_FILTER_SAMPLER_SLOTS];
+
+	// Counts the bind and returns true when it has to be passed on
+	inline bool Issue(const StateBindType type, const bool bChanged);
+	void InvalidateShaderResources();
+};
+
+inline void StateFilterRenderContext::GetStats(StateFilterStats* statsOut) const
+{
+	*statsOut = stats;
+}
+
+inline bool StateFilterRenderContext::Issue(const StateBindType type, const bool bChanged)
+{
+	if (bChanged)
+		++stats.IssuedCount[type];
+	else
+		++stats.FilteredCount[type];
+
+	return bChanged;
+}
+
+#endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "StaticMesh.h"
 
+static uint32_t nextMeshSortId = 0;
+
 StaticMesh::StaticMesh(ID3D11Buffer* vertexBuffer, ID3D11Buffer* indexBuffer,
 	size_t indexCount, size_t indexOffset, const Bounds& bounds,
 	const DXGI_FORMAT indexFormat) :
@@ -8,8 +10,12 @@ StaticMesh::StaticMesh(ID3D11Buffer* vertexBuffer, ID3D11Buffer* indexBuffer,
 	indexCount(indexCount),
 	indexOffset(indexOffset),
 	meshBounds(bounds),
-	indexFormat(indexFormat)
+	indexFormat(indexFormat),
+	occluderMesh(nullptr),
+	sortId(nextMeshSortId++)
 {
+	MeshLod lod = { indexOffset, indexCount, 0.0f };
+	lods.push_back(lod);
 }
 
 void StaticMesh::Destroy()
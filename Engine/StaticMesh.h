@@ -5,9 +5,21 @@
 #include <stdio.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "Geometry.h"
 
+struct OccluderMesh;
+
+// A level of detail, drawn from a range of the mesh's index buffer
+struct MeshLod
+{
+	size_t IndexOffset;
+	size_t IndexCount;
+	// Largest distance of the level from the full mesh, relative to the radius of the mesh
+	float Error;
+};
+
 class StaticMesh
 {
 public:
@@ -21,6 +33,15 @@ public:
 	inline size_t GetIndexCount() const;
 	inline size_t GetIndexOffset() const;
 	inline void GetMeshBounds(Bounds* boundsOut) const;
+	// Simplified geometry rasterized when the mesh occludes others, not owned by the mesh
+	inline OccluderMesh* GetOccluderMesh() const;
+	inline void SetOccluderMesh(OccluderMesh* occluderMesh);
+	// The first level is the full mesh and each following level is coarser
+	inline size_t GetLodCount() const;
+	inline const MeshLod& GetLod(const size_t level) const;
+	inline void SetLods(const std::vector<MeshLod>& lods);
+	// Orders draws by mesh, assigned when the mesh is created
+	inline uint32_t GetSortId() const;
 
 	void Destroy();
 
@@ -33,6 +54,9 @@ protected:
 
 	Bounds meshBounds;
 	DXGI_FORMAT indexFormat;
+	OccluderMesh* occluderMesh;
+	std::vector<MeshLod> lods;
+	uint32_t sortId;
 };
 
 inline ID3D11Buffer* StaticMesh::GetVertexBuffer() const		
@@ -47,6 +71,18 @@ inline size_t StaticMesh::GetIndexOffset()	const
 { return indexOffset; }
 inline void StaticMesh::GetMeshBounds(Bounds* boundsOut) const	
 { *boundsOut = meshBounds; }
+inline OccluderMesh* StaticMesh::GetOccluderMesh() const			
+{ return occluderMesh; }
+inline void StaticMesh::SetOccluderMesh(OccluderMesh* occluderMesh)
+{ this->occluderMesh = occluderMesh; }
+inline size_t StaticMesh::GetLodCount() const
+{ return lods.size(); }
+inline const MeshLod& StaticMesh::GetLod(const size_t level) const
+{ return lods[level]; }
+inline void StaticMesh::SetLods(const std::vector<MeshLod>& lods)
+{ this->lods = lods; }
+inline uint32_t StaticMesh::GetSortId() const
+{ return sortId; }
 
 #define VERTEX_ATTRIBUTE_DISABLED -1
 
@@ -2,6 +2,7 @@
 
 #include "GraphicsDebug.h"
 
+#include <cassert>
 #include <limits>
 #include <vector>
 
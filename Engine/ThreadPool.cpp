@@ -0,0 +1,156 @@
+#include "ThreadPool.h"
+
+#include <Windows.h>
+
+using namespace std;
+
+WorkerPool::WorkerPool() :
+	bExit(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	Destroy();
+}
+
+bool WorkerPool::Initialize(const size_t threadCount)
+{
+	if (threads.size() > 0)
+	{
+		OutputDebugString("Worker pool has already been initialized!\n");
+		return false;
+	}
+
+	bExit = false;
+	for (size_t i = 0; i < threadCount; ++i)
+		threads.push_back(thread(&WorkerPool::RunWorker, this));
+
+	return true;
+}
+
+void WorkerPool::Destroy()
+{
+	{
+		lock_guard<mutex> lock(jobMutex);
+		bExit = true;
+	}
+	jobCondition.notify_all();
+
+	for (auto& worker : threads)
+		worker.join();
+	threads.clear();
+}
+
+void WorkerPool::Push(const Job& job)
+{
+	{
+		lock_guard<mutex> lock(jobMutex);
+		jobs.push_back(job);
+	}
+	jobCondition.notify_one();
+}
+
+bool WorkerPool::RunQueuedJob()
+{
+	Job job;
+	{
+		lock_guard<mutex> lock(jobMutex);
+		if (jobs.empty())
+			return false;
+
+		job = move(jobs.front());
+		jobs.pop_front();
+	}
+
+	job.Function();
+	job.Group->FinishJob();
+	return true;
+}
+
+void WorkerPool::RunWorker()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(jobMutex);
+			jobCondition.wait(lock, [this]() { return bExit || !jobs.empty(); });
+
+			// Finish any remaining jobs before exiting so that no task group waits forever
+			if (jobs.empty())
+				return;
+
+			job = move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job.Function();
+		job.Group->FinishJob();
+	}
+}
+
+TaskGroup::TaskGroup(WorkerPool* pool) :
+	pool(pool),
+	pendingCount(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+void TaskGroup::Run(const function<void()>& function)
+{
+	if (pool == nullptr || pool->GetThreadCount() == 0)
+	{
+		function();
+		return;
+	}
+
+	++pendingCount;
+	pool->Push({ function, this });
+}
+
+void TaskGroup::Wait()
+{
+	while (pendingCount > 0 && pool != nullptr)
+	{
+		if (!pool->RunQueuedJob())
+			break;
+	}
+
+	// The last job notifies with the lock held, so the group is not destroyed while it still
+	// touches the condition
+	unique_lock<mutex> lock(finishMutex);
+	finishCondition.wait(lock, [this]() { return pendingCount == 0; });
+}
+
+void TaskGroup::FinishJob()
+{
+	lock_guard<mutex> lock(finishMutex);
+	if (--pendingCount == 0)
+		finishCondition.notify_all();
+}
+
+void ParallelFor(WorkerPool* pool, const size_t count, const size_t grainSize,
+	const function<void(size_t, size_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	auto rangeSize = grainSize > 0 ? grainSize : 1;
+	TaskGroup group(pool);
+
+	// The calling thread takes the last range itself
+	size_t begin = 0;
+	for (; count - begin > rangeSize; begin += rangeSize)
+	{
+		auto end = begin + rangeSize;
+		group.Run([&function, begin, end]() { function(begin, end); });
+	}
+
+	function(begin, count);
+	group.Wait();
+}
\ No newline at end of file
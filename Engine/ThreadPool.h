@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class TaskGroup;
+
+// A fixed set of worker threads running jobs from a shared queue. Threads waiting on a task
+// group run queued jobs themselves, so jobs may wait on task groups of their own.
+class WorkerPool
+{
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	bool Initialize(const size_t threadCount);
+	void Destroy();
+
+	inline size_t GetThreadCount() const;
+
+protected:
+	struct Job
+	{
+		std::function<void()> Function;
+		TaskGroup* Group;
+	};
+
+	std::vector<std::thread> threads;
+	std::deque<Job> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobCondition;
+	bool bExit;
+
+	void Push(const Job& job);
+	bool RunQueuedJob();
+	void RunWorker();
+
+	friend class TaskGroup;
+};
+
+// A set of jobs which can be waited on together. Without a pool, or with a pool that has
+// no threads, jobs run immediately on the calling thread. Waiting runs queued jobs until the
+// queue is empty, then sleeps until the jobs still running on the workers have finished.
+class TaskGroup
+{
+public:
+	TaskGroup(WorkerPool* pool);
+	~TaskGroup();
+
+	void Run(const std::function<void()>& function);
+	void Wait();
+
+protected:
+	WorkerPool* pool;
+	std::atomic<size_t> pendingCount;
+	std::mutex finishMutex;
+	std::condition_variable finishCondition;
+
+	void FinishJob();
+
+	friend class WorkerPool;
+};
+
+// Calls a function on consecutive ranges of at most grainSize elements, spreading them across
+// the pool. Every range but the last starts at a multiple of grainSize.
+void ParallelFor(WorkerPool* pool, const size_t count, const size_t grainSize,
+	const std::function<void(size_t, size_t)>& function);
+
+inline size_t WorkerPool::GetThreadCount() const
+{
+	return threads.size();
+}
+
+#endif
\ No newline at end of file
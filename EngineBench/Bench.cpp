@@ -0,0 +1,62 @@
+#include "Bench.h"
+
+using namespace DirectX;
+using namespace std;
+
+BenchTimer::BenchTimer()
+{
+	Restart();
+}
+
+void BenchTimer::Restart()
+{
+	start = chrono::high_resolution_clock::now();
+}
+
+double BenchTimer::GetMilliseconds() const
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void CreateBenchScene(const size_t count, const float extent, const uint32_t seed, BenchScene* sceneOut)
+{
+	Bounds meshBounds = { { -0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, 0.5f } };
+	sceneOut->Mesh = new StaticMesh(nullptr, nullptr, 36, 0, meshBounds, DXGI_FORMAT_R16_UINT);
+	CreateStandardMaterial(nullptr, false, &sceneOut->Material);
+
+	sceneOut->Zone.Name = "Bench";
+	sceneOut->Root = CreateSceneGraph(&sceneOut->Zone);
+	sceneOut->Nodes.clear();
+	sceneOut->Nodes.reserve(count);
+
+	mt19937 generator(seed);
+	uniform_real_distribution<float> position(-extent, extent);
+
+	XMFLOAT4X4 transform;
+	for (size_t i = 0; i < count; ++i)
+	{
+		XMStoreFloat4x4(&transform, XMMatrixTranslation(position(generator), position(generator), position(generator)));
+		auto node = CreateStaticMeshNode(sceneOut->Mesh, &sceneOut->Material, transform);
+		AttachSceneNode(sceneOut->Root, node);
+		sceneOut->Nodes.push_back(node);
+	}
+
+	UpdateTransforms(sceneOut->Root, XMMatrixIdentity());
+}
+
+void DestroyBenchScene(BenchScene* scene)
+{
+	DestroySceneGraph(scene->Root);
+	scene->Root = nullptr;
+	scene->Nodes.clear();
+
+	// The mesh has no buffers to release
+	delete scene->Mesh;
+	scene->Mesh = nullptr;
+}
+
+void GetBenchFrustum(const float extent, Frustum* frustumOut)
+{
+	ConstructFrustum(XM_PIDIV4, extent, 0.1f, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f),
+		XMFLOAT3(0.0f, 1.0f, 0.0f), 16.0f / 9.0f, frustumOut);
+}
@@ -0,0 +1,54 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <DirectXMath.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "SceneGraph.h"
+
+// Measures the wall clock time between its creation, or the last restart, and a call to GetMilliseconds
+class BenchTimer
+{
+public:
+	BenchTimer();
+
+	void Restart();
+	double GetMilliseconds() const;
+
+protected:
+	std::chrono::high_resolution_clock::time_point start;
+};
+
+// A zone filled with unit boxes at random positions. The nodes share one mesh without
+// any buffers, so the scene can be culled and queried but not drawn.
+struct BenchScene
+{
+	ZoneData Zone;
+	SceneNode* Root;
+	StaticMesh* Mesh;
+	MaterialData Material;
+	std::vector<SceneNode*> Nodes;
+};
+
+void CreateBenchScene(const size_t count, const float extent, const uint32_t seed, BenchScene* sceneOut);
+void DestroyBenchScene(BenchScene* scene);
+// A frustum at the center of the scene looking down the z axis, seeing about a sixth of it
+void GetBenchFrustum(const float extent, Frustum* frustumOut);
+
+// Each benchmark prints its own results and returns false when one of its checks fails, see
+// Main.cpp for their names
+bool RunHierarchyBuilderBench();
+bool RunParallelBuildBench();
+bool RunFrustumBatchBench();
+bool RunLightClusterBench();
+bool RunMultiViewBench();
+bool RunRingBufferBench();
+bool RunHeadlessFrameBench();
+bool RunDrawPacketBench();
+bool RunParallelCullingBench();
+bool RunCoherentCullingBench();
+bool RunSceneStoreBench();
+
+#endif
@@ -0,0 +1,106 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "RecordingRenderContext.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace DirectX;
+using namespace std;
+
+#define DRAW_BENCH_RUNS 5
+// Materials the nodes are spread across in the scene of many batches
+#define DRAW_BENCH_MATERIAL_COUNT 64
+
+// Renders a whole bench scene into a recording context with draw worker pools of increasing
+// size. In the first scene every node shares one mesh and material, making a single batch as long
+// as the scene. In the second they are spread across many materials. Each batch must be drawn with
+// one call however many chunks it spans. Pools larger than the machine are still run, and marked
+// as oversubscribed.
+bool RunDrawPacketBench()
+{
+	const size_t counts[] = { 100000, 1000000 };
+	const size_t threadCounts[] = { 0, 1, 3, 7, 15 };
+	const size_t materialCounts[] = { 1, DRAW_BENCH_MATERIAL_COUNT };
+
+	vector<MaterialData> materials(DRAW_BENCH_MATERIAL_COUNT);
+	for (auto& material : materials)
+		CreateStandardMaterial(nullptr, false, &material);
+
+	RenderParams params;
+	params.Extent.Width = 1280;
+	params.Extent.Height = 720;
+	params.UseVSync = false;
+	params.Windowed = true;
+	bool bPassed = true;
+
+	for (auto count : counts)
+	{
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+		BuildSceneGraphHierarchy(scene.Root, true);
+
+		// Far enough back to see every node
+		SphericalCamera camera;
+		camera.Position = XMFLOAT3(0.0f, 0.0f, -4.0f * extent);
+		camera.LookAt(XMFLOAT3(0.0f, 0.0f, 0.0f));
+		camera.NearPlane = 0.1f;
+		camera.FarPlane = 8.0f * extent;
+
+		for (auto materialCount : materialCounts)
+		{
+			for (size_t i = 0; i < scene.Nodes.size(); ++i)
+				scene.Nodes[i]->MaterialData = materialCount == 1 ? &scene.Material : &materials[i % materialCount];
+
+			double serialTime = 0.0;
+
+			for (auto threadCount : threadCounts)
+			{
+				bool bOversubscribed = threadCount + 1 > thread::hardware_concurrency();
+
+				WorkerPool workers;
+				workers.Initialize(threadCount);
+
+				RecordingRenderContext context;
+				Renderer renderer;
+				renderer.Initialize(&context, params);
+				renderer.DrawParameters.Workers = (threadCount > 0 ? &workers : nullptr);
+
+				auto bestTime = numeric_limits<double>::infinity();
+				DrawStats drawStats;
+				for (int run = 0; run < DRAW_BENCH_RUNS; ++run)
+				{
+					context.ClearCommands();
+
+					BenchTimer timer;
+					renderer.RenderFrame(scene.Root, &camera);
+					bestTime = min(bestTime, timer.GetMilliseconds());
+					renderer.GetDrawStats(&drawStats);
+				}
+
+				if (threadCount == 0)
+					serialTime = bestTime;
+
+				cout << count << " nodes, " << materialCount << " batches, " << threadCount + 1 << " threads: frame "
+					<< bestTime << " ms, speedup " << serialTime / bestTime << (bOversubscribed ? " (oversubscribed)" : "")
+					<< ", " << drawStats.DrawCount << " draws"
+					<< (drawStats.DrawCount == materialCount ? "" : ", BATCHES SPLIT INTO SEVERAL DRAWS") << endl;
+				bPassed = bPassed && drawStats.DrawCount == materialCount;
+
+				renderer.Destroy();
+				workers.Destroy();
+			}
+		}
+
+		DestroyBenchScene(&scene);
+	}
+
+	return bPassed;
+}
@@ -0,0 +1,70 @@
+#include "Bench.h"
+
+#include <iostream>
+
+using namespace DirectX;
+using namespace std;
+
+#define FRUSTUM_BENCH_BOX_COUNT 1000000
+#define FRUSTUM_BENCH_RUNS 10
+
+// Tests the same boxes one at a time and with the batched kernel, which is eight wide when the
+// engine is built with AVX and four wide otherwise, and checks that both give the same results
+bool RunFrustumBatchBench()
+{
+	const float extent = 200.0f;
+
+	mt19937 generator(3);
+	uniform_real_distribution<float> position(-extent, extent);
+	uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	vector<Bounds> boxes(FRUSTUM_BENCH_BOX_COUNT);
+	vector<float> lowerX(boxes.size()), lowerY(boxes.size()), lowerZ(boxes.size());
+	vector<float> upperX(boxes.size()), upperY(boxes.size()), upperZ(boxes.size());
+	for (size_t i = 0; i < boxes.size(); ++i)
+	{
+		XMFLOAT3 lower(position(generator), position(generator), position(generator));
+		XMFLOAT3 upper(lower.x + size(generator), lower.y + size(generator), lower.z + size(generator));
+		boxes[i] = { lower, upper };
+		lowerX[i] = lower.x;
+		lowerY[i] = lower.y;
+		lowerZ[i] = lower.z;
+		upperX[i] = upper.x;
+		upperY[i] = upper.y;
+		upperZ[i] = upper.z;
+	}
+
+	BoundsStreams streams = { lowerX.data(), lowerY.data(), lowerZ.data(), upperX.data(), upperY.data(), upperZ.data() };
+
+	Frustum frustum;
+	GetBenchFrustum(extent, &frustum);
+
+	vector<FrustumTestResult> scalarResults(boxes.size());
+	vector<FrustumTestResult> batchResults(boxes.size());
+
+	BenchTimer timer;
+	for (int run = 0; run < FRUSTUM_BENCH_RUNS; ++run)
+		for (size_t i = 0; i < boxes.size(); ++i)
+			scalarResults[i] = TestFrustum(boxes[i], frustum);
+	auto scalarTime = timer.GetMilliseconds() / FRUSTUM_BENCH_RUNS;
+
+	timer.Restart();
+	for (int run = 0; run < FRUSTUM_BENCH_RUNS; ++run)
+		TestFrustumBatch(streams, static_cast<uint32_t>(boxes.size()), frustum, batchResults.data());
+	auto batchTime = timer.GetMilliseconds() / FRUSTUM_BENCH_RUNS;
+
+	size_t mismatchCount = 0;
+	size_t outsideCount = 0;
+	for (size_t i = 0; i < boxes.size(); ++i)
+	{
+		if (scalarResults[i] != batchResults[i])
+			++mismatchCount;
+		if (scalarResults[i] == FRUSTUM_OUTSIDE)
+			++outsideCount;
+	}
+
+	cout << boxes.size() << " boxes, " << outsideCount << " outside: scalar " << scalarTime << " ms, batched "
+		<< batchTime << " ms, speedup " << scalarTime / batchTime << ", " << mismatchCount << " mismatches" << endl;
+
+	return mismatchCount == 0;
+}
@@ -0,0 +1,86 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "RecordingRenderContext.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace DirectX;
+using namespace std;
+
+#define HEADLESS_BENCH_NODE_COUNT 50000
+#define HEADLESS_BENCH_FRAME_COUNT 20
+
+// Renders frames of a bench scene into a recording context, without a window or device. Checks
+// that the logged draws match the renderer's stats, that each frame makes the expected uploads,
+// fence and present, and that every object created through the context is released by Destroy.
+bool RunHeadlessFrameBench()
+{
+	auto extent = 2.0f * cbrt(static_cast<float>(HEADLESS_BENCH_NODE_COUNT));
+
+	BenchScene scene;
+	CreateBenchScene(HEADLESS_BENCH_NODE_COUNT, extent, 1, &scene);
+	BuildSceneGraphHierarchy(scene.Root, true);
+
+	SphericalCamera camera;
+	camera.Position = XMFLOAT3(0.0f, 0.0f, -2.0f * extent);
+	camera.LookAt(XMFLOAT3(0.0f, 0.0f, 0.0f));
+	camera.NearPlane = 0.1f;
+	camera.FarPlane = 4.0f * extent;
+
+	RenderParams params;
+	params.Extent.Width = 1280;
+	params.Extent.Height = 720;
+	params.UseVSync = false;
+	params.Windowed = true;
+
+	RecordingRenderContext context;
+	Renderer renderer;
+	if (!renderer.Initialize(&context, params))
+	{
+		cout << "Failed to initialize the renderer on a recording context" << endl;
+		DestroyBenchScene(&scene);
+		return false;
+	}
+
+	size_t mismatchedFrameCount = 0;
+	auto bestTime = numeric_limits<double>::infinity();
+	double totalTime = 0.0;
+	DrawStats drawStats = {};
+
+	for (int frame = 0; frame < HEADLESS_BENCH_FRAME_COUNT; ++frame)
+	{
+		context.ClearCommands();
+
+		BenchTimer timer;
+		renderer.RenderFrame(scene.Root, &camera);
+		auto frameTime = timer.GetMilliseconds();
+		bestTime = min(bestTime, frameTime);
+		totalTime += frameTime;
+
+		// The camera constants, the transformations and the light clusters are uploaded once
+		// each, and the frame ends with the instance ring's fence
+		renderer.GetDrawStats(&drawStats);
+		auto drawCount = context.GetCommandCount(RENDER_COMMAND_TYPE_DRAW_INDEXED_INSTANCED);
+		if (drawCount != drawStats.DrawCount || context.GetCommandCount(RENDER_COMMAND_TYPE_MAP) != 3 ||
+			context.GetCommandCount(RENDER_COMMAND_TYPE_END_QUERY) != 1 ||
+			context.GetCommandCount(RENDER_COMMAND_TYPE_PRESENT) != 1)
+		{
+			++mismatchedFrameCount;
+		}
+	}
+
+	renderer.Destroy();
+
+	cout << HEADLESS_BENCH_NODE_COUNT << " nodes, " << HEADLESS_BENCH_FRAME_COUNT << " frames: "
+		<< drawStats.DrawCount << " draws, " << drawStats.InstancedNodeCount << " nodes drawn instanced, best "
+		<< bestTime << " ms, mean " << totalTime / HEADLESS_BENCH_FRAME_COUNT << " ms, "
+		<< mismatchedFrameCount << " mismatched frames, " << context.GetObjectCount()
+		<< " context objects left" << endl;
+
+	DestroyBenchScene(&scene);
+	return mismatchedFrameCount == 0 && context.GetObjectCount() == 0;
+}
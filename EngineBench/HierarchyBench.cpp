@@ -0,0 +1,140 @@
+#include "Bench.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace DirectX;
+using namespace std;
+
+#define HIERARCHY_BENCH_QUERY_COUNT 1000
+
+// Builds the same scenes with the midpoint and the SAH builder, and compares build time, shape,
+// SAH cost and the time taken by a batch of box queries against each hierarchy
+bool RunHierarchyBuilderBench()
+{
+	const size_t counts[] = { 10000, 100000, 1000000 };
+	const HierarchyBuilder builders[] = { HIERARCHY_BUILDER_MIDPOINT, HIERARCHY_BUILDER_SAH };
+	const char* builderNames[] = { "midpoint", "sah" };
+
+	for (auto count : counts)
+	{
+		// Keep the density of the scene the same at every size
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+
+		mt19937 generator(2);
+		uniform_real_distribution<float> position(-extent, extent);
+		vector<Bounds> queries(HIERARCHY_BENCH_QUERY_COUNT);
+		for (auto& query : queries)
+		{
+			XMFLOAT3 center(position(generator), position(generator), position(generator));
+			query.Lower = XMFLOAT3(center.x - 4.0f, center.y - 4.0f, center.z - 4.0f);
+			query.Upper = XMFLOAT3(center.x + 4.0f, center.y + 4.0f, center.z + 4.0f);
+		}
+
+		for (size_t i = 0; i < 2; ++i)
+		{
+			HierarchyBuildParams params;
+			GetDefaultHierarchyBuildParams(&params);
+			params.Builder = builders[i];
+
+			BenchTimer timer;
+			BuildSceneGraphHierarchy(scene.Root, true, params);
+			auto buildTime = timer.GetMilliseconds();
+
+			HierarchyStats stats;
+			ComputeHierarchyStats(scene.Root, params, &stats);
+
+			size_t hitCount = 0;
+			timer.Restart();
+			QueryBounds(scene.Root, queries.data(), queries.size(), [&hitCount](const SpatialQueryHit& hit)
+			{
+				++hitCount;
+				return true;
+			});
+			auto queryTime = timer.GetMilliseconds();
+
+			cout << count << " nodes, " << builderNames[i] << ": build " << buildTime << " ms, "
+				<< stats.RegionCount << " regions, " << stats.LeafCount << " leaves, depth " << stats.MaxDepth
+				<< ", SAH cost " << stats.SAHCost << ", " << queries.size() << " box queries " << queryTime
+				<< " ms (" << hitCount << " hits)" << endl;
+		}
+
+		DestroyBenchScene(&scene);
+	}
+
+	return true;
+}
+
+// Builds the same scene with worker pools of increasing size. The hierarchy does not depend on the
+// number of threads, so the stats of every build are checked against the serial one. Pools larger
+// than the machine are still run, as a check of the waits, and marked as oversubscribed.
+bool RunParallelBuildBench()
+{
+	const size_t counts[] = { 100000, 1000000 };
+	const size_t threadCounts[] = { 0, 1, 3, 7, 15 };
+	bool bPassed = true;
+
+	for (auto count : counts)
+	{
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+
+		double serialTime = 0.0;
+		HierarchyStats serialStats;
+
+		for (auto threadCount : threadCounts)
+		{
+			// The calling thread builds too
+			bool bOversubscribed = threadCount + 1 > thread::hardware_concurrency();
+
+			WorkerPool workers;
+			workers.Initialize(threadCount);
+
+			HierarchyBuildParams params;
+			GetDefaultHierarchyBuildParams(&params);
+			params.Workers = (threadCount > 0 ? &workers : nullptr);
+
+			// Best of three, the first build of a scene also pays for faulting in the arena
+			auto bestTime = numeric_limits<double>::infinity();
+			for (int run = 0; run < 3; ++run)
+			{
+				BenchTimer timer;
+				BuildSceneGraphHierarchy(scene.Root, true, params);
+				bestTime = min(bestTime, timer.GetMilliseconds());
+			}
+
+			HierarchyStats stats;
+			ComputeHierarchyStats(scene.Root, params, &stats);
+
+			if (threadCount == 0)
+			{
+				serialTime = bestTime;
+				serialStats = stats;
+			}
+
+			bool bMatches = stats.RegionCount == serialStats.RegionCount &&
+				stats.LeafCount == serialStats.LeafCount && stats.MaxDepth == serialStats.MaxDepth &&
+				stats.SAHCost == serialStats.SAHCost;
+
+			cout << count << " nodes, " << threadCount + 1 << " threads: " << bestTime << " ms, speedup "
+				<< serialTime / bestTime << (bOversubscribed ? " (oversubscribed)" : "")
+				<< (bMatches ? "" : ", HIERARCHY DIFFERS FROM SERIAL BUILD") << endl;
+			bPassed = bPassed && bMatches;
+
+			workers.Destroy();
+		}
+
+		DestroyBenchScene(&scene);
+	}
+
+	return bPassed;
+}
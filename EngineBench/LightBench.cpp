@@ -0,0 +1,186 @@
+#include "Bench.h"
+#include "LightClusters.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace DirectX;
+using namespace std;
+
+#define LIGHT_BENCH_LIGHT_COUNT 4096
+#define LIGHT_BENCH_RUNS 10
+// Milliseconds a build across the pool may take, the best of the runs being checked
+#define LIGHT_BENCH_BUDGET_MS 0.5
+// Points sampled inside each light to check that its clusters list it
+#define LIGHT_BENCH_SAMPLES 64
+
+// Omni lights placed by the transforms of their nodes, with half of them offset within the node
+// and scaled by it, so that binning has to go through the node's global transform
+static void CreateBenchLights(SceneNode* root, const XMFLOAT3& lower, const XMFLOAT3& upper, const uint32_t seed,
+	vector<LightData>* lightsOut, vector<SceneNode*>* nodesOut)
+{
+	mt19937 generator(seed);
+	uniform_real_distribution<float> positionX(lower.x, upper.x);
+	uniform_real_distribution<float> positionY(lower.y, upper.y);
+	uniform_real_distribution<float> positionZ(lower.z, upper.z);
+	uniform_real_distribution<float> radius(1.0f, 6.0f);
+
+	lightsOut->resize(LIGHT_BENCH_LIGHT_COUNT);
+	nodesOut->clear();
+
+	XMFLOAT4X4 transform;
+	for (size_t i = 0; i < lightsOut->size(); ++i)
+	{
+		auto& light = (*lightsOut)[i];
+		light.Type = LIGHT_TYPE_OMNI;
+		light.Direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		light.Radius = radius(generator);
+
+		auto translation = XMMatrixTranslation(positionX(generator), positionY(generator), positionZ(generator));
+		if (i % 2 == 0)
+		{
+			light.Position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			XMStoreFloat4x4(&transform, translation);
+		}
+		else
+		{
+			light.Position = XMFLOAT3(1.0f, -1.0f, 0.5f);
+			XMStoreFloat4x4(&transform, XMMatrixScaling(0.5f, 0.5f, 0.5f) * translation);
+		}
+
+		auto node = CreateLightNode(LIGHT_TYPE_OMNI, &light);
+		SetLocalTransform(node, transform);
+		AttachSceneNode(root, node);
+		nodesOut->push_back(node);
+	}
+
+	UpdateTransforms(root, XMMatrixIdentity());
+}
+
+// Samples points inside every light, and counts those inside the frustum whose cluster does not
+// list the light
+static size_t CountMissedSamples(const LightClusterGrid& grid, const vector<SceneNode*>& nodes,
+	const XMFLOAT4X4& view, const float nearPlane, const float farPlane, const float scaleX, const float scaleY)
+{
+	mt19937 generator(4);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	auto& clusters = grid.GetClusters();
+	auto& indices = grid.GetLightIndices();
+	auto viewMatrix = XMLoadFloat4x4(&view);
+	size_t missedCount = 0;
+
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		auto light = nodes[i]->Ref.LightData;
+		auto world = XMLoadFloat4x4(&nodes[i]->Transform.Global);
+		auto center = XMVector3TransformCoord(XMLoadFloat3(&light->Position), world);
+		float radius = light->Radius * XMVectorGetX(XMVector3Length(world.r[0]));
+
+		for (int sample = 0; sample < LIGHT_BENCH_SAMPLES; ++sample)
+		{
+			XMFLOAT3 offset(unit(generator), unit(generator), unit(generator));
+			if (offset.x * offset.x + offset.y * offset.y + offset.z * offset.z > 1.0f)
+				continue;
+
+			XMFLOAT3 point;
+			XMStoreFloat3(&point, XMVector3TransformCoord(center + radius * XMLoadFloat3(&offset), viewMatrix));
+
+			float screenX = point.x * scaleX / point.z;
+			float screenY = point.y * scaleY / point.z;
+			if (point.z <= nearPlane || point.z >= farPlane || fabs(screenX) >= 1.0f || fabs(screenY) >= 1.0f)
+				continue;
+
+			auto x = static_cast<uint32_t>((screenX + 1.0f) * 0.5f * DEFAULT_LIGHT_CLUSTERS_X);
+			auto y = static_cast<uint32_t>((1.0f - screenY) * 0.5f * DEFAULT_LIGHT_CLUSTERS_Y);
+			auto z = static_cast<uint32_t>(log(point.z / nearPlane) / log(farPlane / nearPlane) * DEFAULT_LIGHT_CLUSTERS_Z);
+			z = min<uint32_t>(z, DEFAULT_LIGHT_CLUSTERS_Z - 1);
+
+			auto& cluster = clusters[grid.GetClusterIndex(x, y, z)];
+			auto begin = indices.begin() + cluster.Offset;
+			if (find(begin, begin + cluster.Count, static_cast<uint32_t>(i)) == begin + cluster.Count)
+				++missedCount;
+		}
+	}
+
+	return missedCount;
+}
+
+// Bins the same lights on the calling thread alone and across a worker pool, for lights scattered
+// around the camera and for lights crowding the view. Checks that both give the same indices, that
+// every sampled point of a light falls in a cluster listing it, and that the pool bins them within
+// the budget.
+bool RunLightClusterBench()
+{
+	const float nearPlane = 0.1f;
+	const float farPlane = 200.0f;
+	const float aspect = 16.0f / 9.0f;
+
+	XMFLOAT4X4 view;
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, aspect, nearPlane, farPlane));
+
+	const char* sceneNames[] = { "around the camera", "in front of the camera" };
+	const XMFLOAT3 lowers[] = { XMFLOAT3(-100.0f, -20.0f, -100.0f), XMFLOAT3(-20.0f, -10.0f, 5.0f) };
+	const XMFLOAT3 uppers[] = { XMFLOAT3(100.0f, 20.0f, 100.0f), XMFLOAT3(20.0f, 10.0f, 60.0f) };
+
+	auto threadCount = max<size_t>(thread::hardware_concurrency(), 1) - 1;
+	WorkerPool workers;
+	workers.Initialize(threadCount);
+	bool bPassed = true;
+
+	for (size_t scene = 0; scene < 2; ++scene)
+	{
+		ZoneData zone;
+		zone.Name = "LightBench";
+		auto root = CreateSceneGraph(&zone);
+
+		vector<LightData> lights;
+		vector<SceneNode*> nodes;
+		CreateBenchLights(root, lowers[scene], uppers[scene], 5, &lights, &nodes);
+
+		LightClusterGrid grids[2];
+		double bestTimes[2];
+
+		for (size_t i = 0; i < 2; ++i)
+		{
+			grids[i].Initialize(DEFAULT_LIGHT_CLUSTERS_X, DEFAULT_LIGHT_CLUSTERS_Y, DEFAULT_LIGHT_CLUSTERS_Z);
+
+			bestTimes[i] = numeric_limits<double>::infinity();
+			for (int run = 0; run < LIGHT_BENCH_RUNS; ++run)
+			{
+				grids[i].Build(nodes, view, projection, (i == 1 && threadCount > 0) ? &workers : nullptr);
+
+				LightClusterStats stats;
+				grids[i].GetStats(&stats);
+				bestTimes[i] = min(bestTimes[i], stats.BinTime);
+			}
+		}
+
+		LightClusterStats stats;
+		grids[0].GetStats(&stats);
+		bool bMatches = grids[0].GetLightIndices() == grids[1].GetLightIndices();
+		auto missedCount = CountMissedSamples(grids[0], nodes, view, nearPlane, farPlane, projection.m[0][0],
+			projection.m[1][1]);
+
+		cout << nodes.size() << " lights " << sceneNames[scene] << ": " << stats.BinnedCount << " binned, "
+			<< stats.IndexCount << " indices, 1 thread " << bestTimes[0] << " ms, " << threadCount + 1
+			<< " threads " << bestTimes[1] << " ms, " << missedCount << " missed samples"
+			<< (bMatches ? "" : ", THREADED INDICES DIFFER")
+			<< (bestTimes[1] <= LIGHT_BENCH_BUDGET_MS ? "" : ", OVER BUDGET") << endl;
+		bPassed = bPassed && bMatches && missedCount == 0 && bestTimes[1] <= LIGHT_BENCH_BUDGET_MS;
+
+		grids[0].Destroy();
+		grids[1].Destroy();
+		DestroySceneGraph(root);
+	}
+
+	workers.Destroy();
+	return bPassed;
+}
@@ -0,0 +1,54 @@
+#include "Bench.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+struct BenchEntry
+{
+	const char* Name;
+	bool (*Run)();
+};
+
+static const BenchEntry benchEntries[] =
+{
+	{ "hierarchy-builders", RunHierarchyBuilderBench },
+	{ "parallel-build", RunParallelBuildBench },
+	{ "frustum-batch", RunFrustumBatchBench },
+	{ "light-clusters", RunLightClusterBench },
+	{ "multi-view", RunMultiViewBench },
+	{ "ring-buffer", RunRingBufferBench },
+	{ "headless-frame", RunHeadlessFrameBench },
+	{ "draw-packets", RunDrawPacketBench },
+	{ "parallel-culling", RunParallelCullingBench },
+	{ "coherent-culling", RunCoherentCullingBench },
+	{ "scene-store", RunSceneStoreBench }
+};
+
+// Runs the benchmarks named on the command line, or all of them when none are named. Exits with
+// a failure when a check of any of them failed.
+int main(int argc, char** argv)
+{
+	bool bPassed = true;
+
+	for (auto& entry : benchEntries)
+	{
+		bool bSelected = (argc <= 1);
+		for (int i = 1; i < argc && !bSelected; ++i)
+			bSelected = (entry.Name == string(argv[i]));
+
+		if (!bSelected)
+			continue;
+
+		cout << "== " << entry.Name << " ==" << endl;
+		if (!entry.Run())
+		{
+			cout << entry.Name << " FAILED" << endl;
+			bPassed = false;
+		}
+		cout << endl;
+	}
+
+	return bPassed ? 0 : 1;
+}
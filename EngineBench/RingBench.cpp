@@ -0,0 +1,257 @@
+#include "Bench.h"
+#include "RingBuffer.h"
+#include "RecordingRenderContext.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+#define RING_BENCH_RING_COUNT 200
+#define RING_BENCH_FRAME_COUNT 300
+// The GPU finishes each frame up to this many frames after it was issued
+#define RING_BENCH_MAX_LATENCY 6
+
+// A range handed out by the allocator, in use until its frame's fence is retired
+struct RingBenchRange
+{
+	size_t Offset;
+	size_t Size;
+	uint64_t Fence;
+};
+
+// A recording context whose queries pass some frames after they were ended, as set by the bench,
+// rather than straight away. A query waited on passes at once and is counted.
+class LatentRenderContext : public RecordingRenderContext
+{
+public:
+	LatentRenderContext() :
+		endedCount(0),
+		passedCount(0),
+		waitCount(0)
+	{
+	}
+
+	void End(ID3D11Asynchronous* query) override
+	{
+		RecordingRenderContext::End(query);
+		queryEnds[query] = ++endedCount;
+	}
+
+	HRESULT GetData(ID3D11Asynchronous* query, void* data, UINT dataSize, UINT getDataFlags) override
+	{
+		auto end = queryEnds.find(query);
+		if (end == queryEnds.end())
+			return S_FALSE;
+
+		if (end->second > passedCount)
+		{
+			if ((getDataFlags & D3D11_ASYNC_GETDATA_DONOTFLUSH) != 0)
+				return S_FALSE;
+			passedCount = end->second;
+			++waitCount;
+		}
+
+		if (data != nullptr && dataSize >= sizeof(BOOL))
+			*static_cast<BOOL*>(data) = TRUE;
+		return S_OK;
+	}
+
+	// Lets the GPU finish every query ended more than the given number of frames ago
+	void Advance(const uint64_t latency)
+	{
+		if (endedCount > latency)
+			passedCount = max(passedCount, endedCount - latency);
+	}
+
+	inline uint64_t GetPassedCount() const { return passedCount; }
+	inline size_t GetWaitCount() const { return waitCount; }
+
+protected:
+	map<ID3D11Asynchronous*, uint64_t> queryEnds;
+	uint64_t endedCount;
+	uint64_t passedCount;
+	size_t waitCount;
+};
+
+// Allocates random sizes from rings of random capacity over many frames, finishing frames after a
+// random latency. Counts the ranges handed out misaligned, past the end of the ring, or over a
+// range of a frame that has not been retired.
+static bool RunRingAllocatorCheck()
+{
+	mt19937 generator(7);
+	uniform_int_distribution<size_t> capacityDistribution(1 << 10, 1 << 20);
+	uniform_int_distribution<uint64_t> latencyDistribution(0, RING_BENCH_MAX_LATENCY);
+	uniform_int_distribution<int> allocationCount(0, 32);
+
+	size_t allocationTotal = 0;
+	size_t badRangeCount = 0;
+	size_t wrapCount = 0;
+	size_t growCount = 0;
+	vector<RingBenchRange> liveRanges;
+
+	BenchTimer timer;
+	for (int ring = 0; ring < RING_BENCH_RING_COUNT; ++ring)
+	{
+		RingAllocator allocator;
+		auto capacity = capacityDistribution(generator);
+		allocator.Initialize(capacity);
+		liveRanges.clear();
+		uint64_t completedFence = 0;
+
+		// Sizes follow the capacity the ring started with rather than the one it has grown to, so
+		// that it stops growing once it holds the frames in flight
+		uniform_int_distribution<size_t> sizeDistribution(1, max<size_t>(capacity / 16, 1));
+
+		for (uint64_t fence = 1; fence <= RING_BENCH_FRAME_COUNT; ++fence)
+		{
+			auto latency = latencyDistribution(generator);
+			if (fence > latency + 1)
+				completedFence = max(completedFence, fence - latency - 1);
+
+			allocator.Retire(completedFence);
+			liveRanges.erase(remove_if(liveRanges.begin(), liveRanges.end(),
+				[completedFence](const RingBenchRange& range) { return range.Fence <= completedFence; }),
+				liveRanges.end());
+
+			auto count = allocationCount(generator);
+			for (int i = 0; i < count; ++i)
+			{
+				auto size = sizeDistribution(generator);
+
+				// Growing replaces the memory, as the instance ring does with its buffer
+				size_t offset;
+				if (!allocator.Allocate(size, INSTANCE_RING_ALIGNMENT, &offset))
+				{
+					allocator.Grow(allocator.GetCapacity() * 2);
+					liveRanges.clear();
+					if (!allocator.Allocate(size, INSTANCE_RING_ALIGNMENT, &offset))
+					{
+						++badRangeCount;
+						continue;
+					}
+				}
+
+				bool bOverlaps = any_of(liveRanges.begin(), liveRanges.end(), [&](const RingBenchRange& range)
+				{
+					return offset < range.Offset + range.Size && range.Offset < offset + size;
+				});
+
+				if (bOverlaps || offset % INSTANCE_RING_ALIGNMENT != 0 || offset + size > allocator.GetCapacity())
+					++badRangeCount;
+
+				RingBenchRange range = { offset, size, fence };
+				liveRanges.push_back(range);
+				++allocationTotal;
+			}
+
+			allocator.EndFrame(fence);
+		}
+
+		wrapCount += allocator.GetStats().WrapCount;
+		growCount += allocator.GetStats().GrowCount;
+	}
+
+	cout << RING_BENCH_RING_COUNT << " rings of " << RING_BENCH_FRAME_COUNT << " frames: " << allocationTotal
+		<< " allocations in " << timer.GetMilliseconds() << " ms, " << wrapCount << " wraps, " << growCount
+		<< " grows, " << badRangeCount << " bad ranges" << endl;
+
+	return badRangeCount == 0;
+}
+
+// Writes random data through an instance ring on a context whose frames finish late, checking
+// that what unfinished frames wrote is never overwritten and that each buffer is discarded once
+static bool RunInstanceRingCheck()
+{
+	mt19937 generator(8);
+	uniform_int_distribution<uint64_t> latencyDistribution(0, RING_BENCH_MAX_LATENCY);
+	uniform_int_distribution<int> writeCount(0, 24);
+	uniform_int_distribution<size_t> sizeDistribution(16, 4096);
+	uniform_int_distribution<int> byteDistribution(0, 255);
+
+	struct RingWrite
+	{
+		ID3D11Buffer* Buffer;
+		UINT Offset;
+		vector<uint8_t> Data;
+		uint64_t Frame;
+	};
+
+	LatentRenderContext context;
+	InstanceRingBuffer ring;
+	ring.Initialize(&context, 16 << 10);
+
+	vector<RingWrite> writes;
+	size_t corruptCount = 0;
+	size_t discardCount = 0;
+	vector<uint8_t> data;
+
+	for (uint64_t frame = 1; frame <= RING_BENCH_FRAME_COUNT * 4; ++frame)
+	{
+		context.Advance(latencyDistribution(generator));
+		ring.BeginFrame();
+
+		// Frames the GPU has passed may be overwritten from here on
+		auto passedCount = context.GetPassedCount();
+		writes.erase(remove_if(writes.begin(), writes.end(),
+			[passedCount](const RingWrite& write) { return write.Frame <= passedCount; }), writes.end());
+
+		auto count = writeCount(generator);
+		for (int i = 0; i < count; ++i)
+		{
+			data.resize(sizeDistribution(generator));
+			for (auto& value : data)
+				value = static_cast<uint8_t>(byteDistribution(generator));
+
+			RingWrite write;
+			if (!ring.Write(data.data(), data.size(), &write.Buffer, &write.Offset))
+			{
+				++corruptCount;
+				continue;
+			}
+
+			// Writes to a buffer that has been replaced by a larger one are no longer checked, the
+			// runtime would keep it for the draws already recorded
+			writes.erase(remove_if(writes.begin(), writes.end(),
+				[&write](const RingWrite& other) { return other.Buffer != write.Buffer; }), writes.end());
+
+			write.Data = data;
+			write.Frame = frame;
+			writes.push_back(write);
+		}
+
+		ring.EndFrame();
+
+		for (auto& write : writes)
+		{
+			size_t bufferSize;
+			auto bufferData = context.GetBufferData(write.Buffer, &bufferSize);
+			if (bufferData != nullptr && !equal(write.Data.begin(), write.Data.end(), bufferData + write.Offset))
+				++corruptCount;
+		}
+
+		for (auto& command : context.GetCommands())
+		{
+			if (command.Type == RENDER_COMMAND_TYPE_MAP && command.Values[0] == D3D11_MAP_WRITE_DISCARD)
+				++discardCount;
+		}
+		context.ClearCommands();
+	}
+
+	auto& stats = ring.GetStats();
+	cout << RING_BENCH_FRAME_COUNT * 4 << " frames through an instance ring: capacity " << stats.Capacity
+		<< ", frame high water " << stats.FrameHighWater << ", in flight high water " << stats.InFlightHighWater
+		<< ", " << stats.GrowCount << " buffers, " << discardCount << " discards, " << context.GetWaitCount()
+		<< " waits, " << corruptCount << " corrupted writes" << endl;
+
+	ring.Destroy();
+	return corruptCount == 0;
+}
+
+bool RunRingBufferBench()
+{
+	bool bAllocatorPassed = RunRingAllocatorCheck();
+	bool bRingPassed = RunInstanceRingCheck();
+	return bAllocatorPassed && bRingPassed;
+}
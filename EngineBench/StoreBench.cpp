@@ -0,0 +1,195 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "SceneStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+using namespace DirectX;
+using namespace std;
+
+#define STORE_BENCH_NODE_COUNT 200000
+#define STORE_BENCH_LIGHT_COUNT 256
+#define STORE_BENCH_RUNS 10
+// Every this many meshes is destroyed, and as many created again, to check stale handles
+#define STORE_BENCH_DESTROY_STRIDE 7
+
+// Bytes reserved by the arrays of a flat hierarchy
+static size_t GetFlatHierarchyMemory(const FlatHierarchy& hierarchy)
+{
+	return (hierarchy.LowerX.capacity() + hierarchy.LowerY.capacity() + hierarchy.LowerZ.capacity() +
+		hierarchy.UpperX.capacity() + hierarchy.UpperY.capacity() + hierarchy.UpperZ.capacity()) * sizeof(float) +
+		hierarchy.SkipIndices.capacity() * sizeof(uint32_t) + hierarchy.LeafData.capacity() * sizeof(SceneNode*) +
+		hierarchy.RejectPlanes.capacity();
+}
+
+// The handles of every mesh in the table whose bounds intersect the frustum, tested one by one
+static void CullStoreMeshes(const SceneStore& store, const Frustum& frustum, vector<NodeHandle>* handlesOut)
+{
+	vector<uint32_t> visible;
+	CullNodeTable(store.StaticMeshes, frustum, &visible);
+
+	handlesOut->clear();
+	for (auto denseIndex : visible)
+		handlesOut->push_back(store.StaticMeshes.GetHandle(denseIndex));
+}
+
+// Creates, builds and culls the same meshes as scene nodes and in a scene store. The store must
+// collect the same meshes as the zone and as a linear pass over its table, reject the handles of
+// destroyed nodes, and keep rejecting them once their slots are reused.
+bool RunSceneStoreBench()
+{
+	auto extent = 2.0f * cbrt(static_cast<float>(STORE_BENCH_NODE_COUNT));
+
+	mt19937 generator(1);
+	uniform_real_distribution<float> position(-extent, extent);
+	vector<XMFLOAT4X4> transforms(STORE_BENCH_NODE_COUNT);
+	for (auto& transform : transforms)
+		XMStoreFloat4x4(&transform, XMMatrixTranslation(position(generator), position(generator), position(generator)));
+
+	// An empty bench scene gives the mesh, the material and the zone
+	BenchScene scene;
+	CreateBenchScene(0, extent, 1, &scene);
+
+	BenchTimer timer;
+	for (auto& transform : transforms)
+	{
+		auto node = CreateStaticMeshNode(scene.Mesh, &scene.Material, transform);
+		AttachSceneNode(scene.Root, node);
+		scene.Nodes.push_back(node);
+	}
+	UpdateTransforms(scene.Root, XMMatrixIdentity());
+	auto sceneCreateTime = timer.GetMilliseconds();
+
+	SceneStore store;
+	vector<NodeHandle> handles;
+	handles.reserve(STORE_BENCH_NODE_COUNT);
+
+	timer.Restart();
+	for (auto& transform : transforms)
+		handles.push_back(store.CreateStaticMesh(scene.Mesh, &scene.Material, transform));
+	auto storeCreateTime = timer.GetMilliseconds();
+
+	LightData light = { LIGHT_TYPE_OMNI, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), 4.0f };
+	for (int i = 0; i < STORE_BENCH_LIGHT_COUNT; ++i)
+		store.CreateLight(&light, transforms[i]);
+
+	timer.Restart();
+	BuildSceneGraphHierarchy(scene.Root, true);
+	auto sceneBuildTime = timer.GetMilliseconds();
+
+	timer.Restart();
+	BuildSceneStoreHierarchy(&store);
+	auto storeBuildTime = timer.GetMilliseconds();
+
+	Frustum frustum;
+	GetBenchFrustum(extent, &frustum);
+
+	Renderer renderer;
+	renderer.CullingParameters.Layout = CULLING_LAYOUT_FLAT;
+
+	NodeCollection sceneNodes;
+	NodeHandleCollection storeNodes;
+	vector<NodeHandle> linearHandles;
+	auto sceneCollectTime = numeric_limits<double>::infinity();
+	auto storeCollectTime = numeric_limits<double>::infinity();
+	auto linearCullTime = numeric_limits<double>::infinity();
+
+	for (int run = 0; run < STORE_BENCH_RUNS; ++run)
+	{
+		sceneNodes.StaticMeshes.clear();
+		timer.Restart();
+		renderer.CollectVisibleNodes(scene.Root, &frustum, 1, &sceneNodes);
+		sceneCollectTime = min(sceneCollectTime, timer.GetMilliseconds());
+
+		storeNodes = NodeHandleCollection();
+		timer.Restart();
+		renderer.CollectVisibleNodes(store, frustum, &storeNodes);
+		storeCollectTime = min(storeCollectTime, timer.GetMilliseconds());
+
+		timer.Restart();
+		CullStoreMeshes(store, frustum, &linearHandles);
+		linearCullTime = min(linearCullTime, timer.GetMilliseconds());
+	}
+
+	// Nodes were created in the same order and none were removed, so the dense index of each mesh
+	// in the store is the index of its scene node
+	unordered_map<SceneNode*, uint32_t> nodeIndices;
+	for (uint32_t i = 0; i < scene.Nodes.size(); ++i)
+		nodeIndices[scene.Nodes[i]] = i;
+
+	vector<uint32_t> sceneIndices;
+	for (auto node : sceneNodes.StaticMeshes)
+		sceneIndices.push_back(nodeIndices[node]);
+
+	vector<uint32_t> storeIndices;
+	for (auto handle : storeNodes.StaticMeshes)
+		storeIndices.push_back(store.StaticMeshes.Find(handle));
+
+	sort(sceneIndices.begin(), sceneIndices.end());
+	sort(storeIndices.begin(), storeIndices.end());
+	sort(storeNodes.StaticMeshes.begin(), storeNodes.StaticMeshes.end());
+	sort(linearHandles.begin(), linearHandles.end());
+	bool bMatches = sceneIndices == storeIndices && storeNodes.StaticMeshes == linearHandles;
+
+	MemoryArenaStats arenaStats;
+	scene.Zone.HierarchyArena.GetStats(&arenaStats);
+	auto sceneBytes = sizeof(SceneNode) + (arenaStats.AllocatedBytes +
+		GetFlatHierarchyMemory(scene.Zone.CompiledHierarchy)) / STORE_BENCH_NODE_COUNT;
+	auto storeBytes = (store.GetMemoryUsage() - store.Lights.GetMemoryUsage()) / STORE_BENCH_NODE_COUNT;
+
+	cout << STORE_BENCH_NODE_COUNT << " meshes, " << sceneNodes.StaticMeshes.size() << " collected from the zone, "
+		<< storeNodes.StaticMeshes.size() << " from the store, " << storeNodes.Lights.size() << " of "
+		<< STORE_BENCH_LIGHT_COUNT << " lights" << (bMatches ? "" : ", COLLECTIONS DIFFER") << endl;
+	cout << "scene nodes: create " << sceneCreateTime << " ms, build " << sceneBuildTime << " ms, collect "
+		<< sceneCollectTime << " ms, " << sceneBytes << " bytes per node and a heap allocation each" << endl;
+	cout << "scene store: create " << storeCreateTime << " ms, build " << storeBuildTime << " ms, collect "
+		<< storeCollectTime << " ms, linear pass " << linearCullTime << " ms, " << storeBytes << " bytes per node"
+		<< endl;
+
+	// Destroy every few meshes, collect with the hierarchy left as it was, then create as many
+	// again so that the freed slots are reused under a new generation
+	vector<NodeHandle> destroyedHandles;
+	for (size_t i = 0; i < handles.size(); i += STORE_BENCH_DESTROY_STRIDE)
+	{
+		store.Destroy(handles[i]);
+		destroyedHandles.push_back(handles[i]);
+	}
+
+	storeNodes = NodeHandleCollection();
+	renderer.CollectVisibleNodes(store, frustum, &storeNodes);
+	CullStoreMeshes(store, frustum, &linearHandles);
+	sort(storeNodes.StaticMeshes.begin(), storeNodes.StaticMeshes.end());
+	sort(linearHandles.begin(), linearHandles.end());
+	bool bSkipsDestroyed = storeNodes.StaticMeshes == linearHandles;
+
+	for (size_t i = 0; i < destroyedHandles.size(); ++i)
+		store.CreateStaticMesh(scene.Mesh, &scene.Material, transforms[i * STORE_BENCH_DESTROY_STRIDE]);
+
+	size_t staleAcceptedCount = 0;
+	for (auto handle : destroyedHandles)
+	{
+		Bounds bounds;
+		if (store.IsValid(handle) || store.GetBounds(handle, &bounds) || store.Destroy(handle))
+			++staleAcceptedCount;
+	}
+
+	BuildSceneStoreHierarchy(&store);
+	storeNodes = NodeHandleCollection();
+	renderer.CollectVisibleNodes(store, frustum, &storeNodes);
+	CullStoreMeshes(store, frustum, &linearHandles);
+	sort(storeNodes.StaticMeshes.begin(), storeNodes.StaticMeshes.end());
+	sort(linearHandles.begin(), linearHandles.end());
+	bool bRebuiltMatches = storeNodes.StaticMeshes == linearHandles &&
+		storeNodes.StaticMeshes.size() == sceneNodes.StaticMeshes.size();
+
+	cout << destroyedHandles.size() << " meshes destroyed and created again: " << staleAcceptedCount
+		<< " stale handles accepted" << (bSkipsDestroyed ? "" : ", DESTROYED MESHES COLLECTED")
+		<< (bRebuiltMatches ? "" : ", REBUILT COLLECTION DIFFERS") << endl;
+
+	DestroyBenchScene(&scene);
+	return bMatches && bSkipsDestroyed && staleAcceptedCount == 0 && bRebuiltMatches;
+}
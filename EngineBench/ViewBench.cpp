@@ -0,0 +1,334 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "RecordingRenderContext.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+using namespace DirectX;
+using namespace std;
+
+#define VIEW_BENCH_VIEW_COUNT 11
+#define VIEW_BENCH_RUNS 5
+#define PARALLEL_CULLING_BENCH_RUNS 5
+#define COHERENT_CULLING_BENCH_FRAMES 240
+// Distance the camera moves and radians it turns each frame
+#define COHERENT_CULLING_BENCH_STEP 0.05f
+#define COHERENT_CULLING_BENCH_TURN 0.002f
+
+// Frusta from random points in the scene looking in random directions. Wide views see a large
+// part of the scene, narrow ones so little that pushing visible nodes costs next to nothing.
+static void CreateBenchViews(const float extent, const float fieldOfView, vector<Frustum>* frustaOut)
+{
+	mt19937 generator(6);
+	uniform_real_distribution<float> position(-extent, extent);
+	uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+	frustaOut->resize(VIEW_BENCH_VIEW_COUNT);
+	for (auto& frustum : *frustaOut)
+	{
+		XMFLOAT3 eye(position(generator), position(generator), position(generator));
+		XMFLOAT3 target(eye.x + direction(generator), eye.y + 0.1f * direction(generator), eye.z + direction(generator));
+		ConstructFrustum(fieldOfView, extent, 0.1f, eye, target, XMFLOAT3(0.0f, 1.0f, 0.0f), 16.0f / 9.0f, &frustum);
+	}
+}
+
+static size_t CountCollected(const vector<NodeCollection>& collections)
+{
+	size_t count = 0;
+	for (auto& nodes : collections)
+		count += nodes.StaticMeshes.size();
+	return count;
+}
+
+// Whether both collected the same meshes for every view, in any order
+static bool CompareCollections(vector<NodeCollection>& collections1, vector<NodeCollection>& collections2)
+{
+	for (size_t view = 0; view < collections1.size(); ++view)
+	{
+		auto& meshes1 = collections1[view].StaticMeshes;
+		auto& meshes2 = collections2[view].StaticMeshes;
+		sort(meshes1.begin(), meshes1.end());
+		sort(meshes2.begin(), meshes2.end());
+		if (meshes1 != meshes2)
+			return false;
+	}
+
+	return true;
+}
+
+// Collects the same views one at a time and in a single walk, for both layouts. The walk loads
+// each entry's bounds once for every view, which only shows when the bounds, rather than the
+// plane tests or pushing the visible nodes, are what the collection waits on.
+bool RunMultiViewBench()
+{
+	const size_t counts[] = { 100000, 1000000 };
+	const float fieldsOfView[] = { XM_PIDIV4, 0.05f };
+	const char* viewNames[] = { "wide", "narrow" };
+	const CullingLayout layouts[] = { CULLING_LAYOUT_TREE, CULLING_LAYOUT_FLAT };
+	const char* layoutNames[] = { "tree", "flat" };
+
+	Renderer renderer;
+	bool bPassed = true;
+
+	for (auto count : counts)
+	{
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+		BuildSceneGraphHierarchy(scene.Root, true);
+
+		for (size_t fieldOfView = 0; fieldOfView < 2; ++fieldOfView)
+		{
+			vector<Frustum> frusta;
+			CreateBenchViews(extent, fieldsOfView[fieldOfView], &frusta);
+
+			for (size_t layout = 0; layout < 2; ++layout)
+			{
+				renderer.CullingParameters.Layout = layouts[layout];
+
+				vector<NodeCollection> separate(frusta.size());
+				vector<NodeCollection> combined(frusta.size());
+				auto separateTime = numeric_limits<double>::infinity();
+				auto combinedTime = numeric_limits<double>::infinity();
+
+				for (int run = 0; run < VIEW_BENCH_RUNS; ++run)
+				{
+					for (auto& nodes : separate)
+						nodes.StaticMeshes.clear();
+
+					BenchTimer timer;
+					for (size_t view = 0; view < frusta.size(); ++view)
+						renderer.CollectVisibleNodes(scene.Root, &frusta[view], 1, &separate[view]);
+					separateTime = min(separateTime, timer.GetMilliseconds());
+
+					for (auto& nodes : combined)
+						nodes.StaticMeshes.clear();
+
+					timer.Restart();
+					renderer.CollectVisibleNodes(scene.Root, frusta.data(), static_cast<uint32_t>(frusta.size()),
+						combined.data());
+					combinedTime = min(combinedTime, timer.GetMilliseconds());
+				}
+
+				bool bMatches = CompareCollections(separate, combined);
+				cout << count << " nodes, " << frusta.size() << " " << viewNames[fieldOfView] << " views, "
+					<< layoutNames[layout] << ": " << CountCollected(combined) << " collected, one at a time "
+					<< separateTime << " ms, single walk " << combinedTime << " ms"
+					<< (bMatches ? "" : ", COLLECTIONS DIFFER") << endl;
+				bPassed = bPassed && bMatches;
+			}
+		}
+
+		DestroyBenchScene(&scene);
+	}
+
+	return bPassed;
+}
+
+// The transformations the last frame uploaded for its draws, read back from the buffer bound for
+// them, in the order the nodes were drawn
+static void GetDrawnTransforms(const RecordingRenderContext& context, const size_t nodeCount,
+	vector<uint8_t>* dataOut)
+{
+	dataOut->clear();
+	for (auto& command : context.GetCommands())
+	{
+		if (command.Type != RENDER_COMMAND_TYPE_SET_VERTEX_BUFFERS || command.Values[0] != 1)
+			continue;
+
+		size_t size;
+		auto buffer = static_cast<const ID3D11Buffer*>(context.GetCommandObject(command, 0));
+		auto data = context.GetBufferData(buffer, &size);
+		auto end = min(size, command.Values[3] + nodeCount * sizeof(XMFLOAT4X4));
+		if (data != nullptr)
+			dataOut->assign(data + command.Values[3], data + end);
+		return;
+	}
+}
+
+// Renders frames of a bench scene from inside it, with the visibility collected on culling
+// worker pools of increasing size, for both layouts. The frame is timed whole. The collection
+// must not depend on the number of threads, so every pool must draw the same nodes in the same
+// order as the serial pass. Pools larger than the machine are still run, and marked as
+// oversubscribed.
+bool RunParallelCullingBench()
+{
+	const size_t counts[] = { 100000, 1000000 };
+	const size_t threadCounts[] = { 0, 1, 3, 7 };
+	const CullingLayout layouts[] = { CULLING_LAYOUT_TREE, CULLING_LAYOUT_FLAT };
+	const char* layoutNames[] = { "tree", "flat" };
+
+	RenderParams params;
+	params.Extent.Width = 1280;
+	params.Extent.Height = 720;
+	params.UseVSync = false;
+	params.Windowed = true;
+	bool bPassed = true;
+
+	for (auto count : counts)
+	{
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+		BuildSceneGraphHierarchy(scene.Root, true);
+
+		SphericalCamera camera;
+		camera.Position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		camera.LookAt(XMFLOAT3(0.0f, 0.0f, 1.0f));
+		camera.NearPlane = 0.1f;
+		camera.FarPlane = extent;
+
+		for (size_t layout = 0; layout < 2; ++layout)
+		{
+			double serialTime = 0.0;
+			vector<uint8_t> serialTransforms;
+			vector<uint8_t> transforms;
+
+			for (auto threadCount : threadCounts)
+			{
+				bool bOversubscribed = threadCount + 1 > thread::hardware_concurrency();
+
+				WorkerPool workers;
+				workers.Initialize(threadCount);
+
+				RecordingRenderContext context;
+				Renderer renderer;
+				renderer.Initialize(&context, params);
+				renderer.CullingParameters.Layout = layouts[layout];
+				renderer.CullingParameters.Workers = (threadCount > 0 ? &workers : nullptr);
+
+				auto bestTime = numeric_limits<double>::infinity();
+				DrawStats drawStats;
+				for (int run = 0; run < PARALLEL_CULLING_BENCH_RUNS; ++run)
+				{
+					context.ClearCommands();
+
+					BenchTimer timer;
+					renderer.RenderFrame(scene.Root, &camera);
+					bestTime = min(bestTime, timer.GetMilliseconds());
+				}
+
+				renderer.GetDrawStats(&drawStats);
+				GetDrawnTransforms(context, drawStats.InstancedNodeCount, &transforms);
+				if (threadCount == 0)
+				{
+					serialTime = bestTime;
+					serialTransforms = transforms;
+				}
+
+				bool bMatches = !transforms.empty() && transforms == serialTransforms;
+				cout << count << " nodes, " << layoutNames[layout] << ", " << threadCount + 1 << " threads: "
+					<< drawStats.InstancedNodeCount << " drawn, frame " << bestTime << " ms, speedup "
+					<< serialTime / bestTime << (bOversubscribed ? " (oversubscribed)" : "")
+					<< (bMatches ? "" : ", DRAWN NODES DIFFER FROM SERIAL PASS") << endl;
+				bPassed = bPassed && bMatches;
+
+				renderer.Destroy();
+				workers.Destroy();
+			}
+		}
+
+		DestroyBenchScene(&scene);
+	}
+
+	return bPassed;
+}
+
+// Flies a camera slowly through a bench scene, rendering every frame with coherent culling and
+// without, into recording contexts. Both must draw the same nodes in the same order. Reports how
+// many of the retested cut entries kept their result, the time the renderer estimates coherent
+// collection saved, and the frame times of both.
+bool RunCoherentCullingBench()
+{
+	const size_t counts[] = { 100000, 1000000 };
+
+	RenderParams params;
+	params.Extent.Width = 1280;
+	params.Extent.Height = 720;
+	params.UseVSync = false;
+	params.Windowed = true;
+	bool bPassed = true;
+
+	for (auto count : counts)
+	{
+		auto extent = 2.0f * cbrt(static_cast<float>(count));
+
+		BenchScene scene;
+		CreateBenchScene(count, extent, 1, &scene);
+		BuildSceneGraphHierarchy(scene.Root, true);
+
+		RecordingRenderContext contexts[2];
+		Renderer renderers[2];
+		for (size_t i = 0; i < 2; ++i)
+		{
+			renderers[i].Initialize(&contexts[i], params);
+			renderers[i].CullingParameters.Layout = CULLING_LAYOUT_FLAT;
+			renderers[i].CullingParameters.bCoherentCulling = (i == 1);
+		}
+
+		SphericalCamera camera;
+		camera.Position = XMFLOAT3(0.0f, 0.0f, -0.5f * extent);
+		camera.NearPlane = 0.1f;
+		camera.FarPlane = extent;
+
+		size_t mismatchedFrameCount = 0;
+		size_t fullTraversalCount = 0;
+		size_t retestedCount = 0;
+		size_t reusedCount = 0;
+		double timeSaved = 0.0;
+		double frameTimes[2] = { 0.0, 0.0 };
+		vector<uint8_t> transforms[2];
+
+		for (int frame = 0; frame < COHERENT_CULLING_BENCH_FRAMES; ++frame)
+		{
+			camera.Position.z += COHERENT_CULLING_BENCH_STEP;
+			camera.Yaw += COHERENT_CULLING_BENCH_TURN;
+
+			for (size_t i = 0; i < 2; ++i)
+			{
+				contexts[i].ClearCommands();
+
+				BenchTimer timer;
+				renderers[i].RenderFrame(scene.Root, &camera);
+				frameTimes[i] += timer.GetMilliseconds();
+
+				DrawStats drawStats;
+				renderers[i].GetDrawStats(&drawStats);
+				GetDrawnTransforms(contexts[i], drawStats.InstancedNodeCount, &transforms[i]);
+			}
+
+			if (transforms[0] != transforms[1])
+				++mismatchedFrameCount;
+
+			CoherentCullingStats stats;
+			renderers[1].GetCoherentCullingStats(&stats);
+			if (stats.bFullTraversal)
+				++fullTraversalCount;
+			retestedCount += stats.RetestedCount;
+			reusedCount += stats.ReusedCount;
+			timeSaved += stats.TimeSaved;
+		}
+
+		cout << count << " nodes, " << COHERENT_CULLING_BENCH_FRAMES << " frames: " << fullTraversalCount
+			<< " full traversals, reuse rate " << (retestedCount > 0 ? 100.0 * reusedCount / retestedCount : 0.0)
+			<< "%, estimated saving " << timeSaved / COHERENT_CULLING_BENCH_FRAMES << " ms per frame, frame "
+			<< frameTimes[0] / COHERENT_CULLING_BENCH_FRAMES << " ms from the root, "
+			<< frameTimes[1] / COHERENT_CULLING_BENCH_FRAMES << " ms coherent, " << mismatchedFrameCount
+			<< " mismatched frames" << endl;
+		bPassed = bPassed && mismatchedFrameCount == 0;
+
+		renderers[0].Destroy();
+		renderers[1].Destroy();
+		DestroyBenchScene(&scene);
+	}
+
+	return bPassed;
+}
@@ -5,6 +5,7 @@
 #include "Camera.h"
 #include "InputHandler.h"
 #include "CameraController.h"
+#include "ThreadPool.h"
 
 #include <DirectXMath.h>
 
@@ -80,6 +81,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmdLine,
 			ContentPackage package(&renderer);
 			StaticMesh* mesh1 = nullptr;
 			StaticMesh* mesh2 = nullptr;
+			OccluderMesh* occluderMesh2 = nullptr;
 			ID3D11Resource* texture1 = nullptr;
 			ID3D11ShaderResourceView* resourceView1 = nullptr;
 			ID3D11Resource* texture2 = nullptr;
@@ -91,6 +93,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmdLine,
 			package.SetVertexLayout(renderer.GetElementLayoutStaticMeshInstanced());
 			package.LoadMesh("..\\Content\\ball.DAE", &mesh1);
 			package.LoadMesh("..\\Content\\stage.DAE", &mesh2);
+			if (package.LoadOccluderMesh("..\\Content\\stage.DAE", &occluderMesh2))
+				mesh2->SetOccluderMesh(occluderMesh2);
 			package.LoadTexture2D("..\\Content\\albedo.dds", &texture1, &resourceView1);
 			package.LoadTexture2D("..\\Content\\albedo2.dds", &texture2, &resourceView2);
 			package.LoadTexture2D("..\\Content\\albedo3.dds", &texture3, &resourceView3);
@@ -133,22 +137,35 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmdLine,
 				for (int j = -2; j <= 2; ++j)
 				{
 					XMStoreFloat4x4(&transform, XMMatrixTranslation(3.0f * i, 2.0f, 3.0f * j));
-					scene->Children.push_back(CreateStaticMeshInstancedNode(mesh1, material1, transform));
+					AttachSceneNode(scene, CreateStaticMeshInstancedNode(mesh1, material1, transform));
 				}
 			}
 		
 			XMStoreFloat4x4(&transform, XMMatrixIdentity());
-			scene->Children.push_back(CreateStaticMeshNode(mesh2, material2, transform));
-			scene->Children.push_back(CreateTerrainPatchNode(&terrainPatch, transform));
+			SceneNode* stageNode = CreateStaticMeshNode(mesh2, material2, transform);
+			SceneNode* terrainNode = CreateTerrainPatchNode(&terrainPatch, transform);
+			stageNode->Flags |= NODE_FLAG_OCCLUDER;
+			terrainNode->Flags |= NODE_FLAG_OCCLUDER;
+			AttachSceneNode(scene, stageNode);
+			AttachSceneNode(scene, terrainNode);
 
 			// Update the transforms of the scene
 			UpdateTransforms(scene, XMMatrixIdentity());
 			// Build the bounding volume hierarchy for culling objects
-			BuildSceneGraphHierarchy(scene, true);
+			WorkerPool workers;
+			workers.Initialize(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+			HierarchyBuildParams hierarchyParams;
+			GetDefaultHierarchyBuildParams(&hierarchyParams);
+			hierarchyParams.Workers = &workers;
+			BuildSceneGraphHierarchy(scene, true, hierarchyParams);
+			renderer.CullingParameters.Workers = &workers;
+			renderer.DrawParameters.Workers = &workers;
+			renderer.CullingParameters.bOcclusionCulling = true;
 
 			// Show the window now
 			PresentWindow(hWindow, false);
 			MSG message;
+			std::vector<SceneNode*> changedNodes;
 
 			while (!bExit)
 			{
@@ -165,6 +182,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmdLine,
 				}
 
 				inputHandler.Update(1.0f);
+
+				// Only nodes which have moved need their transforms and regions updated
+				changedNodes.clear();
+				UpdateDirtyTransforms(scene, &changedNodes);
+				if (changedNodes.size() > 0)
+					RefitSceneGraphHierarchy(scene, changedNodes);
+
 				renderer.RenderFrame(scene, &camera);
 			}
 
@@ -173,6 +197,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmdLine,
 			if (scene != nullptr)
 				DestroySceneGraph(scene);
 
+			workers.Destroy();
+
 			terrainPatch.DestroyMesh();
 		}
 